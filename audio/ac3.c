@@ -2,26 +2,97 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#ifdef HAVE_A52
 #include <a52dec/a52.h>
+#endif
 #include "mpeg3private.h"
 #include "mpeg3protos.h"
+#ifndef HAVE_A52
+#include "ac3.h"
+#endif
 
 #include <string.h>
 
 
+#ifndef HAVE_A52
+
+/* Native decoder with the liba52 interface */
+
+mpeg3_ac3_state_t* mpeg3ac3_init()
+{
+	mpeg3_ac3_state_t *state = calloc(1, sizeof(mpeg3_ac3_state_t));
+	state->lfsr = 1;
+	state->block = MPEG3_AC3_BLOCKS;
+	mpeg3ac3_init_imdct(state);
+	return state;
+}
+
+void mpeg3ac3_free(mpeg3_ac3_state_t *state)
+{
+	free(state);
+}
+
+int mpeg3ac3_block(mpeg3_ac3_state_t *state)
+{
+	sample_t *output = state->samples;
+	int i;
+
+	if(state->block >= MPEG3_AC3_BLOCKS) return 1;
+	state->block++;
+
+	if(mpeg3ac3_parse_audblk(state)) 
+	{
+		state->block = MPEG3_AC3_BLOCKS;
+		return 1;
+	}
+	mpeg3ac3_bit_allocate(state);
+	if(mpeg3ac3_coeff_unpack(state))
+	{
+		state->block = MPEG3_AC3_BLOCKS;
+		return 1;
+	}
+	if(state->cplinu) mpeg3ac3_uncouple(state);
+	if(state->acmod == 0x2) mpeg3ac3_rematrix(state);
+
+	if(state->lfeon)
+	{
+		mpeg3ac3_imdct(state, MPEG3_AC3_FBW, output);
+		output += MPEG3_AC3_BLOCK;
+	}
+
+	for(i = 0; i < state->nfchans; i++)
+	{
+		mpeg3ac3_imdct(state, i, output);
+		output += MPEG3_AC3_BLOCK;
+	}
+	return 0;
+}
+
+#endif
+
+
 mpeg3_ac3_t* mpeg3_new_ac3()
 {
 	mpeg3_ac3_t *result = calloc(1, sizeof(mpeg3_ac3_t));
 	result->stream = mpeg3bits_new_stream(0, 0);
+#ifdef HAVE_A52
 	result->state = a52_init(0);
 	result->output = a52_samples(result->state);
+#else
+	result->state = mpeg3ac3_init();
+	result->output = ((mpeg3_ac3_state_t*)result->state)->samples;
+#endif
 	return result;
 }
 
 void mpeg3_delete_ac3(mpeg3_ac3_t *audio)
 {
 	mpeg3bits_delete_stream(audio->stream);
+#ifdef HAVE_A52
 	a52_free(audio->state);
+#else
+	mpeg3ac3_free(audio->state);
+#endif
 	free(audio);
 }
 
@@ -30,7 +101,11 @@ void mpeg3_delete_ac3(mpeg3_ac3_t *audio)
 int mpeg3_ac3_check(unsigned char *header)
 {
 	int flags, samplerate, bitrate;
+#ifdef HAVE_A52
 	return !a52_syncinfo(header,
+#else
+	return !mpeg3ac3_syncinfo(header,
+#endif
 		&flags,
 		&samplerate,
 		&bitrate);
@@ -43,7 +118,11 @@ int mpeg3_ac3_header(mpeg3_ac3_t *audio, unsigned char *header)
 	audio->flags = 0;
 
 //printf("mpeg3_ac3_header %02x%02x%02x%02x%02x%02x%02x%02x\n", header[0], header[1], header[2], header[3], header[4], header[5], header[6], header[7]);
+#ifdef HAVE_A52
 	result = a52_syncinfo(header, 
+#else
+	result = mpeg3ac3_syncinfo(header, 
+#endif
 		&audio->flags,
         &audio->samplerate, 
 		&audio->bitrate);
@@ -93,7 +172,7 @@ int mpeg3_ac3_header(mpeg3_ac3_t *audio, unsigned char *header)
 				audio->channels += 2;
 				break;
 			default:
-				printf("mpeg3_ac3_header: unknown channel code: %p\n", audio->flags & A52_CHANNEL_MASK);
+				printf("mpeg3_ac3_header: unknown channel code: %x\n", audio->flags & A52_CHANNEL_MASK);
 				break;
 		}
 	}
@@ -103,15 +182,16 @@ int mpeg3_ac3_header(mpeg3_ac3_t *audio, unsigned char *header)
 
 
 int mpeg3audio_doac3(mpeg3_ac3_t *audio, 
-	char *frame, 
+	unsigned char *frame, 
 	int frame_size, 
 	float **output,
 	int render)
 {
 	int output_position = 0;
-	sample_t level = 1;
 	int i, j, k, l;
 
+#ifdef HAVE_A52
+	sample_t level = 1;
 //printf("mpeg3audio_doac3 1\n");
 	a52_frame(audio->state, 
 		frame, 
@@ -121,9 +201,19 @@ int mpeg3audio_doac3(mpeg3_ac3_t *audio,
 //printf("mpeg3audio_doac3 2\n");
 	a52_dynrng(audio->state, NULL, NULL);
 //printf("mpeg3audio_doac3 3\n");
+#else
+	mpeg3ac3_frame(audio->state, 
+		frame, 
+		frame_size, 
+		&audio->flags);
+#endif
 	for(i = 0; i < 6; i++)
 	{
+#ifdef HAVE_A52
 		if(!a52_block(audio->state))
+#else
+		if(!mpeg3ac3_block(audio->state))
+#endif
 		{
 			l = 0;
 			if(render)
@@ -1,4 +1,190 @@
 #ifndef AC3_H
 #define AC3_H
 
+/* Native AC3 decoder.  Everything it changes is in the state so any */
+/* number of decoders can run at once. */
+
+#include <stdint.h>
+
+typedef float sample_t;
+
+/* Channel configurations in the flags.  The same as liba52. */
+#define A52_CHANNEL 0
+#define A52_MONO 1
+#define A52_STEREO 2
+#define A52_3F 3
+#define A52_2F1R 4
+#define A52_3F1R 5
+#define A52_2F2R 6
+#define A52_3F2R 7
+#define A52_DOLBY 10
+#define A52_CHANNEL_MASK 15
+#define A52_LFE 16
+
+/* Samples in a block */
+#define MPEG3_AC3_BLOCK 256
+/* Blocks in a frame */
+#define MPEG3_AC3_BLOCKS 6
+/* Full bandwidth channels */
+#define MPEG3_AC3_FBW 5
+/* Coupling sub-bands */
+#define MPEG3_AC3_CPLBANDS 18
+/* Bit allocation bands */
+#define MPEG3_AC3_BANDS 50
+
+/* Exponents, bit allocation and delta bit allocation of one channel */
+typedef struct
+{
+	int expstr;
+	unsigned char exp[MPEG3_AC3_BLOCK];
+	unsigned char bap[MPEG3_AC3_BLOCK];
+	int fsnroffst;
+	int fgaincod;
+	int deltbae;
+	int deltnseg;
+	int deltoffst[8];
+	int deltlen[8];
+	int deltba[8];
+} mpeg3_ac3_alloc_t;
+
+typedef struct
+{
+/* Frame being decoded */
+	unsigned char *buffer;
+	int size;
+	int bit_position;
+
+/* Bit stream information */
+	int fscod;
+	int acmod;
+	int lfeon;
+	int nfchans;
+/* Next block to decode */
+	int block;
+
+/* Audio block fields which are reused by the following blocks */
+	int blksw[MPEG3_AC3_FBW];
+	int dithflag[MPEG3_AC3_FBW];
+	int cplinu;
+	int chincpl[MPEG3_AC3_FBW];
+	int phsflginu;
+	int cplbegf;
+	int cplendf;
+	int cplstrtmant;
+	int cplendmant;
+/* Coupling band of every sub-band */
+	int cplband[MPEG3_AC3_CPLBANDS];
+	int ncplbnd;
+	float cplco[MPEG3_AC3_FBW][MPEG3_AC3_CPLBANDS];
+	int phsflg[MPEG3_AC3_CPLBANDS];
+	int rematflg[4];
+	int endmant[MPEG3_AC3_FBW];
+	int sdcycod;
+	int fdcycod;
+	int sgaincod;
+	int dbpbcod;
+	int floorcod;
+	int csnroffst;
+	int cplfleak;
+	int cplsleak;
+	mpeg3_ac3_alloc_t fbw[MPEG3_AC3_FBW];
+	mpeg3_ac3_alloc_t cpl;
+	mpeg3_ac3_alloc_t lfe;
+
+/* Grouped mantissas left over from the last group read */
+	int group1[3];
+	int group2[3];
+	int group4[2];
+	int total1;
+	int total2;
+	int total4;
+/* Dither generator */
+	unsigned int lfsr;
+
+/* Transform coefficients.  The LFE is the last channel. */
+	float coeffs[MPEG3_AC3_FBW + 1][MPEG3_AC3_BLOCK];
+	float cplcoeffs[MPEG3_AC3_BLOCK];
+/* Second half of the last transform of every channel */
+	float delay[MPEG3_AC3_FBW + 1][MPEG3_AC3_BLOCK];
+/* Output of a block with the LFE first like liba52 */
+	sample_t samples[(MPEG3_AC3_FBW + 1) * MPEG3_AC3_BLOCK];
+
+/* Transform tables */
+	float window[MPEG3_AC3_BLOCK];
+	mpeg3_complex_t twiddle1[128];
+	mpeg3_complex_t twiddle2[64];
+	mpeg3_complex_t roots[64];
+	int reverse128[128];
+	int reverse64[64];
+	mpeg3_complex_t fft[2][128];
+} mpeg3_ac3_state_t;
+
+/* Read the syncinfo.  Returns the frame size in bytes or 0 if it isn't */
+/* an AC3 header. */
+int mpeg3ac3_syncinfo(unsigned char *buffer,
+	int *flags,
+	int *samplerate,
+	int *bitrate);
+
+mpeg3_ac3_state_t* mpeg3ac3_init();
+void mpeg3ac3_free(mpeg3_ac3_state_t *state);
+/* Start decoding a frame.  Returns 1 if the bit stream information is bad. */
+int mpeg3ac3_frame(mpeg3_ac3_state_t *state,
+	unsigned char *buffer,
+	int size,
+	int *flags);
+/* Decode the next block into the samples.  Returns 1 on an error. */
+int mpeg3ac3_block(mpeg3_ac3_state_t *state);
+
+/* Steps of decoding a block */
+int mpeg3ac3_parse_audblk(mpeg3_ac3_state_t *state);
+/* Read the exponent groups of a channel starting at mantissa start. */
+/* Returns 1 if an exponent is out of range. */
+int mpeg3ac3_exponent_unpack(mpeg3_ac3_state_t *state,
+	mpeg3_ac3_alloc_t *alloc,
+	int absexp,
+	int ngrps,
+	int start);
+void mpeg3ac3_bit_allocate(mpeg3_ac3_state_t *state);
+int mpeg3ac3_coeff_unpack(mpeg3_ac3_state_t *state);
+void mpeg3ac3_uncouple(mpeg3_ac3_state_t *state);
+void mpeg3ac3_rematrix(mpeg3_ac3_state_t *state);
+void mpeg3ac3_init_imdct(mpeg3_ac3_state_t *state);
+void mpeg3ac3_imdct(mpeg3_ac3_state_t *state, int channel, sample_t *output);
+
+static inline unsigned int mpeg3ac3_getbits(mpeg3_ac3_state_t *state, int bits)
+{
+	int byte = state->bit_position >> 3;
+	uint64_t code = 0;
+	int i;
+
+	if(!bits) return 0;
+/* Zeros after the end of the frame */
+	if(byte + 8 <= state->size)
+		code = mpeg3_get_code64(state->buffer + byte);
+	else
+	for(i = 0; i < 8; i++)
+	{
+		code <<= 8;
+		if(byte + i < state->size) code |= state->buffer[byte + i];
+	}
+
+	state->bit_position += bits;
+	return (code << (state->bit_position - bits - (byte << 3))) >> (64 - bits);
+}
+
+/* Dither between -0.707 and 0.707 for mantissas without bits */
+static inline float mpeg3ac3_dither(mpeg3_ac3_state_t *state)
+{
+	state->lfsr ^= state->lfsr << 13;
+	state->lfsr ^= state->lfsr >> 17;
+	state->lfsr ^= state->lfsr << 5;
+	return (int16_t)(state->lfsr >> 16) * (0.707107f / 32768);
+}
+
+static inline void mpeg3ac3_skipbits(mpeg3_ac3_state_t *state, int bits)
+{
+	state->bit_position += bits;
+}
+
 #endif
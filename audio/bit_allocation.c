@@ -21,21 +21,25 @@
  *
  */
 
-#include "mpeg3audio.h"
+#include "mpeg3private.h"
+#include "mpeg3protos.h"
+#include "ac3.h"
+
+#include <stdlib.h>
 #include <string.h>
 
 /* Bit allocation tables */
 
-static short mpeg3_slowdec[]  = { 0x0f,  0x11,  0x13,  0x15  };
-static short mpeg3_fastdec[]  = { 0x3f,  0x53,  0x67,  0x7b  };
-static short mpeg3_slowgain[] = { 0x540, 0x4d8, 0x478, 0x410 };
-static short mpeg3_dbpbtab[]  = { 0x000, 0x700, 0x900, 0xb00 };
+static const short mpeg3_slowdec[]  = { 0x0f,  0x11,  0x13,  0x15  };
+static const short mpeg3_fastdec[]  = { 0x3f,  0x53,  0x67,  0x7b  };
+static const short mpeg3_slowgain[] = { 0x540, 0x4d8, 0x478, 0x410 };
+static const short mpeg3_dbpbtab[]  = { 0x000, 0x700, 0x900, 0xb00 };
 
-static unsigned short mpeg3_floortab[] = { 0x2f0, 0x2b0, 0x270, 0x230, 0x1f0, 0x170, 0x0f0, 0xf800 };
-static short mpeg3_fastgain[] = { 0x080, 0x100, 0x180, 0x200, 0x280, 0x300, 0x380, 0x400  };
+static const short mpeg3_floortab[] = { 0x2f0, 0x2b0, 0x270, 0x230, 0x1f0, 0x170, 0x0f0, -0x800 };
+static const short mpeg3_fastgain[] = { 0x080, 0x100, 0x180, 0x200, 0x280, 0x300, 0x380, 0x400  };
 
 
-static short mpeg3_bndtab[] = 
+static const short mpeg3_bndtab[] = 
 {  
 	0,  1,  2,   3,   4,   5,   6,   7,   8,   9, 
 	10, 11, 12,  13,  14,  15,  16,  17,  18,  19,
@@ -44,7 +48,7 @@ static short mpeg3_bndtab[] =
 	79, 85, 97, 109, 121, 133, 157, 181, 205, 229 
 };
 
-static short mpeg3_bndsz[]  = 
+static const short mpeg3_bndsz[]  = 
 { 
 	1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
 	1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
@@ -53,7 +57,7 @@ static short mpeg3_bndsz[]  =
 	6, 12, 12, 12, 12, 24, 24, 24, 24, 24 
 };
 
-static short mpeg3_masktab[] = 
+static const short mpeg3_masktab[] = 
 { 
 	0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
 	16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 28, 28, 29,
@@ -74,7 +78,7 @@ static short mpeg3_masktab[] =
 };
 
 
-static short mpeg3_latab[] = 
+static const short mpeg3_latab[] = 
 { 
 	0x0040, 0x003f, 0x003e, 0x003d, 0x003c, 0x003b, 0x003a, 0x0039,
 	0x0038, 0x0037, 0x0036, 0x0035, 0x0034, 0x0034, 0x0033, 0x0032,
@@ -111,7 +115,7 @@ static short mpeg3_latab[] =
 	0x0000, 0x0000, 0x0000, 0x0000
 };
 
-static short mpeg3_hth[][50] = 
+static const short mpeg3_hth[][50] = 
 {
 	{ 
 		0x04d0, 0x04d0, 0x0440, 0x0400, 0x03e0, 0x03c0, 0x03b0, 0x03b0,  
@@ -145,7 +149,7 @@ static short mpeg3_hth[][50] =
 };
 
 
-static short mpeg3_baptab[] = 
+static const short mpeg3_baptab[] = 
 { 
 	0,  1,  1,  1,  1,  1,  2,  2,  3,  3,  3,  4,  4,  5,  5,  6,
 	6,  6,  6,  7,  7,  7,  7,  8,  8,  8,  8,  9,  9,  9,  9, 10, 
@@ -160,7 +164,7 @@ static int logadd(int a, int b)
 	int address;
 
 	c = a - b; 
-	address = mpeg3_min((abs(c) >> 1), 255); 
+	address = MIN((abs(c) >> 1), 255); 
 	
 	if(c >= 0) 
 		return(a + mpeg3_latab[address]); 
@@ -169,7 +173,7 @@ static int logadd(int a, int b)
 }
 
 
-int mpeg3audio_ac3_calc_lowcomp(int a, int b0, int b1, int bin)
+static int calc_lowcomp(int a, int b0, int b1, int bin)
 { 
 	if(bin < 7) 
 	{ 
@@ -177,43 +181,61 @@ int mpeg3audio_ac3_calc_lowcomp(int a, int b0, int b1, int bin)
 			a = 384; 
 	 	else 
 		if(b0 > b1) 
-			a = mpeg3_max(0, a - 64); 
+			a = MAX(0, a - 64); 
 	} 
 	else if(bin < 20) 
 	{ 
 		if((b0 + 256) == b1) 
 			a = 320; 
 		else if(b0 > b1) 
-			a = mpeg3_max(0, a - 64) ; 
+			a = MAX(0, a - 64) ; 
 	}
 	else  
-		a = mpeg3_max(0, a - 128); 
+		a = MAX(0, a - 128); 
 	
 	return(a);
 }
 
-void mpeg3audio_ac3_ba_compute_psd(int start, 
-		int end, 
-		short exps[], 
-		short psd[], 
-		short bndpsd[])
+/* Compute the bit allocation pointers of one channel */
+static void allocate_channel(mpeg3_ac3_state_t *state,
+	mpeg3_ac3_alloc_t *alloc,
+	int start,
+	int end,
+	int fastleak,
+	int slowleak,
+	int is_lfe)
 {
-	int bin,i,j,k;
-	int lastbin = 0;
-	
+	int psd[MPEG3_AC3_BLOCK];
+	int bndpsd[MPEG3_AC3_BANDS + 1];
+	int excite[MPEG3_AC3_BANDS];
+	int mask[MPEG3_AC3_BANDS];
+	int sdecay = mpeg3_slowdec[state->sdcycod];
+	int fdecay = mpeg3_fastdec[state->fdcycod];
+	int sgain = mpeg3_slowgain[state->sgaincod];
+	int dbknee = mpeg3_dbpbtab[state->dbpbcod];
+	int floor = mpeg3_floortab[state->floorcod];
+	int fgain = mpeg3_fastgain[alloc->fgaincod];
+	int snroffset = (((state->csnroffst - 15) << 4) + alloc->fsnroffst) * 4;
+	int bndstrt, bndend;
+	int lowcomp = 0;
+	int begin;
+	int bin, lastbin;
+	int i, j, k;
+
+	if(start >= end) return;
+	bndstrt = mpeg3_masktab[start]; 
+	bndend = mpeg3_masktab[end - 1] + 1; 
+
 /* Map the exponents into dBs */
-	for (bin = start; bin < end; bin++) 
-	{ 
-		psd[bin] = (3072 - (exps[bin] << 7)); 
-	}
+	for(bin = start; bin < end; bin++) 
+		psd[bin] = 3072 - (alloc->exp[bin] << 7); 
 
 /* Integrate the psd function over each bit allocation band */
 	j = start; 
-	k = mpeg3_masktab[start]; 
-	
+	k = bndstrt; 
 	do 
 	{ 
-		lastbin = mpeg3_min(mpeg3_bndtab[k] + mpeg3_bndsz[k], end); 
+		lastbin = MIN(mpeg3_bndtab[k] + mpeg3_bndsz[k], end); 
 		bndpsd[k] = psd[j]; 
 		j++; 
 
@@ -225,359 +247,160 @@ void mpeg3audio_ac3_ba_compute_psd(int start,
 
 		k++; 
 	}while(end > lastbin);
-}
-
-void mpeg3audio_ac3_ba_compute_excitation(mpeg3audio_t *audio, 
-		int start, 
-		int end,
-		int fgain,
-		int fastleak, 
-		int slowleak, 
-		int is_lfe, 
-		short bndpsd[],
-		short excite[])
-{
-	int bin;
-	int bndstrt;
-	int bndend;
-	int lowcomp = 0;
-	int begin = 0;
+	bndpsd[bndend] = 0;
 
-/* Compute excitation function */
-	bndstrt = mpeg3_masktab[start]; 
-	bndend = mpeg3_masktab[end - 1] + 1; 
-	
-	if(bndstrt == 0) /* For fbw and lfe channels */ 
+/* Compute the excitation function */
+	if(bndstrt == 0)
 	{ 
-		lowcomp = mpeg3audio_ac3_calc_lowcomp(lowcomp, bndpsd[0], bndpsd[1], 0); 
+		lowcomp = calc_lowcomp(lowcomp, bndpsd[0], bndpsd[1], 0); 
 		excite[0] = bndpsd[0] - fgain - lowcomp; 
-		lowcomp = mpeg3audio_ac3_calc_lowcomp(lowcomp, bndpsd[1], bndpsd[2], 1);
+		lowcomp = calc_lowcomp(lowcomp, bndpsd[1], bndpsd[2], 1);
 		excite[1] = bndpsd[1] - fgain - lowcomp; 
-		begin = 7 ; 
+		begin = 7; 
 		
-/* Note: Do not call mpeg3audio_ac3_calc_lowcomp() for the last band of the lfe channel, (bin = 6) */ 
-		for (bin = 2; bin < 7; bin++) 
+/* Do not compute the lowcomp of the last band of the lfe channel */
+		for(bin = 2; bin < 7; bin++) 
 		{ 
-			if(!(is_lfe && (bin == 6)))
-				lowcomp = mpeg3audio_ac3_calc_lowcomp(lowcomp, bndpsd[bin], bndpsd[bin+1], bin); 
+			if(!(is_lfe && bin == 6))
+				lowcomp = calc_lowcomp(lowcomp, bndpsd[bin], bndpsd[bin + 1], bin); 
 			fastleak = bndpsd[bin] - fgain; 
-			slowleak = bndpsd[bin] - audio->ac3_bit_allocation.sgain; 
+			slowleak = bndpsd[bin] - sgain; 
 			excite[bin] = fastleak - lowcomp; 
 			
-			if(!(is_lfe && (bin == 6)))
+			if(!(is_lfe && bin == 6) && bndpsd[bin] <= bndpsd[bin + 1])
 			{
-				if(bndpsd[bin] <= bndpsd[bin+1]) 
-				{
-					begin = bin + 1 ; 
-					break; 
-				} 
+				begin = bin + 1; 
+				break; 
 			}
 		} 
 		
-		for (bin = begin; bin < mpeg3_min(bndend, 22); bin++) 
+		for(bin = begin; bin < MIN(bndend, 22); bin++) 
 		{ 
-			if (!(is_lfe && (bin == 6)))
-				lowcomp = mpeg3audio_ac3_calc_lowcomp(lowcomp, bndpsd[bin], bndpsd[bin+1], bin); 
-			fastleak -= audio->ac3_bit_allocation.fdecay; 
-			fastleak = mpeg3_max(fastleak, bndpsd[bin] - fgain); 
-			slowleak -= audio->ac3_bit_allocation.sdecay; 
-			slowleak = mpeg3_max(slowleak, bndpsd[bin] - audio->ac3_bit_allocation.sgain); 
-			excite[bin] = mpeg3_max(fastleak - lowcomp, slowleak); 
+			if(!(is_lfe && bin == 6))
+				lowcomp = calc_lowcomp(lowcomp, bndpsd[bin], bndpsd[bin + 1], bin); 
+			fastleak -= fdecay; 
+			fastleak = MAX(fastleak, bndpsd[bin] - fgain); 
+			slowleak -= sdecay; 
+			slowleak = MAX(slowleak, bndpsd[bin] - sgain); 
+			excite[bin] = MAX(fastleak - lowcomp, slowleak); 
 		} 
 		begin = 22; 
 	} 
-	else /* For coupling channel */ 
+	else
+/* Coupling channel */
 	{ 
 		begin = bndstrt; 
 	} 
 
-	for (bin = begin; bin < bndend; bin++) 
+	for(bin = begin; bin < bndend; bin++) 
 	{ 
-		fastleak -= audio->ac3_bit_allocation.fdecay; 
-		fastleak = mpeg3_max(fastleak, bndpsd[bin] - fgain); 
-		slowleak -= audio->ac3_bit_allocation.sdecay; 
-		slowleak = mpeg3_max(slowleak, bndpsd[bin] - audio->ac3_bit_allocation.sgain); 
-		excite[bin] = mpeg3_max(fastleak, slowleak) ; 
+		fastleak -= fdecay; 
+		fastleak = MAX(fastleak, bndpsd[bin] - fgain); 
+		slowleak -= sdecay; 
+		slowleak = MAX(slowleak, bndpsd[bin] - sgain); 
+		excite[bin] = MAX(fastleak, slowleak); 
 	} 
-}
-
-void mpeg3audio_ac3_ba_compute_mask(mpeg3audio_t *audio, 
-		int start, 
-		int end, 
-		int fscod,
-		int deltbae, 
-		int deltnseg, 
-		short deltoffst[], 
-		short deltba[],
-		short deltlen[], 
-		short excite[], 
-		short mask[])
-{
-	int bin, k;
-	int bndstrt;
-	int bndend;
-	int delta;
-
-	bndstrt = mpeg3_masktab[start]; 
-	bndend = mpeg3_masktab[end - 1] + 1; 
 
 /* Compute the masking curve */
-
-	for (bin = bndstrt; bin < bndend; bin++) 
+	for(bin = bndstrt; bin < bndend; bin++) 
 	{ 
-		if (audio->ac3_bit_allocation.bndpsd[bin] < audio->ac3_bit_allocation.dbknee) 
-		{ 
-			excite[bin] += ((audio->ac3_bit_allocation.dbknee - audio->ac3_bit_allocation.bndpsd[bin]) >> 2); 
-		} 
-		mask[bin] = mpeg3_max(excite[bin], mpeg3_hth[fscod][bin]);
+		if(bndpsd[bin] < dbknee) 
+			excite[bin] += (dbknee - bndpsd[bin]) >> 2; 
+		mask[bin] = MAX(excite[bin], mpeg3_hth[state->fscod][bin]);
 	}
 	
-/* Perform delta bit modulation if necessary */
-	if ((deltbae == DELTA_BIT_REUSE) || (deltbae == DELTA_BIT_NEW)) 
+/* Perform delta bit modulation */
+	if(alloc->deltbae == DELTA_BIT_NEW) 
 	{ 
 		int band = 0; 
-		int seg = 0; 
+		int seg; 
 		
-		for (seg = 0; seg < deltnseg + 1; seg++) 
+		for(seg = 0; seg <= alloc->deltnseg; seg++) 
 		{ 
-			band += deltoffst[seg]; 
-			if (deltba[seg] >= 4) 
-			{ 
-				delta = (deltba[seg] - 3) << 7;
-			} 
+			int delta;
+			band += alloc->deltoffst[seg]; 
+			if(alloc->deltba[seg] >= 4) 
+				delta = (alloc->deltba[seg] - 3) * 128;
 			else 
-			{ 
-				delta = (deltba[seg] - 4) << 7;
-			} 
+				delta = (alloc->deltba[seg] - 4) * 128;
 			
-			for (k = 0; k < deltlen[seg]; k++) 
+			for(k = 0; k < alloc->deltlen[seg] && band < MPEG3_AC3_BANDS; k++) 
 			{ 
 				mask[band] += delta; 
 				band++; 
 			} 
 		} 
 	}
-}
-
-void mpeg3audio_ac3_ba_compute_bap(mpeg3audio_t *audio, 
-		int start, 
-		int end, 
-		int snroffset,
-		short psd[], 
-		short mask[], 
-		short bap[])
-{
-	int i, j, k;
-	short lastbin = 0;
-	short address = 0;
 
 /* Compute the bit allocation pointer for each bin */
 	i = start; 
-	j = mpeg3_masktab[start]; 
-
+	j = bndstrt; 
 	do
 	{
-		lastbin = mpeg3_min(mpeg3_bndtab[j] + mpeg3_bndsz[j], end); 
+		lastbin = MIN(mpeg3_bndtab[j] + mpeg3_bndsz[j], end); 
 		mask[j] -= snroffset; 
-		mask[j] -= audio->ac3_bit_allocation.floor; 
+		mask[j] -= floor; 
 
 		if(mask[j] < 0) 
 			mask[j] = 0; 
 
 		mask[j] &= 0x1fe0;
-		mask[j] += audio->ac3_bit_allocation.floor; 
+		mask[j] += floor; 
 		for(k = i; k < lastbin; k++)
 		{
-			address = (psd[i] - mask[j]) >> 5; 
-			address = mpeg3_min(63, mpeg3_max(0, address)); 
-			bap[i] = mpeg3_baptab[address]; 
+			int address = (psd[i] - mask[j]) >> 5; 
+			address = MIN(63, MAX(0, address)); 
+			alloc->bap[i] = mpeg3_baptab[address]; 
 			i++; 
 		}
 		j++; 
-	}while (end > lastbin);
+	}while(end > lastbin);
 }
 
-int mpeg3audio_ac3_bit_allocate(mpeg3audio_t *audio, 
-		unsigned int fscod, 
-		mpeg3_ac3bsi_t *bsi, 
-		mpeg3_ac3audblk_t *audblk)
+void mpeg3ac3_bit_allocate(mpeg3_ac3_state_t *state)
 {
-	int result = 0;
 	int i;
-	int fgain;
-	int snroffset;
-	int start;
-	int end;
-	int fastleak;
-	int slowleak;
-
-/*printf("mpeg3audio_ac3_bit_allocate %d %d %d %d %d\n", audblk->sdcycod, audblk->fdcycod, audblk->sgaincod, audblk->dbpbcod, audblk->floorcod); */
-/* Only perform bit_allocation if the exponents have changed or we
- * have new sideband information */
-	if(audblk->chexpstr[0]  == 0 && audblk->chexpstr[1] == 0 &&
-			audblk->chexpstr[2]  == 0 && audblk->chexpstr[3] == 0 &&
-			audblk->chexpstr[4]  == 0 && audblk->cplexpstr   == 0 &&
-			audblk->lfeexpstr    == 0 && audblk->baie        == 0 &&
-			audblk->snroffste    == 0 && audblk->deltbaie    == 0)
-		return 0;
-
-/* Do some setup before we do the bit alloc */
-	audio->ac3_bit_allocation.sdecay = mpeg3_slowdec[audblk->sdcycod]; 
-	audio->ac3_bit_allocation.fdecay = mpeg3_fastdec[audblk->fdcycod];
-	audio->ac3_bit_allocation.sgain = mpeg3_slowgain[audblk->sgaincod]; 
-	audio->ac3_bit_allocation.dbknee = mpeg3_dbpbtab[audblk->dbpbcod]; 
-	audio->ac3_bit_allocation.floor = mpeg3_floortab[audblk->floorcod]; 
-
-/* if all the SNR offset constants are zero then the whole block is zero */
-	if(!audblk->csnroffst    && !audblk->fsnroffst[0] && 
-		 !audblk->fsnroffst[1] && !audblk->fsnroffst[2] && 
-		 !audblk->fsnroffst[3] && !audblk->fsnroffst[4] &&
-		 !audblk->cplfsnroffst && !audblk->lfefsnroffst)
-	{
-		memset(audblk->fbw_bap, 0, sizeof(short) * 256 * 5);
-		memset(audblk->cpl_bap, 0, sizeof(short) * 256);
-		memset(audblk->lfe_bap, 0, sizeof(short) * 7);
-		return 0;
-	}
+	int zero = !state->csnroffst;
 
-	for(i = 0; i < bsi->nfchans; i++)
-	{
-		start = 0;
-		end = audblk->endmant[i]; 
-		fgain = mpeg3_fastgain[audblk->fgaincod[i]]; 
-		snroffset = (((audblk->csnroffst - 15) << 4) + audblk->fsnroffst[i]) << 2 ;
-		fastleak = 0;
-		slowleak = 0;
-
-		mpeg3audio_ac3_ba_compute_psd(start, 
-				end, 
-				(short*)audblk->fbw_exp[i], 
-				audio->ac3_bit_allocation.psd, 
-				audio->ac3_bit_allocation.bndpsd);
-
-		mpeg3audio_ac3_ba_compute_excitation(audio,
-				start, 
-				end , 
-				fgain, 
-				fastleak, 
-				slowleak, 
-				0, 
-				audio->ac3_bit_allocation.bndpsd, 
-				audio->ac3_bit_allocation.excite);
-
-		mpeg3audio_ac3_ba_compute_mask(audio,
-				start, 
-				end, 
-				fscod, 
-				audblk->deltbae[i], 
-				audblk->deltnseg[i], 
-				(short*)audblk->deltoffst[i], 
-				(short*)audblk->deltba[i], 
-				(short*)audblk->deltlen[i], 
-				audio->ac3_bit_allocation.excite, 
-				audio->ac3_bit_allocation.mask);
-
-		mpeg3audio_ac3_ba_compute_bap(audio,
-				start, 
-				end, 
-				snroffset, 
-				audio->ac3_bit_allocation.psd, 
-				audio->ac3_bit_allocation.mask, 
-				(short*)audblk->fbw_bap[i]);
-	}
-
-	if(audblk->cplinu)
-	{
-		start = audblk->cplstrtmant; 
-		end = audblk->cplendmant; 
-		fgain = mpeg3_fastgain[audblk->cplfgaincod];
-		snroffset = (((audblk->csnroffst - 15) << 4) + audblk->cplfsnroffst) << 2 ;
-		fastleak = (audblk->cplfleak << 8) + 768; 
-		slowleak = (audblk->cplsleak << 8) + 768;
-
-		mpeg3audio_ac3_ba_compute_psd(start, 
-				end, 
-				(short*)audblk->cpl_exp, 
-				audio->ac3_bit_allocation.psd, 
-				audio->ac3_bit_allocation.bndpsd);
-
-		mpeg3audio_ac3_ba_compute_excitation(audio,
-				start, 
-				end , 
-				fgain, 
-				fastleak, 
-				slowleak, 
-				0, 
-				audio->ac3_bit_allocation.bndpsd, 
-				audio->ac3_bit_allocation.excite);
-
-		mpeg3audio_ac3_ba_compute_mask(audio,
-				start, 
-				end, 
-				fscod, 
-				audblk->cpldeltbae, 
-				audblk->cpldeltnseg, 
-				(short*)audblk->cpldeltoffst, 
-				(short*)audblk->cpldeltba, 
-				(short*)audblk->cpldeltlen, 
-				audio->ac3_bit_allocation.excite, 
-				audio->ac3_bit_allocation.mask);
-
-		mpeg3audio_ac3_ba_compute_bap(audio,
-				start, 
-				end, 
-				snroffset, 
-				audio->ac3_bit_allocation.psd, 
-				audio->ac3_bit_allocation.mask, 
-				(short*)audblk->cpl_bap);
-	}
+/* If all the SNR offsets are zero the whole block is zero */
+	for(i = 0; i < state->nfchans; i++)
+		if(state->fbw[i].fsnroffst) zero = 0;
+	if(state->cplinu && state->cpl.fsnroffst) zero = 0;
+	if(state->lfeon && state->lfe.fsnroffst) zero = 0;
 
-	if(bsi->lfeon)
+	if(zero)
 	{
-		start = 0;
-		end = 7;
-		fgain = mpeg3_fastgain[audblk->lfefgaincod];
-		snroffset = (((audblk->csnroffst - 15) << 4) + audblk->lfefsnroffst) << 2 ;
-		fastleak = 0;
-		slowleak = 0;
-
-		mpeg3audio_ac3_ba_compute_psd(start, 
-				end, 
-				(short*)audblk->lfe_exp, 
-				audio->ac3_bit_allocation.psd, 
-				audio->ac3_bit_allocation.bndpsd);
-
-		mpeg3audio_ac3_ba_compute_excitation(audio,
-				start, 
-				end , 
-				fgain, 
-				fastleak, 
-				slowleak, 
-				1, 
-				audio->ac3_bit_allocation.bndpsd, 
-				audio->ac3_bit_allocation.excite);
-
-/* Perform no delta bit allocation for lfe */
-		mpeg3audio_ac3_ba_compute_mask(audio,
-				start, 
-				end, 
-				fscod, 
-				2, 
-				0, 
-				0, 
-				0, 
-				0, 
-				audio->ac3_bit_allocation.excite, 
-				audio->ac3_bit_allocation.mask);
-
-		mpeg3audio_ac3_ba_compute_bap(audio,
-				start, 
-				end, 
-				snroffset, 
-				audio->ac3_bit_allocation.psd, 
-				audio->ac3_bit_allocation.mask, 
-				(short*)audblk->lfe_bap);
+		for(i = 0; i < MPEG3_AC3_FBW; i++)
+			memset(state->fbw[i].bap, 0, sizeof(state->fbw[i].bap));
+		memset(state->cpl.bap, 0, sizeof(state->cpl.bap));
+		memset(state->lfe.bap, 0, sizeof(state->lfe.bap));
+		return;
 	}
 
-	return result;
+	for(i = 0; i < state->nfchans; i++)
+		allocate_channel(state,
+			&state->fbw[i],
+			0,
+			state->endmant[i],
+			0,
+			0,
+			0);
+
+	if(state->cplinu)
+		allocate_channel(state,
+			&state->cpl,
+			state->cplstrtmant,
+			state->cplendmant,
+			(state->cplfleak << 8) + 768,
+			(state->cplsleak << 8) + 768,
+			0);
+
+	if(state->lfeon)
+		allocate_channel(state,
+			&state->lfe,
+			0,
+			7,
+			0,
+			0,
+			1);
 }
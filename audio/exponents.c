@@ -19,136 +19,51 @@
  *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA. 
  *
  */
- 
- 
-#define MIN(x, y) ((x) > (y) ? (y) : (x))
 
-#include "mpeg3audio.h"
-#include <stdio.h>
+#include "mpeg3private.h"
+#include "mpeg3protos.h"
+#include "ac3.h"
 
-/* Exponent defines */
-#define UNPACK_FBW  1
-#define UNPACK_CPL  2
-#define UNPACK_LFE  4
+#include <stdio.h>
 
-static inline int mpeg3audio_ac3_exp_unpack_ch(unsigned int type,
-		unsigned int expstr,
-		unsigned int ngrps,
-		unsigned int initial_exp, 
-		unsigned short exps[], 
-		unsigned short *dest)
+int mpeg3ac3_exponent_unpack(mpeg3_ac3_state_t *state,
+	mpeg3_ac3_alloc_t *alloc,
+	int absexp,
+	int ngrps,
+	int start)
 {
-	int i, j;
-	int exp_acc;
-	int exp_1, exp_2, exp_3;
-
-	if(expstr == MPEG3_EXP_REUSE)
-		return 0;
+	int grpsize = 1;
+	int exponent = absexp;
+	int i, j, k;
+	int mantissa = start;
 
-/* Handle the initial absolute exponent */
-	exp_acc = initial_exp;
-	j = 0;
+	if(alloc->expstr == MPEG3_EXP_D25)
+		grpsize = 2;
+	else
+	if(alloc->expstr == MPEG3_EXP_D45)
+		grpsize = 4;
 
-/* In the case of a fbw channel then the initial absolute value is 
- * also an exponent */
-	if(type != UNPACK_CPL)
-		dest[j++] = exp_acc;
+/* The absolute exponent of the coupling channel is only a reference */
+	if(!start) alloc->exp[mantissa++] = exponent;
 
-/* Loop through the groups and fill the dest array appropriately */
 	for(i = 0; i < ngrps; i++)
 	{
-		if(exps[i] > 124)
-		{
-//			fprintf(stderr, "mpeg3audio_ac3_exp_unpack_ch: Invalid exponent %d\n", exps[i]);
-			return 1;
-		}
-
-		exp_1 = exps[i] / 25;
-		exp_2 = (exps[i] % 25) / 5;
-		exp_3 = (exps[i] % 25) % 5;
+		int group = mpeg3ac3_getbits(state, 7);
+		int deltas[3];
 
-		exp_acc += (exp_1 - 2);
+		if(group >= 125) return 1;
+		deltas[0] = group / 25;
+		deltas[1] = (group / 5) % 5;
+		deltas[2] = group % 5;
 
-		switch(expstr)
+		for(j = 0; j < 3; j++)
 		{
-			case MPEG3_EXP_D45:
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
-			case MPEG3_EXP_D25:
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
-			case MPEG3_EXP_D15:
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
-		}
-
-		exp_acc += (exp_2 - 2);
-
-		switch(expstr)
-		{
-			case MPEG3_EXP_D45:
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
-			case MPEG3_EXP_D25:
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
-			case MPEG3_EXP_D15:
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
-		}
-
-		exp_acc += (exp_3 - 2);
-
-		switch(expstr)
-		{
-			case MPEG3_EXP_D45:
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
-			case MPEG3_EXP_D25:
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
-			case MPEG3_EXP_D15:
-				j = MIN(255, j);
-				dest[j++] = exp_acc;
+			exponent += deltas[j] - 2;
+			if(exponent < 0 || exponent > 24) return 1;
+			for(k = 0; k < grpsize && mantissa < MPEG3_AC3_BLOCK; k++)
+				alloc->exp[mantissa++] = exponent;
 		}
 	}
-	return 0;
-}
 
-int mpeg3audio_ac3_exponent_unpack(mpeg3audio_t *audio,
-		mpeg3_ac3bsi_t *bsi,
-		mpeg3_ac3audblk_t *audblk)
-{
-	int i, result = 0;
-
-	for(i = 0; i < bsi->nfchans; i++)
-		result |= mpeg3audio_ac3_exp_unpack_ch(UNPACK_FBW, 
-			audblk->chexpstr[i], 
-			audblk->nchgrps[i], 
-			audblk->exps[i][0], 
-			&audblk->exps[i][1], 
-			audblk->fbw_exp[i]);
-
-	if(audblk->cplinu && !result)
-		result |= mpeg3audio_ac3_exp_unpack_ch(UNPACK_CPL, 
-			audblk->cplexpstr, 
-			audblk->ncplgrps, 
-			audblk->cplabsexp << 1,	
-			audblk->cplexps, 
-			&audblk->cpl_exp[audblk->cplstrtmant]);
-
-	if(bsi->lfeon && !result)
-		result |= mpeg3audio_ac3_exp_unpack_ch(UNPACK_LFE, 
-			audblk->lfeexpstr, 
-			2, 
-			audblk->lfeexps[0], 
-			&audblk->lfeexps[1], 
-			audblk->lfe_exp);
-	return result;
+	return 0;
 }
@@ -1,12 +1,393 @@
 #include "mpeg3private.h"
 #include "mpeg3protos.h"
-#include "tables.h"
+#include "ac3.h"
 
 #include <stdio.h>
+#include <string.h>
 
+int mpeg3_ac3_samplerates[3] = { 48000, 44100, 32000 };
 
+/* Kbits per second of every frame size code / 2 */
+static int mpeg3ac3_bitrates[19] =
+{
+	32,  40,  48,  56,  64,  80,  96,  112, 128, 160,
+	192, 224, 256, 320, 384, 448, 512, 576, 640
+};
 
+/* Sample rate shift of every bsid */
+static int mpeg3ac3_halfrate[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3 };
 
+/* Position of lfeon in byte 6 of every audio coding mode */
+static int mpeg3ac3_lfeon[8] = { 0x10, 0x10, 0x04, 0x04, 0x04, 0x01, 0x04, 0x01 };
 
+/* Full bandwidth channels of every audio coding mode */
+static int mpeg3ac3_nfchans[8] = { 2, 1, 2, 3, 3, 4, 4, 5 };
 
+int mpeg3ac3_syncinfo(unsigned char *buffer,
+	int *flags,
+	int *samplerate,
+	int *bitrate)
+{
+	int half, acmod, frmsizecod, kbps;
 
+	if(buffer[0] != 0x0b || buffer[1] != 0x77) return 0;
+/* bsid */
+	if(buffer[5] >= 0x60) return 0;
+	half = mpeg3ac3_halfrate[buffer[5] >> 3];
+
+	acmod = buffer[6] >> 5;
+	*flags = (((buffer[6] & 0xf8) == 0x50) ? A52_DOLBY : acmod) |
+		((buffer[6] & mpeg3ac3_lfeon[acmod]) ? A52_LFE : 0);
+
+	frmsizecod = buffer[4] & 0x3f;
+	if(frmsizecod >= 38) return 0;
+	kbps = mpeg3ac3_bitrates[frmsizecod >> 1];
+	*bitrate = (kbps * 1000) >> half;
+
+	switch(buffer[4] & 0xc0)
+	{
+		case 0x00:
+			*samplerate = 48000 >> half;
+			return 4 * kbps;
+		case 0x40:
+			*samplerate = 44100 >> half;
+			return 2 * (320 * kbps / 147 + (frmsizecod & 1));
+		case 0x80:
+			*samplerate = 32000 >> half;
+			return 6 * kbps;
+	}
+	return 0;
+}
+
+/* Skip the optional fields of a program */
+static void skip_program(mpeg3_ac3_state_t *state)
+{
+/* dialnorm */
+	mpeg3ac3_skipbits(state, 5);
+/* compr */
+	if(mpeg3ac3_getbits(state, 1)) mpeg3ac3_skipbits(state, 8);
+/* langcod */
+	if(mpeg3ac3_getbits(state, 1)) mpeg3ac3_skipbits(state, 8);
+/* mixlevel, roomtyp */
+	if(mpeg3ac3_getbits(state, 1)) mpeg3ac3_skipbits(state, 7);
+}
+
+int mpeg3ac3_frame(mpeg3_ac3_state_t *state,
+	unsigned char *buffer,
+	int size,
+	int *flags)
+{
+	int samplerate, bitrate;
+	int framesize;
+	int i;
+
+/* No blocks are decoded until the frame is good */
+	state->block = MPEG3_AC3_BLOCKS;
+	framesize = mpeg3ac3_syncinfo(buffer, flags, &samplerate, &bitrate);
+	if(!framesize || framesize > size) return 1;
+
+	state->buffer = buffer;
+	state->size = framesize;
+/* Skip the syncword and crc1 */
+	state->bit_position = 32;
+	state->fscod = mpeg3ac3_getbits(state, 2);
+	if(state->fscod == 3) return 1;
+	mpeg3ac3_skipbits(state, 6);
+
+/* bsid, bsmod */
+	mpeg3ac3_skipbits(state, 8);
+	state->acmod = mpeg3ac3_getbits(state, 3);
+	state->nfchans = mpeg3ac3_nfchans[state->acmod];
+/* cmixlev */
+	if((state->acmod & 0x1) && state->acmod != 0x1)
+		mpeg3ac3_skipbits(state, 2);
+/* surmixlev */
+	if(state->acmod & 0x4)
+		mpeg3ac3_skipbits(state, 2);
+/* dsurmod */
+	if(state->acmod == 0x2)
+		mpeg3ac3_skipbits(state, 2);
+	state->lfeon = mpeg3ac3_getbits(state, 1);
+
+	skip_program(state);
+/* Second program of 1+1 */
+	if(state->acmod == 0)
+		skip_program(state);
+
+/* copyrightb, origbs */
+	mpeg3ac3_skipbits(state, 2);
+/* timecod1 */
+	if(mpeg3ac3_getbits(state, 1)) mpeg3ac3_skipbits(state, 14);
+/* timecod2 */
+	if(mpeg3ac3_getbits(state, 1)) mpeg3ac3_skipbits(state, 14);
+/* addbsi */
+	if(mpeg3ac3_getbits(state, 1))
+		mpeg3ac3_skipbits(state, (mpeg3ac3_getbits(state, 6) + 1) * 8);
+
+/* Delta bit allocation doesn't carry over from the last frame */
+	for(i = 0; i < MPEG3_AC3_FBW; i++)
+		state->fbw[i].deltbae = DELTA_BIT_NONE;
+	state->cpl.deltbae = DELTA_BIT_NONE;
+	state->lfe.deltbae = DELTA_BIT_NONE;
+
+	state->block = 0;
+	return 0;
+}
+
+/* Read the delta bit allocation segments of a channel */
+static void get_deltba(mpeg3_ac3_state_t *state, mpeg3_ac3_alloc_t *alloc)
+{
+	int i;
+	alloc->deltnseg = mpeg3ac3_getbits(state, 3);
+	for(i = 0; i <= alloc->deltnseg; i++)
+	{
+		alloc->deltoffst[i] = mpeg3ac3_getbits(state, 5);
+		alloc->deltlen[i] = mpeg3ac3_getbits(state, 4);
+		alloc->deltba[i] = mpeg3ac3_getbits(state, 3);
+	}
+}
+
+/* Read the SNR offset and fast gain of a channel */
+static void get_snroffst(mpeg3_ac3_state_t *state, mpeg3_ac3_alloc_t *alloc)
+{
+	alloc->fsnroffst = mpeg3ac3_getbits(state, 4);
+	alloc->fgaincod = mpeg3ac3_getbits(state, 3);
+}
+
+/* Number of exponent groups for the exponent strategy */
+static int exponent_groups(int expstr, int mantissas)
+{
+	switch(expstr)
+	{
+		case MPEG3_EXP_D15: return mantissas / 3;
+		case MPEG3_EXP_D25: return (mantissas + 3) / 6;
+		case MPEG3_EXP_D45: return (mantissas + 9) / 12;
+	}
+	return 0;
+}
+
+int mpeg3ac3_parse_audblk(mpeg3_ac3_state_t *state)
+{
+	int nfchans = state->nfchans;
+	int chbwcod[MPEG3_AC3_FBW];
+	int cplcoe, got_cplcoe = 0;
+	int i, j;
+
+	for(i = 0; i < nfchans; i++)
+		state->blksw[i] = mpeg3ac3_getbits(state, 1);
+	for(i = 0; i < nfchans; i++)
+		state->dithflag[i] = mpeg3ac3_getbits(state, 1);
+
+/* Dynamic range isn't applied */
+	if(mpeg3ac3_getbits(state, 1)) mpeg3ac3_skipbits(state, 8);
+	if(state->acmod == 0)
+		if(mpeg3ac3_getbits(state, 1)) mpeg3ac3_skipbits(state, 8);
+
+/* Coupling strategy */
+	if(mpeg3ac3_getbits(state, 1))
+	{
+		state->cplinu = mpeg3ac3_getbits(state, 1);
+		if(state->cplinu)
+		{
+			int ncplsubnd;
+
+			for(i = 0; i < nfchans; i++)
+				state->chincpl[i] = mpeg3ac3_getbits(state, 1);
+			state->phsflginu = 0;
+			if(state->acmod == 0x2)
+				state->phsflginu = mpeg3ac3_getbits(state, 1);
+			state->cplbegf = mpeg3ac3_getbits(state, 4);
+			state->cplendf = mpeg3ac3_getbits(state, 4);
+			ncplsubnd = 3 + state->cplendf - state->cplbegf;
+			if(ncplsubnd < 1) return 1;
+
+			state->cplstrtmant = state->cplbegf * 12 + 37;
+			state->cplendmant = state->cplendf * 12 + 73;
+			state->ncplbnd = 1;
+			state->cplband[0] = 0;
+			for(i = 1; i < ncplsubnd; i++)
+			{
+/* cplbndstrc joins the sub-band to the last band */
+				if(!mpeg3ac3_getbits(state, 1))
+					state->ncplbnd++;
+				state->cplband[i] = state->ncplbnd - 1;
+			}
+			for(i = 0; i < MPEG3_AC3_CPLBANDS; i++)
+				state->phsflg[i] = 0;
+		}
+		else
+		{
+			for(i = 0; i < nfchans; i++)
+				state->chincpl[i] = 0;
+		}
+	}
+
+/* Coupling coordinates */
+	if(state->cplinu)
+	{
+		for(i = 0; i < nfchans; i++)
+		{
+			if(!state->chincpl[i]) continue;
+			cplcoe = mpeg3ac3_getbits(state, 1);
+			if(cplcoe)
+			{
+				int mstrcplco = mpeg3ac3_getbits(state, 2) * 3;
+				got_cplcoe = 1;
+				for(j = 0; j < state->ncplbnd; j++)
+				{
+					int cplcoexp = mpeg3ac3_getbits(state, 4);
+					int cplcomant = mpeg3ac3_getbits(state, 4);
+					float mantissa;
+
+					if(cplcoexp == 15)
+						mantissa = cplcomant / 16.0;
+					else
+						mantissa = (cplcomant + 16) / 32.0;
+/* The coupling channel is 8 times smaller than the channels */
+					state->cplco[i][j] = mantissa * 8 /
+						(1 << (cplcoexp + mstrcplco));
+				}
+			}
+		}
+
+		if(state->acmod == 0x2 && state->phsflginu && got_cplcoe)
+			for(j = 0; j < state->ncplbnd; j++)
+				state->phsflg[j] = mpeg3ac3_getbits(state, 1);
+	}
+
+/* Rematrixing */
+	if(state->acmod == 0x2 && mpeg3ac3_getbits(state, 1))
+	{
+		int total = 4;
+		if(state->cplinu && state->cplbegf == 0)
+			total = 2;
+		else
+		if(state->cplinu && state->cplbegf <= 2)
+			total = 3;
+		for(i = 0; i < 4; i++)
+			state->rematflg[i] = i < total ? mpeg3ac3_getbits(state, 1) : 0;
+	}
+
+/* Exponent strategies */
+	if(state->cplinu)
+		state->cpl.expstr = mpeg3ac3_getbits(state, 2);
+	for(i = 0; i < nfchans; i++)
+		state->fbw[i].expstr = mpeg3ac3_getbits(state, 2);
+	if(state->lfeon)
+		state->lfe.expstr = mpeg3ac3_getbits(state, 1);
+
+	for(i = 0; i < nfchans; i++)
+	{
+		if(state->cplinu && state->chincpl[i])
+			state->endmant[i] = state->cplstrtmant;
+		else
+		if(state->fbw[i].expstr != MPEG3_EXP_REUSE)
+		{
+			chbwcod[i] = mpeg3ac3_getbits(state, 6);
+			if(chbwcod[i] > 60) return 1;
+			state->endmant[i] = chbwcod[i] * 3 + 73;
+		}
+	}
+
+/* Exponents */
+	if(state->cplinu && state->cpl.expstr != MPEG3_EXP_REUSE)
+	{
+		int absexp = mpeg3ac3_getbits(state, 4) << 1;
+		int ngrps;
+		if(state->cpl.expstr == MPEG3_EXP_D15)
+			ngrps = (state->cplendmant - state->cplstrtmant) / 3;
+		else
+		if(state->cpl.expstr == MPEG3_EXP_D25)
+			ngrps = (state->cplendmant - state->cplstrtmant) / 6;
+		else
+			ngrps = (state->cplendmant - state->cplstrtmant) / 12;
+		if(mpeg3ac3_exponent_unpack(state,
+			&state->cpl,
+			absexp,
+			ngrps,
+			state->cplstrtmant)) return 1;
+	}
+
+	for(i = 0; i < nfchans; i++)
+	{
+		if(state->fbw[i].expstr != MPEG3_EXP_REUSE)
+		{
+			int absexp = mpeg3ac3_getbits(state, 4);
+			if(mpeg3ac3_exponent_unpack(state,
+				&state->fbw[i],
+				absexp,
+				exponent_groups(state->fbw[i].expstr, state->endmant[i] - 1),
+				0)) return 1;
+/* gainrng */
+			mpeg3ac3_skipbits(state, 2);
+		}
+	}
+
+	if(state->lfeon && state->lfe.expstr != MPEG3_EXP_REUSE)
+	{
+		int absexp = mpeg3ac3_getbits(state, 4);
+		if(mpeg3ac3_exponent_unpack(state,
+			&state->lfe,
+			absexp,
+			2,
+			0)) return 1;
+	}
+
+/* Bit allocation parametric information */
+	if(mpeg3ac3_getbits(state, 1))
+	{
+		state->sdcycod = mpeg3ac3_getbits(state, 2);
+		state->fdcycod = mpeg3ac3_getbits(state, 2);
+		state->sgaincod = mpeg3ac3_getbits(state, 2);
+		state->dbpbcod = mpeg3ac3_getbits(state, 2);
+		state->floorcod = mpeg3ac3_getbits(state, 3);
+	}
+
+	if(mpeg3ac3_getbits(state, 1))
+	{
+		state->csnroffst = mpeg3ac3_getbits(state, 6);
+		if(state->cplinu)
+			get_snroffst(state, &state->cpl);
+		for(i = 0; i < nfchans; i++)
+			get_snroffst(state, &state->fbw[i]);
+		if(state->lfeon)
+			get_snroffst(state, &state->lfe);
+	}
+
+	if(state->cplinu && mpeg3ac3_getbits(state, 1))
+	{
+		state->cplfleak = mpeg3ac3_getbits(state, 3);
+		state->cplsleak = mpeg3ac3_getbits(state, 3);
+	}
+
+/* Delta bit allocation.  Reuse keeps the last segments. */
+	if(mpeg3ac3_getbits(state, 1))
+	{
+		int cpldeltbae = DELTA_BIT_REUSE;
+		int deltbae[MPEG3_AC3_FBW];
+
+		if(state->cplinu)
+			cpldeltbae = mpeg3ac3_getbits(state, 2);
+		for(i = 0; i < nfchans; i++)
+			deltbae[i] = mpeg3ac3_getbits(state, 2);
+
+		if(cpldeltbae == DELTA_BIT_RESERVED) return 1;
+		if(cpldeltbae != DELTA_BIT_REUSE) state->cpl.deltbae = cpldeltbae;
+		if(cpldeltbae == DELTA_BIT_NEW)
+			get_deltba(state, &state->cpl);
+
+		for(i = 0; i < nfchans; i++)
+		{
+			if(deltbae[i] == DELTA_BIT_RESERVED) return 1;
+			if(deltbae[i] != DELTA_BIT_REUSE) state->fbw[i].deltbae = deltbae[i];
+			if(deltbae[i] == DELTA_BIT_NEW)
+				get_deltba(state, &state->fbw[i]);
+		}
+	}
+
+/* Skip field */
+	if(mpeg3ac3_getbits(state, 1))
+		mpeg3ac3_skipbits(state, mpeg3ac3_getbits(state, 9) * 8);
+
+	return 0;
+}
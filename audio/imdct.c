@@ -0,0 +1,172 @@
+#include "mpeg3private.h"
+#include "mpeg3protos.h"
+#include "ac3.h"
+
+#include <math.h>
+
+
+static double bessel_i0(double x)
+{
+	double result = 1;
+	int i;
+	for(i = 100; i > 0; i--)
+		result = result * x / (i * i) + 1;
+	return result;
+}
+
+static void reverse_bits(int *table, int bits)
+{
+	int i, j;
+	for(i = 0; i < (1 << bits); i++)
+	{
+		table[i] = 0;
+		for(j = 0; j < bits; j++)
+			if(i & (1 << j)) table[i] |= 1 << (bits - 1 - j);
+	}
+}
+
+void mpeg3ac3_init_imdct(mpeg3_ac3_state_t *state)
+{
+	double window[MPEG3_AC3_BLOCK];
+	double sum = 0;
+	int i;
+
+/* Kaiser Bessel derived window with alpha 5 */
+	for(i = 0; i < MPEG3_AC3_BLOCK; i++)
+	{
+		sum += bessel_i0(i * (256 - i) * (5 * M_PI / 256) * (5 * M_PI / 256));
+		window[i] = sum;
+	}
+	sum++;
+	for(i = 0; i < MPEG3_AC3_BLOCK; i++)
+		state->window[i] = sqrt(window[i] / sum);
+
+	for(i = 0; i < 128; i++)
+	{
+		state->twiddle1[i].real = -cos(2 * M_PI * (8 * i + 1) / 4096);
+		state->twiddle1[i].imag = -sin(2 * M_PI * (8 * i + 1) / 4096);
+	}
+
+	for(i = 0; i < 64; i++)
+	{
+		state->twiddle2[i].real = -cos(2 * M_PI * (8 * i + 1) / 2048);
+		state->twiddle2[i].imag = -sin(2 * M_PI * (8 * i + 1) / 2048);
+		state->roots[i].real = cos(2 * M_PI * i / 128);
+		state->roots[i].imag = sin(2 * M_PI * i / 128);
+	}
+
+	reverse_bits(state->reverse128, 7);
+	reverse_bits(state->reverse64, 6);
+}
+
+/* Inverse FFT of bit reversed input */
+static void ifft(mpeg3_ac3_state_t *state, mpeg3_complex_t *buffer, int size)
+{
+	int span, start, i;
+
+	for(span = 1; span < size; span <<= 1)
+	{
+		int step = 64 / span;
+		for(start = 0; start < size; start += span * 2)
+		{
+			mpeg3_complex_t *a = buffer + start;
+			mpeg3_complex_t *b = a + span;
+			for(i = 0; i < span; i++)
+			{
+				mpeg3_complex_t *root = &state->roots[i * step];
+				float real = b[i].real * root->real - b[i].imag * root->imag;
+				float imag = b[i].imag * root->real + b[i].real * root->imag;
+				b[i].real = a[i].real - real;
+				b[i].imag = a[i].imag - imag;
+				a[i].real += real;
+				a[i].imag += imag;
+			}
+		}
+	}
+}
+
+/* Pre twiddle size coefficients spaced by step, transform, and post twiddle. */
+static void transform(mpeg3_ac3_state_t *state,
+	float *coeffs,
+	int step,
+	mpeg3_complex_t *buffer,
+	mpeg3_complex_t *twiddle,
+	int *reverse,
+	int size)
+{
+	int last = (size * 2 - 1) * step;
+	int i;
+
+	for(i = 0; i < size; i++)
+	{
+		float a = coeffs[last - 2 * i * step];
+		float b = coeffs[2 * i * step];
+		mpeg3_complex_t *out = &buffer[reverse[i]];
+		out->real = a * twiddle[i].real - b * twiddle[i].imag;
+		out->imag = b * twiddle[i].real + a * twiddle[i].imag;
+	}
+
+	ifft(state, buffer, size);
+
+	for(i = 0; i < size; i++)
+	{
+		float real = buffer[i].real;
+		float imag = buffer[i].imag;
+		buffer[i].real = real * twiddle[i].real - imag * twiddle[i].imag;
+		buffer[i].imag = imag * twiddle[i].real + real * twiddle[i].imag;
+	}
+}
+
+void mpeg3ac3_imdct(mpeg3_ac3_state_t *state, int channel, sample_t *output)
+{
+	float *coeffs = state->coeffs[channel];
+	float *delay = state->delay[channel];
+	float *w = state->window;
+	float x[MPEG3_AC3_BLOCK * 2];
+	int n;
+
+	if(channel == MPEG3_AC3_FBW || !state->blksw[channel])
+	{
+		mpeg3_complex_t *y = state->fft[0];
+		transform(state, coeffs, 1, y, state->twiddle1, state->reverse128, 128);
+
+		for(n = 0; n < 64; n++)
+		{
+			x[2 * n] = -y[64 + n].imag * w[2 * n];
+			x[2 * n + 1] = y[63 - n].real * w[2 * n + 1];
+			x[128 + 2 * n] = -y[n].real * w[128 + 2 * n];
+			x[128 + 2 * n + 1] = y[127 - n].imag * w[128 + 2 * n + 1];
+			x[256 + 2 * n] = -y[64 + n].real * w[255 - 2 * n];
+			x[256 + 2 * n + 1] = y[63 - n].imag * w[254 - 2 * n];
+			x[384 + 2 * n] = y[n].imag * w[127 - 2 * n];
+			x[384 + 2 * n + 1] = -y[127 - n].real * w[126 - 2 * n];
+		}
+	}
+	else
+	{
+/* Two short transforms of the even and odd coefficients */
+		mpeg3_complex_t *y1 = state->fft[0];
+		mpeg3_complex_t *y2 = state->fft[1];
+		transform(state, coeffs, 2, y1, state->twiddle2, state->reverse64, 64);
+		transform(state, coeffs + 1, 2, y2, state->twiddle2, state->reverse64, 64);
+
+		for(n = 0; n < 64; n++)
+		{
+			x[2 * n] = -y1[n].imag * w[2 * n];
+			x[2 * n + 1] = y1[63 - n].real * w[2 * n + 1];
+			x[128 + 2 * n] = -y1[n].real * w[128 + 2 * n];
+			x[128 + 2 * n + 1] = y1[63 - n].imag * w[128 + 2 * n + 1];
+			x[256 + 2 * n] = -y2[n].real * w[255 - 2 * n];
+			x[256 + 2 * n + 1] = y2[63 - n].imag * w[254 - 2 * n];
+			x[384 + 2 * n] = y2[n].imag * w[127 - 2 * n];
+			x[384 + 2 * n + 1] = -y2[63 - n].real * w[126 - 2 * n];
+		}
+	}
+
+/* Overlap with the second half of the last block */
+	for(n = 0; n < MPEG3_AC3_BLOCK; n++)
+	{
+		output[n] = 2 * (x[n] + delay[n]);
+		delay[n] = x[MPEG3_AC3_BLOCK + n];
+	}
+}
@@ -21,374 +21,174 @@
  *
  */
 
-#include "mpeg3audio.h"
+#include "mpeg3private.h"
+#include "mpeg3protos.h"
+#include "ac3.h"
 
+#include <string.h>
 
-/* Lookup tables of 0.16 two's complement quantization values */
-static short mpeg3_q_1[3] = 
-{
-	(-2 << 15) / 3, 
-	0, 
-	(2 << 15) / 3
-};
 
-static short mpeg3_q_2[5] = 
+/* Symmetric quantization levels (2 * i - (levels - 1)) / levels.  The last */
+/* entry is the value of a bad code. */
+static const float mpeg3_q_1[4] = 
 {
-	(-4 << 15) / 5, 
-	((-2 << 15) / 5) << 1, 
-	0,
-	(2 << 15) / 5, 
-	((4 << 15) / 5) << 1
+	-2.0 / 3, 0, 2.0 / 3, 0
 };
 
-static short mpeg3_q_3[7] = 
+static const float mpeg3_q_2[6] = 
 {
-	(-6 << 15) / 7, 
-	(-4 << 15) / 7, 
-	(-2 << 15) / 7,
-	0, 
-	(2 << 15) / 7, 
-	(4 << 15) / 7,
-	(6 << 15) / 7
+	-4.0 / 5, -2.0 / 5, 0, 2.0 / 5, 4.0 / 5, 0
 };
 
-static short mpeg3_q_4[11] = 
+static const float mpeg3_q_3[8] = 
 {
-	(-10 << 15) / 11, 
-	(-8 << 15) / 11, 
-	(-6 << 15) / 11,
-	(-4 << 15) / 11, 
-	(-2 << 15) / 11, 
-	0,
-	( 2 << 15) / 11, 
-	( 4 << 15) / 11, 
-	( 6 << 15) / 11,
-	( 8 << 15) / 11, 
-	(10 << 15) / 11
+	-6.0 / 7, -4.0 / 7, -2.0 / 7, 0, 2.0 / 7, 4.0 / 7, 6.0 / 7, 0
 };
 
-static short mpeg3_q_5[15] = 
+static const float mpeg3_q_4[12] = 
 {
-	(-14 << 15) / 15, 
-	(-12 << 15) / 15, 
-	(-10 << 15) / 15,
-    (-8 << 15) / 15, 
-	(-6 << 15) / 15, 
-	(-4 << 15) / 15,
-	(-2 << 15) / 15, 			
-	0, 
-	( 2 << 15) / 15,
-	( 4 << 15) / 15, 
-	( 6 << 15) / 15, 
-	( 8 << 15) / 15,
-	(10 << 15) / 15, 
-	(12 << 15) / 15, 
-	(14 << 15) / 15
+	-10.0 / 11, -8.0 / 11, -6.0 / 11, -4.0 / 11, -2.0 / 11, 0, 
+	2.0 / 11, 4.0 / 11, 6.0 / 11, 8.0 / 11, 10.0 / 11, 0
 };
 
-static short mpeg3_qnttztab[16] = {0, 0, 0, 3, 0, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 16};
-
-
-/* */
-/* Scale factors for tofloat */
-/* */
-
-static const u_int32_t mpeg3_scale_factors[25] = 
+static const float mpeg3_q_5[16] = 
 {
-	0x38000000, /*2 ^ -(0 + 15) */
-	0x37800000, /*2 ^ -(1 + 15) */
-	0x37000000, /*2 ^ -(2 + 15) */
-	0x36800000, /*2 ^ -(3 + 15) */
-	0x36000000, /*2 ^ -(4 + 15) */
-	0x35800000, /*2 ^ -(5 + 15) */
-	0x35000000, /*2 ^ -(6 + 15) */
-	0x34800000, /*2 ^ -(7 + 15) */
-	0x34000000, /*2 ^ -(8 + 15) */
-	0x33800000, /*2 ^ -(9 + 15) */
-	0x33000000, /*2 ^ -(10 + 15) */
-	0x32800000, /*2 ^ -(11 + 15) */
-	0x32000000, /*2 ^ -(12 + 15) */
-	0x31800000, /*2 ^ -(13 + 15) */
-	0x31000000, /*2 ^ -(14 + 15) */
-	0x30800000, /*2 ^ -(15 + 15) */
-	0x30000000, /*2 ^ -(16 + 15) */
-	0x2f800000, /*2 ^ -(17 + 15) */
-	0x2f000000, /*2 ^ -(18 + 15) */
-	0x2e800000, /*2 ^ -(19 + 15) */
-	0x2e000000, /*2 ^ -(20 + 15) */
-	0x2d800000, /*2 ^ -(21 + 15) */
-	0x2d000000, /*2 ^ -(22 + 15) */
-	0x2c800000, /*2 ^ -(23 + 15) */
-	0x2c000000  /*2 ^ -(24 + 15) */
+	-14.0 / 15, -12.0 / 15, -10.0 / 15, -8.0 / 15, -6.0 / 15, -4.0 / 15, -2.0 / 15, 0, 
+	2.0 / 15, 4.0 / 15, 6.0 / 15, 8.0 / 15, 10.0 / 15, 12.0 / 15, 14.0 / 15, 0
 };
 
-static MPEG3_FLOAT32 *mpeg3_scale_factor = (MPEG3_FLOAT32*)mpeg3_scale_factors;
-
-#define CLIP(x, y, z)  ((x) < (y) ? (y) : ((x) > (z) ? (z) : (x)))
-
-static float mpeg3audio_ac3_tofloat(unsigned short exponent, int mantissa)
+/* Bits of the asymmetric mantissas */
+static const int mpeg3_qntztab[16] = 
 {
-	float x;
-	
-	x = mantissa * mpeg3_scale_factor[CLIP(exponent, 0, 25)];
-//printf(__FUNCTION__ " %f\n", x);
-
-	return x;
-}
-
-static void mpeg3audio_ac3_mantissa_reset(mpeg3_ac3_mantissa_t *mantissa)
-{
-	mantissa->m_1[2] = mantissa->m_1[1] = mantissa->m_1[0] = 0;
-	mantissa->m_2[2] = mantissa->m_2[1] = mantissa->m_2[0] = 0;
-	mantissa->m_4[1] = mantissa->m_4[0] = 0;
-/* Force new groups to be loaded */
-	mantissa->m_1_pointer = mantissa->m_2_pointer = mantissa->m_4_pointer = 3;
-}
+	0, 0, 0, 3, 0, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 16
+};
 
-/* 
- * Generate eight bits of pseudo-entropy using a 16 bit linear
- * feedback shift register (LFSR). The primitive polynomial used
- * is 1 + x^4 + x^14 + x^16.
- *
- * The distribution is uniform, over the range [-0.707,0.707]
- *
- */
-static unsigned int mpeg3audio_ac3_dither_gen(mpeg3audio_t *audio)
+/* 2 ^ -exponent */
+#define SCALE(x) (1.0 / (1 << (x)))
+static const float mpeg3_scale_factor[25] =
 {
-	int i;
-	unsigned int state;
-
-/* explicitly bring the state into a local var as gcc > 3.0? */
-/* doesn't know how to optimize out the stores */
-	state = audio->ac3_lfsr_state;
-
-/* Generate eight pseudo random bits */
-	for(i = 0; i < 8; i++)
-	{
-		state <<= 1;	
-
-		if(state & 0x10000)
-			state ^= 0xa011;
-	}
-
-	audio->ac3_lfsr_state = state;
-	return (((((int)state << 8) >> 8) * (int)(0.707106f * 256.0f)) >> 16);
-}
+	SCALE(0),  SCALE(1),  SCALE(2),  SCALE(3),  SCALE(4),
+	SCALE(5),  SCALE(6),  SCALE(7),  SCALE(8),  SCALE(9),
+	SCALE(10), SCALE(11), SCALE(12), SCALE(13), SCALE(14),
+	SCALE(15), SCALE(16), SCALE(17), SCALE(18), SCALE(19),
+	SCALE(20), SCALE(21), SCALE(22), SCALE(23), SCALE(24)
+};
 
 
-/* Fetch an unpacked, left justified, and properly biased/dithered mantissa value */
-static unsigned short mpeg3audio_ac3_mantissa_get(mpeg3audio_t *audio, 
-	unsigned short bap, 
-	unsigned short dithflag)
+/* Get one mantissa.  The grouped mantissas are shared by every channel */
+/* in the block. */
+static inline float get_mantissa(mpeg3_ac3_state_t *state, int bap, int dither)
 {
-	unsigned short mantissa;
-	unsigned int group_code;
-	mpeg3_ac3_mantissa_t *mantissa_struct = &(audio->ac3_mantissa);
+	int code;
 
-/* If the bap is 0-5 then we have special cases to take care of */
 	switch(bap)
 	{
 		case 0:
-			if(dithflag)
-				mantissa = mpeg3audio_ac3_dither_gen(audio);
-			else
-				mantissa = 0;
-			break;
+			return dither ? mpeg3ac3_dither(state) : 0;
 
 		case 1:
-			if(mantissa_struct->m_1_pointer > 2)
+			if(!state->total1)
 			{
-				group_code = mpeg3bits_getbits(audio->astream, 5);
-
-				if(group_code > 26)
-				{
-/* FIXME do proper block error handling */
-//					fprintf(stderr, "mpeg3audio_ac3_mantissa_get: Invalid mantissa 1 %d\n", group_code);
-					return 0;
-				}
-
-				mantissa_struct->m_1[0] = group_code / 9; 
-				mantissa_struct->m_1[1] = (group_code % 9) / 3; 
-				mantissa_struct->m_1[2] = (group_code % 9) % 3; 
-				mantissa_struct->m_1_pointer = 0;
+				code = mpeg3ac3_getbits(state, 5);
+				if(code >= 27) code = 13;
+				state->group1[0] = code / 9;
+				state->group1[1] = (code / 3) % 3;
+				state->group1[2] = code % 3;
+				state->total1 = 3;
 			}
-			mantissa = mantissa_struct->m_1[mantissa_struct->m_1_pointer++];
-			mantissa = mpeg3_q_1[mantissa];
-			break;
+			return mpeg3_q_1[state->group1[3 - state->total1--]];
 
 		case 2:
-			if(mantissa_struct->m_2_pointer > 2)
+			if(!state->total2)
 			{
-				group_code = mpeg3bits_getbits(audio->astream, 7);
-
-				if(group_code > 124)
-				{
-//					fprintf(stderr, "mpeg3audio_ac3_mantissa_get: Invalid mantissa 2 %d\n", group_code);
-					return 0;
-				}
-
-				mantissa_struct->m_2[0] = group_code / 25;
-				mantissa_struct->m_2[1] = (group_code % 25) / 5;
-				mantissa_struct->m_2[2] = (group_code % 25) % 5; 
-				mantissa_struct->m_2_pointer = 0;
+				code = mpeg3ac3_getbits(state, 7);
+				if(code >= 125) code = 62;
+				state->group2[0] = code / 25;
+				state->group2[1] = (code / 5) % 5;
+				state->group2[2] = code % 5;
+				state->total2 = 3;
 			}
-			mantissa = mantissa_struct->m_2[mantissa_struct->m_2_pointer++];
-			mantissa = mpeg3_q_2[mantissa];
-			break;
+			return mpeg3_q_2[state->group2[3 - state->total2--]];
 
 		case 3:
-			mantissa = mpeg3bits_getbits(audio->astream, 3);
-
-			if(mantissa > 6)
-			{
-//				fprintf(stderr, "mpeg3audio_ac3_mantissa_get: Invalid mantissa 3 %d\n", group_code);
-				return 0;
-			}
-
-			mantissa = mpeg3_q_3[mantissa];
-			break;
+			return mpeg3_q_3[mpeg3ac3_getbits(state, 3)];
 
 		case 4:
-			if(mantissa_struct->m_4_pointer > 1)
+			if(!state->total4)
 			{
-				group_code = mpeg3bits_getbits(audio->astream, 7);
-
-				if(group_code > 120)
-				{
-//					fprintf(stderr, "mpeg3audio_ac3_mantissa_get: Invalid mantissa 4 %d\n", group_code);
-					return 0;
-				}
-
-				mantissa_struct->m_4[0] = group_code / 11;
-				mantissa_struct->m_4[1] = group_code % 11;
-				mantissa_struct->m_4_pointer = 0;
+				code = mpeg3ac3_getbits(state, 7);
+				if(code >= 121) code = 60;
+				state->group4[0] = code / 11;
+				state->group4[1] = code % 11;
+				state->total4 = 2;
 			}
-			mantissa = mantissa_struct->m_4[mantissa_struct->m_4_pointer++];
-			mantissa = mpeg3_q_4[mantissa];
-			break;
+			return mpeg3_q_4[state->group4[2 - state->total4--]];
 
 		case 5:
-			mantissa = mpeg3bits_getbits(audio->astream, 4);
-
-			if(mantissa > 14)
-			{
-/* FIXME do proper block error handling */
-//				fprintf(stderr, "mpeg3audio_ac3_mantissa_get: Invalid mantissa 5 %d\n", group_code);
-				return 0;
-			}
-
-			mantissa = mpeg3_q_5[mantissa];
-			break;
+			return mpeg3_q_5[mpeg3ac3_getbits(state, 4)];
 
 		default:
-			mantissa = mpeg3bits_getbits(audio->astream, mpeg3_qnttztab[bap]);
-			mantissa <<= 16 - mpeg3_qnttztab[bap];
+/* Two's complement fraction */
+			code = mpeg3_qntztab[bap];
+			return (float)((int32_t)(mpeg3ac3_getbits(state, code) << (32 - code)) >> (32 - code)) /
+				(1 << (code - 1));
 	}
-	return mantissa;
 }
 
-void mpeg3audio_ac3_uncouple_channel(mpeg3audio_t *audio,
-		float samples[],
-		mpeg3_ac3bsi_t *bsi, 
-		mpeg3_ac3audblk_t *audblk, 
-		unsigned int ch)
+static void get_channel(mpeg3_ac3_state_t *state,
+	mpeg3_ac3_alloc_t *alloc,
+	float *coeffs,
+	int start,
+	int end,
+	int dither)
 {
-	unsigned int bnd = 0;
-	unsigned int sub_bnd = 0;
-	unsigned int i, j;
-	MPEG3_FLOAT32 cpl_coord = 1.0;
-	unsigned int cpl_exp_tmp;
-	unsigned int cpl_mant_tmp;
-	short mantissa;
-
-	for(i = audblk->cplstrtmant; i < audblk->cplendmant; )
-	{
-		if(!audblk->cplbndstrc[sub_bnd++])
-		{
-			cpl_exp_tmp = audblk->cplcoexp[ch][bnd] + 3 * audblk->mstrcplco[ch];
-			if(audblk->cplcoexp[ch][bnd] == 15)
-				cpl_mant_tmp = (audblk->cplcomant[ch][bnd]) << 11;
-			else
-				cpl_mant_tmp = ((0x10) | audblk->cplcomant[ch][bnd]) << 10;
-
-			cpl_coord = mpeg3audio_ac3_tofloat(cpl_exp_tmp, cpl_mant_tmp) * 8.0f;
-
-/*Invert the phase for the right channel if necessary */
-			if(bsi->acmod == 0x2 && audblk->phsflginu && ch == 1 && audblk->phsflg[bnd])
-				cpl_coord *= -1;
-
-			bnd++;
-		}
-
-		for(j = 0; j < 12; j++)
-		{
-/* Get new dither values for each channel if necessary, so */
-/* the channels are uncorrelated */
-			if(audblk->dithflag[ch] && audblk->cpl_bap[i] == 0)
-				mantissa = mpeg3audio_ac3_dither_gen(audio);
-			else
-				mantissa = audblk->cplmant[i];
-
-			samples[i] = cpl_coord * mpeg3audio_ac3_tofloat(audblk->cpl_exp[i], mantissa);;
-
-			i++;
-		}
-	}
-	return;
+	int i;
+	for(i = start; i < end; i++)
+		coeffs[i] = get_mantissa(state, alloc->bap[i], dither) *
+			mpeg3_scale_factor[alloc->exp[i]];
 }
 
-int mpeg3audio_ac3_coeff_unpack(mpeg3audio_t *audio, 
-	mpeg3_ac3bsi_t *bsi, 
-	mpeg3_ac3audblk_t *audblk,
-	mpeg3ac3_stream_samples_t samples)
+int mpeg3ac3_coeff_unpack(mpeg3_ac3_state_t *state)
 {
-	int i, j;
-	int done_cpl = 0;
-	short mantissa;
+	int got_cpl = 0;
+	int i;
 
-	mpeg3audio_ac3_mantissa_reset(&(audio->ac3_mantissa));
+	state->total1 = 0;
+	state->total2 = 0;
+	state->total4 = 0;
 
-	for(i = 0; i < bsi->nfchans && !mpeg3bits_error(audio->astream); i++)
+	for(i = 0; i < state->nfchans; i++)
 	{
-		for(j = 0; j < audblk->endmant[i] && !mpeg3bits_error(audio->astream); j++)
-		{
-			mantissa = mpeg3audio_ac3_mantissa_get(audio, audblk->fbw_bap[i][j], audblk->dithflag[i]);
-			samples[i][j] = mpeg3audio_ac3_tofloat(audblk->fbw_exp[i][j], mantissa);
-		}
-
-		if(audblk->cplinu && audblk->chincpl[i] && !(done_cpl) && !mpeg3bits_error(audio->astream))
+		get_channel(state,
+			&state->fbw[i],
+			state->coeffs[i],
+			0,
+			state->endmant[i],
+			state->dithflag[i]);
+		memset(state->coeffs[i] + state->endmant[i],
+			0,
+			sizeof(float) * (MPEG3_AC3_BLOCK - state->endmant[i]));
+
+/* The coupling channel follows the first coupled channel.  Its dither */
+/* depends on the channel it's uncoupled into. */
+		if(state->cplinu && state->chincpl[i] && !got_cpl)
 		{
-/* ncplmant is equal to 12 * ncplsubnd */
-/* Don't dither coupling channel until channel separation so that
- * interchannel noise is uncorrelated */
-			for(j = audblk->cplstrtmant; 
-				j < audblk->cplendmant && !mpeg3bits_error(audio->astream); 
-				j++)
-			{
-				audblk->cplmant[j] = mpeg3audio_ac3_mantissa_get(audio, audblk->cpl_bap[j], 0);
-			}
-			done_cpl = 1;
+			get_channel(state,
+				&state->cpl,
+				state->cplcoeffs,
+				state->cplstrtmant,
+				state->cplendmant,
+				0);
+			got_cpl = 1;
 		}
 	}
 
-/* Uncouple the channel */
-	if(audblk->cplinu)
-	{
-		if(audblk->chincpl[i])
-			mpeg3audio_ac3_uncouple_channel(audio, samples[i], bsi, audblk, i);
-	}
-
-	if(bsi->lfeon && !mpeg3bits_error(audio->astream))
+	if(state->lfeon)
 	{
-/* There are always 7 mantissas for lfe, no dither for lfe */
-		for(j = 0; j < 7 && !mpeg3bits_error(audio->astream); j++)
-		{
-			mantissa = mpeg3audio_ac3_mantissa_get(audio, audblk->lfe_bap[j], 0);
-			samples[5][j] = mpeg3audio_ac3_tofloat(audblk->lfe_exp[j], mantissa);
-//printf("%f ", samples[5][j]);
-		}
-//printf("\n");
+		float *coeffs = state->coeffs[MPEG3_AC3_FBW];
+		get_channel(state, &state->lfe, coeffs, 0, 7, 0);
+		memset(coeffs + 7, 0, sizeof(float) * (MPEG3_AC3_BLOCK - 7));
 	}
 
-	return mpeg3bits_error(audio->astream);
+	return state->bit_position > state->size * 8;
 }
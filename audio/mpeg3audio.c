@@ -7,7 +7,9 @@
 
 
 
-static pthread_mutex_t *decode_lock = 0;
+#ifdef HAVE_A52
+static pthread_mutex_t decode_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 
 static void toc_error()
@@ -22,8 +24,9 @@ static void toc_error()
 static int rewind_audio(mpeg3audio_t *audio)
 {
 	mpeg3_atrack_t *track = audio->track;
-	if(track->sample_offsets)
-		mpeg3demux_seek_byte(track->demuxer, track->sample_offsets[0]);
+	if(mpeg3atrack_has_offsets(track))
+		mpeg3demux_seek_byte(track->demuxer, 
+			mpeg3atrack_sample_offset(track, 0));
 	else
 		mpeg3demux_seek_byte(track->demuxer, 0);
 	return 0;
@@ -295,6 +298,38 @@ static int delete_struct(mpeg3audio_t *audio)
 
 
 
+/* Reallocate the output for channels and allocated samples.  The samples */
+/* in the output move to the start of the ring buffer. */
+static void resize_output(mpeg3audio_t *audio, int channels, int allocated)
+{
+	float **new_output = calloc(sizeof(float*), channels);
+	int first = audio->output_allocated - audio->output_start;
+	int i;
+
+	if(first > audio->output_size) first = audio->output_size;
+	for(i = 0; i < channels; i++)
+	{
+		new_output[i] = calloc(sizeof(float), allocated + MAXFRAMESAMPLES);
+		if(i < audio->output_channels && audio->output_size)
+		{
+			memcpy(new_output[i], 
+				audio->output[i] + audio->output_start, 
+				sizeof(float) * first);
+			memcpy(new_output[i] + first, 
+				audio->output[i], 
+				sizeof(float) * (audio->output_size - first));
+		}
+	}
+
+	for(i = 0; i < audio->output_channels; i++)
+		free(audio->output[i]);
+	free(audio->output);
+	audio->output = new_output;
+	audio->output_channels = channels;
+	audio->output_allocated = allocated;
+	audio->output_start = 0;
+}
+
 static int read_frame(mpeg3audio_t *audio, int render)
 {
 	int result = 0;
@@ -302,18 +337,36 @@ static int read_frame(mpeg3audio_t *audio, int render)
 	mpeg3_t *file = audio->file;
 	float **temp_output = 0;
 	int samples = 0;
+	int64_t frame_offset = 0;
 	int i;
-	int old_channels = track->channels;
 
+#ifdef HAVE_A52
 // Liba52 is not reentrant
 	if(track->format == AUDIO_AC3)
 	{
-		pthread_mutex_lock(decode_lock);
+		pthread_mutex_lock(&decode_lock);
 	}
+#endif
 
 /* Find and read next header */
 	result = read_header(audio);
 
+/* In streaming mode wait for the rest of the frame instead of losing it */
+	if(!result && !file->seekable &&
+		track->demuxer->data_size - track->demuxer->data_position < 
+			audio->framesize - audio->packet_position &&
+		track->demuxer->data_position >= audio->packet_position)
+	{
+		track->demuxer->data_position -= audio->packet_position;
+		audio->packet_position = 0;
+		result = 1;
+	}
+
+/* Payload byte where the frame starts for the seek table of the TOC */
+	if(!result && track->total_payloads)
+		frame_offset = track->payload_bytes - 
+			(track->demuxer->data_size - track->demuxer->data_position) -
+			audio->packet_position;
 
 /* Read rest of frame */
 	if(!result)
@@ -324,31 +377,19 @@ static int read_frame(mpeg3audio_t *audio, int render)
 	}
 
 /* Handle increase in channel count, for ATSC */
-	if(old_channels < track->channels)
-	{
-		float **new_output = calloc(sizeof(float*), track->channels);
-		for(i = 0; i < track->channels; i++)
-		{
-			new_output[i] = calloc(sizeof(float), audio->output_allocated);
-			if(i < old_channels) 
-				memcpy(new_output[i], 
-					audio->output[i], 
-					sizeof(float) * audio->output_size);
-		}
-		for(i = 0; i < old_channels; i++)
-			free(audio->output[i]);
-		free(audio->output);
-		audio->output = new_output;
-	}
+	if(render && audio->output_channels < track->channels)
+		resize_output(audio, track->channels, audio->output_allocated);
 
 
 
 	if(render)
 	{
+		int index = mpeg3audio_output_index(audio, 
+			audio->output_position + audio->output_size);
 		temp_output = malloc(sizeof(float*) * track->channels);
 		for(i = 0; i < track->channels; i++)
 		{
-			temp_output[i] = audio->output[i] + audio->output_size;
+			temp_output[i] = audio->output[i] + index;
 		}
 	}
 
@@ -403,17 +444,42 @@ static int read_frame(mpeg3audio_t *audio, int render)
 	}
 
 
-	audio->output_size += samples;
 	if(render)
 	{
+/* Move the part of the frame after the end of the ring buffer to the start */
+		int wrapped = temp_output[0] + samples - 
+			(audio->output[0] + audio->output_allocated);
+		if(wrapped > 0)
+		{
+			for(i = 0; i < track->channels; i++)
+				memcpy(audio->output[i], 
+					audio->output[i] + audio->output_allocated, 
+					sizeof(float) * wrapped);
+		}
 		free(temp_output);
 	}
 
+/* Layer 3 drops the first frame after a seek so a seek to this frame */
+/* starts with the samples after it. */
+	if(!result && track->total_payloads)
+		mpeg3_seek_frame(track, 
+			frame_offset, 
+			(int64_t)audio->output_position + audio->output_size +
+				(track->format == AUDIO_MPEG && 
+					audio->layer_decoder->layer == 3 ? samples : 0));
+
+	audio->output_size += samples;
+/* Drop the oldest samples if the frame overwrote them */
+	if(render && audio->output_size > audio->output_allocated)
+		mpeg3_shift_audio(audio, audio->output_size - audio->output_allocated);
+
+#ifdef HAVE_A52
 // Liba52 is not reentrant
 	if(track->format == AUDIO_AC3)
 	{
-		pthread_mutex_unlock(decode_lock);
+		pthread_mutex_unlock(&decode_lock);
 	}
+#endif
 
 
 // Shift demuxer data
@@ -441,7 +507,7 @@ static int get_length(mpeg3audio_t *audio)
 	int samples = 0;
 
 // Table of contents
-	if(track->sample_offsets)
+	if(mpeg3atrack_has_offsets(track))
 	{
 		int try = 0;
 
@@ -521,6 +587,13 @@ int calculate_format(mpeg3_t *file, mpeg3_atrack_t *track)
 		else
 			result = 1;
 
+		if(!result && !file->seekable &&
+			track->demuxer->data_position >= 8)
+		{
+// Streaming mode can't rewind so leave the bytes for every decoder
+			track->demuxer->data_position -= 8;
+		}
+		else
 		if(audio)
 		{
 			
@@ -545,14 +618,6 @@ mpeg3audio_t* mpeg3audio_new(mpeg3_t *file,
 	int result = 0;
 	int i;
 
-	if(!decode_lock)
-	{
-		pthread_mutexattr_t attr;
-		pthread_mutexattr_init(&attr);
-		decode_lock = calloc(1, sizeof(pthread_mutex_t));
-		pthread_mutex_init(decode_lock, &attr);
-	}
-
 	audio->file = file;
 	audio->track = track;
 
@@ -599,16 +664,8 @@ mpeg3audio_t* mpeg3audio_new(mpeg3_t *file,
 	}
 
 
-/* Set up the output buffer */
-	if(!result && file->seekable)
-	{
-		audio->output = calloc(sizeof(float*), track->channels);
-		audio->output_allocated = 4;
-		for(i = 0; i < track->channels; i++)
-		{
-			audio->output[i] = calloc(sizeof(float), audio->output_allocated);
-		}
-	}
+/* The output buffer is allocated by the first decode */
+	audio->history = file->audio_history;
 
 
 /* Calculate Length */
@@ -674,15 +731,43 @@ static int seek(mpeg3audio_t *audio)
 			;
 		}
 		else
+/* Use the seek table of the table of contents */
+		if(mpeg3atrack_has_seek_points(track) &&
+			track->total_seek_points > 0 &&
+			audio->sample_seek >= mpeg3atrack_seek_sample(track, 0))
+		{
+			int64_t sample;
+			int low = 0;
+			int high = track->total_seek_points;
+
+/* Last point at or before the sample */
+			while(high - low > 1)
+			{
+				int middle = (low + high) / 2;
+				if(mpeg3atrack_seek_sample(track, middle) <= audio->sample_seek)
+					low = middle;
+				else
+					high = middle;
+			}
+			sample = mpeg3atrack_seek_sample(track, low);
+
+			mpeg3demux_seek_byte(demuxer, mpeg3atrack_seek_packet(track, low));
+/* Search for the header in new bytes only */
+			audio->packet_position = 0;
+			audio->output_position = sample;
+			audio->output_size = 0;
+			seeked = 1;
+		}
+		else
 /* Use table of contents */
-		if(track->sample_offsets)
+		if(mpeg3atrack_has_offsets(track))
 		{
 			int index;
 			int64_t byte;
 
 			index = audio->sample_seek / MPEG3_AUDIO_CHUNKSIZE;
 			if(index >= track->total_sample_offsets) index = track->total_sample_offsets - 1;
-			byte = track->sample_offsets[index];
+			byte = mpeg3atrack_sample_offset(track, index);
 
 			mpeg3demux_seek_byte(demuxer, byte);
 
@@ -887,32 +972,46 @@ int mpeg3audio_read_raw(mpeg3audio_t *audio,
 
 void mpeg3_shift_audio(mpeg3audio_t *audio, int diff)
 {
-	int i, j, k;
-	mpeg3_atrack_t *track = audio->track;
-
-	for(k = 0; k < track->channels; k++)
-	{
-		for(i = 0, j = diff; j < audio->output_size; i++, j++)
-		{
-			audio->output[k][i] = audio->output[k][j];
-		}
-	}
+	if(audio->output_allocated)
+		audio->output_start = (audio->output_start + diff) % 
+			audio->output_allocated;
 	audio->output_size -= diff;
 	audio->output_position += diff;
 }
 
+int mpeg3audio_output_index(mpeg3audio_t *audio, int position)
+{
+	int index = audio->output_start + position - audio->output_position;
+	if(index >= audio->output_allocated) index -= audio->output_allocated;
+	return index;
+}
 
+float* mpeg3audio_output(mpeg3audio_t *audio, 
+	int channel, 
+	int position, 
+	int len)
+{
+	float *output = audio->output[channel];
+	int index = mpeg3audio_output_index(audio, position);
+	int wrapped = index + len - audio->output_allocated;
+
+/* Copy the start of the ring buffer after the end */
+	if(wrapped > 0)
+		memcpy(output + audio->output_allocated, 
+			output, 
+			sizeof(float) * wrapped);
+	return output + index;
+}
 
-/* Channel is 0 to channels - 1 */
-int mpeg3audio_decode_audio(mpeg3audio_t *audio, 
-		float *output_f, 
-		short *output_i, 
-		int channel,
-		int len)
+
+
+/* Decode until len samples from the current position are in the output. */
+/* Returns 1 if there is no data to decode in streaming mode. */
+static int fill_output(mpeg3audio_t *audio, int len)
 {
 	mpeg3_t *file = audio->file;
 	mpeg3_atrack_t *track = audio->track;
-	int i, j, k;
+	int i;
 	int try = 0;
 /* Always render since now the TOC contains index files. */
 	int render = 1;
@@ -948,18 +1047,12 @@ int mpeg3audio_decode_audio(mpeg3audio_t *audio,
 			audio->output_position;
 
 /* Expand output until enough room exists for new data */
-	if(new_size > audio->output_allocated)
+	if(new_size > audio->output_allocated ||
+		track->channels > audio->output_channels)
 	{
-
-		for(i = 0; i < track->channels; i++)
-		{
-			float *new_output;
-			new_output = calloc(sizeof(float), new_size);
-			memcpy(new_output, audio->output[i], sizeof(float) * audio->output_size);
-			free(audio->output[i]);
-			audio->output[i] = new_output;
-		}
-		audio->output_allocated = new_size;
+		resize_output(audio, 
+			MAX(track->channels, audio->output_channels), 
+			MAX(new_size, audio->output_allocated));
 	}
 
 
@@ -987,63 +1080,263 @@ int mpeg3audio_decode_audio(mpeg3audio_t *audio,
 			try = 0;
 	}
 
+	return 0;
+}
 
-/* Copy the buffer to the output */
-	if(channel >= track->channels) channel = track->channels - 1;
+/* Number of samples from the current position which are in the output */
+static int available_output(mpeg3audio_t *audio, int len)
+{
+	mpeg3_atrack_t *track = audio->track;
+	int offset = track->current_position - audio->output_position;
+	int result = audio->output_size - offset;
+	if(offset < 0 || result < 0) return 0;
+	if(result > len) result = len;
+	return result;
+}
 
-	if(output_f)
+/* Index in the output of sample i of a read of total samples and the */
+/* number of samples before the end of the ring buffer */
+static int output_span(mpeg3audio_t *audio, int i, int total, int *span)
+{
+	mpeg3_atrack_t *track = audio->track;
+	int index = mpeg3audio_output_index(audio, track->current_position + i);
+	*span = MIN(total - i, audio->output_allocated - index);
+	return index;
+}
+
+/* Drop the samples before the history */
+static int trim_output(mpeg3audio_t *audio)
+{
+	mpeg3_atrack_t *track = audio->track;
+	int diff = track->current_position - audio->history - 
+		audio->output_position;
+
+/* Shift audio back */
+	if(diff > audio->output_size) diff = audio->output_size;
+	if(diff > 0)
+		mpeg3_shift_audio(audio, diff);
+//printf("mpeg3audio_decode_audio %d %d\n", __LINE__, audio->output_size);
+
+
+	if(audio->output_size > 0)
+		return 0;
+	else
+		return 1;
+}
+
+#if defined(__x86_64__)
+
+#include <emmintrin.h>
+
+/* Convert 8 floats to int16 the same way as the scalar loop.  Clamping */
+/* before the conversion keeps large values from wrapping to -32768. */
+static inline __m128i mpeg3audio_int16_sse2(float *input)
+{
+	__m128 scale = _mm_set1_ps(32767);
+	__m128 max = _mm_set1_ps(32767);
+	__m128 min = _mm_set1_ps(-32768);
+	__m128 a = _mm_mul_ps(_mm_loadu_ps(input), scale);
+	__m128 b = _mm_mul_ps(_mm_loadu_ps(input + 4), scale);
+	a = _mm_min_ps(_mm_max_ps(a, min), max);
+	b = _mm_min_ps(_mm_max_ps(b, min), max);
+	return _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+}
+
+#endif
+
+static inline short mpeg3audio_int16(float input)
+{
+	int sample = (int)(input * 32767);
+	if(sample > 32767) sample = 32767;
+	else 
+	if(sample < -32768) sample = -32768;
+	return sample;
+}
+
+static void float_to_int16(short *output, float *input, int len)
+{
+	int i = 0;
+#if defined(__x86_64__)
+	for( ; i + 8 <= len; i += 8)
+		_mm_storeu_si128((__m128i*)(output + i), 
+			mpeg3audio_int16_sse2(input + i));
+#endif
+	for( ; i < len; i++)
+		output[i] = mpeg3audio_int16(input[i]);
+}
+
+/* Interleave len samples of every channel starting at offset in the */
+/* output.  Either destination may be 0. */
+static void interleave(float *output_f, 
+	short *output_i, 
+	float **input, 
+	int offset, 
+	int channels, 
+	int len)
+{
+	int i = 0, j, k;
+
+#if defined(__x86_64__)
+	if(channels == 2)
 	{
-		for(i = 0, j = track->current_position - audio->output_position; 
-			i < len && j < audio->output_size; 
-			i++, j++)
+		float *left = input[0] + offset;
+		float *right = input[1] + offset;
+		for( ; i + 8 <= len; i += 8)
 		{
-			output_f[i] = audio->output[channel][j];
-		}
-		for( ; i < len; i++)
-		{
-			output_f[i] = 0;
+			if(output_f)
+			{
+				__m128 l = _mm_loadu_ps(left + i);
+				__m128 r = _mm_loadu_ps(right + i);
+				__m128 l2 = _mm_loadu_ps(left + i + 4);
+				__m128 r2 = _mm_loadu_ps(right + i + 4);
+				_mm_storeu_ps(output_f + i * 2, _mm_unpacklo_ps(l, r));
+				_mm_storeu_ps(output_f + i * 2 + 4, _mm_unpackhi_ps(l, r));
+				_mm_storeu_ps(output_f + i * 2 + 8, _mm_unpacklo_ps(l2, r2));
+				_mm_storeu_ps(output_f + i * 2 + 12, _mm_unpackhi_ps(l2, r2));
+			}
+			if(output_i)
+			{
+				__m128i l = mpeg3audio_int16_sse2(left + i);
+				__m128i r = mpeg3audio_int16_sse2(right + i);
+				_mm_storeu_si128((__m128i*)(output_i + i * 2), 
+					_mm_unpacklo_epi16(l, r));
+				_mm_storeu_si128((__m128i*)(output_i + i * 2 + 8), 
+					_mm_unpackhi_epi16(l, r));
+			}
 		}
 	}
-	else
-	if(output_i)
+#endif
+
+/* Convert a chunk of each channel at a time so the output stays in cache */
+	while(i < len)
 	{
-		int sample;
-		for(i = 0, j = track->current_position - audio->output_position; 
-			i < len && j < audio->output_size; 
-			i++, j++)
-		{
-			sample = (int)(audio->output[channel][j] * 32767);
-			if(sample > 32767) sample = 32767;
-			else 
-			if(sample < -32768) sample = -32768;
+		short chunk[256];
+		int size = len - i;
+		if(size > 256) size = 256;
 
-			output_i[i] = sample;
-		}
-		for( ; i < len; i++)
+		for(j = 0; j < channels; j++)
 		{
-			output_i[i] = 0;
+			float *in = input[j] + offset + i;
+			if(output_f)
+			{
+				float *out = output_f + i * channels + j;
+				for(k = 0; k < size; k++)
+					out[k * channels] = in[k];
+			}
+			if(output_i)
+			{
+				short *out = output_i + i * channels + j;
+				float_to_int16(chunk, in, size);
+				for(k = 0; k < size; k++)
+					out[k * channels] = chunk[k];
+			}
 		}
+		i += size;
 	}
+}
 
+/* Channel is 0 to channels - 1 */
+int mpeg3audio_decode_audio(mpeg3audio_t *audio, 
+		float *output_f, 
+		short *output_i, 
+		int channel,
+		int len)
+{
+	mpeg3_atrack_t *track = audio->track;
+	int total, i, index, span;
 
+	if(fill_output(audio, len)) return 1;
 
-/* Shift audio back */
-	if(audio->output_size > MPEG3_AUDIO_HISTORY)
+/* Copy the buffer to the output */
+	if(channel >= track->channels) channel = track->channels - 1;
+	total = available_output(audio, len);
+
+	for(i = 0; i < total; i += span)
 	{
-		int diff = audio->output_size - MPEG3_AUDIO_HISTORY;
-		mpeg3_shift_audio(audio, diff);
+		index = output_span(audio, i, total, &span);
+		if(output_f)
+			memcpy(output_f + i, 
+				audio->output[channel] + index, 
+				sizeof(float) * span);
+		else
+		if(output_i)
+			float_to_int16(output_i + i, audio->output[channel] + index, span);
 	}
-//printf("mpeg3audio_decode_audio %d %d\n", __LINE__, audio->output_size);
 
-
-	if(audio->output_size > 0)
-		return 0;
+	if(output_f)
+		memset(output_f + total, 0, sizeof(float) * (len - total));
 	else
-		return 1;
+	if(output_i)
+		memset(output_i + total, 0, sizeof(short) * (len - total));
+
+	return trim_output(audio);
 }
 
+int mpeg3audio_decode_planar(mpeg3audio_t *audio, 
+		float **output_f, 
+		short **output_i, 
+		int len)
+{
+	mpeg3_atrack_t *track = audio->track;
+	int total, i, j, index, span;
 
+	if(fill_output(audio, len)) return 1;
 
+	total = available_output(audio, len);
 
+	for(i = 0; i < total; i += span)
+	{
+		index = output_span(audio, i, total, &span);
+		for(j = 0; j < track->channels; j++)
+		{
+			if(output_f && output_f[j])
+				memcpy(output_f[j] + i, 
+					audio->output[j] + index, 
+					sizeof(float) * span);
+			if(output_i && output_i[j])
+				float_to_int16(output_i[j] + i, audio->output[j] + index, span);
+		}
+	}
+
+	for(j = 0; j < track->channels; j++)
+	{
+		if(output_f && output_f[j])
+			memset(output_f[j] + total, 0, sizeof(float) * (len - total));
+		if(output_i && output_i[j])
+			memset(output_i[j] + total, 0, sizeof(short) * (len - total));
+	}
+
+	return trim_output(audio);
+}
+
+int mpeg3audio_decode_interleaved(mpeg3audio_t *audio, 
+		float *output_f, 
+		short *output_i, 
+		int len)
+{
+	mpeg3_atrack_t *track = audio->track;
+	int channels = track->channels;
+	int total, i, index, span;
 
+	if(fill_output(audio, len)) return 1;
 
+	total = available_output(audio, len);
+
+	for(i = 0; i < total; i += span)
+	{
+		index = output_span(audio, i, total, &span);
+		interleave(output_f ? output_f + i * channels : 0, 
+			output_i ? output_i + i * channels : 0, 
+			audio->output, 
+			index, 
+			channels, 
+			span);
+	}
+
+	if(output_f)
+		memset(output_f + total * channels, 0, sizeof(float) * (len - total) * channels);
+	if(output_i)
+		memset(output_i + total * channels, 0, sizeof(short) * (len - total) * channels);
+
+	return trim_output(audio);
+}
@@ -3,6 +3,7 @@
 #include "tables.h"
 
 #include <math.h>
+#include <pthread.h>
 
 /* Bitrate indexes */
 int mpeg3_tabsel_123[2][3][16] = {
@@ -135,7 +136,7 @@ int *mpeg3_mapend[9][3];
 unsigned int mpeg3_n_slen2[512]; /* MPEG 2.0 slen for 'normal' mode */
 unsigned int mpeg3_i_slen2[256]; /* MPEG 2.0 slen for intensity stereo */
 
-static int init_layer2(mpeg3_layer_t *audio)
+static int init_layer2()
 {
 	static double mulmul[27] = 
 	{
@@ -182,15 +183,11 @@ static int init_layer2(mpeg3_layer_t *audio)
 	return 0;
 }
 
-static int init_layer3(mpeg3_layer_t *audio)
+static int init_layer3()
 {
 	int i, j, k, l;
 	int down_sample_sblimit = 32;
 
-	audio->mp3_block[0][0][0] = 0;
-	audio->mp3_blc[0] = 0;
-	audio->mp3_blc[1] = 0;
-
 	for(i = -256; i < 118 + 4; i++)
 	  	mpeg3_gainpow2[i + 256] = pow((double)2.0, -0.25 * (double)(i + 210));
 
@@ -412,7 +409,11 @@ static int init_layer3(mpeg3_layer_t *audio)
 	return 0;
 }
 
-int mpeg3_new_decode_tables(mpeg3_layer_t *audio)
+/* The tables are shared by all the decoders so they're only computed once. */
+/* Decoders may be created while others are running. */
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void init_tables()
 {
 	int i, j, k, kr, divv;
 	float *costab;
@@ -473,7 +474,15 @@ int mpeg3_new_decode_tables(mpeg3_layer_t *audio)
 /* Initialize AC3 */
 //	mpeg3audio_imdct_init(audio);
 /* Initialize MPEG */
-	init_layer2(audio); /* inits also shared tables with layer1 */
-	init_layer3(audio);
+	init_layer2(); /* inits also shared tables with layer1 */
+	init_layer3();
+}
+
+int mpeg3_new_decode_tables(mpeg3_layer_t *audio)
+{
+	audio->mp3_block[0][0][0] = 0;
+	audio->mp3_blc[0] = 0;
+	audio->mp3_blc[1] = 0;
+	pthread_once(&tables_once, init_tables);
 	return 0;
 }
@@ -20,116 +20,65 @@
  *
  */
 
-#include "../bitstream.h"
-#include "mpeg3audio.h"
+#include "mpeg3private.h"
+#include "mpeg3protos.h"
+#include "ac3.h"
 
-static unsigned char mpeg3_first_bit_lut[256] = 
-{
-	0, 8, 7, 7, 6, 6, 6, 6, 5, 5, 5, 5, 5, 5, 5, 5, 
-	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 
-	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 
-	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 
-	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 
-	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
-	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
-	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
-	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
-};
 
-/* Converts an unsigned exponent in the range of 0-24 and a 16 bit mantissa
- * to an IEEE single precision floating point value */
-static inline void mpeg3audio_ac3_convert_to_float(unsigned short exp, 
-	unsigned short mantissa, 
-	u_int32_t *dest)
+/* Scale the coupling channel into the coupled channels */
+void mpeg3ac3_uncouple(mpeg3_ac3_state_t *state)
 {
-	int num;
-	short exponent;
-	int i;
+	int i, j, k;
 
-/* If the mantissa is zero we can simply return zero */
-	if(mantissa == 0)
+	for(i = 0; i < state->nfchans; i++)
 	{
-		*dest = 0;
-		return;
-	}
-
-/* Exponent is offset by 127 in IEEE format minus the shift to
- * align the mantissa to 1.f (subtracted in the final result) */
-	exponent = 127 - exp;
+		float *coeffs = state->coeffs[i];
+		int bin = state->cplstrtmant;
 
-/* Take care of the one asymmetric negative number */
-	if(mantissa == 0x8000)
-		mantissa++;
-
-/* Extract the sign bit, invert the mantissa if it's negative, and 
-   shift out the sign bit */
-	if(mantissa & 0x8000)
-	{
-		mantissa *= -1;
-		num = 0x80000000 + (exponent << 23);
-	}
-	else
-	{
-		mantissa *= 1;
-		num = exponent << 23;
-	}
+		if(!state->chincpl[i]) continue;
 
-/* Find the index of the most significant one bit */
-	i = mpeg3_first_bit_lut[mantissa >> 8];
+		for(j = 0; j < state->cplendf + 3 - state->cplbegf; j++)
+		{
+			int band = state->cplband[j];
+			float cplco = state->cplco[i][band];
 
-	if(i == 0)
-		i = mpeg3_first_bit_lut[mantissa & 0xff] + 8;
+			if(i == 1 && state->acmod == 0x2 && state->phsflg[band])
+				cplco = -cplco;
 
-	*dest = num - (i << 23) + (mantissa << (7 + i));
-	return;
+			for(k = 0; k < 12; k++)
+			{
+/* Zero mantissas are dithered separately in every channel */
+				if(!state->cpl.bap[bin] && state->dithflag[i])
+					coeffs[bin] = mpeg3ac3_dither(state) * 
+						cplco / 
+						(1 << state->cpl.exp[bin]);
+				else
+					coeffs[bin] = state->cplcoeffs[bin] * cplco;
+				bin++;
+			}
+		}
+	}
 }
 
-
-int mpeg3audio_ac3_uncouple(mpeg3audio_t *audio, 
-		mpeg3_ac3bsi_t *bsi,
-		mpeg3_ac3audblk_t *audblk,
-		mpeg3_stream_coeffs_t *coeffs)
+/* Restore left and right from the sum and difference */
+void mpeg3ac3_rematrix(mpeg3_ac3_state_t *state)
 {
+	static const int start[4] = { 13, 25, 37, 61 };
+	static const int end[4] = { 25, 37, 61, 253 };
+	int last = MIN(state->endmant[0], state->endmant[1]);
 	int i, j;
 
-	for(i = 0; i < bsi->nfchans; i++)
-	{
-		for(j = 0; j < audblk->endmant[i]; j++)
-			 mpeg3audio_ac3_convert_to_float(audblk->fbw_exp[i][j], 
-			 		audblk->chmant[i][j],
-					(u_int32_t*)&coeffs->fbw[i][j]);
-	}
+	if(state->cplinu) last = state->cplstrtmant;
 
-	if(audblk->cplinu)
+	for(i = 0; i < 4; i++)
 	{
-		for(i = 0; i < bsi->nfchans; i++)
+		if(!state->rematflg[i]) continue;
+		for(j = start[i]; j < MIN(end[i], last); j++)
 		{
-			if(audblk->chincpl[i])
-			{
-				mpeg3audio_ac3_uncouple_channel(audio, 
-					coeffs,
-					audblk,
-					i);
-			}
+			float sum = state->coeffs[0][j];
+			float difference = state->coeffs[1][j];
+			state->coeffs[0][j] = sum + difference;
+			state->coeffs[1][j] = sum - difference;
 		}
-
-	}
-
-	if(bsi->lfeon)
-	{
-/* There are always 7 mantissas for lfe */
-		for(j = 0; j < 7 ; j++)
-			 mpeg3audio_ac3_convert_to_float(audblk->lfe_exp[j], 
-			 		audblk->lfemant[j],
-					 (u_int32_t*)&coeffs->lfe[j]);
-
 	}
-	return 0;
 }
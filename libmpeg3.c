@@ -6,6 +6,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 
 int mpeg3_major()
@@ -30,6 +31,7 @@ mpeg3_t* mpeg3_new(char *path)
 	int i;
 	mpeg3_t *file = calloc(1, sizeof(mpeg3_t));
 	file->cpus = 1;
+	file->audio_history = MPEG3_AUDIO_HISTORY;
 	file->fs = mpeg3_new_fs(path);
 // Late compilers don't produce usable code.
 	file->demuxer = mpeg3_new_demuxer(file, 0, 0, -1);
@@ -49,8 +51,11 @@ mpeg3_index_t* mpeg3_new_index()
 void mpeg3_delete_index(mpeg3_index_t *index)
 {
 	int i;
-	for(i = 0;i < index->index_channels; i++)
-		free(index->index_data[i]);
+	if(!index->mapped)
+	{
+		for(i = 0;i < index->index_channels; i++)
+			free(index->index_data[i]);
+	}
 	free(index->index_data);
 	free(index);
 }
@@ -61,6 +66,10 @@ int mpeg3_delete(mpeg3_t *file)
 const int debug = 0;
 
 if(debug) printf("mpeg3_delete 1\n");
+// A table of contents which wasn't finished leaves the old one
+	if(file->toc_fd) mpeg3_cancel_toc_file(file);
+	if(file->shared) mpeg3_delete_shared(file->shared);
+
 	for(i = 0; i < file->total_vstreams; i++)
 		mpeg3_delete_vtrack(file, file->vtrack[i]);
 if(debug) printf("mpeg3_delete 2\n");
@@ -70,6 +79,16 @@ if(debug) printf("mpeg3_delete 2\n");
 
 	for(i = 0; i < file->total_sstreams; i++)
 		mpeg3_delete_strack(file->strack[i]);
+
+	if(file->vtrack) free(file->vtrack);
+	if(file->atrack) free(file->atrack);
+	if(file->strack) free(file->strack);
+
+// Tracks from a parallel TOC belong to the files of its ranges
+	if(file->toc_split) mpeg3_delete_tocsplit(file->toc_split);
+	for(i = 0; i < file->total_resume; i++)
+		mpeg3_delete_tocresume(file->toc_resume[i]);
+	if(file->toc_resume) free(file->toc_resume);
 	
 
 if(debug) printf("mpeg3_delete 3\n");
@@ -90,6 +109,13 @@ if(debug) printf("mpeg3_delete 5\n");
 		free(file->keyframe_numbers);
 		free(file->total_frame_offsets);
 		free(file->total_keyframe_numbers);
+		if(file->packed_frame_offsets) free(file->packed_frame_offsets);
+		if(file->packed_keyframe_numbers) free(file->packed_keyframe_numbers);
+	}
+	if(file->video_points)
+	{
+		free(file->video_points);
+		free(file->total_video_points);
 	}
 
 if(debug) printf("mpeg3_delete 6\n");
@@ -100,6 +126,18 @@ if(debug) printf("mpeg3_delete 6\n");
 
 		free(file->sample_offsets);
 		free(file->total_sample_offsets);
+		if(file->packed_sample_offsets) free(file->packed_sample_offsets);
+	}
+	if(file->audio_points)
+	{
+		free(file->audio_points);
+		free(file->total_audio_points);
+	}
+	if(file->packed_seek_packets)
+	{
+		free(file->packed_seek_packets);
+		free(file->packed_seek_samples);
+		free(file->total_seek_points);
 	}
 
 if(debug) printf("mpeg3_delete 7\n");
@@ -120,6 +158,8 @@ if(debug) printf("mpeg3_delete 9\n");
 		free(file->indexes);
 	}
 
+	if(file->toc_map) munmap(file->toc_map, file->toc_map_size);
+
 if(debug) printf("mpeg3_delete 10\n");
 	free(file);
 if(debug) printf("mpeg3_delete 11\n");
@@ -391,11 +431,11 @@ int mpeg3_get_file_type(mpeg3_t *file,
 static void copy_subtitles(mpeg3_t *file, mpeg3_t *old_file)
 {
 	int i, j;
-	file->total_sstreams = old_file->total_sstreams;
-	for(i = 0; i < file->total_sstreams; i++)
+	for(i = 0; i < old_file->total_sstreams; i++)
 	{
-		file->strack[i] = mpeg3_new_strack(old_file->strack[i]->id);
-		mpeg3_copy_strack(file->strack[i], old_file->strack[i]);
+		mpeg3_copy_strack(
+			mpeg3_append_strack(file, mpeg3_new_strack(old_file->strack[i]->id)),
+			old_file->strack[i]);
 	}
 
 	memcpy(file->palette, old_file->palette, 16 * 4);
@@ -403,7 +443,10 @@ static void copy_subtitles(mpeg3_t *file, mpeg3_t *old_file)
 }
 
 
-mpeg3_t* mpeg3_open_copy(char *path, mpeg3_t *old_file, int *error_return)
+static mpeg3_t* open_stream(char *path, 
+	mpeg3_t *old_file, 
+	int io_mode, 
+	int *error_return)
 {
 	mpeg3_t *file = 0;
 	int i, done;
@@ -418,6 +461,8 @@ mpeg3_t* mpeg3_open_copy(char *path, mpeg3_t *old_file, int *error_return)
 
 /* Initialize the file structure */
 	file = mpeg3_new(path);
+	file->io_mode = io_mode;
+	file->fs->io_mode = io_mode;
 
 
 /* Need to perform authentication before reading a single byte. */
@@ -462,6 +507,7 @@ mpeg3_t* mpeg3_open_copy(char *path, mpeg3_t *old_file, int *error_return)
 		file->is_program_stream = old_file->is_program_stream;
 		file->is_bd = old_file->is_bd;
 		file->source_date = old_file->source_date;
+		file->source_size = old_file->source_size;
 	}
 	else
 /* Start from scratch */
@@ -487,33 +533,32 @@ mpeg3_t* mpeg3_open_copy(char *path, mpeg3_t *old_file, int *error_return)
 	{
 /* Create video tracks */
 		for(i = 0; 
-			i < MPEG3_MAX_STREAMS && file->total_vstreams < toc_vtracks; 
+			i < file->demuxer->total_streams && file->total_vstreams < toc_vtracks; 
 			i++)
 		{
-			if(file->demuxer->vstream_table[i])
+			mpeg3_streamid_t *stream = &file->demuxer->streams[i];
+			if(stream->video)
 			{
-				file->vtrack[file->total_vstreams] = 
-					mpeg3_new_vtrack(file, 
-						i, 
-						file->demuxer, 
-						file->total_vstreams);
-				if(file->vtrack[file->total_vstreams]) 
-					file->total_vstreams++;
-
+				mpeg3_vtrack_t *vtrack = mpeg3_new_vtrack(file, 
+					stream->id, 
+					file->demuxer, 
+					file->total_vstreams);
+				if(vtrack) mpeg3_append_vtrack(file, vtrack);
 			}
 		}
 
 /* Create audio tracks */
-		for(i = 0; i < MPEG3_MAX_STREAMS && file->total_astreams < toc_atracks; i++)
+		for(i = 0; i < file->demuxer->total_streams && file->total_astreams < toc_atracks; i++)
 		{
-			if(file->demuxer->astream_table[i])
+			mpeg3_streamid_t *stream = &file->demuxer->streams[i];
+			if(stream->audio)
 			{
-				file->atrack[file->total_astreams] = mpeg3_new_atrack(file, 
-					i, 
-					file->demuxer->astream_table[i], 
+				mpeg3_atrack_t *atrack = mpeg3_new_atrack(file, 
+					stream->id, 
+					stream->audio, 
 					file->demuxer,
 					file->total_astreams);
-				if(file->atrack[file->total_astreams]) file->total_astreams++;
+				if(atrack) mpeg3_append_atrack(file, atrack);
 			}
 		}
 	}
@@ -521,23 +566,23 @@ mpeg3_t* mpeg3_open_copy(char *path, mpeg3_t *old_file, int *error_return)
 	if(file->is_video_stream)
 	{
 /* Create video tracks */
-		file->vtrack[0] = mpeg3_new_vtrack(file, 
+		mpeg3_vtrack_t *vtrack = mpeg3_new_vtrack(file, 
 			-1, 
 			file->demuxer, 
 			0);
-		if(file->vtrack[0]) file->total_vstreams++;
+		if(vtrack) mpeg3_append_vtrack(file, vtrack);
 	}
 	else
 	if(file->is_audio_stream)
 	{
 /* Create audio tracks */
 
-		file->atrack[0] = mpeg3_new_atrack(file, 
+		mpeg3_atrack_t *atrack = mpeg3_new_atrack(file, 
 			-1, 
 			AUDIO_UNKNOWN, 
 			file->demuxer,
 			0);
-		if(file->atrack[0]) file->total_astreams++;
+		if(atrack) mpeg3_append_atrack(file, atrack);
 	}
 
 
@@ -549,6 +594,19 @@ mpeg3_t* mpeg3_open_copy(char *path, mpeg3_t *old_file, int *error_return)
 	return file;
 }
 
+mpeg3_t* mpeg3_open_copy(char *path, mpeg3_t *old_file, int *error_return)
+{
+	return open_stream(path, 
+		old_file, 
+		old_file ? old_file->io_mode : MPEG3_IO_STDIO, 
+		error_return);
+}
+
+mpeg3_t* mpeg3_open_io(char *path, int io_mode, int *error_return)
+{
+	return open_stream(path, 0, io_mode, error_return);
+}
+
 mpeg3_t* mpeg3_open(char *path, int *error_return)
 {
 	return mpeg3_open_copy(path, 0, error_return);
@@ -570,6 +628,42 @@ int mpeg3_set_cpus(mpeg3_t *file, int cpus)
 	return 0;
 }
 
+int mpeg3_set_bframe_cpus(mpeg3_t *file, int cpus)
+{
+	file->bframe_cpus = cpus;
+	return 0;
+}
+
+int mpeg3_set_audio_history(mpeg3_t *file, int samples)
+{
+	int i;
+	if(samples < 0) samples = 0;
+	file->audio_history = samples;
+	for(i = 0; i < file->total_astreams; i++)
+		if(file->atrack[i]->audio) 
+			file->atrack[i]->audio->history = samples;
+	return 0;
+}
+
+int mpeg3_set_shared_demux(mpeg3_t *file, int value)
+{
+	if(value && !file->shared)
+	{
+		if(!file->seekable ||
+			(!file->is_transport_stream && !file->is_program_stream) ||
+			!(file->total_astreams + file->total_vstreams)) return 1;
+		file->shared = mpeg3_new_shared(file);
+		if(!file->shared) return 1;
+	}
+	else
+	if(!value && file->shared)
+	{
+		mpeg3_delete_shared(file->shared);
+		file->shared = 0;
+	}
+	return 0;
+}
+
 int mpeg3_has_audio(mpeg3_t *file)
 {
 	return file->total_astreams > 0;
@@ -828,6 +922,9 @@ int mpeg3_end_of_video(mpeg3_t *file, int stream)
 {
 	int result = 0;
 	result = mpeg3demux_eof(file->vtrack[stream]->demuxer);
+/* A picture decoded ahead is still waiting */
+	if(file->vtrack[stream]->video &&
+		file->vtrack[stream]->video->ahead_valid) result = 0;
 	return result;
 }
 
@@ -840,7 +937,7 @@ int mpeg3_drop_frames(mpeg3_t *file, long frames, int stream)
 	{
 		result = mpeg3video_drop_frames(file->vtrack[stream]->video, 
 						frames,
-						0);
+						-1);
 		if(frames > 0) file->vtrack[stream]->current_position += frames;
 		file->last_type_read = 2;
 		file->last_stream_read = stream;
@@ -978,6 +1075,50 @@ int mpeg3_read_audio(mpeg3_t *file,
 	return result;
 }
 
+int mpeg3_read_audio_planar(mpeg3_t *file, 
+		float **output_f, 
+		short **output_i, 
+		long samples,
+		int stream)
+{
+	int result = -1;
+
+	if(file->total_astreams)
+	{
+		result = mpeg3audio_decode_planar(file->atrack[stream]->audio, 
+					output_f, 
+					output_i, 
+					samples);
+		file->last_type_read = 1;
+		file->last_stream_read = stream;
+		file->atrack[stream]->current_position += samples;
+	}
+
+	return result;
+}
+
+int mpeg3_read_audio_interleaved(mpeg3_t *file, 
+		float *output_f, 
+		short *output_i, 
+		long samples,
+		int stream)
+{
+	int result = -1;
+
+	if(file->total_astreams)
+	{
+		result = mpeg3audio_decode_interleaved(file->atrack[stream]->audio, 
+					output_f, 
+					output_i, 
+					samples);
+		file->last_type_read = 1;
+		file->last_stream_read = stream;
+		file->atrack[stream]->current_position += samples;
+	}
+
+	return result;
+}
+
 int mpeg3_reread_audio(mpeg3_t *file, 
 		float *output_f, 
 		short *output_i, 
@@ -1053,3 +1194,56 @@ int64_t mpeg3_memory_usage(mpeg3_t *file)
 	return result;
 }
 
+int mpeg3_set_cache_size(mpeg3_t *file, int64_t bytes)
+{
+	int i;
+	for(i = 0; i < file->total_vstreams; i++)
+		mpeg3_cache_set_size(file->vtrack[i]->frame_cache, bytes);
+	return 0;
+}
+
+int mpeg3_cache_stats(mpeg3_t *file, 
+	int64_t *hits, 
+	int64_t *misses, 
+	int64_t *evictions)
+{
+	int i;
+	*hits = *misses = *evictions = 0;
+	for(i = 0; i < file->total_vstreams; i++)
+	{
+		mpeg3_cache_t *cache = file->vtrack[i]->frame_cache;
+		*hits += cache->hits;
+		*misses += cache->misses;
+		*evictions += cache->evictions;
+	}
+	return 0;
+}
+
+
+static int64_t demuxer_stall_time(mpeg3_demuxer_t *demuxer)
+{
+	int i;
+	int64_t result = 0;
+	if(!demuxer) return 0;
+	for(i = 0; i < demuxer->total_titles; i++)
+		result += demuxer->titles[i]->fs->stall_time;
+	return result;
+}
+
+int64_t mpeg3_io_stall_time(mpeg3_t *file)
+{
+	int i;
+	int64_t result = file->fs->stall_time;
+	result += demuxer_stall_time(file->demuxer);
+	for(i = 0; i < file->total_vstreams; i++)
+		result += demuxer_stall_time(file->vtrack[i]->demuxer);
+	for(i = 0; i < file->total_astreams; i++)
+		result += demuxer_stall_time(file->atrack[i]->demuxer);
+	return result;
+}
+
+int mpeg3_probe_stats(mpeg3_t *file, mpeg3_probe_stats_t *stats)
+{
+	*stats = file->probe_stats;
+	return 0;
+}
@@ -29,6 +29,13 @@ extern "C" {
 #define MPEG3_YUV422P 13
 
 
+/* I/O backends for mpeg3_open_io */
+#define MPEG3_IO_STDIO 0
+#define MPEG3_IO_MMAP 1
+/* stdio with a thread reading the next buffer in the background */
+#define MPEG3_IO_READAHEAD 2
+
+
 /* Error codes for the error_return variable */
 #define MPEG3_UNDEFINED_ERROR 1
 #define MPEG3_INVALID_TOC_VERSION 2
@@ -51,6 +58,11 @@ mpeg3_t* mpeg3_open(char *path, int *error_return);
 /* Eliminates some initial scanning and is used for opening audio streams. */
 /* An error code is put into *error_return if it fails and error_return is nonzero. */
 mpeg3_t* mpeg3_open_copy(char *path, mpeg3_t *old_file, int *error_return);
+
+/* Open the MPEG stream with a specific I/O backend. */
+/* MPEG3_IO_MMAP reads straight from the page cache and falls back to */
+/* MPEG3_IO_STDIO for any file which can't be mapped. */
+mpeg3_t* mpeg3_open_io(char *path, int io_mode, int *error_return);
 int mpeg3_close(mpeg3_t *file);
 
 
@@ -58,6 +70,18 @@ int mpeg3_close(mpeg3_t *file);
 
 /* Performance */
 int mpeg3_set_cpus(mpeg3_t *file, int cpus);
+/* Decode each B frame on this many additional threads while the next */
+/* picture is decoded.  Frames are still returned in display order. */
+/* 0 disables frame parallel decoding. */
+int mpeg3_set_bframe_cpus(mpeg3_t *file, int cpus);
+/* Parse a program or transport stream once on a separate thread and hand */
+/* every track its packets instead of having every track read the whole */
+/* file.  Returns 1 if the stream can't be shared. */
+int mpeg3_set_shared_demux(mpeg3_t *file, int value);
+/* Decoded samples kept before the current position of every audio stream */
+/* so rereading and seeking back a short way don't decode again.  The */
+/* default is 0x100000.  Smaller values use less memory. */
+int mpeg3_set_audio_history(mpeg3_t *file, int samples);
 
 /* Query the MPEG3 stream about audio. */
 int mpeg3_has_audio(mpeg3_t *file);
@@ -91,6 +115,22 @@ int mpeg3_reread_audio(mpeg3_t *file,
 		long samples,         /* Number of samples to decode */
 		int stream);          /* Stream containing the channel */
 
+/* Read samples from every channel at once and advance the position.  */
+/* Planar outputs are arrays of mpeg3_audio_channels pointers to buffers of */
+/* samples.  A 0 pointer skips the channel. */
+int mpeg3_read_audio_planar(mpeg3_t *file, 
+		float **output_f,     /* Pointers to pre-allocated buffers of floats */
+		short **output_i,     /* Pointers to pre-allocated buffers of int16's */
+		long samples,         /* Number of samples to decode */
+		int stream);          /* Stream to decode */
+
+/* Interleaved outputs hold samples * mpeg3_audio_channels values. */
+int mpeg3_read_audio_interleaved(mpeg3_t *file, 
+		float *output_f,      /* Pointer to pre-allocated buffer of floats */
+		short *output_i,      /* Pointer to pre-allocated buffer of int16's */
+		long samples,         /* Number of samples to decode */
+		int stream);          /* Stream to decode */
+
 /* Read the next compressed audio chunk.  Store the size in size and return a  */
 /* 1 if error. */
 /* Stream defines the number of the multiplexed stream to read. */
@@ -203,6 +243,21 @@ int mpeg3_set_program(int program);
 
 /* Memory used by video caches. */
 int64_t mpeg3_memory_usage(mpeg3_t *file);
+/* Bytes of decoded frames to cache for every video stream. */
+/* The least recently used frames are dropped.  0 disables the cache. */
+int mpeg3_set_cache_size(mpeg3_t *file, int64_t bytes);
+/* Cache lookups which found a frame, lookups which didn't, and frames */
+/* dropped to stay in the cache size, summed over all the video streams. */
+int mpeg3_cache_stats(mpeg3_t *file, 
+	int64_t *hits, 
+	int64_t *misses, 
+	int64_t *evictions);
+
+/* Total microseconds spent waiting for file reads by all the tracks */
+int64_t mpeg3_io_stall_time(mpeg3_t *file);
+/* How the streams were found when the file was opened without a table */
+/* of contents and the bytes and microseconds it took. */
+int mpeg3_probe_stats(mpeg3_t *file, mpeg3_probe_stats_t *stats);
 
 
 
@@ -229,8 +284,25 @@ void mpeg3_show_subtitle(mpeg3_t *file, int track);
 /* Table of contents generation */
 /* Begin constructing table of contents */
 mpeg3_t* mpeg3_start_toc(char *path, char *toc_path, int64_t *total_bytes);
+/* Begin constructing table of contents with a thread scanning each of */
+/* cpus byte ranges of the file.  Used like mpeg3_start_toc. */
+mpeg3_t* mpeg3_start_toc_parallel(char *path, 
+	char *toc_path, 
+	int cpus, 
+	int64_t *total_bytes);
+/* Begin extending the table of contents of a source which has grown since */
+/* toc_path was written.  Used like mpeg3_start_toc.  Only the packets after */
+/* the old table of contents are left for mpeg3_do_toc.  Builds the whole */
+/* table of contents if the old one can't be extended. */
+mpeg3_t* mpeg3_start_toc_append(char *path, 
+	char *toc_path, 
+	int64_t *total_bytes);
 /* Set the maximum number of bytes per index track */
 void mpeg3_set_index_bytes(mpeg3_t *file, int64_t bytes);
+/* Store an audio seek point about every samples so a seek decodes at most */
+/* that many samples before the one it wants.  1 stores every frame. */
+/* 0 stores none, which is the default.  Called before mpeg3_stop_toc. */
+void mpeg3_set_seek_samples(mpeg3_t *file, int samples);
 /* Process one packet */
 int mpeg3_do_toc(mpeg3_t *file, int64_t *bytes_processed);
 /* Write table of contents */
@@ -241,6 +313,10 @@ void mpeg3_stop_toc(mpeg3_t *file);
 int64_t mpeg3_get_source_date(mpeg3_t *file);
 /* Get modification date of source file from source file. */
 int64_t mpeg3_calculate_source_date(char *path);
+/* Get size of source file from table of contents.  0 if it isn't stored. */
+int64_t mpeg3_get_source_size(mpeg3_t *file);
+/* Get size of source file from source file. */
+int64_t mpeg3_calculate_source_size(char *path);
 
 
 
@@ -192,27 +192,12 @@ int main(int argc, char *argv[])
 			if(!mpeg3_end_of_audio(input, astream))
 			{
 				int fragment = afragment;
-				int i, j, k;
 
-				i = astream;
-				k = 0;
-				for(j = 0; j < mpeg3_audio_channels(input, i); j++, k++)
-				{
-					if(j == 0)
-						mpeg3_read_audio(input, 
-							audio_output[k], 	 /* Pointer to pre-allocated buffer of floats */
-							0,      /* Pointer to pre-allocated buffer of int16's */
-							j,          /* Channel to decode */
-							fragment,         /* Number of samples to decode */
-							i);
-					else
-						mpeg3_reread_audio(input, 
-							audio_output[k], 	 /* Pointer to pre-allocated buffer of floats */
-							0,      /* Pointer to pre-allocated buffer of int16's */
-							j,          /* Channel to decode */
-							fragment,         /* Number of samples to decode */
-							i);
-				}
+				mpeg3_read_audio_planar(input, 
+					audio_output, 	 /* Pointers to pre-allocated buffers of floats */
+					0,      /* Pointers to pre-allocated buffers of int16's */
+					fragment,         /* Number of samples to decode */
+					astream);
 
 
 
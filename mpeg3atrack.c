@@ -2,6 +2,7 @@
 #include "mpeg3protos.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 mpeg3_atrack_t* mpeg3_new_atrack(mpeg3_t *file, 
 	int custom_id, 
@@ -23,15 +24,38 @@ mpeg3_atrack_t* mpeg3_new_atrack(mpeg3_t *file,
 	}
 	new_atrack->current_position = 0;
 	new_atrack->pid = custom_id;
+	new_atrack->frame_packet = -1;
 
 
 /* Copy pointers */
 	if(file->sample_offsets)
 	{
 		new_atrack->sample_offsets = file->sample_offsets[number];
+		if(file->packed_sample_offsets)
+			new_atrack->packed_sample_offsets = 
+				file->packed_sample_offsets[number];
 		new_atrack->total_sample_offsets = file->total_sample_offsets[number];
 		new_atrack->total_samples = file->total_samples[number];
-		new_atrack->demuxer->stream_end = file->audio_eof[number];
+		new_atrack->demuxer->stream_end = 
+			new_atrack->audio_eof = file->audio_eof[number];
+	}
+
+	if(file->packed_seek_packets)
+	{
+		new_atrack->packed_seek_packets = file->packed_seek_packets[number];
+		new_atrack->packed_seek_samples = file->packed_seek_samples[number];
+		new_atrack->total_seek_points = file->total_seek_points[number];
+	}
+
+/* Keep the resume points for rewriting the TOC */
+	if(file->audio_points)
+	{
+		int i;
+		for(i = 0; i < file->total_audio_points[number]; i++)
+			mpeg3_append_point(&new_atrack->toc_points,
+				&new_atrack->total_toc_points,
+				file->audio_points[number][i].packet,
+				file->audio_points[number][i].count);
 	}
 
 	new_atrack->audio = mpeg3audio_new(file, 
@@ -56,10 +80,27 @@ int mpeg3_delete_atrack(mpeg3_t *file, mpeg3_atrack_t *atrack)
 	{
 		free(atrack->sample_offsets);
 	}
+	if(atrack->toc_points) free(atrack->toc_points);
+	if(atrack->seek_packets) free(atrack->seek_packets);
+	if(atrack->seek_samples) free(atrack->seek_samples);
+	if(atrack->payload_packets) free(atrack->payload_packets);
+	if(atrack->payload_offsets) free(atrack->payload_offsets);
 	free(atrack);
 	return 0;
 }
 
+mpeg3_atrack_t* mpeg3_append_atrack(mpeg3_t *file, mpeg3_atrack_t *atrack)
+{
+	if(file->total_astreams >= file->atracks_allocated)
+	{
+		file->atracks_allocated = MAX(file->total_astreams * 2, 4);
+		file->atrack = realloc(file->atrack,
+			sizeof(mpeg3_atrack_t*) * file->atracks_allocated);
+	}
+	file->atrack[file->total_astreams++] = atrack;
+	return atrack;
+}
+
 void mpeg3_append_samples(mpeg3_atrack_t *atrack, int64_t offset)
 {
 	if(atrack->total_sample_offsets >= atrack->sample_offsets_allocated)
@@ -74,6 +115,61 @@ void mpeg3_append_samples(mpeg3_atrack_t *atrack, int64_t offset)
 	atrack->private_offsets = 1;
 }
 
+void mpeg3_append_seek(mpeg3_atrack_t *atrack, int64_t packet, int64_t sample)
+{
+	if(atrack->total_seek_points >= atrack->seek_points_allocated)
+	{
+		atrack->seek_points_allocated = 
+			MAX(atrack->total_seek_points * 2, 1024);
+		atrack->seek_packets = realloc(atrack->seek_packets,
+			sizeof(int64_t) * atrack->seek_points_allocated);
+		atrack->seek_samples = realloc(atrack->seek_samples,
+			sizeof(int64_t) * atrack->seek_points_allocated);
+	}
+	atrack->seek_packets[atrack->total_seek_points] = packet;
+	atrack->seek_samples[atrack->total_seek_points++] = sample;
+}
+
+void mpeg3_append_payload(mpeg3_atrack_t *atrack, int64_t packet, int bytes)
+{
+	if(!bytes) return;
+	if(atrack->total_payloads >= atrack->payloads_allocated)
+	{
+		atrack->payloads_allocated = MAX(atrack->total_payloads * 2, 64);
+		atrack->payload_packets = realloc(atrack->payload_packets,
+			sizeof(int64_t) * atrack->payloads_allocated);
+		atrack->payload_offsets = realloc(atrack->payload_offsets,
+			sizeof(int64_t) * atrack->payloads_allocated);
+	}
+	atrack->payload_packets[atrack->total_payloads] = packet;
+	atrack->payload_offsets[atrack->total_payloads++] = atrack->payload_bytes;
+	atrack->payload_bytes += bytes;
+}
+
+void mpeg3_seek_frame(mpeg3_atrack_t *atrack, int64_t offset, int64_t sample)
+{
+	int64_t packet;
+	int i = 0;
 
+// Forget the packets which ended before the frame
+	while(i + 1 < atrack->total_payloads && 
+		atrack->payload_offsets[i + 1] <= offset) i++;
+	if(i)
+	{
+		atrack->total_payloads -= i;
+		memmove(atrack->payload_packets, 
+			atrack->payload_packets + i, 
+			sizeof(int64_t) * atrack->total_payloads);
+		memmove(atrack->payload_offsets, 
+			atrack->payload_offsets + i, 
+			sizeof(int64_t) * atrack->total_payloads);
+	}
 
+	if(!atrack->total_payloads || offset < atrack->payload_offsets[0]) return;
 
+// A seek to the packet decodes from its first frame
+	packet = atrack->payload_packets[0];
+	if(packet != atrack->frame_packet)
+		mpeg3_append_seek(atrack, packet, sample);
+	atrack->frame_packet = packet;
+}
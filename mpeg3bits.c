@@ -114,7 +114,7 @@ int mpeg3bits_refill(mpeg3_bits_t* stream)
 	}
 	else
 	{
-		stream->bfr = mpeg3demux_read_char(stream->demuxer) << 24;
+		stream->bfr = (uint32_t)mpeg3demux_read_char(stream->demuxer) << 24;
 		stream->bfr |= mpeg3demux_read_char(stream->demuxer) << 16;
 		stream->bfr |= mpeg3demux_read_char(stream->demuxer) << 8;
 		stream->bfr |= mpeg3demux_read_char(stream->demuxer);
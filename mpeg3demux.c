@@ -9,6 +9,16 @@
 
 #define ABS(x) ((x) >= 0 ? (x) : -(x))
 
+/* Make room for size bytes in one of the demuxer's buffers */
+static inline void grow_buffer(unsigned char **buffer, int *allocated, int size)
+{
+	if(size > *allocated)
+	{
+		*allocated = MAX(size, *allocated * 2);
+		*buffer = realloc(*buffer, *allocated);
+	}
+}
+
 /* Don't advance pointer */
 static inline unsigned char packet_next_char(mpeg3_demuxer_t *demuxer)
 {
@@ -125,12 +135,79 @@ static int get_adaptation_field(mpeg3_demuxer_t *demuxer)
 	return 0;
 }
 
+/* Declare a PID or stream ID of an elementary stream */
+static void probe_add_id(mpeg3_probe_t *probe, int id)
+{
+	int i;
+	for(i = 0; i < probe->total_ids; i++)
+		if(probe->ids[i] == id) return;
+	if(probe->total_ids < MPEG3_PIDMAX)
+		probe->ids[probe->total_ids++] = id;
+	else
+		probe->incomplete = 1;
+}
+
+/* Start of the PSI section in the packet and its length. */
+/* 0 if the section isn't all in the packet. */
+static unsigned char* get_section(mpeg3_demuxer_t *demuxer, int *size)
+{
+	unsigned char *section;
+	int offset;
+
+	if(demuxer->raw_offset >= demuxer->raw_size) return 0;
+/* Skip pointer field */
+	offset = demuxer->raw_offset + 1 + demuxer->raw_data[demuxer->raw_offset];
+	if(offset + 3 > demuxer->raw_size) return 0;
+	section = demuxer->raw_data + offset;
+	*size = 3 + (((section[1] & 0xf) << 8) | section[2]);
+/* Smallest section with a header and CRC */
+	if(*size < 12 || offset + *size > demuxer->raw_size) return 0;
+	return section;
+}
+
 static int get_program_association_table(mpeg3_demuxer_t *demuxer)
 {
+	mpeg3_probe_t *probe = demuxer->probe;
+	unsigned char *section;
+	int size, i, j;
+
 	demuxer->program_association_tables++;
-	demuxer->table_id = packet_read_char(demuxer);
-	demuxer->section_length = packet_read_int16(demuxer) & 0xfff;
-	demuxer->transport_stream_id = packet_read_int16(demuxer);
+	section = get_section(demuxer, &size);
+	if(section)
+	{
+		demuxer->table_id = section[0];
+		demuxer->section_length = size - 3;
+		demuxer->transport_stream_id = (section[3] << 8) | section[4];
+
+/* Only the current table in one section gives every program */
+		if(probe && 
+			!probe->got_map &&
+			demuxer->table_id == MPEG3_PROGRAM_ASSOCIATION_TABLE &&
+			(section[5] & 0x1))
+		{
+			if(section[6] || section[7]) probe->incomplete = 1;
+
+/* Entries end before the CRC */
+			for(i = 8; i + 4 <= size - 4; i += 4)
+			{
+				int program_number = (section[i] << 8) | section[i + 1];
+				int pid = ((section[i + 2] & 0x1f) << 8) | section[i + 3];
+
+/* Program 0 points to the network information table */
+				if(!program_number) continue;
+				for(j = 0; j < probe->total_pmts; j++)
+				{
+/* Programs sharing a PMT PID need more than 1 section */
+					if(probe->pmt_pids[j] == pid) probe->incomplete = 1;
+				}
+				if(probe->total_pmts < MPEG3_PIDMAX)
+					probe->pmt_pids[probe->total_pmts++] = pid;
+				else
+					probe->incomplete = 1;
+			}
+			probe->got_map = 1;
+		}
+	}
 	packet_skip(demuxer, demuxer->raw_size - demuxer->raw_offset);
 	if(demuxer->dump)
 	{
@@ -142,6 +219,40 @@ static int get_program_association_table(mpeg3_demuxer_t *demuxer)
 	return 0;
 }
 
+/* Declare the elementary streams of a program */
+static int get_program_map_table(mpeg3_demuxer_t *demuxer, int pmt)
+{
+	mpeg3_probe_t *probe = demuxer->probe;
+	unsigned char *section;
+	int size, i;
+
+	section = get_section(demuxer, &size);
+	packet_skip(demuxer, demuxer->raw_size - demuxer->raw_offset);
+	if(!section ||
+		section[0] != MPEG3_PROGRAM_MAP_TABLE ||
+		!(section[5] & 0x1)) return 0;
+	if(section[6] || section[7]) probe->incomplete = 1;
+
+/* Skip program info */
+	i = 12 + (((section[10] & 0xf) << 8) | section[11]);
+	while(i + 5 <= size - 4)
+	{
+		int stream_type = section[i];
+		int pid = ((section[i + 1] & 0x1f) << 8) | section[i + 2];
+		if(demuxer->dump)
+		{
+			fprintf(stderr, " stream_type=0x%02x pid=0x%x\n", stream_type, pid);
+		}
+
+/* The PES headers still give the format so the streams are the same */
+/* as the ones found by scanning. */
+		probe_add_id(probe, pid);
+		i += 5 + (((section[i + 3] & 0xf) << 8) | section[i + 4]);
+	}
+	probe->got_pmt[pmt] = 1;
+	return 0;
+}
+
 static int get_transport_payload(mpeg3_demuxer_t *demuxer, 
 	int is_audio, 
 	int is_video)
@@ -165,6 +276,9 @@ static int get_transport_payload(mpeg3_demuxer_t *demuxer,
  * if(demuxer->pid == 0x1100) 
  * printf("get_transport_payload 1 0x%x %d\n", demuxer->audio_pid, bytes);
  */
+		grow_buffer(&demuxer->audio_buffer,
+			&demuxer->audio_allocated,
+			demuxer->audio_size + bytes);
 		memcpy(demuxer->audio_buffer + demuxer->audio_size,
 			demuxer->raw_data + demuxer->raw_offset,
 			bytes);
@@ -174,6 +288,9 @@ static int get_transport_payload(mpeg3_demuxer_t *demuxer,
 	if(demuxer->read_all && is_video)
 	{
 //printf("get_transport_payload 2\n");
+		grow_buffer(&demuxer->video_buffer,
+			&demuxer->video_allocated,
+			demuxer->video_size + bytes);
 		memcpy(demuxer->video_buffer + demuxer->video_size,
 			demuxer->raw_data + demuxer->raw_offset,
 			bytes);
@@ -181,6 +298,9 @@ static int get_transport_payload(mpeg3_demuxer_t *demuxer,
 	}
 	else
 	{
+		grow_buffer(&demuxer->data_buffer,
+			&demuxer->data_allocated,
+			demuxer->data_size + bytes);
 		memcpy(demuxer->data_buffer + demuxer->data_size,
 			demuxer->raw_data + demuxer->raw_offset,
 			bytes);
@@ -256,6 +376,9 @@ static int get_pes_packet_header(mpeg3_demuxer_t *demuxer,
 static int get_unknown_data(mpeg3_demuxer_t *demuxer)
 {
 	int bytes = demuxer->raw_size - demuxer->raw_offset;
+	grow_buffer(&demuxer->data_buffer,
+		&demuxer->data_allocated,
+		demuxer->data_size + bytes);
 	memcpy(demuxer->data_buffer + demuxer->data_size,
 			demuxer->raw_data + demuxer->raw_offset,
 			bytes);
@@ -284,7 +407,7 @@ static int get_transport_pes_packet(mpeg3_demuxer_t *demuxer)
 		demuxer->custom_id = demuxer->pid;
 
 		if(demuxer->read_all)
-			demuxer->astream_table[demuxer->custom_id] = AUDIO_AC3;
+			mpeg3demux_set_audio_stream(demuxer, demuxer->custom_id, AUDIO_AC3);
 		if(demuxer->astream == -1)
 		    demuxer->astream = demuxer->custom_id;
 
@@ -318,7 +441,7 @@ static int get_transport_pes_packet(mpeg3_demuxer_t *demuxer)
 
 /* Just pick the first available stream if no ID is set */
 		if(demuxer->read_all)
-			demuxer->astream_table[demuxer->custom_id] = AUDIO_MPEG;
+			mpeg3demux_set_audio_stream(demuxer, demuxer->custom_id, AUDIO_MPEG);
 		if(demuxer->astream == -1)
 		    demuxer->astream = demuxer->custom_id;
 
@@ -348,7 +471,7 @@ static int get_transport_pes_packet(mpeg3_demuxer_t *demuxer)
 /* Just pick the first available stream if no ID is set */
 		if(demuxer->read_all)
 		{
-			demuxer->vstream_table[demuxer->custom_id] = 1;
+			mpeg3demux_set_video_stream(demuxer, demuxer->custom_id, 1);
 		}
 		else
 		if(demuxer->vstream == -1)
@@ -428,6 +551,18 @@ static int get_payload(mpeg3_demuxer_t *demuxer)
 //printf("get_payload 1 pid=0x%x unit_start=%d\n", demuxer->pid, demuxer->payload_unit_start_indicator);
 	if(demuxer->payload_unit_start_indicator)
 	{
+		if(demuxer->probe)
+		{
+			int i;
+			mpeg3_probe_t *probe = demuxer->probe;
+			probe->started[demuxer->pid] = 1;
+			for(i = 0; i < probe->total_pmts; i++)
+			{
+				if(probe->pmt_pids[i] == demuxer->pid && !probe->got_pmt[i])
+					return get_program_map_table(demuxer, i);
+			}
+		}
+
     	if(demuxer->pid == 0) 
 			get_program_association_table(demuxer);
     	else 
@@ -512,38 +647,30 @@ demuxer->dump = 0;
 		mpeg3io_read_int32(title->fs);
 
 // Search for Sync byte */
-	do
-	{
-		bits = mpeg3io_read_char(title->fs);
-	}while(!mpeg3io_eof(title->fs) && !result && bits != MPEG3_SYNC_BYTE);
+	if(mpeg3io_scan_char(title->fs, MPEG3_SYNC_BYTE)) return 1;
 
 /* Hit EOF */
-	if(mpeg3io_eof(title->fs) || result) return 1;
-
-	if(bits == MPEG3_SYNC_BYTE && !result)
+	if(mpeg3io_tell(title->fs) + 1 >= mpeg3io_total_bytes(title->fs))
 	{
-// Store byte just read as first byte
-		demuxer->raw_data[0] = MPEG3_SYNC_BYTE;
+		mpeg3io_seek(title->fs, mpeg3io_total_bytes(title->fs));
+		return 1;
+	}
 
-// Read packet
-		int fragment_size = file->packet_size - 1;
 // Skip BD header
-		if(file->is_bd) 
-		{
-			fragment_size -= 4;
-			demuxer->raw_size -= 4;
-		}
-		result = mpeg3io_read_data(demuxer->raw_data + 1, 
-			fragment_size, 
+	if(file->is_bd) demuxer->raw_size -= 4;
+
+// Parse the packet in the I/O buffer if it's all there
+	demuxer->raw_data = mpeg3io_read_direct(title->fs, demuxer->raw_size);
+	if(!demuxer->raw_data)
+	{
+		grow_buffer(&demuxer->raw_buffer,
+			&demuxer->raw_allocated,
+			demuxer->raw_size);
+		demuxer->raw_data = demuxer->raw_buffer;
+		result = mpeg3io_read_data(demuxer->raw_data, 
+			demuxer->raw_size, 
 			title->fs);
 	}
-	else
-	{
-// Failed
-		demuxer->program_byte = mpeg3io_tell(title->fs) + 
-			title->start_byte;
-		return 1;
-	}
 
 
 // Sync byte
@@ -577,27 +704,14 @@ demuxer->dump = 0;
 		demuxer->is_padding = 0;
 	}
 
-/* Get pid from table */
-	for(table_entry = 0, result = 0; 
-		table_entry < demuxer->total_pids; 
-		table_entry++)
-	{
-		if(demuxer->pid == demuxer->pid_table[table_entry])
-		{
-			result = 1;
-			break;
-		}
-	}
-
-
-
-
 /* Not in pid table */
-	if(!result && demuxer->total_pids < MPEG3_PIDMAX)
+	if(!demuxer->pid_entry[demuxer->pid] && 
+		demuxer->total_pids < MPEG3_PIDMAX)
 	{
+		table_entry = demuxer->total_pids++;
 		demuxer->pid_table[table_entry] = demuxer->pid;
 		demuxer->continuity_counters[table_entry] = demuxer->continuity_counter;  /* init */
-		demuxer->total_pids++;
+		demuxer->pid_entry[demuxer->pid] = demuxer->total_pids;
 	}
 	result = 0;
 
@@ -637,11 +751,83 @@ demuxer->dump = 0;
 	return result;
 }
 
+/* Declare a stream ID of a program stream */
+static void probe_stream_id(mpeg3_probe_t *probe, int stream_id)
+{
+/* Private streams contain substreams and 0xb8, 0xb9 stand for all the */
+/* audio or video streams.  The scan has to find those. */
+	if(stream_id == 0xb8 || 
+		stream_id == 0xb9 || 
+		stream_id == 0xbd || 
+		stream_id == MPEG3_PRIVATE_STREAM_2)
+		probe->incomplete = 1;
+	else
+	if(stream_id != MPEG3_PADDING_STREAM)
+		probe_add_id(probe, stream_id);
+}
+
 static int get_system_header(mpeg3_demuxer_t *demuxer)
 {
 	mpeg3_title_t *title = demuxer->titles[demuxer->current_title];
+	mpeg3_probe_t *probe = demuxer->probe;
 	int length = mpeg3io_read_int16(title->fs);
-	mpeg3io_seek_relative(title->fs, length);
+	int64_t start = mpeg3io_tell(title->fs);
+	int i;
+
+	if(probe && !probe->got_map && length >= 6)
+	{
+/* Skip the bounds and flags */
+		mpeg3io_seek_relative(title->fs, 6);
+		for(i = 6; i + 3 <= length; i += 3)
+		{
+			int stream_id = mpeg3io_read_char(title->fs);
+			if(!(stream_id & 0x80)) break;
+/* Skip the buffer size */
+			mpeg3io_read_int16(title->fs);
+			probe_stream_id(probe, stream_id);
+		}
+		probe->got_map = 1;
+	}
+	mpeg3io_seek(title->fs, start + length);
+	return 0;
+}
+
+/* The program stream map replaces the streams of the system header */
+static int get_program_stream_map(mpeg3_demuxer_t *demuxer, int length)
+{
+	mpeg3_title_t *title = demuxer->titles[demuxer->current_title];
+	mpeg3_probe_t *probe = demuxer->probe;
+	int64_t start = mpeg3io_tell(title->fs);
+	int64_t end;
+
+	if(probe && !probe->got_psm && length >= 10)
+	{
+/* Skip version and markers */
+		mpeg3io_read_int16(title->fs);
+		mpeg3io_seek_relative(title->fs, mpeg3io_read_int16(title->fs) & 0x3ff);
+		end = mpeg3io_tell(title->fs) + 2 + mpeg3io_read_int16(title->fs);
+		if(end + 4 <= start + length)
+		{
+			probe->total_ids = 0;
+			probe->incomplete = 0;
+			while(mpeg3io_tell(title->fs) + 4 <= end)
+			{
+				int stream_type = mpeg3io_read_char(title->fs);
+				int stream_id = mpeg3io_read_char(title->fs);
+				if(demuxer->dump)
+				{
+					fprintf(stderr, " stream_type=0x%02x stream_id=0x%02x\n", 
+						stream_type, 
+						stream_id);
+				}
+				probe_stream_id(probe, stream_id);
+				mpeg3io_seek_relative(title->fs, mpeg3io_read_int16(title->fs));
+			}
+			probe->got_map = 1;
+			probe->got_psm = 1;
+		}
+	}
+	mpeg3io_seek(title->fs, start + length);
 	return 0;
 }
 
@@ -714,6 +900,9 @@ static int get_program_payload(mpeg3_demuxer_t *demuxer,
 
 	if(demuxer->read_all && is_audio)
 	{
+		grow_buffer(&demuxer->audio_buffer,
+			&demuxer->audio_allocated,
+			demuxer->audio_size + bytes);
 		mpeg3io_read_data(demuxer->audio_buffer + demuxer->audio_size, 
 			bytes, 
 			title->fs);
@@ -722,6 +911,9 @@ static int get_program_payload(mpeg3_demuxer_t *demuxer,
 	else
 	if(demuxer->read_all && is_video)
 	{
+		grow_buffer(&demuxer->video_buffer,
+			&demuxer->video_allocated,
+			demuxer->video_size + bytes);
 		mpeg3io_read_data(demuxer->video_buffer + demuxer->video_size, 
 			bytes, 
 			title->fs);
@@ -729,6 +921,9 @@ static int get_program_payload(mpeg3_demuxer_t *demuxer,
 	}
 	else
 	{
+		grow_buffer(&demuxer->data_buffer,
+			&demuxer->data_allocated,
+			demuxer->data_size + bytes);
 		mpeg3io_read_data(demuxer->data_buffer + demuxer->data_size, 
 			bytes, 
 			title->fs);
@@ -880,13 +1075,9 @@ static void handle_subtitle(mpeg3_t *file,
 	const int debug = 0;
 
 if(debug) fprintf(stderr, "handle_subtitle %d\n", __LINE__);
-	if(demuxer->subtitle_size + bytes > demuxer->subtitle_allocated)
-	{
-		printf("handle_subtitle: buffer overflow\n");
-		demuxer->subtitle_size = 0;
-		bytes = MIN(bytes, demuxer->subtitle_allocated);
-	}
-
+	grow_buffer(&demuxer->subtitle_buffer,
+		&demuxer->subtitle_allocated,
+		bytes);
 	mpeg3io_read_data(demuxer->subtitle_buffer, 
 		bytes, 
 		title->fs);
@@ -1010,6 +1201,9 @@ static int handle_pcm(mpeg3_demuxer_t *demuxer, int bytes)
 
 	if(demuxer->read_all && demuxer->audio_size)
 	{
+		grow_buffer(&demuxer->audio_buffer,
+			&demuxer->audio_allocated,
+			demuxer->audio_size + PCM_HEADERSIZE - 3);
 		output = demuxer->audio_buffer + demuxer->audio_start;
 		data_buffer = demuxer->audio_buffer;
 		data_start = demuxer->audio_start;
@@ -1017,6 +1211,9 @@ static int handle_pcm(mpeg3_demuxer_t *demuxer, int bytes)
 	}
 	else
 	{
+		grow_buffer(&demuxer->data_buffer,
+			&demuxer->data_allocated,
+			demuxer->data_size + PCM_HEADERSIZE - 3);
 		output = demuxer->data_buffer + demuxer->data_start;
 		data_buffer = demuxer->data_buffer;
 		data_start = demuxer->data_start;
@@ -1103,6 +1300,10 @@ static int get_program_pes_packet(mpeg3_demuxer_t *demuxer, unsigned int header)
 	pes_packet_length = mpeg3io_read_int16(title->fs);
 	pes_packet_start = mpeg3io_tell(title->fs);
 
+	if(demuxer->probe) demuxer->probe->started[demuxer->stream_id] = 1;
+	if(demuxer->stream_id == MPEG3_PROGRAM_STREAM_MAP)
+		return get_program_stream_map(demuxer, pes_packet_length);
+
 
 
 /*
@@ -1242,7 +1443,7 @@ static int get_program_pes_packet(mpeg3_demuxer_t *demuxer, unsigned int header)
 
 
 			if(demuxer->read_all)
-				demuxer->astream_table[demuxer->custom_id] = AUDIO_MPEG;
+				mpeg3demux_set_audio_stream(demuxer, demuxer->custom_id, AUDIO_MPEG);
 			else
 			if(demuxer->astream == -1) 
 				demuxer->astream = demuxer->custom_id;
@@ -1286,7 +1487,7 @@ static int get_program_pes_packet(mpeg3_demuxer_t *demuxer, unsigned int header)
 
 			if(demuxer->read_all)
 			{
-				demuxer->vstream_table[demuxer->custom_id] = 1;
+				mpeg3demux_set_video_stream(demuxer, demuxer->custom_id, 1);
 			}
 			else
 			if(demuxer->vstream == -1) 
@@ -1335,7 +1536,11 @@ static int get_program_pes_packet(mpeg3_demuxer_t *demuxer, unsigned int header)
 /* Get data length */
 			pes_packet_length -= mpeg3io_tell(title->fs) - pes_packet_start;
 
-			handle_subtitle(file, stream_id, demuxer, pes_packet_length);
+/* The shared reader leaves subtitles to the video track */
+			if(demuxer->shared)
+				mpeg3io_seek_relative(title->fs, pes_packet_length);
+			else
+				handle_subtitle(file, stream_id, demuxer, pes_packet_length);
 //printf("mpeg3_demux id=0x%02x size=%d total_size=%d\n", stream_id, pes_packet_length, subtitle->size);
 
 		}
@@ -1364,7 +1569,7 @@ static int get_program_pes_packet(mpeg3_demuxer_t *demuxer, unsigned int header)
 
 /* Take first stream ID if not building TOC. */
 			if(demuxer->read_all)
-				demuxer->astream_table[demuxer->custom_id] = format;
+				mpeg3demux_set_audio_stream(demuxer, demuxer->custom_id, format);
 			else
 			if(demuxer->astream == -1)
 				demuxer->astream = demuxer->custom_id;
@@ -1403,7 +1608,6 @@ static int get_program_pes_packet(mpeg3_demuxer_t *demuxer, unsigned int header)
 				pes_packet_length -= mpeg3io_tell(title->fs) - pes_packet_start;
     			mpeg3io_seek_relative(title->fs, pes_packet_length);
       		}
-//printf("get_program_pes_packet 6 %d\n", demuxer->astream_table[0x20]);
     	}
     	else 
 		if(demuxer->stream_id == 0xbc || 1)
@@ -1428,6 +1632,9 @@ static int get_program_pes_packet(mpeg3_demuxer_t *demuxer, unsigned int header)
 
 	if(do_pcm) handle_pcm(demuxer, pes_packet_length);
 
+	if(demuxer->shared)
+		mpeg3_shared_pes(demuxer, pts > 0 ? (double)pts / 60000 : -1);
+
 
 
 
@@ -1743,21 +1950,96 @@ do_phys_seek:
 
 
 
+// Number of bytes after the read position which can be scanned without
+// leaving the I/O buffer, the cell or the stream.
+static int next_code_span(mpeg3_demuxer_t *demuxer)
+{
+	mpeg3_title_t *title = demuxer->titles[demuxer->current_title];
+	mpeg3_cell_t *cell;
+	int64_t size;
+
+	if(!title->cell_table) return 0;
+	cell = &title->cell_table[demuxer->title_cell];
+	if(demuxer->program_byte < cell->program_start ||
+		demuxer->program_byte >= cell->program_end ||
+		mpeg3io_sync_buffer(title->fs)) return 0;
+
+	size = MIN(cell->program_end - demuxer->program_byte,
+		title->fs->buffer_size - title->fs->buffer_offset);
+	if(demuxer->stream_end > 0)
+		size = MIN(size, demuxer->stream_end - demuxer->program_byte);
+	return size;
+}
+
+// Number of bytes before the read position which can be scanned without
+// leaving the I/O buffer or the cell.  Leaves the I/O position on the
+// last byte of them.
+static int prev_code_span(mpeg3_demuxer_t *demuxer)
+{
+	mpeg3_title_t *title = demuxer->titles[demuxer->current_title];
+	mpeg3_cell_t *cell;
+
+	if(!title->cell_table) return 0;
+	cell = &title->cell_table[demuxer->title_cell];
+	if(demuxer->program_byte <= cell->program_start ||
+		demuxer->program_byte > cell->program_end) return 0;
+
+	mpeg3io_seek(title->fs, demuxer->program_byte - title->start_byte - 1LL);
+	if(mpeg3io_sync_buffer(title->fs)) return 0;
+
+	return MIN(demuxer->program_byte - cell->program_start,
+		title->fs->buffer_offset + 1);
+}
+
+// code must be a start code
 static int next_code(mpeg3_demuxer_t *demuxer,
 	uint32_t code)
 {
 	uint32_t result = 0;
 	int error = 0;
 	mpeg3_title_t *title = demuxer->titles[demuxer->current_title];
-	mpeg3_fs_t *fd = title->fs;
+	int size, offset, i;
 
 	while(result != code &&
 		!error)
 	{
 		title = demuxer->titles[demuxer->current_title];
-		result <<= 8;
-		result |= (unsigned char)mpeg3io_read_char(title->fs);
-		demuxer->program_byte++;
+		size = next_code_span(demuxer);
+
+		if(size >= 4)
+		{
+			unsigned char *buffer = title->fs->buffer + title->fs->buffer_offset;
+
+// Codes starting before the span
+			for(offset = 0; offset < 3 && result != code; offset++)
+				result = (result << 8) | buffer[offset];
+
+			if(result != code)
+			{
+				for(i = 0; (i = mpeg3_find_startcode(buffer, i, size)) >= 0; i++)
+					if(mpeg3_get_code(buffer + i) == code) break;
+
+				if(i >= 0)
+				{
+					offset = i + 4;
+					result = code;
+				}
+				else
+				{
+					offset = size;
+					result = mpeg3_get_code(buffer + size - 4);
+				}
+			}
+
+			mpeg3io_seek_relative(title->fs, offset);
+			demuxer->program_byte += offset;
+		}
+		else
+		{
+			result <<= 8;
+			result |= (unsigned char)mpeg3io_read_char(title->fs);
+			demuxer->program_byte++;
+		}
 		error = mpeg3_seek_phys(demuxer);
 	}
 	return error;
@@ -1789,6 +2071,12 @@ int mpeg3_read_next_packet(mpeg3_demuxer_t *demuxer)
 	demuxer->audio_size = 0;
 	demuxer->video_size = 0;
 
+/* Take the packet from the shared reader */
+	if(demuxer->ring &&
+		!demuxer->reverse &&
+		!mpeg3_shared_read(demuxer, &result)) return result;
+	demuxer->shared_eof = -1;
+
 
 /*
  * printf("mpeg3_read_next_packet %d demuxer->program_byte=%llx demuxer->reverse=%d\n", 
@@ -1862,6 +2150,9 @@ int mpeg3_read_next_packet(mpeg3_demuxer_t *demuxer)
 				if(demuxer->read_all && file->is_audio_stream)
 				{
 /* Read elementary stream. */
+					grow_buffer(&demuxer->audio_buffer,
+						&demuxer->audio_allocated,
+						file->packet_size);
 					result = mpeg3io_read_data(demuxer->audio_buffer, 
 						file->packet_size, title->fs);
 					demuxer->audio_size = file->packet_size;
@@ -1872,6 +2163,9 @@ int mpeg3_read_next_packet(mpeg3_demuxer_t *demuxer)
 				if(demuxer->read_all && file->is_video_stream)
 				{
 /* Read elementary stream. */
+					grow_buffer(&demuxer->video_buffer,
+						&demuxer->video_allocated,
+						file->packet_size);
 					result = mpeg3io_read_data(demuxer->video_buffer, 
 						file->packet_size, title->fs);
 						demuxer->video_size = file->packet_size;
@@ -1880,6 +2174,9 @@ int mpeg3_read_next_packet(mpeg3_demuxer_t *demuxer)
 				}
 				else
 				{
+					grow_buffer(&demuxer->data_buffer,
+						&demuxer->data_allocated,
+						file->packet_size);
 					result = mpeg3io_read_data(demuxer->data_buffer, 
 						file->packet_size, title->fs);
 					demuxer->data_size = file->packet_size;
@@ -1912,24 +2209,58 @@ int mpeg3_read_next_packet(mpeg3_demuxer_t *demuxer)
 
 
 
+// code must be a start code
 static int prev_code(mpeg3_demuxer_t *demuxer,
 	uint32_t code)
 {
 	uint32_t result = 0;
 	int error = 0;
 	mpeg3_title_t *title = demuxer->titles[demuxer->current_title];
-	mpeg3_fs_t *fd = title->fs;
+	int size, offset, i;
 
 
 	while(result != code &&
 		demuxer->program_byte > 0 && 
 		!error)
 	{
-		result >>= 8;
 		title = demuxer->titles[demuxer->current_title];
-		mpeg3io_seek(title->fs, demuxer->program_byte - title->start_byte - 1LL);
-		result |= ((uint32_t)mpeg3io_read_char(title->fs)) << 24;
-		demuxer->program_byte--;
+		size = prev_code_span(demuxer);
+
+		if(size >= 4)
+		{
+			unsigned char *buffer = title->fs->buffer + 
+				title->fs->buffer_offset + 1 - size;
+
+// Codes ending after the span
+			for(offset = 0; offset < 3 && result != code; offset++)
+				result = (result >> 8) | ((uint32_t)buffer[size - 1 - offset] << 24);
+
+			if(result != code)
+			{
+				for(i = size - 3; (i = mpeg3_rfind_startcode(buffer, 0, i + 3)) >= 0; )
+					if(mpeg3_get_code(buffer + i) == code) break;
+
+				if(i >= 0)
+				{
+					offset = size - i;
+					result = code;
+				}
+				else
+				{
+					offset = size;
+					result = mpeg3_get_code(buffer);
+				}
+			}
+
+			demuxer->program_byte -= offset;
+		}
+		else
+		{
+			result >>= 8;
+			mpeg3io_seek(title->fs, demuxer->program_byte - title->start_byte - 1LL);
+			result |= ((uint32_t)mpeg3io_read_char(title->fs)) << 24;
+			demuxer->program_byte--;
+		}
 		error = mpeg3_seek_phys(demuxer);
 	}
 	return error;
@@ -1944,8 +2275,10 @@ int mpeg3_read_prev_packet(mpeg3_demuxer_t *demuxer)
 {
 	int result = 0;
 	mpeg3_t *file = demuxer->file;
-	mpeg3_title_t *title = demuxer->titles[demuxer->current_title];
+	mpeg3_title_t *title;
 
+	mpeg3_shared_detach(demuxer);
+	title = demuxer->titles[demuxer->current_title];
 	demuxer->data_size = 0;
 	demuxer->data_position = 0;
 
@@ -2031,6 +2364,9 @@ printf("mpeg3_read_prev_packet 100 result=%d title=%d tell=%llx program_byte=%ll
 		{
 /* Elementary stream */
 /* Read the packet forwards and seek back to the start */
+			grow_buffer(&demuxer->data_buffer,
+				&demuxer->data_allocated,
+				file->packet_size);
 			result = mpeg3io_read_data(demuxer->data_buffer, 
 				file->packet_size, 
 				title->fs);
@@ -2180,20 +2516,20 @@ int mpeg3demux_copy_titles(mpeg3_demuxer_t *dst, mpeg3_demuxer_t *src)
 	mpeg3_t *file = dst->file;
 	mpeg3_title_t *dst_title, *src_title;
 
-	dst->total_titles = src->total_titles;
 	dst->total_programs = src->total_programs;
 
-	for(i = 0; i < MPEG3_MAX_STREAMS; i++)
-	{
-		dst->astream_table[i] = src->astream_table[i];
-		dst->vstream_table[i] = src->vstream_table[i];
-	}
+	dst->total_streams = dst->streams_allocated = src->total_streams;
+	dst->streams = realloc(dst->streams,
+		sizeof(mpeg3_streamid_t) * src->total_streams);
+	memcpy(dst->streams,
+		src->streams,
+		sizeof(mpeg3_streamid_t) * src->total_streams);
 
 	for(i = 0; i < src->total_titles; i++)
 	{
 		src_title = src->titles[i];
-		dst_title = dst->titles[i] = mpeg3_new_title(file, 
-			src->titles[i]->fs->path);
+		dst_title = mpeg3demux_append_title(dst,
+			mpeg3_new_title(file, src->titles[i]->fs->path));
 		mpeg3_copy_title(dst_title, src_title);
 	}
 
@@ -2202,6 +2538,107 @@ int mpeg3demux_copy_titles(mpeg3_demuxer_t *dst, mpeg3_demuxer_t *src)
 	return 0;
 }
 
+mpeg3_title_t* mpeg3demux_append_title(mpeg3_demuxer_t *demuxer,
+	mpeg3_title_t *title)
+{
+	if(demuxer->total_titles >= demuxer->titles_allocated)
+	{
+		demuxer->titles_allocated = MAX(4, demuxer->titles_allocated * 2);
+		demuxer->titles = realloc(demuxer->titles,
+			sizeof(mpeg3_title_t*) * demuxer->titles_allocated);
+	}
+	demuxer->titles[demuxer->total_titles++] = title;
+	return title;
+}
+
+/* Binary search for the stream ID.  Returns the index it belongs at */
+/* if it isn't in the table. */
+static int find_stream(mpeg3_demuxer_t *demuxer, int id)
+{
+	int min = 0, max = demuxer->total_streams;
+	while(min < max)
+	{
+		int i = (min + max) / 2;
+		if(demuxer->streams[i].id < id)
+			min = i + 1;
+		else
+			max = i;
+	}
+	return min;
+}
+
+static mpeg3_streamid_t* get_stream(mpeg3_demuxer_t *demuxer, int id)
+{
+	int i = find_stream(demuxer, id);
+	if(i < demuxer->total_streams && demuxer->streams[i].id == id)
+		return &demuxer->streams[i];
+	return 0;
+}
+
+static mpeg3_streamid_t* new_stream(mpeg3_demuxer_t *demuxer, int id)
+{
+	int i = find_stream(demuxer, id);
+	mpeg3_streamid_t *stream;
+
+	if(i < demuxer->total_streams && demuxer->streams[i].id == id)
+		return &demuxer->streams[i];
+
+	if(demuxer->total_streams >= demuxer->streams_allocated)
+	{
+		demuxer->streams_allocated = MAX(8, demuxer->streams_allocated * 2);
+		demuxer->streams = realloc(demuxer->streams,
+			sizeof(mpeg3_streamid_t) * demuxer->streams_allocated);
+	}
+
+	stream = &demuxer->streams[i];
+	memmove(stream + 1,
+		stream,
+		sizeof(mpeg3_streamid_t) * (demuxer->total_streams - i));
+	demuxer->total_streams++;
+	stream->id = id;
+	stream->audio = 0;
+	stream->video = 0;
+	return stream;
+}
+
+int mpeg3demux_audio_stream(mpeg3_demuxer_t *demuxer, int id)
+{
+	mpeg3_streamid_t *stream = get_stream(demuxer, id);
+	return stream ? stream->audio : 0;
+}
+
+int mpeg3demux_video_stream(mpeg3_demuxer_t *demuxer, int id)
+{
+	mpeg3_streamid_t *stream = get_stream(demuxer, id);
+	return stream ? stream->video : 0;
+}
+
+void mpeg3demux_set_audio_stream(mpeg3_demuxer_t *demuxer, int id, int format)
+{
+	new_stream(demuxer, id)->audio = format;
+}
+
+void mpeg3demux_set_video_stream(mpeg3_demuxer_t *demuxer, int id, int value)
+{
+	new_stream(demuxer, id)->video = value;
+}
+
+int mpeg3demux_probe_done(mpeg3_demuxer_t *demuxer)
+{
+	mpeg3_probe_t *probe = demuxer->probe;
+	int i;
+
+	if(!probe || 
+		!probe->got_map || 
+		probe->incomplete || 
+		!probe->total_ids) return 0;
+	for(i = 0; i < probe->total_pmts; i++)
+		if(!probe->got_pmt[i]) return 0;
+	for(i = 0; i < probe->total_ids; i++)
+		if(!probe->started[probe->ids[i]]) return 0;
+	return 1;
+}
+
 /* ==================================================================== */
 /*                            Entry points */
 /* ==================================================================== */
@@ -2216,20 +2653,6 @@ mpeg3_demuxer_t* mpeg3_new_demuxer(mpeg3_t *file, int do_audio, int do_video, in
 	demuxer->do_audio = do_audio;
 	demuxer->do_video = do_video;
 
-/* Allocate buffer + padding */
-	demuxer->raw_data = calloc(1, MPEG3_RAW_SIZE);
-	demuxer->data_buffer = calloc(1, MPEG3_RAW_SIZE);
-	demuxer->data_allocated = MPEG3_RAW_SIZE;
-
-	demuxer->audio_buffer = calloc(1, MPEG3_RAW_SIZE);
-	demuxer->audio_allocated = MPEG3_RAW_SIZE;
-
-	demuxer->video_buffer = calloc(1, MPEG3_RAW_SIZE);
-	demuxer->video_allocated = MPEG3_RAW_SIZE;
-
-	demuxer->subtitle_buffer = calloc(1, MPEG3_RAW_SIZE);
-	demuxer->subtitle_allocated = MPEG3_RAW_SIZE;
-
 /* System specific variables */
 	demuxer->audio_pid = custom_id;
 	demuxer->video_pid = custom_id;
@@ -2240,6 +2663,7 @@ mpeg3_demuxer_t* mpeg3_new_demuxer(mpeg3_t *file, int do_audio, int do_video, in
 	demuxer->pes_video_time = -1;
 //printf("mpeg3_new_demuxer %f\n", demuxer->time);
 	demuxer->stream_end = -1;
+	demuxer->shared_eof = -1;
 
 	return demuxer;
 }
@@ -2257,11 +2681,14 @@ int mpeg3_delete_demuxer(mpeg3_demuxer_t *demuxer)
 	{
 		mpeg3_delete_title(demuxer->titles[i]);
 	}
+	if(demuxer->titles) free(demuxer->titles);
+	if(demuxer->streams) free(demuxer->streams);
 
 	if(demuxer->data_buffer) free(demuxer->data_buffer);
-	if(demuxer->raw_data) free(demuxer->raw_data);
+	if(demuxer->raw_buffer) free(demuxer->raw_buffer);
 	if(demuxer->audio_buffer) free(demuxer->audio_buffer);
 	if(demuxer->video_buffer) free(demuxer->video_buffer);
+	if(demuxer->subtitle_buffer) free(demuxer->subtitle_buffer);
 	for(i = 0; i < demuxer->total_subtitles; i++)
 	{
 		mpeg3_delete_subtitle(demuxer->subtitles[i]);
@@ -2277,7 +2704,10 @@ int mpeg3demux_eof(mpeg3_demuxer_t *demuxer)
 	mpeg3_t *file = demuxer->file;
 	if(file->seekable)
 	{
-		if(demuxer->current_title >= 0)
+/* Last packet came from the shared reader */
+		if(demuxer->shared_eof > 0) return 1;
+		else
+		if(demuxer->shared_eof < 0 && demuxer->current_title >= 0)
 		{
 			if(mpeg3io_eof(demuxer->titles[demuxer->current_title]->fs) &&
 				demuxer->current_title >= demuxer->total_titles - 1)
@@ -2327,6 +2757,8 @@ int mpeg3demux_seek_byte(mpeg3_demuxer_t *demuxer, int64_t byte)
  * for(i = 0; i < demuxer->total_titles; i++) mpeg3_dump_title(demuxer->titles[i]);
  */
 
+	mpeg3_shared_detach(demuxer);
+
 	demuxer->program_byte = byte;
 	demuxer->data_position = 0;
 	demuxer->data_size = 0;
@@ -1,7 +1,10 @@
 #include "libmpeg3.h"
 #include "mpeg3protos.h"
+#include <malloc.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
 
 #define BUFSIZE 65536
 
@@ -16,6 +19,179 @@ void test_32bit_overflow(char *outfile, int (*out_counter), FILE *(*out))
 	}
 }
 
+// Read every packet without decoding anything
+void benchmark_demux(mpeg3_t *file)
+{
+	mpeg3_demuxer_t *demuxer = mpeg3_new_demuxer(file, 0, 0, -1);
+	struct timeval start_time, end_time;
+	int64_t packets = 0;
+	double seconds;
+
+	demuxer->read_all = 1;
+	mpeg3demux_copy_titles(demuxer, file->demuxer);
+	mpeg3demux_seek_byte(demuxer, 0);
+
+	gettimeofday(&start_time, 0);
+	while(!mpeg3_read_next_packet(demuxer)) packets++;
+	gettimeofday(&end_time, 0);
+
+	seconds = (end_time.tv_sec - start_time.tv_sec) + 
+		(double)(end_time.tv_usec - start_time.tv_usec) / 1000000;
+	if(seconds <= 0) seconds = 0.000001;
+	printf("%lld packets %lld bytes %.03f seconds %.0f packets/sec %.01f MB/sec\n",
+		(long long)packets,
+		(long long)mpeg3demux_tell_byte(demuxer),
+		seconds,
+		packets / seconds,
+		mpeg3demux_tell_byte(demuxer) / seconds / 1000000);
+	mpeg3_delete_demuxer(demuxer);
+}
+
+// Find every start code in the first video stream without decoding it
+void benchmark_startcodes(mpeg3_t *file)
+{
+	mpeg3_demuxer_t *demuxer;
+	mpeg3_bits_t *stream;
+	struct timeval start_time, end_time;
+	int64_t codes = 0;
+	double seconds;
+
+	if(!mpeg3_total_vstreams(file)) return;
+	demuxer = mpeg3_new_demuxer(file, 0, 1, file->vtrack[0]->pid);
+	mpeg3demux_copy_titles(demuxer, file->vtrack[0]->demuxer);
+	stream = mpeg3bits_new_stream(file, demuxer);
+	mpeg3bits_seek_byte(stream, 0);
+
+	gettimeofday(&start_time, 0);
+	while(1)
+	{
+		mpeg3bits_next_startcode(stream);
+		if(mpeg3bits_eof(stream)) break;
+		mpeg3bits_getbyte_noptr(stream);
+		codes++;
+	}
+	gettimeofday(&end_time, 0);
+
+	seconds = (end_time.tv_sec - start_time.tv_sec) + 
+		(double)(end_time.tv_usec - start_time.tv_usec) / 1000000;
+	if(seconds <= 0) seconds = 0.000001;
+	printf("%lld start codes %lld bytes %.03f seconds %.01f MB/sec\n",
+		(long long)codes,
+		(long long)mpeg3demux_tell_byte(demuxer),
+		seconds,
+		mpeg3demux_tell_byte(demuxer) / seconds / 1000000);
+	mpeg3bits_delete_stream(stream);
+	mpeg3_delete_demuxer(demuxer);
+}
+
+static int64_t allocated_bytes()
+{
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+// Print the bytes allocated by opening the file and by each of its tracks
+void print_footprint(char *path)
+{
+	int64_t start = allocated_bytes();
+	int64_t opened, before;
+	int error = 0;
+	int i;
+	mpeg3_t *file = mpeg3_open(path, &error);
+
+	if(!file) return;
+	opened = allocated_bytes() - start;
+	printf("open %lld bytes\n", (long long)opened);
+
+// Deleting a track frees everything it allocated
+	for(i = 0; i < file->total_vstreams; i++)
+	{
+		before = allocated_bytes();
+		mpeg3_delete_vtrack(file, file->vtrack[i]);
+		printf("  video track %d: %lld bytes\n", i, (long long)(before - allocated_bytes()));
+	}
+	file->total_vstreams = 0;
+
+	for(i = 0; i < file->total_astreams; i++)
+	{
+		before = allocated_bytes();
+		mpeg3_delete_atrack(file, file->atrack[i]);
+		printf("  audio track %d: %lld bytes\n", i, (long long)(before - allocated_bytes()));
+	}
+	file->total_astreams = 0;
+
+	before = allocated_bytes();
+	mpeg3_close(file);
+	printf("  file: %lld bytes\n", (long long)(before - allocated_bytes()));
+}
+
+typedef struct
+{
+	char *path;
+	pthread_t tid;
+	int64_t samples;
+} decoder_thread_t;
+
+static void* decode_audio(void *ptr)
+{
+	decoder_thread_t *thread = ptr;
+	int error = 0;
+	mpeg3_t *file = mpeg3_open(thread->path, &error);
+	float *buffer;
+	int channels;
+
+	if(!file) return 0;
+	if(!mpeg3_total_astreams(file))
+	{
+		mpeg3_close(file);
+		return 0;
+	}
+
+	channels = mpeg3_audio_channels(file, 0);
+	buffer = malloc(sizeof(float) * BUFSIZE * channels);
+	while(!mpeg3_end_of_audio(file, 0))
+	{
+		if(mpeg3_read_audio_interleaved(file, buffer, 0, BUFSIZE, 0)) break;
+		thread->samples += BUFSIZE;
+	}
+	free(buffer);
+	mpeg3_close(file);
+	return 0;
+}
+
+// Decode the first audio stream in several threads at once
+void benchmark_audio(char *path, int threads)
+{
+	decoder_thread_t *thread = calloc(threads, sizeof(decoder_thread_t));
+	struct timeval start_time, end_time;
+	int64_t samples = 0;
+	double seconds;
+	int i;
+
+	gettimeofday(&start_time, 0);
+	for(i = 0; i < threads; i++)
+	{
+		thread[i].path = path;
+		pthread_create(&thread[i].tid, 0, decode_audio, &thread[i]);
+	}
+	for(i = 0; i < threads; i++)
+	{
+		pthread_join(thread[i].tid, 0);
+		samples += thread[i].samples;
+	}
+	gettimeofday(&end_time, 0);
+
+	seconds = (end_time.tv_sec - start_time.tv_sec) + 
+		(double)(end_time.tv_usec - start_time.tv_usec) / 1000000;
+	if(seconds <= 0) seconds = 0.000001;
+	printf("%d threads %lld samples %.03f seconds %.0f samples/sec\n",
+		threads,
+		(long long)samples,
+		seconds,
+		samples / seconds);
+	free(thread);
+}
+
 int main(int argc, char *argv[])
 {
 	mpeg3_t *file;
@@ -32,6 +208,8 @@ int main(int argc, char *argv[])
 /* Print cell offsets */
 	int print_offsets = 0;
 	int print_pids = 1;
+	int benchmark = 0;
+	int threads = 0;
 
 	outfile[0] = 0;
 	if(argc < 2)
@@ -39,12 +217,48 @@ int main(int argc, char *argv[])
 		printf(
 "Dump information or extract audio to a 24 bit pcm file.\n"
 "Example: dump -a0 outputfile.pcm take1.vob\n"
+"-t compares the accelerated IDCT, motion compensation and color conversion to the C versions.\n"
+"-b reads every packet without decoding and prints the demuxing speed.\n"
+"-s finds every start code in the first video stream and prints the scanning speed.\n"
+"-c <threads> decodes the first audio stream in every thread at once and prints the decoding speed.\n"
+"-m prints the bytes allocated by opening the file and by each of its tracks.\n"
 		);
 		exit(1);
 	}
 
 	for(i = 1; i < argc; i++)
 	{
+		if(!strcmp(argv[i], "-t"))
+		{
+			int errors = mpeg3video_check_idct() + 
+				mpeg3video_check_recon() + 
+				mpeg3video_check_dither();
+			printf("%s\n", errors ? "FAILED" : "OK");
+			exit(errors ? 1 : 0);
+		}
+		else
+		if(!strcmp(argv[i], "-b"))
+		{
+			benchmark = 1;
+		}
+		else
+		if(!strcmp(argv[i], "-s"))
+		{
+			benchmark = 2;
+		}
+		else
+		if(!strcmp(argv[i], "-m"))
+		{
+			benchmark = 4;
+		}
+		else
+		if(!strcmp(argv[i], "-c") && i + 1 < argc)
+		{
+			benchmark = 3;
+			threads = atol(argv[++i]);
+			if(threads < 1) threads = 1;
+		}
+		else
 		if(!strncmp(argv[i], "-a", 2))
 		{
 // Check for track number
@@ -74,8 +288,26 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if(benchmark == 4)
+	{
+		print_footprint(argv[argc - 1]);
+		exit(0);
+	}
+
 	int error = 0;
 	file = mpeg3_open(argv[argc - 1], &error);
+	if(file && benchmark)
+	{
+		if(benchmark == 1)
+			benchmark_demux(file);
+		else
+		if(benchmark == 2)
+			benchmark_startcodes(file);
+		else
+			benchmark_audio(argv[argc - 1], threads);
+		mpeg3_close(file);
+		exit(0);
+	}
 	if(outfile[0])
 	{
 		out = fopen(outfile, "wb");
@@ -90,6 +322,13 @@ int main(int argc, char *argv[])
 
 	if(file)
 	{
+		mpeg3_probe_stats_t probe;
+		mpeg3_probe_stats(file, &probe);
+		if(probe.method != MPEG3_PROBE_NONE)
+			fprintf(stderr, "probe=%s bytes=%lld time=%lldus\n",
+				probe.method == MPEG3_PROBE_TABLES ? "tables" : "scan",
+				(long long)probe.bytes,
+				(long long)probe.time);
 
 // Audio streams
 		fprintf(stderr, "total_astreams=%d\n", mpeg3_total_astreams(file));
@@ -108,7 +347,7 @@ int main(int argc, char *argv[])
 				fprintf(stderr, "total_sample_offsets=%d\n", file->atrack[i]->total_sample_offsets);
 				for(j = 0; j < file->atrack[i]->total_sample_offsets; j++)
 				{
-					fprintf(stderr, "%llx ", file->atrack[i]->sample_offsets[j]);
+					fprintf(stderr, "%llx ", mpeg3atrack_sample_offset(file->atrack[i], j));
 					if(j > 0 && !(j % 8)) fprintf(stderr, "\n");
 				}
 				fprintf(stderr, "\n");
@@ -135,7 +374,7 @@ int main(int argc, char *argv[])
 				fprintf(stderr, "total_frame_offsets=%d\n", file->vtrack[i]->total_frame_offsets);
 				for(j = 0; j < file->vtrack[i]->total_frame_offsets; j++)
 				{
-					fprintf(stderr, "%d=%llx ", j, file->vtrack[i]->frame_offsets[j]);
+					fprintf(stderr, "%d=%llx ", j, mpeg3vtrack_frame_offset(file->vtrack[i], j));
 					if(j > 0 && !(j % 8)) fprintf(stderr, "\n");
 				}
 				fprintf(stderr, "\n");
@@ -143,7 +382,7 @@ int main(int argc, char *argv[])
 				fprintf(stderr, "total_keyframe_numbers=%d\n", file->vtrack[i]->total_keyframe_numbers);
 				for(j = 0; j < file->vtrack[i]->total_keyframe_numbers; j++)
 				{
-					fprintf(stderr, "%lld ", file->vtrack[i]->keyframe_numbers[j]);
+					fprintf(stderr, "%lld ", mpeg3vtrack_keyframe_number(file->vtrack[i], j));
 					if(j > 0 && !(j % 8)) fprintf(stderr, "\n");
 				}
 				fprintf(stderr, "\n");
@@ -209,7 +448,7 @@ int main(int argc, char *argv[])
 		if(decompress_audio)
 		{
 			mpeg3_set_cpus(file, 2);
- 			audio_output_f = malloc(BUFSIZE * sizeof(float));
+ 			audio_output_f = malloc(BUFSIZE * sizeof(float) * mpeg3_audio_channels(file, audio_track));
 			audio_output_i = malloc(BUFSIZE * 3 * mpeg3_audio_channels(file, audio_track));
 
 //printf("%d\n", mpeg3_end_of_audio(file, audio_track));
@@ -217,37 +456,24 @@ int main(int argc, char *argv[])
 			{
 				test_32bit_overflow(outfile, &out_counter, &out);
 				
-				for(i = 0; i < mpeg3_audio_channels(file, audio_track); i++)
+				result = mpeg3_read_audio_interleaved(file, 
+					audio_output_f, 
+					0, 
+					BUFSIZE, 
+					audio_track);
+
+				for(j = 0; j < BUFSIZE * mpeg3_audio_channels(file, audio_track); j++)
 				{
-					if(i == 0)
-  						result = mpeg3_read_audio(file, 
-							audio_output_f, 
-							0, 
-							i, 
-							BUFSIZE, 
-							audio_track);
+					int sample = audio_output_f[j] * 0x7fffff;
+					unsigned char *output_i = audio_output_i + j * 3;
+					if(sample > 0x7fffff) 
+						sample = 0x7fffff;
 					else
-						result = mpeg3_reread_audio(file, 
-							audio_output_f,      /* Pointer to pre-allocated buffer of floats */
-							0,      /* Pointer to pre-allocated buffer of int16's */
-							i,          /* Channel to decode */
-							BUFSIZE,         /* Number of samples to decode */
-							audio_track);
-
-					for(j = 0; j < BUFSIZE; j++)
-					{
-						int sample = audio_output_f[j] * 0x7fffff;
-						unsigned char *output_i = audio_output_i + j * 3 * mpeg3_audio_channels(file, audio_track) + i * 3;
-						if(sample > 0x7fffff) 
-							sample = 0x7fffff;
-						else
-						if(sample < -0x7fffff)
-							sample = -0x7fffff;
-						*output_i++ = (sample & 0xff0000) >> 16;
-						*output_i++ = (sample & 0xff00) >> 8;
-						*output_i = sample & 0xff;
-					}
-						
+					if(sample < -0x7fffff)
+						sample = -0x7fffff;
+					*output_i++ = (sample & 0xff0000) >> 16;
+					*output_i++ = (sample & 0xff00) >> 8;
+					*output_i = sample & 0xff;
 				}
 				
 				result = !fwrite(audio_output_i, BUFSIZE * 3 * mpeg3_audio_channels(file, audio_track), 1, out);
@@ -372,8 +372,8 @@ static void get_ifo_playlist(mpeg3_t *file, mpeg3_demuxer_t *demuxer)
 					mpeg3_title_t *title;
 
 					mpeg3io_joinpath(title_path, directory, new_filename->d_name);
-					title = demuxer->titles[demuxer->total_titles++] = 
-						mpeg3_new_title(file, title_path);
+					title = mpeg3demux_append_title(demuxer,
+						mpeg3_new_title(file, title_path));
 					title->total_bytes = mpeg3io_path_total_bytes(title_path);
 					title->start_byte = total_bytes;
 					title->end_byte = total_bytes + title->total_bytes;
@@ -422,7 +422,7 @@ static void get_ifo_header(mpeg3_demuxer_t *demuxer, ifo_t *ifo)
 {
 	int i;
 // Video header
-	demuxer->vstream_table[0] = 1;
+	mpeg3demux_set_video_stream(demuxer, 0, 1);
 
 // Audio header
 	if(!ifo_vts(ifo))
@@ -446,9 +446,9 @@ static void get_ifo_header(mpeg3_demuxer_t *demuxer, ifo_t *ifo)
 		}
 		mpeg3demux_seek_byte(demuxer, 0);
 
-		for(i = 0; i < MPEG3_MAX_STREAMS; i++)
+		for(i = 0; i < demuxer->total_streams; i++)
 		{
-			if(demuxer->astream_table[i]) atracks_empirical++;
+			if(demuxer->streams[i].audio) atracks_empirical++;
 		}
 
 // Doesn't detect PCM audio or total number of tracks
@@ -464,7 +464,7 @@ static void get_ifo_header(mpeg3_demuxer_t *demuxer, ifo_t *ifo)
  * 					case 2: audio_mode = AUDIO_MPEG; break;
  * 					case 3: audio_mode = AUDIO_PCM;  break;
  * 				}
- * 				if(!demuxer->astream_table[i + 0x80]) demuxer->astream_table[i + 0x80] = audio_mode;
+ * 				if(!mpeg3demux_audio_stream(demuxer, i + 0x80)) mpeg3demux_set_audio_stream(demuxer, i + 0x80, audio_mode);
  * 			}
  */
 	}
@@ -1,3 +1,4 @@
+#include "libmpeg3.h"
 #include "mpeg3private.h"
 #include "mpeg3protos.h"
 
@@ -6,12 +7,17 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+
+// Read from when the position is outside a mapped file
+static unsigned char mpeg3io_empty_buffer[16];
 
 mpeg3_fs_t* mpeg3_new_fs(char *path)
 {
 	mpeg3_fs_t *fs = calloc(1, sizeof(mpeg3_fs_t));
-	fs->buffer = calloc(1, MPEG3_IO_SIZE);
+// The stdio buffer is allocated on the first read
 // Force initial read
 	fs->buffer_position = -0xffff;
 	fs->css = mpeg3_new_css();
@@ -21,8 +27,10 @@ mpeg3_fs_t* mpeg3_new_fs(char *path)
 
 int mpeg3_delete_fs(mpeg3_fs_t *fs)
 {
+	mpeg3io_close_file(fs);
 	mpeg3_delete_css(fs->css);
 	free(fs->buffer);
+	free(fs->readahead_buffer);
 	free(fs);
 	return 0;
 }
@@ -73,16 +81,195 @@ int mpeg3io_open_file(mpeg3_fs_t *fs)
 	if(!fs->total_bytes)
 	{
 		fclose(fs->fd);
+		fs->fd = 0;
 		return 1;
 	}
 
 	fs->current_byte = 0;
 	fs->buffer_position = -0xffff;
+
+	if(fs->io_mode == MPEG3_IO_MMAP)
+		mpeg3io_map_file(fs);
+	else
+	if(fs->io_mode == MPEG3_IO_READAHEAD)
+		mpeg3io_start_readahead(fs);
+	return 0;
+}
+
+int64_t mpeg3io_time()
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void* mpeg3io_readahead_loop(void *ptr)
+{
+	mpeg3_fs_t *fs = ptr;
+	int64_t position, size, bytes;
+
+	pthread_mutex_lock(&fs->readahead_lock);
+	while(!fs->readahead_done)
+	{
+		if(fs->request_position < 0)
+		{
+			pthread_cond_wait(&fs->readahead_cond, &fs->readahead_lock);
+			continue;
+		}
+
+		position = fs->request_position;
+		size = fs->request_size;
+		fs->request_position = -1;
+		fs->busy_position = position;
+		fs->busy_size = size;
+		fs->readahead_position = -1;
+		pthread_mutex_unlock(&fs->readahead_lock);
+
+// pread doesn't disturb the stdio file position used by the reader
+		bytes = 0;
+		while(bytes < size)
+		{
+			ssize_t result = pread(fileno(fs->fd), 
+				fs->readahead_buffer + bytes, 
+				size - bytes, 
+				position + bytes);
+			if(result <= 0) break;
+			bytes += result;
+		}
+
+		pthread_mutex_lock(&fs->readahead_lock);
+		fs->busy_position = -1;
+		fs->readahead_position = position;
+		fs->readahead_size = bytes;
+		pthread_cond_broadcast(&fs->readahead_cond);
+	}
+	pthread_mutex_unlock(&fs->readahead_lock);
+	return 0;
+}
+
+int mpeg3io_start_readahead(mpeg3_fs_t *fs)
+{
+	if(!fs->readahead_buffer)
+		fs->readahead_buffer = calloc(1, MPEG3_IO_SIZE);
+	fs->readahead_done = 0;
+	fs->request_position = -1;
+	fs->busy_position = -1;
+	fs->readahead_position = -1;
+	pthread_mutex_init(&fs->readahead_lock, 0);
+	pthread_cond_init(&fs->readahead_cond, 0);
+
+	if(pthread_create(&fs->readahead_tid, 0, mpeg3io_readahead_loop, fs))
+	{
+		perror("mpeg3io_start_readahead");
+		pthread_mutex_destroy(&fs->readahead_lock);
+		pthread_cond_destroy(&fs->readahead_cond);
+		return 1;
+	}
+	fs->readahead_running = 1;
+	return 0;
+}
+
+int mpeg3io_stop_readahead(mpeg3_fs_t *fs)
+{
+	if(!fs->readahead_running) return 0;
+
+	pthread_mutex_lock(&fs->readahead_lock);
+	fs->readahead_done = 1;
+	pthread_cond_broadcast(&fs->readahead_cond);
+	pthread_mutex_unlock(&fs->readahead_lock);
+	pthread_join(fs->readahead_tid, 0);
+
+	pthread_mutex_destroy(&fs->readahead_lock);
+	pthread_cond_destroy(&fs->readahead_cond);
+	fs->readahead_running = 0;
+	return 0;
+}
+
+// Queue a block for the thread unless it already has it.
+static void mpeg3io_request_readahead(mpeg3_fs_t *fs, 
+	int64_t position, 
+	int64_t size)
+{
+	if(!fs->readahead_running || size <= 0) return;
+
+	pthread_mutex_lock(&fs->readahead_lock);
+	if(fs->busy_position != position && 
+		fs->readahead_position != position)
+	{
+		fs->request_position = position;
+		fs->request_size = size;
+		pthread_cond_signal(&fs->readahead_cond);
+	}
+	pthread_mutex_unlock(&fs->readahead_lock);
+}
+
+// Wait if a block which is queued or being read contains the range.
+// Returns 1 if readahead_buffer holds the range.
+static int mpeg3io_wait_readahead(mpeg3_fs_t *fs, 
+	int64_t position, 
+	int64_t size)
+{
+	int result;
+	if(!fs->readahead_running) return 0;
+
+	pthread_mutex_lock(&fs->readahead_lock);
+	while((fs->busy_position >= 0 &&
+			position >= fs->busy_position &&
+			position + size <= fs->busy_position + fs->busy_size) ||
+		(fs->request_position >= 0 &&
+			position >= fs->request_position &&
+			position + size <= fs->request_position + fs->request_size))
+		pthread_cond_wait(&fs->readahead_cond, &fs->readahead_lock);
+
+	result = fs->readahead_position >= 0 &&
+		position >= fs->readahead_position &&
+		position + size <= fs->readahead_position + fs->readahead_size;
+// Keep the thread off readahead_buffer until the caller is done with it
+	if(result) fs->request_position = -1;
+	pthread_mutex_unlock(&fs->readahead_lock);
+	return result;
+}
+
+int mpeg3io_map_file(mpeg3_fs_t *fs)
+{
+	void *data;
+
+/* Files larger than the address space stay on stdio */
+	if((size_t)fs->total_bytes != fs->total_bytes) return 1;
+
+	data = mmap(0, fs->total_bytes, PROT_READ, MAP_SHARED, fileno(fs->fd), 0);
+	if(data == MAP_FAILED)
+	{
+		perror("mpeg3io_map_file");
+		return 1;
+	}
+
+	madvise(data, fs->total_bytes, MADV_SEQUENTIAL);
+
+/* The readahead buffer isn't needed anymore */
+	if(fs->buffer) free(fs->buffer);
+	fs->mmap_data = data;
+	fs->mmap_size = fs->total_bytes;
+	fs->buffer = fs->mmap_data;
+	fs->buffer_position = 0;
+	fs->buffer_size = fs->mmap_size;
 	return 0;
 }
 
 int mpeg3io_close_file(mpeg3_fs_t *fs)
 {
+	mpeg3io_stop_readahead(fs);
+
+	if(fs->mmap_data)
+	{
+		munmap(fs->mmap_data, fs->mmap_size);
+		fs->mmap_data = 0;
+		fs->mmap_size = 0;
+		fs->buffer = 0;
+		fs->buffer_size = 0;
+		fs->buffer_position = -0xffff;
+	}
+
 	if(fs->fd) fclose(fs->fd);
 	fs->fd = 0;
 	return 0;
@@ -118,6 +305,77 @@ int mpeg3io_read_data(unsigned char *buffer, int64_t bytes, mpeg3_fs_t *fs)
 	return (result && bytes);
 }
 
+// Skip to the next occurrence of c without reading it.  Returns 1 at EOF.
+int mpeg3io_scan_char(mpeg3_fs_t *fs, int c)
+{
+	while(!mpeg3io_eof(fs) && !mpeg3io_sync_buffer(fs))
+	{
+		unsigned char *start = fs->buffer + fs->buffer_offset;
+		unsigned char *ptr = memchr(start, c, fs->buffer_size - fs->buffer_offset);
+		int bytes = ptr ? ptr - start : fs->buffer_size - fs->buffer_offset;
+
+		fs->buffer_offset += bytes;
+		fs->current_byte += bytes;
+		if(ptr) return 0;
+	}
+	return 1;
+}
+
+// Start codes are found 8 bytes at a time by skipping words with no zero
+// byte in them.
+#define HAS_ZERO(word) \
+	(((word) - 0x0101010101010101ULL) & ~(word) & 0x8080808080808080ULL)
+
+int mpeg3_find_startcode(unsigned char *buffer, int start, int end)
+{
+	int i = start, j;
+	uint64_t word;
+
+	while(i <= end - 4)
+	{
+		if(i + 8 <= end)
+		{
+			memcpy(&word, buffer + i, 8);
+			if(!HAS_ZERO(word))
+			{
+				i += 8;
+				continue;
+			}
+		}
+
+		for(j = i + 8; i < j && i <= end - 4; i++)
+		{
+			if(!buffer[i] && !buffer[i + 1] && buffer[i + 2] == 1) return i;
+		}
+	}
+	return -1;
+}
+
+int mpeg3_rfind_startcode(unsigned char *buffer, int start, int end)
+{
+	int i = end - 4, j;
+	uint64_t word;
+
+	while(i >= start)
+	{
+		if(i - 7 >= start)
+		{
+			memcpy(&word, buffer + i - 7, 8);
+			if(!HAS_ZERO(word))
+			{
+				i -= 8;
+				continue;
+			}
+		}
+
+		for(j = i - 8; i > j && i >= start; i--)
+		{
+			if(!buffer[i] && !buffer[i + 1] && buffer[i + 2] == 1) return i;
+		}
+	}
+	return -1;
+}
+
 int mpeg3io_seek(mpeg3_fs_t *fs, int64_t byte)
 {
 //printf("mpeg3io_seek 1 %lld\n", byte);
@@ -135,11 +393,38 @@ int mpeg3io_seek_relative(mpeg3_fs_t *fs, int64_t bytes)
 
 void mpeg3io_read_buffer(mpeg3_fs_t *fs)
 {
+// The whole file is the buffer.  Outside it, expose an empty buffer so
+// reads past the ends behave like a short fread.
+	if(fs->mmap_data)
+	{
+		if(fs->current_byte >= 0 && fs->current_byte < fs->mmap_size)
+		{
+			fs->buffer = fs->mmap_data;
+			fs->buffer_position = 0;
+			fs->buffer_size = fs->mmap_size;
+		}
+		else
+		{
+			fs->buffer = mpeg3io_empty_buffer;
+			fs->buffer_position = fs->current_byte;
+			fs->buffer_size = 0;
+		}
+		fs->buffer_offset = fs->current_byte - fs->buffer_position;
+		return;
+	}
+
+	if(!fs->buffer)
+		fs->buffer = calloc(1, MPEG3_IO_SIZE);
+
 // Special case for sequential reverse buffer.
 // This is only used for searching for previous codes.
 // Here we move a full half buffer backwards since the search normally
 // goes backwards and then forwards a little bit.
-	if(fs->current_byte < fs->buffer_position &&
+// An empty buffer at the end of the file has nothing to shift so it
+// must be treated as a random seek.
+	int64_t start_time = mpeg3io_time();
+	if(fs->buffer_size > 0 &&
+		fs->current_byte < fs->buffer_position &&
 		fs->current_byte >= fs->buffer_position - MPEG3_IO_SIZE / 2)
 	{
 		int64_t new_buffer_position = fs->current_byte - MPEG3_IO_SIZE / 2;
@@ -162,13 +447,28 @@ void mpeg3io_read_buffer(mpeg3_fs_t *fs)
 
 
 
-		fseeko64(fs->fd, new_buffer_position, SEEK_SET);
-		fread(fs->buffer, 1, remainder_start, fs->fd);
+		if(mpeg3io_wait_readahead(fs, new_buffer_position, remainder_start))
+		{
+			memcpy(fs->buffer, 
+				fs->readahead_buffer + new_buffer_position - fs->readahead_position, 
+				remainder_start);
+		}
+		else
+		{
+			fseeko64(fs->fd, new_buffer_position, SEEK_SET);
+			fread(fs->buffer, 1, remainder_start, fs->fd);
+		}
 
 
 		fs->buffer_position = new_buffer_position;
 		fs->buffer_size = new_buffer_size;
 		fs->buffer_offset = fs->current_byte - fs->buffer_position;
+		fs->stall_time += mpeg3io_time() - start_time;
+
+// Get the full buffer before this one in case the search keeps going
+		mpeg3io_request_readahead(fs, 
+			MAX(fs->buffer_position - MPEG3_IO_SIZE, 0), 
+			MIN(fs->buffer_position, MPEG3_IO_SIZE));
 	}
 	else
 // Sequential forward buffer or random seek
@@ -177,9 +477,28 @@ void mpeg3io_read_buffer(mpeg3_fs_t *fs)
 		fs->buffer_position = fs->current_byte;
 		fs->buffer_offset = 0;
 
-		result = fseeko64(fs->fd, fs->buffer_position, SEEK_SET);
+		if(mpeg3io_wait_readahead(fs, fs->buffer_position, 0) &&
+			fs->readahead_position == fs->buffer_position)
+		{
+// Swap buffers.  The thread only writes readahead_buffer after a new request.
+			unsigned char *temp = fs->buffer;
+			fs->buffer = fs->readahead_buffer;
+			fs->readahead_buffer = temp;
+			fs->buffer_size = fs->readahead_size;
+			fs->readahead_position = -1;
+		}
+		else
+		{
+			result = fseeko64(fs->fd, fs->buffer_position, SEEK_SET);
 //printf("mpeg3io_read_buffer 2 %llx %llx\n", fs->buffer_position, ftell(fs->fd));
-		fs->buffer_size = fread(fs->buffer, 1, MPEG3_IO_SIZE, fs->fd);
+			fs->buffer_size = fread(fs->buffer, 1, MPEG3_IO_SIZE, fs->fd);
+		}
+		fs->stall_time += mpeg3io_time() - start_time;
+
+		if(fs->buffer_size == MPEG3_IO_SIZE)
+			mpeg3io_request_readahead(fs, 
+				fs->buffer_position + MPEG3_IO_SIZE, 
+				MPEG3_IO_SIZE);
 
 
 
@@ -1,4 +1,5 @@
 #include "libmpeg3.h"
+#include "mpeg3protos.h"
 #include <stdlib.h>
 
 
@@ -47,7 +48,7 @@ int main(int argc, char *argv[])
 				chunk_number = file->atrack[0]->total_sample_offsets - 1;
 			printf("sample=%lld offset=0x%llx\n",
 				frame_number,
-				file->atrack[0]->sample_offsets[chunk_number]);
+				mpeg3atrack_sample_offset(file->atrack[0], chunk_number));
 			exit(0);
 		}
 
@@ -61,6 +62,6 @@ int main(int argc, char *argv[])
 			frame_number = file->vtrack[0]->total_frame_offsets - 1;
 		printf("frame=%lld offset=0x%llx\n", 
 			frame_number,
-			file->vtrack[0]->frame_offsets[frame_number]);
+			mpeg3vtrack_frame_offset(file->vtrack[0], frame_number));
 	}
 }
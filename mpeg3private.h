@@ -1,9 +1,11 @@
 #ifndef MPEG3PRIVATE_H
 #define MPEG3PRIVATE_H
 
+#include <endian.h>
 #include <pthread.h>
 
 #include <stdint.h>
+#include <string.h>
 
 #include <stdio.h>
 
@@ -23,7 +25,15 @@
 
 #define MPEG3_TOC_PREFIX                 0x544f4320
 // This decreases with every new version
-#define MPEG3_TOC_VERSION                0x000000fa
+#define MPEG3_TOC_VERSION                0x000000f9
+// Last version with the tables inline.  Still read.
+#define MPEG3_TOC_VERSION_INLINE         0x000000fa
+// Byte order mark of a memory mapped table of contents
+#define MPEG3_TOC_ORDER                  0x01020304
+// Alignment of its sections
+#define MPEG3_TOC_ALIGN                  16
+// Entries in a block of a packed offset table
+#define MPEG3_TOC_BLOCK                  64
 #define MPEG3_ID3_PREFIX                 0x494433
 #define MPEG3_IFO_PREFIX                 0x44564456
 // First byte to read when opening a file
@@ -43,8 +53,11 @@
 #define MPEG3_SYSTEM_START_CODE          0x000001bb
 #define MPEG3_STRLEN                     1024
 #define MPEG3_PIDMAX                     256             /* Maximum number of PIDs in one stream */
+#define MPEG3_TOTAL_PIDS                 0x2000          /* Number of 13 bit PIDs */
 #define MPEG3_PROGRAM_ASSOCIATION_TABLE  0x00
 #define MPEG3_CONDITIONAL_ACCESS_TABLE   0x01
+#define MPEG3_PROGRAM_MAP_TABLE          0x02
+#define MPEG3_PROGRAM_STREAM_MAP         0xbc
 #define MPEG3_PACKET_START_CODE_PREFIX   0x000001
 #define MPEG3_PRIVATE_STREAM_2           0xbf
 #define MPEG3_PADDING_STREAM             0xbe
@@ -57,8 +70,14 @@
 #define MPEG3_AC3_START_CODE             0x0b77
 #define MPEG3_PCM_START_CODE             0x7f7f807f
 #define MPEG3_MAX_CPUS                   256
+/* Default bytes of decoded frames to cache for every video track */
+#define MPEG3_CACHE_SIZE                 0x4000000
+/* Output rows converted by a slice decoder at a time */
+#define MPEG3_OUTPUT_BAND                16
 #define MPEG3_MAX_STREAMS                0x10000
 #define MPEG3_MAX_PACKSIZE               262144
+/* Bytes scanned for stream ID's when opening a file without a table of contents */
+#define MPEG3_PROBE_BYTES                0x1000000
 /* Maximum number of complete subtitles to buffer in a subtitle track */
 /* or number of incomplete subtitles to buffer in demuxer. */
 #define MPEG3_MAX_SUBTITLES              256
@@ -75,10 +94,25 @@
 /* Minimum amount of data required to read a video header in streaming mode. */
 #define MPEG3_VIDEO_STREAM_SIZE          0x1000 
 #define MPEG3_LITTLE_ENDIAN              ((*(uint32_t*)"x\0\0\0") & 0x000000ff)
-/* Number of samples in audio history */
+/* Default number of samples in audio history */
 #define MPEG3_AUDIO_HISTORY              0x100000 
 /* Range to scan for pts after byte seek */
 #define MPEG3_PTS_RANGE                  0x100000 
+/* Payload bytes and packets buffered for every track in shared demuxing */
+#define MPEG3_SHARED_SIZE                0x100000
+#define MPEG3_SHARED_PACKETS             0x1000
+/* Smallest byte range scanned by a thread when building the TOC in parallel */
+#define MPEG3_TOC_RANGE_MIN              0x1000000
+/* Most bytes a range scans past its end looking for the seam with the next */
+#define MPEG3_TOC_OVERLAP                0x800000
+/* Records a track needs past the end of a range before the range stops */
+#define MPEG3_TOC_RECORDS                48
+/* Samples which must match on both sides of an audio seam */
+#define MPEG3_TOC_VERIFY                 0x2000
+/* High and low pairs per channel a range keeps before halving them */
+#define MPEG3_TOC_PAIRS                  0x80000
+/* Last packets of every track stored for extending the TOC */
+#define MPEG3_TOC_POINTS                 256
 
 /* Values for audio format */
 #define AUDIO_UNKNOWN 0
@@ -110,6 +144,22 @@
 #define IFO_PALETTE 0xd
 #define FILE_INFO 0xe
 
+/* Sections in the directory of a memory mapped table of contents */
+/* The records above without the tables */
+#define SECTION_INFO 0x10
+#define SECTION_INDEX 0x11
+#define SECTION_SUBTITLE_OFFSETS 0x12
+/* Packed offset tables */
+#define SECTION_PACKED_SAMPLE_OFFSETS 0x13
+#define SECTION_PACKED_FRAME_OFFSETS 0x14
+#define SECTION_PACKED_KEYFRAMES 0x15
+/* Resume points of the tracks */
+#define SECTION_AUDIO_POINTS 0x16
+#define SECTION_VIDEO_POINTS 0x17
+/* Audio seek tables */
+#define SECTION_PACKED_SEEK_PACKETS 0x18
+#define SECTION_PACKED_SEEK_SAMPLES 0x19
+
 // Combine the pid and the stream id into one unit
 #define CUSTOM_ID(pid, stream_id) (((pid << 8) | stream_id) & 0xffff)
 #define CUSTOM_ID_PID(id) (id >> 8)
@@ -191,7 +241,7 @@ typedef struct
 	FILE *fd;
 	mpeg3_css_t *css;          /* Encryption object */
 	char path[MPEG3_STRLEN];
-	unsigned char *buffer;   /* Readahead buffer */
+	unsigned char *buffer;   /* Readahead buffer or window into mmap_data */
 	int64_t buffer_offset;      /* Current buffer position */
 	int64_t buffer_size;        /* Bytes in buffer */
 	int64_t buffer_position;    /* Byte in file of start of buffer */
@@ -199,6 +249,33 @@ typedef struct
 /* Hypothetical position of file pointer */
 	int64_t current_byte;
 	int64_t total_bytes;
+
+/* MPEG3_IO_STDIO, MPEG3_IO_MMAP, or MPEG3_IO_READAHEAD */
+	int io_mode;
+/* Whole file mapped if mmap succeeded */
+	unsigned char *mmap_data;
+	int64_t mmap_size;
+
+/* Prefetch thread for MPEG3_IO_READAHEAD */
+	int readahead_running;
+	int readahead_done;
+	pthread_t readahead_tid;
+	pthread_mutex_t readahead_lock;
+	pthread_cond_t readahead_cond;
+/* Second buffer filled by the thread */
+	unsigned char *readahead_buffer;
+/* Block requested but not started.  -1 if none */
+	int64_t request_position;
+	int64_t request_size;
+/* Block being read by the thread.  -1 if idle */
+	int64_t busy_position;
+	int64_t busy_size;
+/* Block in readahead_buffer.  -1 if none */
+	int64_t readahead_position;
+	int64_t readahead_size;
+
+/* Microseconds the reader spent waiting for data */
+	int64_t stall_time;
 } mpeg3_fs_t;
 
 
@@ -310,8 +387,117 @@ typedef struct
 
 
 
+// Shared demuxer
+
+/* A packet in a track's ring.  Only the payload for the track is stored. */
+typedef struct
+{
+/* Program byte the packet was read from and the byte after it */
+	int64_t start_byte;
+	int64_t end_byte;
+	int size;
+/* Demuxer was at the end of the file after the packet */
+	int eof;
+	double time;
+/* Presentation time stamp in the packet or -1 */
+	double pts;
+} mpeg3_shared_packet_t;
+
+/* Payload fanned out to one track */
+typedef struct
+{
+	int is_audio;
+	int id;
+/* Byte ring */
+	unsigned char *data;
+	int data_start;
+	int data_size;
+/* Packet ring */
+	mpeg3_shared_packet_t *packets;
+	int packet_start;
+	int total_packets;
+/* Every packet for the track starting on or after this byte is in the ring */
+	int64_t valid_from;
+/* Track reads from the ring instead of its own demuxer */
+	int attached;
+/* Track is waiting for the ring to get a packet */
+	int waiting;
+/* Payload for the packet being parsed by the reader */
+	unsigned char *stage;
+	int stage_size;
+	int stage_allocated;
+	double stage_pts;
+} mpeg3_shared_ring_t;
+
+/* One reader thread parses the stream once for all the tracks */
+typedef struct
+{
+/* mpeg3_t */
+	void *file;
+/* mpeg3_demuxer_t for the reader */
+	void *demuxer;
+	mpeg3_shared_ring_t **rings;
+	int total_rings;
+/* Rings with attached tracks */
+	int total_attached;
+/* Rings with waiting tracks */
+	int total_waiting;
+/* Reader waiting for a track to make room in its ring */
+	int blocked;
+/* Wake the tracks after the packet is committed */
+	int wake;
+/* Reader parsed up to here */
+	int64_t position;
+	int eof;
+/* Seek the reader before parsing the next packet */
+	int restart;
+	int64_t restart_byte;
+	int done;
+	pthread_t tid;
+	pthread_mutex_t lock;
+/* Signalled when the reader has something to do */
+	pthread_cond_t reader_cond;
+/* Signalled when packets are added or the reader hits the end */
+	pthread_cond_t track_cond;
+} mpeg3_shared_t;
+
+
+
+
 // Demuxer
 
+/* Stream ID found in a program or transport stream */
+typedef struct
+{
+	int id;
+/* macro of audio format if audio */
+	int audio;
+/* 1 if video */
+	int video;
+} mpeg3_streamid_t;
+
+/* Streams declared by the PAT and PMT's of a transport stream or by the */
+/* system header and program stream map of a program stream.  Only exists */
+/* while the title is created. */
+typedef struct
+{
+/* 1 after the PAT, system header, or program stream map is read */
+	int got_map;
+/* 1 after a program stream map replaced the system header */
+	int got_psm;
+/* The tables don't list every stream */
+	int incomplete;
+/* PID's of the PMT's and 1 for every PMT that was read */
+	int pmt_pids[MPEG3_PIDMAX];
+	int got_pmt[MPEG3_PIDMAX];
+	int total_pmts;
+/* PID's or stream ID's of the elementary streams */
+	int ids[MPEG3_PIDMAX];
+	int total_ids;
+/* 1 for every PID or stream ID which started a packet */
+	unsigned char started[MPEG3_TOTAL_PIDS];
+} mpeg3_probe_t;
+
 
 
 
@@ -325,8 +511,11 @@ typedef struct
 {
 /* mpeg3_t */
 	void* file;
-/* One unparsed packet.  MPEG3_RAW_SIZE allocated since we don't know the packet size */
+/* One unparsed transport packet.  Points into the I/O buffer if the packet */
+/* is contiguous in it or to raw_buffer if it had to be copied. */
 	unsigned char *raw_data;
+	unsigned char *raw_buffer;
+	int raw_allocated;
 /* Offset in raw_data of read pointer */
 	int raw_offset;
 /* Amount loaded in last raw_data */
@@ -334,7 +523,8 @@ typedef struct
 
 
 /* Elementary stream data when only one stream is to be read. */
-/* Erased in every call to read a packet. */
+/* Erased in every call to read a packet.  The buffers are allocated */
+/* when the first packet for them is read and grow to the largest packet. */
 	unsigned char *data_buffer;
 /* Allocation of data_buffer */
 	int data_allocated;
@@ -387,15 +577,17 @@ typedef struct
 	int64_t last_packet_decryption;
 
 /* Titles */
-	mpeg3_title_t *titles[MPEG3_MAX_STREAMS];
+	mpeg3_title_t **titles;
 	int total_titles;
+	int titles_allocated;
 /* Title currently being used */
 	int current_title;
 	
 
-/* Tables of every stream ID encountered */
-	int astream_table[MPEG3_MAX_STREAMS];  /* macro of audio format if audio  */
-	int vstream_table[MPEG3_MAX_STREAMS];  /* 1 if video */
+/* Every stream ID encountered, sorted by ID */
+	mpeg3_streamid_t *streams;
+	int total_streams;
+	int streams_allocated;
 
 /* Programs */
 	int total_programs;
@@ -423,9 +615,12 @@ typedef struct
 	int adaptation_field_control;
 	int continuity_counter;
 	int is_padding;
+/* PIDs in the order they were found */
 	int pid_table[MPEG3_PIDMAX];
 	int continuity_counters[MPEG3_PIDMAX];
 	int total_pids;
+/* Entry in pid_table + 1 of every PID or 0 if it wasn't found */
+	unsigned short pid_entry[MPEG3_TOTAL_PIDS];
 	int adaptation_fields;
 	double time;           /* Time in seconds */
 	int audio_pid;
@@ -451,6 +646,15 @@ typedef struct
 	double pes_video_time;  /* Presentation Time stamps */
 /* Cause the stream parameters to be dumped in human readable format */
 	int dump;
+/* Ring the track reads from in shared demuxing */
+	mpeg3_shared_ring_t *ring;
+/* End of file flag of the last packet taken from the ring.  -1 if the */
+/* last packet was read by this demuxer. */
+	int shared_eof;
+/* Set in the reader's demuxer in shared demuxing */
+	mpeg3_shared_t *shared;
+/* Declared streams while the title is created.  0 otherwise. */
+	mpeg3_probe_t *probe;
 } mpeg3_demuxer_t;
 
 
@@ -481,7 +685,7 @@ typedef struct
 
 typedef struct
 {
-	uint32_t bfr;  /* bfr = buffer for bits */
+	uint64_t bfr;  /* bfr = buffer for bits */
 	int bit_number;   /* position of pointer in bfr */
 	int bfr_size;    /* number of bits in bfr.  Should always be a multiple of 8 */
 	void *file;    /* Mpeg2 file */
@@ -616,7 +820,7 @@ typedef struct
 	int bitrate;
 	int flags;
 	int channels;
-	void *state;  /* a52_state_t */
+	void *state;  /* a52_state_t or mpeg3_ac3_state_t */
 	void *output; /* sample_t */
 	int framesize;
 } mpeg3_ac3_t;
@@ -672,14 +876,22 @@ typedef struct
 	int framesize;
 /* First byte of audio data in the file */
 	int64_t start_byte;
-/* Output from synthesizer in linear floats */
+/* Output from synthesizer in linear floats.  Each channel is a ring */
+/* buffer of output_allocated samples followed by MAXFRAMESAMPLES for */
+/* frames which wrap around the end. */
 	float **output;           
+/* Channels allocated in output */
+	int output_channels;
 /* Number of pcm samples in the buffer */
 	int output_size;         
 /* Allocated number of samples in output */
 	int output_allocated;    
 /* Sample position in file of start of output buffer */
 	int output_position;     
+/* Index in output of the sample at output_position */
+	int output_start;
+/* Samples kept before the current position for rereading */
+	int history;
 
 /* Perform a seek to the sample */
 	int sample_seek;
@@ -709,8 +921,41 @@ typedef struct
 	int index_size;
 /* Downsampling of index buffers when constructing index */
 	int index_zoom;
+/* index_data points into a memory mapped table of contents */
+	int mapped;
 } mpeg3_index_t;
 
+/* Entry in the directory of a memory mapped table of contents. */
+/* Stored in the byte order of the machine which wrote it. */
+typedef struct
+{
+	uint32_t type;
+	uint32_t track;
+	uint64_t offset;
+	uint64_t count;
+	uint64_t bytes;
+} mpeg3_tocsection_t;
+
+/* Block of a packed offset table.  The blocks are at the start of the */
+/* section.  Each entry is stored in bits bits as the difference from base, */
+/* least significant bit first, starting offset bytes into the section. */
+/* The data is followed by 8 bytes of padding so every entry can be read */
+/* with one 8 byte load. */
+typedef struct
+{
+	int64_t base;
+	uint32_t offset;
+	uint32_t bits;
+} mpeg3_tocblock_t;
+
+/* Packet of a track which changed the number of frames or samples and the */
+/* number after it.  Used to line up a new scan with an old TOC. */
+typedef struct
+{
+	int64_t packet;
+	int64_t count;
+} mpeg3_tocpoint_t;
+
 
 
 typedef struct
@@ -736,8 +981,32 @@ typedef struct
 	int sample_offsets_allocated;
 /* If this sample offset table must be deleted by the track */
 	int private_offsets;
-/* End of stream in table of contents construction */
+/* Replaces sample_offsets when the TOC has packed tables */
+	unsigned char *packed_sample_offsets;
+/* End of stream in table of contents construction or from the TOC */
 	int64_t audio_eof;
+/* Ring of the last MPEG3_TOC_POINTS resume points */
+	mpeg3_tocpoint_t *toc_points;
+	int total_toc_points;
+/* Seek table.  The packet and the first sample of the first frame */
+/* starting in the packet.  Private to the track when the TOC is being */
+/* created.  Replaced by the packed tables when the TOC is read. */
+	int64_t *seek_packets;
+	int64_t *seek_samples;
+	int total_seek_points;
+	int seek_points_allocated;
+	unsigned char *packed_seek_packets;
+	unsigned char *packed_seek_samples;
+/* Packets whose payload is still in the demuxer when the TOC is being */
+/* created and the offset of each payload in the track.  Oldest first. */
+	int64_t *payload_packets;
+	int64_t *payload_offsets;
+	int total_payloads;
+	int payloads_allocated;
+/* Bytes of payload appended to the demuxer */
+	int64_t payload_bytes;
+/* Packet of the last frame found */
+	int64_t frame_packet;
 
 
 
@@ -845,10 +1114,8 @@ typedef struct
 	int buffer_size;         /* Size of buffer */
 	int buffer_allocation;   /* Space allocated for buffer  */
 	int current_position;    /* Position in buffer */
-	uint32_t bits;
+	uint64_t bits;
 	int bits_size;
-	pthread_mutex_t completion_lock; /* Lock slice until completion */
-	int done;           /* Signal for slice decoder to skip */
 } mpeg3_slice_buffer_t;
 
 /* Each slice decoder */
@@ -857,18 +1124,17 @@ typedef struct
 	void *video;     /* mpeg3video_t */
 	mpeg3_slice_buffer_t *slice_buffer;
 
-	int thread_number;      /* Number of this thread */
-	int current_buffer;     /* Buffer this slice decoder is on */
-	int buffer_step;        /* Number of buffers to skip */
-	int last_buffer;        /* Last buffer this decoder should process */
+	int thread_number;      /* Number of this thread.  0 runs in the caller. */
+	int picture_number;     /* Last picture this decoder was started on */
 	int fault;
 	int done;
 	int quant_scale;
 	int pri_brk;                  /* slice/macroblock */
+	int first_macroblock;         /* Macroblocks reconstructed by the last slice */
+	int last_macroblock;
 	short block[12][64];
 	int sparse[12];
 	pthread_t tid;   /* ID of thread */
-	pthread_mutex_t input_lock, output_lock, completion_lock;
 } mpeg3_slice_t;
 
 typedef struct 
@@ -888,15 +1154,76 @@ typedef struct
 	int u_size;
 	int v_size;
 	int64_t frame_number;
+	int next_hash;            /* Next frame in the hash bucket or the free list */
+	int prev, next;           /* Neighbors in the LRU list */
 } mpeg3_cacheframe_t;
 
 typedef struct
 {
 	mpeg3_cacheframe_t *frames;
-	int total;
+	int total;                /* Frames in the cache */
 	int allocation;
+	int *hash;                /* First frame in every bucket or -1 */
+	int hash_size;
+	int free_frames;          /* First unused entry in frames or -1 */
+	int lru_head, lru_tail;   /* Most and least recently used frames */
+	int64_t bytes;            /* Bytes in the cached frames */
+	int64_t max_bytes;        /* The least recently used frames are dropped above this */
+	int64_t hits, misses, evictions;
 } mpeg3_cache_t;
 
+/* Motion compensation for 1 block */
+typedef void (*mpeg3_recon_t)(unsigned char *src, 
+	unsigned char *dst, 
+	int lx, 
+	int lx2, 
+	int h);
+
+/* State of the picture being decoded.  Every header read changes it. */
+typedef struct
+{
+	int found_seqhdr;
+	int bitrate;
+	mpeg3_timecode_t gop_timecode;     /* Timecode for the last GOP header read. */
+	int has_gops; /* Some streams have no GOPs so try sequence start codes instead */
+
+/* Frames from yuv_buffer.  2 refframes are swapped in and out */
+/* while only 1 auxframe is used. */
+	unsigned char *oldrefframe[3], *refframe[3], *auxframe[3];
+/* Rotated in while a B frame is decoded in the background */
+	unsigned char *spareframe[3], *spareauxframe[3];
+// Source for the next frame presentation
+	unsigned char *output_src[3];
+/* Pointers to frame buffers. */
+	unsigned char *newframe[3];
+	int horizontal_size, vertical_size, mb_width, mb_height;
+	int coded_picture_width,  coded_picture_height;
+	int chroma_format, chrom_width, chrom_height, blk_cnt;
+	int pict_type;
+	int field_sequence;
+	int forw_r_size, back_r_size, full_forw, full_back;
+	int prog_seq, prog_frame;
+	int h_forw_r_size, v_forw_r_size, h_back_r_size, v_back_r_size;
+	int dc_prec, pict_struct, topfirst, frame_pred_dct, conceal_mv;
+	int intravlc;
+	int repeatfirst;
+/* Number of times to repeat the current frame * 100 since floating point is impossible in MMX */
+	int repeat_count;
+/* Number of times the current frame has been repeated * 100 */
+	int current_repeat;
+	int secondfield;
+	int stwc_table_index, llw, llh, hm, hn, vm, vn;
+	int lltempref, llx0, lly0, llprog_frame, llfieldsel;
+	int matrix_coefficients;
+	int framerate_code;
+	double frame_rate;
+	int intra_quantizer_matrix[64], non_intra_quantizer_matrix[64];
+	int chroma_intra_quantizer_matrix[64], chroma_non_intra_quantizer_matrix[64];
+	int mpeg2;
+	int qscale_type, altscan;      /* picture coding extension */
+	int pict_scal;                /* picture spatial scalable extension */
+	int scalable_mode;            /* sequence scalable extension */
+} mpeg3_picture_t;
 
 typedef struct
 {
@@ -917,10 +1244,43 @@ typedef struct
 	mpeg3_slice_t slice_decoders[MPEG3_MAX_CPUS];  /* One slice decoder for every CPU */
 	int total_slice_decoders;                       /* Total slice decoders in use */
 	mpeg3_slice_buffer_t slice_buffers[MPEG3_MAX_CPUS];   /* Buffers for holding the slice data */
-	int total_slice_buffers;         /* Total buffers in the array to be decompressed */
+	int total_slice_buffers;         /* Total buffers loaded for the decoders */
+	int slice_buffers_loaded;        /* Set when the picture has no more buffers */
 	int slice_buffers_initialized;     /* Total buffers initialized in the array */
-	pthread_mutex_t slice_lock;      /* Lock slice array while getting the next buffer */
+	int next_slice_buffer;           /* Next buffer to decode.  Incremented atomically. */
+	int picture_number;              /* Incremented to start the slice decoders on a picture */
+	int busy_slice_decoders;         /* Slice decoders still working on the picture */
+	pthread_mutex_t slice_lock;      /* Lock the picture state */
+	pthread_cond_t slice_start;      /* Signalled when a picture is started */
+	pthread_cond_t slice_done;       /* Signalled when the last decoder is done */
+	pthread_cond_t slice_loaded;     /* Signalled when buffers are loaded or rows are reconstructed */
 	pthread_mutex_t test_lock;
+	int async_slices;                /* All decoders are threads and get_macroblocks doesn't wait */
+
+/* Output conversion in row bands on the slice decoders */
+	int early_output;                /* Allow bands to start while the picture is decoded */
+	int output_done;                 /* The output was converted while the picture was decoded */
+	unsigned char *output_band_src[3]; /* Frame being converted */
+	int total_output_bands;          /* Bands to convert.  0 if none are being converted. */
+	int next_output_band;            /* Next band to convert.  Incremented atomically. */
+	int *mb_rows_done;               /* Macroblocks reconstructed in every row */
+	int mb_rows_allocated;
+	int mb_rows_ready;               /* Rows from the top which are reconstructed */
+	int finished_slice_buffers;      /* Slices reconstructed in the picture */
+
+/* Frame parallel decoding */
+	void *bframe_video;      /* mpeg3video_t decoding B frames in the background */
+	int bframe_pending;      /* B frame started on bframe_video but not waited for */
+	int decode_ahead;        /* Allow the next picture to be decoded with a B frame */
+	int ahead_valid;         /* ahead_picture contains the next picture */
+	int ahead_result;        /* Result of decoding the next picture */
+	mpeg3_picture_t *ahead_picture;  /* Picture state after the next picture */
+	unsigned char *spare_buffer[2];  /* Frames for spareframe and spareauxframe */
+
+/* Picture being decoded.  Points to one of pictures and is exchanged */
+/* with ahead_picture. */
+	mpeg3_picture_t *picture;
+	mpeg3_picture_t pictures[2];
 
 	int blockreadsize;
 	int maxframe;         /* Max value of frame num to read */
@@ -928,10 +1288,7 @@ typedef struct
 	int frame_seek;        /* Perform a frame seek before the next frame is read */
 	int framenum;         /* Number of the next frame to be decoded */
 	int last_number;       /* Last framenum rendered */
-	int found_seqhdr;
-	int bitrate;
-	mpeg3_timecode_t gop_timecode;     /* Timecode for the last GOP header read. */
-	int has_gops; /* Some streams have no GOPs so try sequence start codes instead */
+	int skip_bframes;
 
 /* These are only available from elementary streams. */
 	int frames_per_gop;       /* Frames per GOP after the first GOP. */
@@ -940,47 +1297,17 @@ typedef struct
 	int last_frame;      /* Last frame in file */
 
 /* ================================= Compression variables ===================== */
-/* Malloced frame buffers.  2 refframes are swapped in and out. */
-/* while only 1 auxframe is used. */
+/* Malloced frame buffers */
 	unsigned char *yuv_buffer[5];  /* Make YVU buffers contiguous for all frames */
-	unsigned char *oldrefframe[3], *refframe[3], *auxframe[3];
 	unsigned char *llframe0[3], *llframe1[3];
 	unsigned char *mpeg3_zigzag_scan_table;
 	unsigned char *mpeg3_alternate_scan_table;
-// Source for the next frame presentation
-	unsigned char *output_src[3];
-/* Pointers to frame buffers. */
-	unsigned char *newframe[3];
-	int horizontal_size, vertical_size, mb_width, mb_height;
-	int coded_picture_width,  coded_picture_height;
-	int chroma_format, chrom_width, chrom_height, blk_cnt;
-	int pict_type;
-	int field_sequence;
-	int forw_r_size, back_r_size, full_forw, full_back;
-	int prog_seq, prog_frame;
-	int h_forw_r_size, v_forw_r_size, h_back_r_size, v_back_r_size;
-	int dc_prec, pict_struct, topfirst, frame_pred_dct, conceal_mv;
-	int intravlc;
-	int repeatfirst;
-/* Number of times to repeat the current frame * 100 since floating point is impossible in MMX */
-	int repeat_count;
-/* Number of times the current frame has been repeated * 100 */
-	int current_repeat;
-	int secondfield;
-	int skip_bframes;
-	int stwc_table_index, llw, llh, hm, hn, vm, vn;
-	int lltempref, llx0, lly0, llprog_frame, llfieldsel;
-	int matrix_coefficients;
-	int framerate_code;
-	double frame_rate;
+/* IDCT for the CPU */
+	void (*idct_conversion)(short *block);
+/* Motion compensation for the CPU */
+	mpeg3_recon_t *recon_table;
 	int *cr_to_r, *cr_to_g, *cb_to_g, *cb_to_b;
 	int *cr_to_r_ptr, *cr_to_g_ptr, *cb_to_g_ptr, *cb_to_b_ptr;
-	int intra_quantizer_matrix[64], non_intra_quantizer_matrix[64];
-	int chroma_intra_quantizer_matrix[64], chroma_non_intra_quantizer_matrix[64];
-	int mpeg2;
-	int qscale_type, altscan;      /* picture coding extension */
-	int pict_scal;                /* picture spatial scalable extension */
-	int scalable_mode;            /* sequence scalable extension */
 
 /* Subtitling frame */
 	unsigned char *subtitle_frame[3];
@@ -1000,6 +1327,7 @@ typedef struct
 
 
 
+
 typedef struct
 {
 	int width;
@@ -1026,13 +1354,19 @@ typedef struct
 	int64_t *keyframe_numbers;
 	int total_keyframe_numbers;
 	int keyframe_numbers_allocated;
+/* Replace frame_offsets and keyframe_numbers when the TOC has packed tables */
+	unsigned char *packed_frame_offsets;
+	unsigned char *packed_keyframe_numbers;
 /* Starting byte of previous packet for making TOC */
 	int64_t prev_offset;
 /* Starting byte of previous packet when the start code was found. */
 /* Used for headers which require multiple packets. */
 	int64_t prev_frame_offset;
-/* End of stream in table of contents construction */
+/* End of stream in table of contents construction or from the TOC */
 	int64_t video_eof;
+/* Ring of the last MPEG3_TOC_POINTS resume points */
+	mpeg3_tocpoint_t *toc_points;
+	int total_toc_points;
 	int got_top;
 	int got_keyframe;
 
@@ -1075,6 +1409,180 @@ typedef struct
 
 
 
+// Parallel table of contents
+
+/* Video track after a packet which added frames */
+typedef struct
+{
+	int64_t packet;
+/* Frames in the track after the packet */
+	int frames;
+/* State of the frame scanner.  Ranges agree on the following frames */
+/* once this matches. */
+	int remaining;
+	int64_t prev_frame_offset;
+	int got_top;
+	int got_keyframe;
+	int repeat_count;
+	int current_repeat;
+	int pict_struct;
+	int prog_seq;
+	int found_seqhdr;
+	int mpeg2;
+	uint32_t bfr;
+	int bit_number;
+	int bfr_size;
+} mpeg3_tocframe_t;
+
+/* Audio track after a packet which decoded samples */
+typedef struct
+{
+	int64_t packet;
+/* Start of the previous packet of the track.  Chunks ending in this */
+/* packet point to it. */
+	int64_t prev_offset;
+/* Samples decoded by the range after the packet */
+	int64_t samples;
+/* Packets without samples before this one */
+	int idle;
+/* State of the decoder */
+	int remaining;
+	int packet_position;
+} mpeg3_tocchunk_t;
+
+/* Track found by a range */
+typedef struct
+{
+	int pid;
+	mpeg3_atrack_t *atrack;
+	mpeg3_vtrack_t *vtrack;
+/* Packet the track was created in */
+	int64_t created;
+/* Start of the last packet of the track */
+	int64_t prev_offset;
+/* Records after the end of the range */
+	int overlap;
+
+/* Keyframe flag of every frame */
+	unsigned char *keyframes;
+	int keyframes_allocated;
+	int total_keyframes;
+	mpeg3_tocframe_t *frames;
+	int total_frames;
+	int frames_allocated;
+
+	mpeg3_tocchunk_t *chunks;
+	int total_chunks;
+	int chunks_allocated;
+/* Packets without samples after the last chunk */
+	int idle;
+	int channels;
+	int64_t samples;
+/* High and low pairs of every zoom samples.  0 until samples are decoded. */
+/* The zoom is doubled up to the largest power of 2 dividing every frame. */
+	int zoom;
+	int max_zoom;
+	float **pairs;
+	int total_pairs;
+	int pairs_allocated;
+
+/* Stitched tables when this is the last range of the track */
+	int stitched;
+	mpeg3_vtrack_t *stitched_vtrack;
+	mpeg3_atrack_t *stitched_atrack;
+	mpeg3_index_t *stitched_index;
+	int64_t stitched_samples;
+/* Samples in the range before its first sample in the stitched track */
+	int64_t delta;
+} mpeg3_toctrack_t;
+
+/* Byte range of the file scanned by one thread */
+typedef struct
+{
+/* mpeg3_tocsplit_t */
+	void *split;
+/* mpeg3_t opened for the range */
+	void *file;
+	int64_t start_byte;
+	int64_t end_byte;
+/* Scanned up to here */
+	int64_t position;
+	int eof;
+	int failed;
+	int done;
+/* Parallel to the tracks of the file */
+	mpeg3_toctrack_t **atracks;
+	int total_atracks;
+	mpeg3_toctrack_t **vtracks;
+	int total_vtracks;
+	pthread_t tid;
+} mpeg3_tocrange_t;
+
+/* Ranges building the TOC for the file returned by mpeg3_start_toc */
+typedef struct
+{
+/* mpeg3_t */
+	void *file;
+	int64_t total_bytes;
+	mpeg3_tocrange_t **ranges;
+	int total_ranges;
+	int total_started;
+/* Ranges which have finished */
+	int total_done;
+/* Stop the ranges */
+	int abort;
+	int stitched;
+	pthread_mutex_t lock;
+/* Signalled when a range makes progress */
+	pthread_cond_t cond;
+} mpeg3_tocsplit_t;
+
+/* Track of a TOC being extended */
+typedef struct
+{
+	int pid;
+	int is_audio;
+/* Tables of the old TOC up to where the new scan takes over */
+	mpeg3_atrack_t *atrack;
+	mpeg3_index_t *index;
+	mpeg3_vtrack_t *vtrack;
+/* Resume points of the old TOC */
+	mpeg3_tocpoint_t *points;
+	int total_points;
+/* The points go back to the start of the track so the new scan repeats */
+/* the old one from the start of the file. */
+	int whole;
+/* Next point to compare with the new scan */
+	int point;
+/* Old count minus new count for the points matched in a row */
+	int64_t delta;
+	int matched;
+/* Old count and new count of the first of them */
+	int64_t first_count;
+	int64_t first_local;
+/* The new scan took over the tables */
+	int done;
+} mpeg3_tocresume_t;
+
+/* How the streams were found when opening a file without a table of contents */
+#define MPEG3_PROBE_NONE                 0   /* Nothing to scan */
+#define MPEG3_PROBE_SCAN                 1   /* Scanned up to MPEG3_PROBE_BYTES */
+#define MPEG3_PROBE_TABLES               2   /* Stopped when every declared stream was found */
+
+typedef struct
+{
+	int method;
+/* Bytes read to find the streams */
+	int64_t bytes;
+/* Microseconds spent */
+	int64_t time;
+} mpeg3_probe_stats_t;
+
+
+
+
+
+
 
 
 // Whole thing
@@ -1087,16 +1595,32 @@ typedef struct
 
 /* Media specific */
 	int total_astreams;
-	mpeg3_atrack_t *atrack[MPEG3_MAX_STREAMS];
+	int atracks_allocated;
+	mpeg3_atrack_t **atrack;
 	int total_vstreams;
-	mpeg3_vtrack_t *vtrack[MPEG3_MAX_STREAMS];
+	int vtracks_allocated;
+	mpeg3_vtrack_t **vtrack;
 	int total_sstreams;
-	mpeg3_strack_t *strack[MPEG3_MAX_STREAMS];
+	int stracks_allocated;
+	mpeg3_strack_t **strack;
 
 /* Table of contents storage */
 	int64_t **frame_offsets;
 	int64_t **sample_offsets;
 	int64_t **keyframe_numbers;
+/* Packed tables in the memory mapped TOC */
+	unsigned char **packed_frame_offsets;
+	unsigned char **packed_sample_offsets;
+	unsigned char **packed_keyframe_numbers;
+/* Resume points in the memory mapped TOC */
+	mpeg3_tocpoint_t **audio_points;
+	int *total_audio_points;
+	mpeg3_tocpoint_t **video_points;
+	int *total_video_points;
+/* Packed seek tables in the memory mapped TOC */
+	unsigned char **packed_seek_packets;
+	unsigned char **packed_seek_samples;
+	int *total_seek_points;
 	int64_t *video_eof;
 	int64_t *audio_eof;
 	int *total_frame_offsets;
@@ -1113,6 +1637,8 @@ typedef struct
 /* Number of bytes to devote to the index of a single track in the index */
 /* building process. */
 	int64_t index_bytes;
+/* Samples between the audio seek points stored in the TOC.  0 for none. */
+	int seek_samples;
 
 /* Only one of these is set to 1 to specify what kind of stream we have. */
 	int is_transport_stream;
@@ -1134,12 +1660,37 @@ typedef struct
 /* Number of program to play */
 	int program;
 	int cpus;
+/* Samples of audio history for every audio track */
+	int audio_history;
+/* Threads decoding B frames in parallel with the next picture */
+	int bframe_cpus;
+/* I/O backend given to every mpeg3_fs_t opened for this file */
+	int io_mode;
+/* Reader thread for all the tracks if shared demuxing is on */
+	mpeg3_shared_t *shared;
 
 /* Filesystem is seekable.  Also means the file isn't a stream. */
 	int seekable;
 
 /* For building TOC, the output file. */
 	FILE *toc_fd;
+/* Path of the TOC.  The output file is the path with .new appended until */
+/* it's complete and renamed over the old TOC. */
+	char toc_path[MPEG3_STRLEN];
+/* Memory mapped table of contents.  The tables of the tracks point into it. */
+	unsigned char *toc_map;
+	int64_t toc_map_size;
+/* Threads building the TOC from byte ranges of the file */
+	mpeg3_tocsplit_t *toc_split;
+/* Range scanned when this is one of them */
+	mpeg3_tocrange_t *toc_range;
+/* Tracks of the old TOC when extending it */
+	mpeg3_tocresume_t **toc_resume;
+	int total_resume;
+/* A track of the new scan didn't line up with the old TOC */
+	int resume_failed;
+/* Read a TOC whose source has changed */
+	int ignore_source_date;
 
 /*
  * After byte seeking is called, this is set to -1.
@@ -1158,6 +1709,12 @@ typedef struct
 /* Date of source file index was created from. */
 /* Used to compare DVD source file to table of contents source. */
 	int64_t source_date;
+/* Size of the source file.  0 if the TOC didn't store it. */
+	int64_t source_size;
+/* Path of the source file as it's stored in the table of contents */
+	char source_path[MPEG3_STRLEN];
+/* How the streams were found when the file was opened */
+	mpeg3_probe_stats_t probe_stats;
 } mpeg3_t;
 
 
@@ -45,6 +45,17 @@ int mpeg3_create_title(mpeg3_demuxer_t *demuxer, FILE *toc);
 int mpeg3_delete_title(mpeg3_title_t *title);
 
 int mpeg3demux_copy_titles(mpeg3_demuxer_t *dst, mpeg3_demuxer_t *src);
+/* Add a title to the end of the demuxer's titles and return it */
+mpeg3_title_t* mpeg3demux_append_title(mpeg3_demuxer_t *demuxer,
+	mpeg3_title_t *title);
+
+/* Stream ID's encountered by the demuxer.  0 if the ID wasn't found. */
+int mpeg3demux_audio_stream(mpeg3_demuxer_t *demuxer, int id);
+int mpeg3demux_video_stream(mpeg3_demuxer_t *demuxer, int id);
+void mpeg3demux_set_audio_stream(mpeg3_demuxer_t *demuxer, int id, int format);
+void mpeg3demux_set_video_stream(mpeg3_demuxer_t *demuxer, int id, int value);
+/* Every stream declared by the stream tables has started a packet */
+int mpeg3demux_probe_done(mpeg3_demuxer_t *demuxer);
 
 /* Called by mpeg3_open for a single file */
 int mpeg3demux_create_title(mpeg3_demuxer_t *demuxer, 
@@ -59,8 +70,17 @@ mpeg3_atrack_t* mpeg3_new_atrack(mpeg3_t *file,
 	mpeg3_demuxer_t *demuxer,
 	int number);
 int mpeg3_delete_atrack(mpeg3_t *file, mpeg3_atrack_t *atrack);
+/* Add a track to the end of the file's audio tracks and return it */
+mpeg3_atrack_t* mpeg3_append_atrack(mpeg3_t *file, mpeg3_atrack_t *atrack);
 
 void mpeg3_append_samples(mpeg3_atrack_t *atrack, int64_t offset);
+/* Add a point to the seek table */
+void mpeg3_append_seek(mpeg3_atrack_t *atrack, int64_t packet, int64_t sample);
+/* Note bytes of payload from packet appended to the demuxer for the TOC */
+void mpeg3_append_payload(mpeg3_atrack_t *atrack, int64_t packet, int bytes);
+/* Add the first frame of a packet to the seek table.  offset is the */
+/* payload byte where the frame starts. */
+void mpeg3_seek_frame(mpeg3_atrack_t *atrack, int64_t offset, int64_t sample);
 
 
 /* These return 1 on failure and 0 on success */
@@ -73,6 +93,8 @@ mpeg3_vtrack_t* mpeg3_new_vtrack(mpeg3_t *file,
 	mpeg3_demuxer_t *demuxer,
 	int number);
 int mpeg3_delete_vtrack(mpeg3_t *file, mpeg3_vtrack_t *vtrack);
+/* Add a track to the end of the file's video tracks and return it */
+mpeg3_vtrack_t* mpeg3_append_vtrack(mpeg3_t *file, mpeg3_vtrack_t *vtrack);
 
 void mpeg3_append_frame(mpeg3_vtrack_t *vtrack, int64_t offset, int is_keyframe);
 
@@ -82,6 +104,8 @@ void mpeg3_append_frame(mpeg3_vtrack_t *vtrack, int64_t offset, int is_keyframe)
 mpeg3_strack_t* mpeg3_new_strack(int id);
 void mpeg3_delete_strack(mpeg3_strack_t *ptr);
 void mpeg3_copy_strack(mpeg3_strack_t *dst, mpeg3_strack_t *src);
+/* Add a track to the end of the file's subtitle tracks and return it */
+mpeg3_strack_t* mpeg3_append_strack(mpeg3_t *file, mpeg3_strack_t *strack);
 
 int mpeg3_subtitle_tracks(mpeg3_t *file);
 
@@ -123,10 +147,28 @@ int mpeg3audio_decode_audio(mpeg3audio_t *audio,
 	short *output_i, 
 	int channel,
 	int len);
+/* Decode up to len samples of every channel into an array per channel. */
+int mpeg3audio_decode_planar(mpeg3audio_t *audio, 
+	float **output_f, 
+	short **output_i, 
+	int len);
+/* Decode up to len samples of every channel interleaved into one array. */
+int mpeg3audio_decode_interleaved(mpeg3audio_t *audio, 
+	float *output_f, 
+	short *output_i, 
+	int len);
 
 /* Shift the audio by the number of samples */
 /* Used by table of contents routines and decode_audio */
 void mpeg3_shift_audio(mpeg3audio_t *audio, int diff);
+/* Index in the output ring buffer of a sample position */
+int mpeg3audio_output_index(mpeg3audio_t *audio, int position);
+/* Pointer to len contiguous samples of a channel of the output starting */
+/* at position.  len can't be more than MAXFRAMESAMPLES. */
+float* mpeg3audio_output(mpeg3audio_t *audio, 
+	int channel, 
+	int position, 
+	int len);
 
 
 /* Audio consists of many possible formats, each packetized into frames. */
@@ -203,7 +245,7 @@ int mpeg3audio_dolayer2(mpeg3_layer_t *audio,
 
 /* Decode a frame of ac3 audio */
 int mpeg3audio_doac3(mpeg3_ac3_t *audio, 
-	char *frame, 
+	unsigned char *frame, 
 	int frame_size, 
 	float **output,
 	int render);
@@ -267,12 +309,21 @@ int mpeg3_read_yuvframe(mpeg3_t *file,
 		int in_w,
 		int in_h,
 		int stream);
-// cache_it - store dropped frames in cache
-int mpeg3video_drop_frames(mpeg3video_t *video, long frames, int cache_it);
+// cache_from - store dropped frames from this frame number on in the cache.
+// -1 stores nothing.
+int mpeg3video_drop_frames(mpeg3video_t *video, long frames, long cache_from);
 void mpeg3_decode_subtitle(mpeg3video_t *video);
 
 void mpeg3video_calc_dmv(mpeg3video_t *video, int DMV[][2], int *dmvector, int mvx, int mvy);
 void mpeg3video_idct_conversion(short *block);
+void mpeg3video_idct_sse2(short *block);
+void mpeg3video_idct_avx2(short *block);
+void mpeg3video_init_idct(mpeg3video_t *video);
+void mpeg3video_init_recon(mpeg3video_t *video);
+int mpeg3video_check_idct();
+int mpeg3video_check_recon();
+int mpeg3video_check_dither();
+extern mpeg3_recon_t mpeg3video_recon_c[16];
 void mpeg3video_motion_vector(mpeg3_slice_t *slice, mpeg3video_t *video, int *PMV, int *dmvector, int h_r_size, int v_r_size, int dmv, int mvscale, int full_pel_vector);
 int mpeg3video_clearblock(mpeg3_slice_t *slice, int comp, int size);
 int mpeg3video_colormodel(mpeg3video_t *video);
@@ -287,8 +338,18 @@ int mpeg3video_getintrablock(mpeg3_slice_t *slice, mpeg3video_t *video, int comp
 int mpeg3video_getmpg2interblock(mpeg3_slice_t *slice, mpeg3video_t *video, int comp);
 int mpeg3video_getmpg2intrablock(mpeg3_slice_t *slice, mpeg3video_t *video, int comp, int dc_dct_pred[]);
 int mpeg3video_getpicture(mpeg3video_t *video, int framenum);
+void mpeg3video_wait_slices(mpeg3video_t *video);
+void mpeg3video_start_bands(mpeg3video_t *video, unsigned char **src, int rows_ready);
+void mpeg3video_present_bands(mpeg3video_t *video, unsigned char **src);
+int mpeg3video_dither_band(mpeg3video_t *video, int band);
+int mpeg3video_band_mb_row(mpeg3video_t *video, int band);
+int mpeg3video_allocate_decoders(mpeg3video_t *video, int decoder_count);
+int mpeg3video_new_bframe_video(mpeg3video_t *video);
+void mpeg3video_drop_ahead(mpeg3video_t *video);
 int mpeg3video_getslicehdr(mpeg3_slice_t *slice, mpeg3video_t *video);
 int mpeg3video_init_output(void);
+void mpeg3video_init_yuv_tables(mpeg3video_t *video);
+int* mpeg3video_get_scaletable(int input_w, int output_w);
 int mpeg3video_macroblock_modes(mpeg3_slice_t *slice, mpeg3video_t *video, int *pmb_type, int *pstwtype, int *pstwclass, int *pmotion_type, int *pmv_count, int *pmv_format, int *pdmv, int *pmvscale, int *pdct_type);
 int mpeg3video_motion_vectors(mpeg3_slice_t *slice, mpeg3video_t *video, int PMV[2][2][2], int dmvector[2], int mv_field_sel[2][2], int s, int mv_count, int mv_format, int h_r_size, int v_r_size, int dmv, int mvscale);
 int mpeg3video_present_frame(mpeg3video_t *video);
@@ -332,9 +393,11 @@ int mpeg3_cache_get_frame(mpeg3_cache_t *ptr,
 	unsigned char **y,
 	unsigned char **u,
 	unsigned char **v);
-int mpeg3_ceche_has_frame(mpeg3_cache_t *ptr,
+int mpeg3_cache_has_frame(mpeg3_cache_t *ptr,
 	int64_t frame_number);
 int64_t mpeg3_cache_usage(mpeg3_cache_t *ptr);
+// Drop frames until the cache fits in bytes.  0 disables caching.
+void mpeg3_cache_set_size(mpeg3_cache_t *ptr, int64_t bytes);
 
 
 
@@ -353,9 +416,29 @@ int mpeg3_copy_fs(mpeg3_fs_t *dst, mpeg3_fs_t *src);
 int mpeg3_delete_fs(mpeg3_fs_t *fs);
 int mpeg3io_open_file(mpeg3_fs_t *fs);
 int mpeg3io_close_file(mpeg3_fs_t *fs);
+int mpeg3io_map_file(mpeg3_fs_t *fs);
+int mpeg3io_start_readahead(mpeg3_fs_t *fs);
+int mpeg3io_stop_readahead(mpeg3_fs_t *fs);
 int mpeg3io_seek(mpeg3_fs_t *fs, int64_t byte);
 int mpeg3io_seek_relative(mpeg3_fs_t *fs, int64_t bytes);
 int mpeg3io_read_data(unsigned char *buffer, int64_t bytes, mpeg3_fs_t *fs);
+int mpeg3io_scan_char(mpeg3_fs_t *fs, int c);
+/* Microseconds since the epoch */
+int64_t mpeg3io_time();
+/* Offset of the first or last 00 00 01 xx start code lying entirely between */
+/* start and end or -1 if there is none. */
+int mpeg3_find_startcode(unsigned char *buffer, int start, int end);
+int mpeg3_rfind_startcode(unsigned char *buffer, int start, int end);
+/* 32 bit code starting at ptr */
+#define mpeg3_get_code(ptr) \
+	(((uint32_t)(ptr)[0] << 24) | ((ptr)[1] << 16) | ((ptr)[2] << 8) | (ptr)[3])
+/* 64 big endian bits starting at ptr in a single load */
+static inline uint64_t mpeg3_get_code64(unsigned char *ptr)
+{
+	uint64_t code;
+	memcpy(&code, ptr, sizeof(code));
+	return be64toh(code);
+}
 
 void mpeg3io_complete_path(char *complete_path, char *path);
 void mpeg3io_get_directory(char *directory, char *path);
@@ -471,6 +554,122 @@ int mpeg3_finished_subtitles(mpeg3_demuxer_t *demuxer, int id);
 unsigned char mpeg3demux_read_char_packet(mpeg3_demuxer_t *demuxer);
 unsigned char mpeg3demux_read_prev_char_packet(mpeg3_demuxer_t *demuxer);
 
+
+/* SHARED DEMUXER */
+
+/* Start a reader thread feeding all the tracks of the file */
+mpeg3_shared_t* mpeg3_new_shared(mpeg3_t *file);
+void mpeg3_delete_shared(mpeg3_shared_t *shared);
+/* Called by the reader's demuxer after every program stream PES packet */
+void mpeg3_shared_pes(mpeg3_demuxer_t *demuxer, double pts);
+/* Read the next packet for the track from its ring. */
+/* Returns 1 if the track has to read it from its own demuxer. */
+int mpeg3_shared_read(mpeg3_demuxer_t *demuxer, int *result);
+/* Stop taking packets from the ring before seeking or reading backwards */
+void mpeg3_shared_detach(mpeg3_demuxer_t *demuxer);
+
+
+/* PARALLEL TABLE OF CONTENTS */
+
+/* Open the source for a table of contents and read every packet from the start */
+int mpeg3_open_toc_source(mpeg3_t *file);
+/* Start threads scanning byte ranges of the file. */
+/* Returns 0 if the file is too small to split. */
+mpeg3_tocsplit_t* mpeg3_new_tocsplit(mpeg3_t *file, int cpus);
+void mpeg3_delete_tocsplit(mpeg3_tocsplit_t *split);
+/* Wait for the ranges and stitch their tables into the file. */
+/* Returns 1 if the ranges couldn't be stitched and the file has to be */
+/* scanned from the start. */
+int mpeg3_tocsplit_wait(mpeg3_tocsplit_t *split, int64_t *bytes_processed);
+
+/* Create the temporary output file of a table of contents. */
+/* Returns 1 on error. */
+int mpeg3_create_toc_file(mpeg3_t *file, char *toc_path);
+/* Close the output file and rename it over the table of contents. */
+/* Returns 1 on error. */
+int mpeg3_finish_toc_file(mpeg3_t *file);
+/* Close and delete the output file, leaving the old table of contents. */
+void mpeg3_cancel_toc_file(mpeg3_t *file);
+
+/* Write the tables of a file to a table of contents.  The file is either */
+/* being scanned or was opened from another table of contents. */
+/* Returns 1 on error. */
+int mpeg3_write_toc(mpeg3_t *file, char *toc_path);
+
+
+/* EXTENDED TABLE OF CONTENTS */
+
+/* Add a resume point to the ring of a track if the count changed */
+void mpeg3_append_point(mpeg3_tocpoint_t **points, 
+	int *total, 
+	int64_t packet, 
+	int64_t count);
+/* Add shift to the counts of the points in the ring */
+void mpeg3_shift_points(mpeg3_tocpoint_t *points, int total, int64_t shift);
+/* Get point number of the points in the ring, oldest first */
+mpeg3_tocpoint_t* mpeg3_get_point(mpeg3_tocpoint_t *points, 
+	int total, 
+	int number);
+/* Old track waiting for the new scan to line up with it or 0 */
+mpeg3_tocresume_t* mpeg3_pending_resume(mpeg3_t *file, int pid, int is_audio);
+/* Compare a packet of a track with the resume points of the old TOC */
+void mpeg3_resume_atrack(mpeg3_t *file, int track, int64_t packet);
+void mpeg3_resume_vtrack(mpeg3_t *file, mpeg3_vtrack_t *vtrack, int64_t packet);
+void mpeg3_delete_tocresume(mpeg3_tocresume_t *resume);
+
+
+/* PACKED OFFSET TABLES */
+
+/* Get entry number of a packed table */
+static int64_t mpeg3_packed_entry(unsigned char *table, int64_t number)
+{
+	mpeg3_tocblock_t *block = (mpeg3_tocblock_t*)table + 
+		number / MPEG3_TOC_BLOCK;
+	uint64_t bit = (number % MPEG3_TOC_BLOCK) * block->bits;
+	unsigned char *ptr = table + block->offset + (bit >> 3);
+	uint64_t word = (uint64_t)ptr[0] |
+		((uint64_t)ptr[1] << 8) |
+		((uint64_t)ptr[2] << 16) |
+		((uint64_t)ptr[3] << 24) |
+		((uint64_t)ptr[4] << 32) |
+		((uint64_t)ptr[5] << 40) |
+		((uint64_t)ptr[6] << 48) |
+		((uint64_t)ptr[7] << 56);
+	if(block->bits < 64)
+		word = (word >> (bit & 7)) & (((uint64_t)1 << block->bits) - 1);
+	return block->base + word;
+}
+
+/* Tracks of a TOC have either the plain or the packed tables */
+#define mpeg3atrack_has_offsets(track) \
+	((track)->sample_offsets || (track)->packed_sample_offsets)
+#define mpeg3atrack_sample_offset(track, number) \
+	((track)->packed_sample_offsets ? \
+		mpeg3_packed_entry((track)->packed_sample_offsets, (number)) : \
+		(track)->sample_offsets[number])
+
+#define mpeg3atrack_has_seek_points(track) \
+	((track)->seek_packets || (track)->packed_seek_packets)
+#define mpeg3atrack_seek_packet(track, number) \
+	((track)->packed_seek_packets ? \
+		mpeg3_packed_entry((track)->packed_seek_packets, (number)) : \
+		(track)->seek_packets[number])
+#define mpeg3atrack_seek_sample(track, number) \
+	((track)->packed_seek_samples ? \
+		mpeg3_packed_entry((track)->packed_seek_samples, (number)) : \
+		(track)->seek_samples[number])
+
+#define mpeg3vtrack_has_offsets(track) \
+	((track)->frame_offsets || (track)->packed_frame_offsets)
+#define mpeg3vtrack_frame_offset(track, number) \
+	((track)->packed_frame_offsets ? \
+		mpeg3_packed_entry((track)->packed_frame_offsets, (number)) : \
+		(track)->frame_offsets[number])
+#define mpeg3vtrack_keyframe_number(track, number) \
+	((track)->packed_keyframe_numbers ? \
+		mpeg3_packed_entry((track)->packed_keyframe_numbers, (number)) : \
+		(track)->keyframe_numbers[number])
+
 #define mpeg3demux_error(demuxer) (((mpeg3_demuxer_t *)(demuxer))->error_flag)
 
 static unsigned char mpeg3demux_read_char(mpeg3_demuxer_t *demuxer)
@@ -555,9 +754,9 @@ static void mpeg3bits_fill_reverse_bits(mpeg3_bits_t* stream, int bits)
 	while(stream->bfr_size - stream->bit_number < bits)
 	{
 		if(stream->input_ptr)
-			stream->bfr |= (unsigned int)(*--stream->input_ptr) << stream->bfr_size;
+			stream->bfr |= (uint64_t)(*--stream->input_ptr) << stream->bfr_size;
 		else
-			stream->bfr |= (unsigned int)mpeg3demux_read_prev_char(stream->demuxer) << stream->bfr_size;
+			stream->bfr |= (uint64_t)mpeg3demux_read_prev_char(stream->demuxer) << stream->bfr_size;
 		stream->bfr_size += 8;
 	}
 }
@@ -578,7 +777,7 @@ static void mpeg3bits_fill_bits(mpeg3_bits_t* stream, int bits)
 		}
 		stream->bit_number += 8;
 		stream->bfr_size += 8;
-		if(stream->bfr_size > 32) stream->bfr_size = 32;
+		if(stream->bfr_size > 64) stream->bfr_size = 64;
 	}
 }
 
@@ -594,7 +793,7 @@ static unsigned int mpeg3bits_getbyte_noptr(mpeg3_bits_t* stream)
 			stream->bfr |= mpeg3demux_read_char(stream->demuxer);
 
 		stream->bfr_size += 8;
-		if(stream->bfr_size > 32) stream->bfr_size = 32;
+		if(stream->bfr_size > 64) stream->bfr_size = 64;
 
 		return (stream->bfr >> stream->bit_number) & 0xff;
 	}
@@ -609,7 +808,7 @@ static unsigned int mpeg3bits_getbit_noptr(mpeg3_bits_t* stream)
 		stream->bfr |= mpeg3demux_read_char(stream->demuxer);
 
 		stream->bfr_size += 8;
-		if(stream->bfr_size > 32) stream->bfr_size = 32;
+		if(stream->bfr_size > 64) stream->bfr_size = 64;
 
 		stream->bit_number = 7;
 
@@ -635,11 +834,12 @@ static unsigned int mpeg3bits_showbits24_noptr(mpeg3_bits_t* stream)
 		stream->bfr |= mpeg3demux_read_char(stream->demuxer);
 		stream->bit_number += 8;
 		stream->bfr_size += 8;
-		if(stream->bfr_size > 32) stream->bfr_size = 32;
+		if(stream->bfr_size > 64) stream->bfr_size = 64;
 	}
 	return (stream->bfr >> (stream->bit_number - 24)) & 0xffffff;
 }
 
+/* The last 4 bytes read even if the bit position isn't byte aligned */
 static unsigned int mpeg3bits_showbits32_noptr(mpeg3_bits_t* stream)
 {
 	while(stream->bit_number < 32)
@@ -648,9 +848,9 @@ static unsigned int mpeg3bits_showbits32_noptr(mpeg3_bits_t* stream)
 		stream->bfr |= mpeg3demux_read_char(stream->demuxer);
 		stream->bit_number += 8;
 		stream->bfr_size += 8;
-		if(stream->bfr_size > 32) stream->bfr_size = 32;
+		if(stream->bfr_size > 64) stream->bfr_size = 64;
 	}
-	return stream->bfr;
+	return (uint32_t)stream->bfr;
 }
 
 static unsigned int mpeg3bits_showbits(mpeg3_bits_t* stream, int bits)
@@ -742,6 +942,19 @@ static unsigned char mpeg3io_next_char(mpeg3_fs_t *fs)
 	return result;
 }
 
+// Return a pointer to the next bytes in the buffer instead of copying them.
+// Returns 0 if they aren't contiguous in the buffer.
+static unsigned char* mpeg3io_read_direct(mpeg3_fs_t *fs, int bytes)
+{
+	unsigned char *result;
+	if(mpeg3io_sync_buffer(fs) ||
+		fs->buffer_offset + bytes > fs->buffer_size) return 0;
+	result = fs->buffer + fs->buffer_offset;
+	fs->buffer_offset += bytes;
+	fs->current_byte += bytes;
+	return result;
+}
+
 static uint32_t mpeg3io_read_int32(mpeg3_fs_t *fs)
 {
 	int a, b, c, d;
@@ -788,17 +1001,32 @@ static uint16_t mpeg3io_read_int16(mpeg3_fs_t *fs)
 // More bitstream
 
 
+/* Load as many bytes as fit in bits at once if they're in the buffer */
 #define mpeg3slice_fillbits(buffer, nbits) \
+	if(((mpeg3_slice_buffer_t*)(buffer))->bits_size < (nbits) && \
+		((mpeg3_slice_buffer_t*)(buffer))->buffer_size - ((mpeg3_slice_buffer_t*)(buffer))->current_position >= 8) \
+	{ \
+		int new_bits = (63 - ((mpeg3_slice_buffer_t*)(buffer))->bits_size) & ~7; \
+		((mpeg3_slice_buffer_t*)(buffer))->bits = (((mpeg3_slice_buffer_t*)(buffer))->bits << new_bits) | \
+			(mpeg3_get_code64(((mpeg3_slice_buffer_t*)(buffer))->data + ((mpeg3_slice_buffer_t*)(buffer))->current_position) >> (64 - new_bits)); \
+		((mpeg3_slice_buffer_t*)(buffer))->current_position += new_bits >> 3; \
+		((mpeg3_slice_buffer_t*)(buffer))->bits_size += new_bits; \
+	} \
+	else \
 	while(((mpeg3_slice_buffer_t*)(buffer))->bits_size < (nbits)) \
 	{ \
+		((mpeg3_slice_buffer_t*)(buffer))->bits <<= 8; \
 		if(((mpeg3_slice_buffer_t*)(buffer))->current_position < ((mpeg3_slice_buffer_t*)(buffer))->buffer_size) \
-		{ \
-			((mpeg3_slice_buffer_t*)(buffer))->bits <<= 8; \
 			((mpeg3_slice_buffer_t*)(buffer))->bits |= ((mpeg3_slice_buffer_t*)(buffer))->data[((mpeg3_slice_buffer_t*)(buffer))->current_position++]; \
-		} \
 		((mpeg3_slice_buffer_t*)(buffer))->bits_size += 8; \
 	}
 
+/* The bits loaded from the buffer haven't all been read */
+#define mpeg3slice_more_data(buffer) \
+	(((mpeg3_slice_buffer_t*)(buffer))->current_position - \
+		(((mpeg3_slice_buffer_t*)(buffer))->bits_size >> 3) < \
+		((mpeg3_slice_buffer_t*)(buffer))->buffer_size)
+
 #define mpeg3slice_flushbits(buffer, nbits) \
 	{ \
 		mpeg3slice_fillbits((buffer), (nbits)); \
@@ -863,7 +1091,7 @@ static unsigned int mpeg3slice_getbyte(mpeg3_slice_buffer_t *buffer)
 }
 
 
-static unsigned int mpeg3slice_getbits(mpeg3_slice_buffer_t *slice_buffer, int bits)
+static inline unsigned int mpeg3slice_getbits(mpeg3_slice_buffer_t *slice_buffer, int bits)
 {
 	if(bits == 1) return mpeg3slice_getbit(slice_buffer);
 	mpeg3slice_fillbits(slice_buffer, bits);
@@ -917,14 +1145,15 @@ static unsigned int mpeg3slice_showbits5(mpeg3_slice_buffer_t *buffer)
 	return 0;
 }
 
-static unsigned int mpeg3slice_showbits(mpeg3_slice_buffer_t *slice_buffer, int bits)
+static inline unsigned int mpeg3slice_showbits(mpeg3_slice_buffer_t *slice_buffer, int bits)
 {
 	mpeg3slice_fillbits(slice_buffer, bits);
 	return (slice_buffer->bits >> (slice_buffer->bits_size - bits)) & (0xffffffff >> (32 - bits));
 }
 
 int mpeg3_new_slice_buffer(mpeg3_slice_buffer_t *slice_buffer);
-int mpeg3_new_slice_decoder(void *video, mpeg3_slice_t *slice);
+int mpeg3_new_slice_decoder(void *video, mpeg3_slice_t *slice, int thread_number);
+int mpeg3_decode_slices(mpeg3_slice_t *slice);
 int mpeg3_delete_slice_buffer(mpeg3_slice_buffer_t *slice_buffer);
 int mpeg3_delete_slice_decoder(mpeg3_slice_t *slice);
 int mpeg3_expand_slice_buffer(mpeg3_slice_buffer_t *slice_buffer);
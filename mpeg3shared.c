@@ -0,0 +1,523 @@
+#include "libmpeg3.h"
+#include "mpeg3protos.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Shared demuxing.  One thread parses the stream once and copies the */
+/* payload of every packet to the ring of the track it belongs to. */
+/* Tracks take their packets from the rings until they seek or read */
+/* backwards.  Then they read with their own demuxers until the reader */
+/* has covered their position again. */
+
+
+
+static mpeg3_shared_ring_t* new_ring(int is_audio, int id)
+{
+	mpeg3_shared_ring_t *ring = calloc(1, sizeof(mpeg3_shared_ring_t));
+	ring->is_audio = is_audio;
+	ring->id = id;
+	ring->data = malloc(MPEG3_SHARED_SIZE);
+	ring->packets = malloc(sizeof(mpeg3_shared_packet_t) *
+		MPEG3_SHARED_PACKETS);
+	ring->stage_pts = -1;
+	return ring;
+}
+
+static void delete_ring(mpeg3_shared_ring_t *ring)
+{
+	free(ring->data);
+	free(ring->packets);
+	if(ring->stage) free(ring->stage);
+	free(ring);
+}
+
+static mpeg3_shared_ring_t* find_ring(mpeg3_shared_t *shared,
+	int is_audio,
+	int id)
+{
+	int i;
+	for(i = 0; i < shared->total_rings; i++)
+	{
+		mpeg3_shared_ring_t *ring = shared->rings[i];
+		if(ring->is_audio == is_audio && ring->id == id) return ring;
+	}
+	return 0;
+}
+
+static int ring_fits(mpeg3_shared_ring_t *ring, int size)
+{
+	return ring->total_packets < MPEG3_SHARED_PACKETS &&
+		ring->data_size + size <= MPEG3_SHARED_SIZE;
+}
+
+static void drop_packet(mpeg3_shared_ring_t *ring)
+{
+	mpeg3_shared_packet_t *packet = &ring->packets[ring->packet_start];
+	ring->data_start = (ring->data_start + packet->size) % MPEG3_SHARED_SIZE;
+	ring->data_size -= packet->size;
+	ring->valid_from = packet->end_byte;
+	ring->packet_start = (ring->packet_start + 1) % MPEG3_SHARED_PACKETS;
+	ring->total_packets--;
+}
+
+/* Append the payload staged by the reader for the ring */
+static void stage_data(mpeg3_shared_ring_t *ring,
+	unsigned char *data,
+	int size,
+	double pts)
+{
+	if(ring->stage_size + size > ring->stage_allocated)
+	{
+		ring->stage_allocated = (ring->stage_size + size) * 2;
+		ring->stage = realloc(ring->stage, ring->stage_allocated);
+	}
+	memcpy(ring->stage + ring->stage_size, data, size);
+	ring->stage_size += size;
+	if(pts >= 0) ring->stage_pts = pts;
+}
+
+static void clear_stages(mpeg3_shared_t *shared)
+{
+	int i;
+	for(i = 0; i < shared->total_rings; i++)
+	{
+		shared->rings[i]->stage_size = 0;
+		shared->rings[i]->stage_pts = -1;
+	}
+}
+
+/* A transport packet only belongs to the track with its PID. */
+static void stage_transport(mpeg3_shared_t *shared, mpeg3_demuxer_t *demuxer)
+{
+	mpeg3_shared_ring_t *ring;
+	unsigned char *data = demuxer->data_buffer;
+	int size = demuxer->data_size;
+
+	if(demuxer->audio_size)
+	{
+		data = demuxer->audio_buffer;
+		size = demuxer->audio_size;
+	}
+	else
+	if(demuxer->video_size)
+	{
+		data = demuxer->video_buffer;
+		size = demuxer->video_size;
+	}
+
+	if(!size) return;
+
+	if(!demuxer->video_size &&
+		(ring = find_ring(shared, 1, demuxer->custom_id)))
+		stage_data(ring,
+			data,
+			size,
+			demuxer->got_audio ? demuxer->pes_audio_time : -1);
+
+	if(!demuxer->audio_size &&
+		(ring = find_ring(shared, 0, demuxer->custom_id)))
+		stage_data(ring,
+			data,
+			size,
+			demuxer->got_video ? demuxer->pes_video_time : -1);
+}
+
+/* A program stream packet can contain several streams so the payload */
+/* is routed after every PES packet. */
+void mpeg3_shared_pes(mpeg3_demuxer_t *demuxer, double pts)
+{
+	mpeg3_shared_t *shared = demuxer->shared;
+	mpeg3_shared_ring_t *ring;
+
+	if(demuxer->audio_size > demuxer->audio_start &&
+		(ring = find_ring(shared, 1, demuxer->custom_id)))
+		stage_data(ring,
+			demuxer->audio_buffer + demuxer->audio_start,
+			demuxer->audio_size - demuxer->audio_start,
+			pts);
+
+	if(demuxer->video_size > demuxer->video_start &&
+		(ring = find_ring(shared, 0, demuxer->custom_id)))
+		stage_data(ring,
+			demuxer->video_buffer + demuxer->video_start,
+			demuxer->video_size - demuxer->video_start,
+			pts);
+
+	demuxer->audio_size = demuxer->audio_start = 0;
+	demuxer->video_size = demuxer->video_start = 0;
+}
+
+/* Move the staged payload into the ring.  Called with the lock held. */
+static void commit_stage(mpeg3_shared_t *shared,
+	mpeg3_shared_ring_t *ring,
+	mpeg3_shared_packet_t *packet)
+{
+	int size = ring->stage_size;
+	int i, fragment;
+
+// Wait for the track to make room unless another track is starving.
+	shared->blocked = 1;
+	while(ring->attached &&
+		!ring_fits(ring, size) &&
+		!shared->total_waiting &&
+		!shared->restart &&
+		!shared->done)
+		pthread_cond_wait(&shared->reader_cond, &shared->lock);
+	shared->blocked = 0;
+	if(shared->restart || shared->done) return;
+
+// The track isn't keeping up.  It reads from its own demuxer until it
+// catches up.
+	if(!ring_fits(ring, size))
+	{
+		if(ring->attached)
+		{
+			ring->attached = 0;
+			shared->total_attached--;
+		}
+
+		while(ring->total_packets && !ring_fits(ring, size))
+			drop_packet(ring);
+
+		if(!ring_fits(ring, size))
+		{
+			ring->valid_from = packet->end_byte;
+			ring->stage_size = 0;
+			ring->stage_pts = -1;
+			return;
+		}
+	}
+
+	i = (ring->data_start + ring->data_size) % MPEG3_SHARED_SIZE;
+	fragment = MIN(size, MPEG3_SHARED_SIZE - i);
+	memcpy(ring->data + i, ring->stage, fragment);
+	memcpy(ring->data, ring->stage + fragment, size - fragment);
+	ring->data_size += size;
+
+	i = (ring->packet_start + ring->total_packets) % MPEG3_SHARED_PACKETS;
+	ring->packets[i] = *packet;
+	ring->packets[i].size = size;
+	ring->packets[i].pts = ring->stage_pts;
+	ring->total_packets++;
+
+	ring->stage_size = 0;
+	ring->stage_pts = -1;
+
+	if(ring->waiting)
+	{
+		ring->waiting = 0;
+		shared->total_waiting--;
+		shared->wake = 1;
+	}
+}
+
+static void* shared_loop(void *ptr)
+{
+	mpeg3_shared_t *shared = ptr;
+	mpeg3_demuxer_t *demuxer = shared->demuxer;
+	mpeg3_t *file = shared->file;
+	mpeg3_shared_packet_t packet;
+	int result, i;
+
+	pthread_mutex_lock(&shared->lock);
+	while(!shared->done)
+	{
+		if(shared->restart)
+		{
+			int64_t byte = shared->restart_byte;
+			shared->restart = 0;
+			clear_stages(shared);
+			pthread_mutex_unlock(&shared->lock);
+			mpeg3demux_seek_byte(demuxer, byte);
+			pthread_mutex_lock(&shared->lock);
+			continue;
+		}
+
+// Nobody to read for
+		if(shared->eof || !shared->total_attached)
+		{
+			pthread_cond_wait(&shared->reader_cond, &shared->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&shared->lock);
+
+		packet.start_byte = mpeg3demux_tell_byte(demuxer);
+		result = mpeg3_read_next_packet(demuxer);
+		if(!result && file->is_transport_stream)
+			stage_transport(shared, demuxer);
+		packet.end_byte = mpeg3demux_tell_byte(demuxer);
+		packet.eof = mpeg3demux_eof(demuxer);
+		packet.time = mpeg3demux_get_time(demuxer);
+
+		pthread_mutex_lock(&shared->lock);
+		for(i = 0; i < shared->total_rings && !shared->restart; i++)
+		{
+			if(shared->rings[i]->stage_size)
+				commit_stage(shared, shared->rings[i], &packet);
+		}
+
+		if(shared->restart) continue;
+
+		shared->position = packet.end_byte;
+		if(result) shared->eof = 1;
+		if(shared->wake || (shared->eof && shared->total_waiting))
+			pthread_cond_broadcast(&shared->track_cond);
+		shared->wake = 0;
+	}
+	pthread_mutex_unlock(&shared->lock);
+	return 0;
+}
+
+/* Put the track's own file where the ring left off */
+static void resync_track(mpeg3_demuxer_t *demuxer)
+{
+	if(demuxer->shared_eof >= 0)
+	{
+		demuxer->shared_eof = -1;
+		mpeg3_seek_phys(demuxer);
+	}
+}
+
+static void release_track(mpeg3_demuxer_t *demuxer)
+{
+	if(demuxer->ring)
+	{
+		resync_track(demuxer);
+		demuxer->ring = 0;
+	}
+}
+
+mpeg3_shared_t* mpeg3_new_shared(mpeg3_t *file)
+{
+	mpeg3_shared_t *shared = calloc(1, sizeof(mpeg3_shared_t));
+	mpeg3_demuxer_t *demuxer;
+	int i;
+
+	shared->file = file;
+	demuxer = shared->demuxer = mpeg3_new_demuxer(file, 0, 0, -1);
+	demuxer->read_all = 1;
+	demuxer->shared = shared;
+	mpeg3demux_copy_titles(demuxer, file->demuxer);
+
+	shared->rings = calloc(file->total_astreams + file->total_vstreams,
+		sizeof(mpeg3_shared_ring_t*));
+	for(i = 0; i < file->total_astreams; i++)
+	{
+		mpeg3_atrack_t *atrack = file->atrack[i];
+		atrack->demuxer->ring =
+			shared->rings[shared->total_rings++] =
+			new_ring(1, atrack->pid);
+	}
+	for(i = 0; i < file->total_vstreams; i++)
+	{
+		mpeg3_vtrack_t *vtrack = file->vtrack[i];
+		vtrack->demuxer->ring =
+			shared->rings[shared->total_rings++] =
+			new_ring(0, vtrack->pid);
+	}
+
+	pthread_mutex_init(&shared->lock, 0);
+	pthread_cond_init(&shared->reader_cond, 0);
+	pthread_cond_init(&shared->track_cond, 0);
+	if(pthread_create(&shared->tid, 0, shared_loop, shared))
+	{
+		perror("mpeg3_new_shared");
+		shared->done = 1;
+		mpeg3_delete_shared(shared);
+		return 0;
+	}
+
+	return shared;
+}
+
+void mpeg3_delete_shared(mpeg3_shared_t *shared)
+{
+	mpeg3_t *file = shared->file;
+	int i;
+
+	if(!shared->done)
+	{
+		pthread_mutex_lock(&shared->lock);
+		shared->done = 1;
+		pthread_cond_broadcast(&shared->reader_cond);
+		pthread_cond_broadcast(&shared->track_cond);
+		pthread_mutex_unlock(&shared->lock);
+		pthread_join(shared->tid, 0);
+	}
+
+	for(i = 0; i < file->total_astreams; i++)
+		release_track(file->atrack[i]->demuxer);
+	for(i = 0; i < file->total_vstreams; i++)
+		release_track(file->vtrack[i]->demuxer);
+
+	for(i = 0; i < shared->total_rings; i++)
+		delete_ring(shared->rings[i]);
+	free(shared->rings);
+	mpeg3_delete_demuxer(shared->demuxer);
+	pthread_mutex_destroy(&shared->lock);
+	pthread_cond_destroy(&shared->reader_cond);
+	pthread_cond_destroy(&shared->track_cond);
+	free(shared);
+}
+
+/* Start the reader over at the track's position.  Called with the lock held. */
+static void restart_reader(mpeg3_shared_t *shared, int64_t byte)
+{
+	int i;
+	for(i = 0; i < shared->total_rings; i++)
+	{
+		mpeg3_shared_ring_t *ring = shared->rings[i];
+		ring->data_start = ring->data_size = 0;
+		ring->packet_start = ring->total_packets = 0;
+		ring->valid_from = byte;
+	}
+
+	shared->restart = 1;
+	shared->restart_byte = byte;
+	shared->position = byte;
+	shared->eof = 0;
+	pthread_cond_broadcast(&shared->reader_cond);
+}
+
+int mpeg3_shared_read(mpeg3_demuxer_t *demuxer, int *result)
+{
+	mpeg3_t *file = demuxer->file;
+	mpeg3_shared_t *shared = file->shared;
+	mpeg3_shared_ring_t *ring = demuxer->ring;
+	mpeg3_shared_packet_t *packet;
+	int64_t byte = demuxer->program_byte;
+	int i, fragment;
+
+// Subtitles are only extracted by the video track's own demuxer
+	if(!ring->is_audio && file->subtitle_track >= 0)
+	{
+		mpeg3_shared_detach(demuxer);
+		return 1;
+	}
+
+	pthread_mutex_lock(&shared->lock);
+
+// Discard packets the track already read itself
+	while(ring->total_packets &&
+		ring->packets[ring->packet_start].end_byte <= byte)
+		drop_packet(ring);
+
+	if(!ring->attached)
+	{
+		if(!shared->total_attached)
+		{
+			restart_reader(shared, byte);
+		}
+		else
+		if(ring->valid_from > byte ||
+			shared->position < byte ||
+			(ring->total_packets &&
+				ring->packets[ring->packet_start].start_byte < byte))
+		{
+			pthread_mutex_unlock(&shared->lock);
+			return 1;
+		}
+
+		ring->attached = 1;
+		shared->total_attached++;
+	}
+
+	while(!ring->total_packets && !shared->eof && !shared->done)
+	{
+		if(!ring->waiting)
+		{
+			ring->waiting = 1;
+			shared->total_waiting++;
+		}
+		if(shared->blocked) pthread_cond_broadcast(&shared->reader_cond);
+		pthread_cond_wait(&shared->track_cond, &shared->lock);
+	}
+
+	if(ring->waiting)
+	{
+		ring->waiting = 0;
+		shared->total_waiting--;
+	}
+
+// The reader dropped packets the track hadn't read
+	if(ring->valid_from > byte)
+	{
+		if(ring->attached)
+		{
+			ring->attached = 0;
+			shared->total_attached--;
+		}
+		pthread_mutex_unlock(&shared->lock);
+		return 1;
+	}
+
+	if(!ring->total_packets)
+	{
+/* End of file */
+		demuxer->program_byte = shared->position;
+		demuxer->shared_eof = 1;
+		*result = 1;
+	}
+	else
+	{
+		packet = &ring->packets[ring->packet_start];
+
+		if(demuxer->stream_end > 0 &&
+			packet->start_byte >= demuxer->stream_end)
+		{
+			demuxer->program_byte = packet->start_byte;
+			demuxer->shared_eof = 0;
+			*result = 1;
+		}
+		else
+		{
+			i = ring->data_start;
+			fragment = MIN(packet->size, MPEG3_SHARED_SIZE - i);
+			demuxer->data_size = 0;
+			mpeg3demux_append_data(demuxer, ring->data + i, fragment);
+			mpeg3demux_append_data(demuxer,
+				ring->data,
+				packet->size - fragment);
+			demuxer->data_position = 0;
+			demuxer->program_byte = packet->end_byte;
+			demuxer->time = packet->time;
+			demuxer->shared_eof = packet->eof;
+			if(packet->pts >= 0)
+			{
+				if(ring->is_audio)
+					demuxer->pes_audio_time = packet->pts;
+				else
+					demuxer->pes_video_time = packet->pts;
+			}
+
+			drop_packet(ring);
+			if(shared->blocked) pthread_cond_broadcast(&shared->reader_cond);
+			*result = 0;
+		}
+	}
+
+	pthread_mutex_unlock(&shared->lock);
+	return 0;
+}
+
+void mpeg3_shared_detach(mpeg3_demuxer_t *demuxer)
+{
+	mpeg3_t *file = demuxer->file;
+	mpeg3_shared_t *shared = file->shared;
+	mpeg3_shared_ring_t *ring = demuxer->ring;
+
+	if(!ring) return;
+
+	pthread_mutex_lock(&shared->lock);
+	if(ring->attached)
+	{
+		ring->attached = 0;
+		shared->total_attached--;
+		if(shared->blocked) pthread_cond_broadcast(&shared->reader_cond);
+	}
+	pthread_mutex_unlock(&shared->lock);
+
+	resync_track(demuxer);
+}
+
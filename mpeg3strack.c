@@ -55,6 +55,18 @@ void mpeg3_copy_strack(mpeg3_strack_t *dst, mpeg3_strack_t *src)
 	dst->allocated_offsets = src->allocated_offsets;
 }
 
+mpeg3_strack_t* mpeg3_append_strack(mpeg3_t *file, mpeg3_strack_t *strack)
+{
+	if(file->total_sstreams >= file->stracks_allocated)
+	{
+		file->stracks_allocated = MAX(file->total_sstreams * 2, 4);
+		file->strack = realloc(file->strack,
+			sizeof(mpeg3_strack_t*) * file->stracks_allocated);
+	}
+	file->strack[file->total_sstreams++] = strack;
+	return strack;
+}
+
 mpeg3_strack_t* mpeg3_get_strack_id(mpeg3_t *file, int id)
 {
 	int i;
@@ -75,29 +87,21 @@ mpeg3_strack_t* mpeg3_get_strack(mpeg3_t *file, int number)
 mpeg3_strack_t* mpeg3_create_strack(mpeg3_t *file, int id)
 {
 	int i;
-	int j;
 	mpeg3_strack_t *result = 0;
 
 	if(!(result = mpeg3_get_strack_id(file, id)))
 	{
-		result = mpeg3_new_strack(id);
-		for(i = 0; i < file->total_sstreams; i++)
+		result = mpeg3_append_strack(file, mpeg3_new_strack(id));
+/* Shift back 1 until the previous ID is lower */
+		for(i = file->total_sstreams - 1; 
+			i > 0 && file->strack[i - 1]->id > id; 
+			i--)
 		{
-/* Search for first ID > current id */
-			if(file->strack[i]->id > id)
-			{
-/* Shift back 1 */
-				for(j = file->total_sstreams; j >= i; j--)
-				{
-					file->strack[j] = file->strack[j - 1];
-				}
-				break;
-			}
+			file->strack[i] = file->strack[i - 1];
 		}
 
 /* Store in table */
 		file->strack[i] = result;
-		file->total_sstreams++;
 	}
 
 	return result;
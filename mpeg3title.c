@@ -10,6 +10,7 @@ mpeg3_title_t* mpeg3_new_title(mpeg3_t *file, char *path)
 {
 	mpeg3_title_t *title = calloc(1, sizeof(mpeg3_title_t));
 	title->fs = mpeg3_new_fs(path);
+	title->fs->io_mode = file->io_mode;
 	title->file = file;
 	return title;
 }
@@ -138,8 +139,7 @@ int mpeg3_create_title(mpeg3_demuxer_t *demuxer,
 /* Create a single title */
 	if(!demuxer->total_titles)
 	{
-		demuxer->titles[0] = mpeg3_new_title(file, file->fs->path);
-		demuxer->total_titles = 1;
+		mpeg3demux_append_title(demuxer, mpeg3_new_title(file, file->fs->path));
 		mpeg3demux_open_title(demuxer, 0);
 	}
 
@@ -163,6 +163,11 @@ __LINE__, file->fs->path, title->total_bytes);
 /* Get PID's and tracks */
 	if(file->is_transport_stream || file->is_program_stream)
 	{
+		int64_t start_time = mpeg3io_time();
+/* Stop when every stream in the stream tables is found if not building a toc. */
+		if(!toc) demuxer->probe = calloc(1, sizeof(mpeg3_probe_t));
+		file->probe_stats.method = MPEG3_PROBE_SCAN;
+
 		mpeg3io_seek(title->fs, MPEG3_START_BYTE);
 		while(!done && !result && !mpeg3io_eof(title->fs))
 		{
@@ -170,8 +175,20 @@ __LINE__, file->fs->path, title->total_bytes);
 			result = mpeg3_read_next_packet(demuxer);
 
 /* Just get the first bytes if not building a toc to get the stream ID's. */
-			if(next_byte > MPEG3_START_BYTE + 0x1000000 && !toc) done = 1;
+			if(next_byte > MPEG3_START_BYTE + MPEG3_PROBE_BYTES && !toc) done = 1;
+			else
+			if(mpeg3demux_probe_done(demuxer))
+			{
+				file->probe_stats.method = MPEG3_PROBE_TABLES;
+				done = 1;
+			}
 		}
+
+		file->probe_stats.bytes = MIN(mpeg3io_tell(title->fs), title->total_bytes) - 
+			MPEG3_START_BYTE;
+		file->probe_stats.time = mpeg3io_time() - start_time;
+		free(demuxer->probe);
+		demuxer->probe = 0;
 	}
 
 	mpeg3io_seek(title->fs, MPEG3_START_BYTE);
@@ -206,13 +223,14 @@ int mpeg3demux_print_streams(mpeg3_demuxer_t *demuxer, FILE *toc)
 {
 	int i;
 /* Print the stream information */
-	for(i = 0; i < MPEG3_MAX_STREAMS; i++)
+	for(i = 0; i < demuxer->total_streams; i++)
 	{
-		if(demuxer->astream_table[i])
-			fprintf(toc, "ASTREAM: %d %d\n", i, demuxer->astream_table[i]);
+		mpeg3_streamid_t *stream = &demuxer->streams[i];
+		if(stream->audio)
+			fprintf(toc, "ASTREAM: %d %d\n", stream->id, stream->audio);
 
-		if(demuxer->vstream_table[i])
-			fprintf(toc, "VSTREAM: %d %d\n", i, demuxer->vstream_table[i]);
+		if(stream->video)
+			fprintf(toc, "VSTREAM: %d %d\n", stream->id, stream->video);
 	}
 	return 0;
 }
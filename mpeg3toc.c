@@ -18,6 +18,9 @@ int main(int argc, char *argv[])
 	int i, j, l;
 	char *src = 0, *dst = 0;
 	int verbose = 0;
+	int cpus = 1;
+	int append = 0;
+	int seek_samples = 0;
 
 	if(argc < 3)
 	{
@@ -26,6 +29,10 @@ int main(int argc, char *argv[])
 			"Usage: mpeg3toc <path> <output>\n"
 			"\n"
 			"-v Print tracking information\n"
+			"-j <n> Scan the file with n threads\n"
+			"-a Extend the table of contents of a file which has grown\n"
+			"-s <n> Store an audio seek point about every n samples.\n"
+			"       1 stores every frame.\n"
 			"\n"
 			"The path should be absolute unless you plan\n"
 			"to always run your movie editor from the same directory\n"
@@ -46,6 +53,47 @@ int main(int argc, char *argv[])
 			verbose = 1;
 		}
 		else
+		if(!strcmp(argv[i], "-a"))
+		{
+			append = 1;
+		}
+		else
+		if(!strcmp(argv[i], "-j"))
+		{
+			if(i < argc - 1)
+			{
+				cpus = atoi(argv[++i]);
+				if(cpus < 1)
+				{
+					fprintf(stderr, "-j requires a positive number of threads.\n");
+					exit(1);
+				}
+			}
+			else
+			{
+				fprintf(stderr, "-j requires an argument.\n");
+				exit(1);
+			}
+		}
+		else
+		if(!strcmp(argv[i], "-s"))
+		{
+			if(i < argc - 1)
+			{
+				seek_samples = atoi(argv[++i]);
+				if(seek_samples < 1)
+				{
+					fprintf(stderr, "-s requires a positive number of samples.\n");
+					exit(1);
+				}
+			}
+			else
+			{
+				fprintf(stderr, "-s requires an argument.\n");
+				exit(1);
+			}
+		}
+		else
 		if(argv[i][0] == '-')
 		{
 			fprintf(stderr, "Unrecognized command %s\n", argv[i]);
@@ -82,8 +130,16 @@ int main(int argc, char *argv[])
 
 
 	int64_t total_bytes;
-	mpeg3_t *file = mpeg3_start_toc(src, dst, &total_bytes);
+	mpeg3_t *file;
+	if(append)
+		file = mpeg3_start_toc_append(src, dst, &total_bytes);
+	else
+	if(cpus > 1)
+		file = mpeg3_start_toc_parallel(src, dst, cpus, &total_bytes);
+	else
+		file = mpeg3_start_toc(src, dst, &total_bytes);
 	if(!file) exit(1);
+	mpeg3_set_seek_samples(file, seek_samples);
 	struct timeval new_time;
 	struct timeval prev_time;
 	struct timeval start_time;
@@ -522,7 +578,7 @@ mpeg3demux_movie_size(input->atrack[j]->demuxer));
 
 // Skip the first frame.
 							mpeg3video_get_header(video, 0);
-							video->current_repeat += 100;
+							video->picture->current_repeat += 100;
 						}
 
 
@@ -532,19 +588,19 @@ mpeg3demux_movie_size(input->atrack[j]->demuxer));
 						do
 						{
 							mpeg3video_get_header(video, 0);
-							video->current_repeat += 100;
+							video->picture->current_repeat += 100;
 
-							if(video->pict_struct == TOP_FIELD)
+							if(video->picture->pict_struct == TOP_FIELD)
 							{
 								got_top = 1;
 							}
 							else
-							if(video->pict_struct == BOTTOM_FIELD)
+							if(video->picture->pict_struct == BOTTOM_FIELD)
 							{
 								got_bottom = 1;
 							}
 							else
-							if(video->pict_struct == FRAME_PICTURE)
+							if(video->picture->pict_struct == FRAME_PICTURE)
 							{
 								got_top = got_bottom = 1;
 							}
@@ -552,7 +608,7 @@ mpeg3demux_movie_size(input->atrack[j]->demuxer));
 
 // The way we do it, the I frames have the top field but both the I frame and
 // subsequent P frame make the keyframe.
-							if(video->pict_type == I_TYPE)
+							if(video->picture->pict_type == I_TYPE)
 								got_keyframe = 1;
 						}while(!mpeg3_end_of_video(input, j) && 
 							!got_bottom && 
@@ -631,20 +687,21 @@ mpeg3demux_movie_size(input->atrack[j]->demuxer));
 
 // Write stream ID's
 // Only program and transport streams have these
-		for(i = 0; i < MPEG3_MAX_STREAMS; i++)
+		for(i = 0; i < input->demuxer->total_streams; i++)
 		{
-			if(input->demuxer->astream_table[i])
+			mpeg3_streamid_t *stream = &input->demuxer->streams[i];
+			if(stream->audio)
 			{
 				fputc(STREAM_AUDIO, output);
-				PUT_INT32(i);
-				PUT_INT32(input->demuxer->astream_table[i]);
+				PUT_INT32(stream->id);
+				PUT_INT32(stream->audio);
 			}
 
-			if(input->demuxer->vstream_table[i])
+			if(stream->video)
 			{
 				fputc(STREAM_VIDEO, output);
-				PUT_INT32(i);
-				PUT_INT32(input->demuxer->vstream_table[i]);
+				PUT_INT32(stream->id);
+				PUT_INT32(stream->video);
 			}
 		}
 
@@ -0,0 +1,546 @@
+#include "libmpeg3.h"
+#include "mpeg3protos.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Extend the table of contents of a file which is still being written.
+ *
+ * The TOC stores the last packets of every track which changed its number
+ * of frames or samples with the number after the packet.  The new scan
+ * starts at the first of these packets.  Once a track has gone through
+ * them with the same difference from the old counts, the old tables up to
+ * the last of them replace the tables of the new scan and the scan goes on
+ * from there.
+ */
+
+
+static mpeg3_tocresume_t* new_resume(int pid,
+	int is_audio,
+	mpeg3_tocpoint_t *points,
+	int total_points)
+{
+	mpeg3_tocresume_t *resume = calloc(1, sizeof(mpeg3_tocresume_t));
+	resume->pid = pid;
+	resume->is_audio = is_audio;
+	resume->points = malloc(sizeof(mpeg3_tocpoint_t) * MAX(total_points, 1));
+	memcpy(resume->points, points, sizeof(mpeg3_tocpoint_t) * total_points);
+	resume->total_points = total_points;
+	resume->whole = total_points < MPEG3_TOC_POINTS;
+	return resume;
+}
+
+void mpeg3_delete_tocresume(mpeg3_tocresume_t *resume)
+{
+	if(resume->atrack)
+	{
+		free(resume->atrack->sample_offsets);
+		free(resume->atrack->seek_packets);
+		free(resume->atrack->seek_samples);
+		free(resume->atrack);
+	}
+	if(resume->index) mpeg3_delete_index(resume->index);
+	if(resume->vtrack)
+	{
+		free(resume->vtrack->frame_offsets);
+		free(resume->vtrack->keyframe_numbers);
+		free(resume->vtrack);
+	}
+	free(resume->points);
+	free(resume);
+}
+
+/* Copy the chunks of an audio track which are in its index */
+static mpeg3_tocresume_t* load_atrack(mpeg3_t *old, int number, int pid)
+{
+	mpeg3_index_t *old_index = old->indexes[number];
+	mpeg3_tocresume_t *resume;
+	mpeg3_index_t *index;
+/* The last 2 offsets are from mpeg3_stop_toc and the samples it flushed. */
+/* If it had none to flush the last chunk is left for the new scan. */
+	int64_t chunks = (int64_t)old->total_sample_offsets[number] - 3;
+	int zoom = old_index->index_zoom;
+	int64_t pairs;
+	int i;
+
+	if(chunks < 1 ||
+		!old_index->index_data ||
+		zoom < 1 ||
+		MPEG3_AUDIO_CHUNKSIZE % zoom) return 0;
+	pairs = chunks * (MPEG3_AUDIO_CHUNKSIZE / zoom);
+	if(pairs > old_index->index_size) return 0;
+
+	resume = new_resume(pid,
+		1,
+		old->audio_points[number],
+		old->total_audio_points[number]);
+	resume->atrack = calloc(1, sizeof(mpeg3_atrack_t));
+	for(i = 0; i <= chunks; i++)
+		mpeg3_append_samples(resume->atrack,
+			mpeg3_packed_entry(old->packed_sample_offsets[number], i));
+
+/* Seek points before the samples the new scan takes over */
+	for(i = 0; 
+		old->packed_seek_packets && i < old->total_seek_points[number]; 
+		i++)
+	{
+		int64_t sample = 
+			mpeg3_packed_entry(old->packed_seek_samples[number], i);
+		if(sample >= chunks * MPEG3_AUDIO_CHUNKSIZE) break;
+		mpeg3_append_seek(resume->atrack,
+			mpeg3_packed_entry(old->packed_seek_packets[number], i),
+			sample);
+	}
+
+	index = resume->index = mpeg3_new_index();
+	index->index_zoom = zoom;
+	index->index_size = index->index_allocated = pairs;
+	index->index_channels = old_index->index_channels;
+	index->index_data = calloc(index->index_channels, sizeof(float*));
+	for(i = 0; i < index->index_channels; i++)
+	{
+		index->index_data[i] = malloc(sizeof(float) * 2 * pairs);
+		memcpy(index->index_data[i],
+			old_index->index_data[i],
+			sizeof(float) * 2 * pairs);
+	}
+	return resume;
+}
+
+static mpeg3_tocresume_t* load_vtrack(mpeg3_t *old, int number, int pid)
+{
+	mpeg3_tocresume_t *resume;
+	mpeg3_vtrack_t *vtrack;
+	int total = old->total_frame_offsets[number];
+	int keyframes = old->total_keyframe_numbers[number];
+	int i;
+
+	if(total < 1) return 0;
+
+	resume = new_resume(pid,
+		0,
+		old->video_points[number],
+		old->total_video_points[number]);
+	vtrack = resume->vtrack = calloc(1, sizeof(mpeg3_vtrack_t));
+	vtrack->frame_offsets = malloc(sizeof(int64_t) * total);
+	vtrack->total_frame_offsets = vtrack->frame_offsets_allocated = total;
+	for(i = 0; i < total; i++)
+		vtrack->frame_offsets[i] =
+			mpeg3_packed_entry(old->packed_frame_offsets[number], i);
+	vtrack->keyframe_numbers = malloc(sizeof(int64_t) * MAX(keyframes, 1));
+	vtrack->total_keyframe_numbers = vtrack->keyframe_numbers_allocated =
+		keyframes;
+	for(i = 0; i < keyframes; i++)
+		vtrack->keyframe_numbers[i] =
+			mpeg3_packed_entry(old->packed_keyframe_numbers[number], i);
+	vtrack->private_offsets = 1;
+	return resume;
+}
+
+/* Open the old TOC without creating tracks.  Returns 0 if it can't be */
+/* extended. */
+static mpeg3_t* open_old(char *path, 
+	char *toc_path, 
+	int *atracks, 
+	int *vtracks)
+{
+	mpeg3_t *old = mpeg3_new(toc_path);
+	int64_t size = mpeg3_calculate_source_size(path);
+	int64_t date = mpeg3_calculate_source_date(path);
+	uint32_t version;
+
+	old->ignore_source_date = 1;
+	if(mpeg3io_open_file(old->fs))
+	{
+		mpeg3_delete(old);
+		return 0;
+	}
+
+/* Only the version with the resume points */
+	mpeg3io_seek(old->fs, 4);
+	version = mpeg3io_read_int32(old->fs);
+	mpeg3io_seek(old->fs, 0);
+	if(version != MPEG3_TOC_VERSION)
+	{
+		mpeg3io_close_file(old->fs);
+		mpeg3_delete(old);
+		return 0;
+	}
+
+	if(mpeg3_get_file_type(old, 0, atracks, vtracks) ||
+		strcmp(old->source_path, path) ||
+		!(old->is_transport_stream || old->is_program_stream) ||
+		old->demuxer->total_titles != 1 ||
+		old->total_sstreams ||
+/* Rewritten instead of extended */
+		size < old->source_size ||
+		(size == old->source_size && date != old->source_date))
+	{
+		mpeg3_delete(old);
+		return 0;
+	}
+
+	return old;
+}
+
+/* Copy the tracks of the old TOC.  Returns 1 if one can't be extended. */
+static int load_tracks(mpeg3_t *file, mpeg3_t *old, int atracks, int vtracks)
+{
+	int atrack = 0, vtrack = 0;
+	int i;
+
+	file->toc_resume = calloc(atracks + vtracks + 1, 
+		sizeof(mpeg3_tocresume_t*));
+
+/* Tracks are numbered in the order of the stream ID's like mpeg3_open does */
+	for(i = 0; i < old->demuxer->total_streams; i++)
+	{
+		mpeg3_streamid_t *stream = &old->demuxer->streams[i];
+		mpeg3_tocresume_t *resume = 0;
+
+		if(stream->audio)
+			mpeg3demux_set_audio_stream(file->demuxer,
+				stream->id,
+				stream->audio);
+		if(stream->video)
+			mpeg3demux_set_video_stream(file->demuxer,
+				stream->id,
+				stream->video);
+
+		if(stream->audio && atrack < atracks)
+		{
+			if(!(resume = load_atrack(old, atrack++, stream->id))) return 1;
+			file->toc_resume[file->total_resume++] = resume;
+		}
+
+		if(stream->video && vtrack < vtracks)
+		{
+			if(!(resume = load_vtrack(old, vtrack++, stream->id))) return 1;
+			file->toc_resume[file->total_resume++] = resume;
+		}
+	}
+
+/* Every track needs a stream ID */
+	if(atrack < atracks || vtrack < vtracks) return 1;
+	return 0;
+}
+
+/* Old tracks which haven't lined up */
+static int pending_tracks(mpeg3_t *file)
+{
+	int result = 0;
+	int i;
+	for(i = 0; i < file->total_resume; i++)
+		if(!file->toc_resume[i]->done) result++;
+	return result;
+}
+
+mpeg3_tocresume_t* mpeg3_pending_resume(mpeg3_t *file, int pid, int is_audio)
+{
+	int i;
+	for(i = 0; i < file->total_resume; i++)
+	{
+		mpeg3_tocresume_t *resume = file->toc_resume[i];
+		if(resume->pid == pid &&
+			resume->is_audio == is_audio &&
+			!resume->done) return resume;
+	}
+	return 0;
+}
+
+/* Compare the count after a packet with the resume points.  Returns 1 once */
+/* the last point is passed. */
+static int compare_point(mpeg3_tocresume_t *resume,
+	int64_t packet,
+	int64_t count)
+{
+/* Points the new scan didn't stop at break the run */
+	while(resume->point < resume->total_points &&
+		resume->points[resume->point].packet < packet)
+	{
+		resume->matched = 0;
+		resume->point++;
+	}
+
+	if(resume->point < resume->total_points &&
+		resume->points[resume->point].packet == packet)
+	{
+		mpeg3_tocpoint_t *point = &resume->points[resume->point++];
+		if(!count)
+			resume->matched = 0;
+		else
+		if(resume->matched && point->count - count == resume->delta)
+			resume->matched++;
+		else
+		{
+			resume->delta = point->count - count;
+			resume->matched = 1;
+			resume->first_count = point->count;
+			resume->first_local = count;
+		}
+	}
+
+	return resume->point >= resume->total_points;
+}
+
+/* The new scan has matched enough points to take over */
+static int enough_points(mpeg3_tocresume_t *resume)
+{
+/* Repeating the old scan gives the same counts */
+	if(resume->whole) return resume->matched && !resume->delta;
+	return resume->matched >= MPEG3_TOC_RECORDS;
+}
+
+void mpeg3_resume_atrack(mpeg3_t *file, int track, int64_t packet)
+{
+	mpeg3_atrack_t *atrack = file->atrack[track];
+	mpeg3audio_t *audio = atrack->audio;
+	mpeg3_tocresume_t *resume = mpeg3_pending_resume(file, atrack->pid, 1);
+	int64_t consumed, local;
+	int i;
+
+	if(!resume ||
+		!compare_point(resume,
+			packet,
+			(int64_t)audio->output_position + audio->output_size)) return;
+
+/* The first sample after the old index in the new decoder.  The decoder */
+/* must have been decoding the same frames for a while before it. */
+	consumed = (int64_t)(resume->atrack->total_sample_offsets - 1) *
+		MPEG3_AUDIO_CHUNKSIZE;
+	local = consumed - resume->delta;
+	if(!enough_points(resume) ||
+		atrack->channels != resume->index->index_channels ||
+		(!resume->whole && consumed < resume->first_count + MPEG3_TOC_VERIFY) ||
+		local < audio->output_position ||
+		local > (int64_t)audio->output_position + audio->output_size)
+	{
+		file->resume_failed = 1;
+		return;
+	}
+
+/* Put the decoder at the first sample which isn't in the index */
+	mpeg3_shift_audio(audio, local - audio->output_position);
+	audio->output_position = consumed;
+	atrack->current_position = consumed;
+	mpeg3_shift_points(atrack->toc_points,
+		atrack->total_toc_points,
+		resume->delta);
+
+	if(atrack->sample_offsets && atrack->private_offsets)
+		free(atrack->sample_offsets);
+	atrack->sample_offsets = resume->atrack->sample_offsets;
+	atrack->total_sample_offsets = resume->atrack->total_sample_offsets;
+	atrack->sample_offsets_allocated = resume->atrack->sample_offsets_allocated;
+	atrack->private_offsets = 1;
+
+/* Seek points of the new scan after the old ones */
+	for(i = 0; i < atrack->total_seek_points; i++)
+		if(atrack->seek_samples[i] >= local)
+			mpeg3_append_seek(resume->atrack,
+				atrack->seek_packets[i],
+				atrack->seek_samples[i] + resume->delta);
+	if(atrack->seek_packets) free(atrack->seek_packets);
+	if(atrack->seek_samples) free(atrack->seek_samples);
+	atrack->seek_packets = resume->atrack->seek_packets;
+	atrack->seek_samples = resume->atrack->seek_samples;
+	atrack->total_seek_points = resume->atrack->total_seek_points;
+	atrack->seek_points_allocated = resume->atrack->seek_points_allocated;
+	free(resume->atrack);
+	resume->atrack = 0;
+
+	mpeg3_delete_index(file->indexes[track]);
+	file->indexes[track] = resume->index;
+	resume->index = 0;
+	resume->done = 1;
+}
+
+/* The frames after the first matched point are the same in both tables */
+static int frames_equal(mpeg3_vtrack_t *old,
+	mpeg3_vtrack_t *vtrack,
+	int from,
+	int64_t delta)
+{
+	int i, j;
+
+/* Keyframe numbers are 1 less than the frame and the first one is 0 */
+	from = MAX(from, 2);
+	if(from + delta < 2) return 0;
+	for(i = from; i < vtrack->total_frame_offsets; i++)
+		if(old->frame_offsets[i + delta] != vtrack->frame_offsets[i])
+			return 0;
+
+	i = old->total_keyframe_numbers - 1;
+	j = vtrack->total_keyframe_numbers - 1;
+	while(j >= 0 && vtrack->keyframe_numbers[j] >= from - 1)
+	{
+		if(i < 0 ||
+			old->keyframe_numbers[i] != vtrack->keyframe_numbers[j] + delta)
+			return 0;
+		i--;
+		j--;
+	}
+	return i < 0 || old->keyframe_numbers[i] < from - 1 + delta;
+}
+
+void mpeg3_resume_vtrack(mpeg3_t *file, mpeg3_vtrack_t *vtrack, int64_t packet)
+{
+	mpeg3_tocresume_t *resume = mpeg3_pending_resume(file, vtrack->pid, 0);
+	mpeg3_vtrack_t *old;
+
+	if(!resume ||
+		!compare_point(resume, packet, vtrack->total_frame_offsets)) return;
+
+	old = resume->vtrack;
+	if(!enough_points(resume) ||
+		vtrack->total_frame_offsets + resume->delta !=
+			old->total_frame_offsets ||
+		!frames_equal(old, vtrack, resume->first_local, resume->delta))
+	{
+		file->resume_failed = 1;
+		return;
+	}
+
+	mpeg3_shift_points(vtrack->toc_points,
+		vtrack->total_toc_points,
+		resume->delta);
+	if(vtrack->private_offsets)
+	{
+		if(vtrack->frame_offsets) free(vtrack->frame_offsets);
+		if(vtrack->keyframe_numbers) free(vtrack->keyframe_numbers);
+	}
+	vtrack->frame_offsets = old->frame_offsets;
+	vtrack->total_frame_offsets = old->total_frame_offsets;
+	vtrack->frame_offsets_allocated = old->frame_offsets_allocated;
+	vtrack->keyframe_numbers = old->keyframe_numbers;
+	vtrack->total_keyframe_numbers = old->total_keyframe_numbers;
+	vtrack->keyframe_numbers_allocated = old->keyframe_numbers_allocated;
+	vtrack->private_offsets = 1;
+	free(old);
+	resume->vtrack = 0;
+	resume->done = 1;
+}
+
+/* Scan until every old track lines up.  Returns 1 if one doesn't. */
+static int line_up(mpeg3_t *file, int64_t total_bytes, int64_t old_size)
+{
+	int64_t start = -1, bytes = 0;
+	int i;
+
+	for(i = 0; i < file->total_resume; i++)
+	{
+		mpeg3_tocresume_t *resume = file->toc_resume[i];
+		if(!resume->total_points) return 1;
+		if(resume->whole)
+			start = 0;
+		else
+		if(start < 0 || resume->points[0].packet < start)
+			start = resume->points[0].packet;
+	}
+	if(start < 0) return 1;
+	mpeg3demux_seek_byte(file->demuxer, start);
+
+	while(!file->resume_failed && pending_tracks(file))
+	{
+		start = mpeg3demux_tell_byte(file->demuxer);
+		mpeg3_do_toc(file, &bytes);
+		if(bytes <= start || bytes >= total_bytes) break;
+	}
+
+	if(file->resume_failed || pending_tracks(file)) return 1;
+
+/* Tracks which aren't in the old TOC must start after it */
+	for(i = 0; i < file->total_astreams; i++)
+	{
+		mpeg3_atrack_t *atrack = file->atrack[i];
+		int j;
+		for(j = 0; j < file->total_resume; j++)
+			if(file->toc_resume[j]->is_audio &&
+				file->toc_resume[j]->pid == atrack->pid) break;
+		if(j >= file->total_resume && atrack->sample_offsets[0] < old_size)
+			return 1;
+	}
+
+	for(i = 0; i < file->total_vstreams; i++)
+	{
+		mpeg3_vtrack_t *vtrack = file->vtrack[i];
+		int j;
+		for(j = 0; j < file->total_resume; j++)
+			if(!file->toc_resume[j]->is_audio &&
+				file->toc_resume[j]->pid == vtrack->pid) break;
+		if(j >= file->total_resume && vtrack->frame_offsets[0] < old_size)
+			return 1;
+	}
+
+	for(i = 0; i < file->total_resume; i++)
+		mpeg3_delete_tocresume(file->toc_resume[i]);
+	file->total_resume = 0;
+	return 0;
+}
+
+mpeg3_t* mpeg3_start_toc_append(char *path,
+	char *toc_path,
+	int64_t *total_bytes)
+{
+	int atracks = 0, vtracks = 0;
+	mpeg3_t *old = open_old(path, toc_path, &atracks, &vtracks);
+	mpeg3_t *file;
+	int64_t old_size;
+
+	if(!old)
+	{
+		fprintf(stderr,
+			"mpeg3_start_toc_append: can't extend \"%s\".  "
+			"Scanning from the start.\n",
+			toc_path);
+		return mpeg3_start_toc(path, toc_path, total_bytes);
+	}
+
+/* The tables of the old TOC are copied so it can be closed */
+	file = mpeg3_new(path);
+	if(load_tracks(file, old, atracks, vtracks))
+	{
+		mpeg3_delete(old);
+		mpeg3_delete(file);
+		fprintf(stderr,
+			"mpeg3_start_toc_append: can't extend \"%s\".  "
+			"Scanning from the start.\n",
+			toc_path);
+		return mpeg3_start_toc(path, toc_path, total_bytes);
+	}
+	old_size = old->source_size;
+	mpeg3_delete(old);
+
+	if(mpeg3_create_toc_file(file, toc_path))
+	{
+		printf("mpeg3_start_toc_append: can't open \"%s\".  %s\n",
+			toc_path,
+			strerror(errno));
+		mpeg3_delete(file);
+		return 0;
+	}
+
+	strcpy(file->source_path, path);
+	file->source_date = mpeg3_calculate_source_date(path);
+	if(mpeg3_open_toc_source(file))
+	{
+		mpeg3_delete(file);
+		return 0;
+	}
+	*total_bytes = file->source_size = mpeg3demux_movie_size(file->demuxer);
+
+	if(line_up(file, *total_bytes, old_size))
+	{
+		fprintf(stderr,
+			"mpeg3_start_toc_append: the new scan doesn't line up with \"%s\".  "
+			"Scanning from the start.\n",
+			toc_path);
+		mpeg3_delete(file);
+		return mpeg3_start_toc(path, toc_path, total_bytes);
+	}
+
+	return file;
+}
@@ -0,0 +1,174 @@
+#include "libmpeg3.h"
+#include "mpeg3protos.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+
+
+
+static double get_time()
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Bytes in the section of a packed table
+static int64_t packed_bytes(unsigned char *table, int64_t total)
+{
+	int64_t blocks = (total + MPEG3_TOC_BLOCK - 1) / MPEG3_TOC_BLOCK;
+	mpeg3_tocblock_t *last;
+
+	if(!blocks) return 8;
+	last = (mpeg3_tocblock_t*)table + blocks - 1;
+	return last->offset +
+		((total - (blocks - 1) * MPEG3_TOC_BLOCK) * last->bits + 7) / 8 +
+		8;
+}
+
+// Decode the whole table and look up random entries in the plain and the
+// packed table.
+static void benchmark(char *name, unsigned char *table, int64_t total)
+{
+	int64_t *plain;
+	int64_t passes, lookups, i, j;
+	uint64_t sum1 = 0, sum2 = 0;
+	uint32_t seed = 1;
+	double start, decode_time, plain_time, packed_time;
+
+	if(!table || !total) return;
+	plain = malloc(sizeof(int64_t) * total);
+	passes = MAX(1, 0x1000000 / total);
+	lookups = 0x1000000;
+
+	start = get_time();
+	for(i = 0; i < passes; i++)
+		for(j = 0; j < total; j++)
+			plain[j] = mpeg3_packed_entry(table, j);
+	decode_time = get_time() - start;
+
+	start = get_time();
+	for(i = 0; i < lookups; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		sum1 += plain[seed % total];
+	}
+	plain_time = get_time() - start;
+
+	seed = 1;
+	start = get_time();
+	for(i = 0; i < lookups; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		sum2 += mpeg3_packed_entry(table, seed % total);
+	}
+	packed_time = get_time() - start;
+
+	printf("%-16s entries=%-8lld plain=%-9lld packed=%-9lld ratio=%.2f\n",
+		name,
+		(long long)total,
+		(long long)(total * sizeof(int64_t)),
+		(long long)packed_bytes(table, total),
+		(double)total * sizeof(int64_t) / packed_bytes(table, total));
+	printf("%-16s decode=%.2fns/entry random plain=%.2fns packed=%.2fns%s\n",
+		"",
+		decode_time * 1e9 / passes / total,
+		plain_time * 1e9 / lookups,
+		packed_time * 1e9 / lookups,
+		sum1 == sum2 ? "" : " MISMATCH");
+	free(plain);
+}
+
+int main(int argc, char *argv[])
+{
+	mpeg3_t *file;
+	char *input = 0;
+	char *output = 0;
+	int do_benchmark = 0;
+	int error = 0;
+	int i;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "-b"))
+			do_benchmark = 1;
+		else
+		if(!input)
+			input = argv[i];
+		else
+		if(!output)
+			output = argv[i];
+	}
+
+	if(!input)
+	{
+		printf("Usage: mpeg3tocpack [-b] <table of contents> [output]\n");
+		printf("Rewrite a table of contents with packed offset tables.\n");
+		printf("Without an output the table of contents is replaced.\n");
+		printf("-b Compare the size and decoding speed of the plain and packed tables.\n");
+		printf("Example: mpeg3tocpack heroine.toc\n");
+		exit(1);
+	}
+
+	if(!output) output = input;
+
+	file = mpeg3_open(input, &error);
+	if(!file)
+	{
+		fprintf(stderr, "mpeg3tocpack: can't open \"%s\"\n", input);
+		exit(1);
+	}
+
+	if(!mpeg3_has_toc(file))
+	{
+		fprintf(stderr, "mpeg3tocpack: \"%s\" isn't a table of contents\n", input);
+		mpeg3_close(file);
+		exit(1);
+	}
+
+// The input stays mapped until it's closed.  The output replaces it only
+// after it's written.
+	if(mpeg3_write_toc(file, output))
+	{
+		mpeg3_close(file);
+		exit(1);
+	}
+	mpeg3_close(file);
+
+	if(do_benchmark)
+	{
+		file = mpeg3_open(output, &error);
+		if(!file)
+		{
+			fprintf(stderr, "mpeg3tocpack: can't open \"%s\"\n", output);
+			exit(1);
+		}
+
+		for(i = 0; i < file->total_vstreams; i++)
+		{
+			mpeg3_vtrack_t *vtrack = file->vtrack[i];
+			printf("video %d:\n", i);
+			benchmark("frame offsets",
+				vtrack->packed_frame_offsets,
+				vtrack->total_frame_offsets);
+			benchmark("keyframes",
+				vtrack->packed_keyframe_numbers,
+				vtrack->total_keyframe_numbers);
+		}
+
+		for(i = 0; i < file->total_astreams; i++)
+		{
+			mpeg3_atrack_t *atrack = file->atrack[i];
+			printf("audio %d:\n", i);
+			benchmark("sample offsets",
+				atrack->packed_sample_offsets,
+				atrack->total_sample_offsets);
+		}
+		mpeg3_close(file);
+	}
+
+	return 0;
+}
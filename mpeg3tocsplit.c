@@ -0,0 +1,1104 @@
+#include "libmpeg3.h"
+#include "mpeg3protos.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* Parallel table of contents.  The file is split into byte ranges on */
+/* packet boundaries and every range is scanned by mpeg3_do_toc on its own */
+/* thread and its own mpeg3_t.  A range doesn't know the state of the */
+/* decoders at its start, so it keeps scanning past its end until the */
+/* tracks of the next range have caught up.  The seam of a track is the */
+/* first packet after which both ranges agree on the state of its scanner. */
+/* The frame, sample and seek tables are stitched at the seams and the */
+/* audio index is rebuilt from high and low pairs kept by every range.  The */
+/* synthesis filter of the next range starts at a different offset in its */
+/* ring buffer so its pairs may differ from a single scan by rounding. */
+/* If a seam isn't found the file is scanned from the start instead. */
+
+
+
+static mpeg3_toctrack_t* new_track(int pid, int64_t created)
+{
+	mpeg3_toctrack_t *track = calloc(1, sizeof(mpeg3_toctrack_t));
+	track->pid = pid;
+	track->created = created;
+	return track;
+}
+
+static void delete_track(mpeg3_toctrack_t *track)
+{
+	int i;
+	if(track->keyframes) free(track->keyframes);
+	if(track->frames) free(track->frames);
+	if(track->chunks) free(track->chunks);
+	if(track->pairs)
+	{
+		for(i = 0; i < track->channels; i++)
+			free(track->pairs[i]);
+		free(track->pairs);
+	}
+
+	if(track->stitched_vtrack)
+	{
+		free(track->stitched_vtrack->frame_offsets);
+		free(track->stitched_vtrack->keyframe_numbers);
+		free(track->stitched_vtrack);
+	}
+	if(track->stitched_atrack)
+	{
+		free(track->stitched_atrack->sample_offsets);
+		free(track->stitched_atrack->seek_packets);
+		free(track->stitched_atrack->seek_samples);
+		free(track->stitched_atrack);
+	}
+	if(track->stitched_index) mpeg3_delete_index(track->stitched_index);
+	free(track);
+}
+
+static void delete_range(mpeg3_tocrange_t *range)
+{
+	int i;
+	for(i = 0; i < range->total_atracks; i++)
+		delete_track(range->atracks[i]);
+	for(i = 0; i < range->total_vtracks; i++)
+		delete_track(range->vtracks[i]);
+	if(range->atracks) free(range->atracks);
+	if(range->vtracks) free(range->vtracks);
+	if(range->file) mpeg3_delete(range->file);
+	free(range);
+}
+
+static mpeg3_toctrack_t* append_track(mpeg3_toctrack_t ***tracks,
+	int *total,
+	mpeg3_toctrack_t *track)
+{
+	*tracks = realloc(*tracks, sizeof(mpeg3_toctrack_t*) * (*total + 1));
+	(*tracks)[(*total)++] = track;
+	return track;
+}
+
+/* Keep the state of the frame scanner after a packet which added frames */
+static void video_packet(mpeg3_tocrange_t *range,
+	mpeg3_toctrack_t *track,
+	mpeg3_vtrack_t *vtrack,
+	int64_t start)
+{
+	mpeg3video_t *video = vtrack->video;
+	mpeg3_tocframe_t *frame;
+	int frames = vtrack->total_frame_offsets;
+	int i;
+
+	if(frames > track->keyframes_allocated)
+	{
+		int new_allocated = MAX(frames * 2, 1024);
+		track->keyframes = realloc(track->keyframes, new_allocated);
+		bzero(track->keyframes + track->keyframes_allocated,
+			new_allocated - track->keyframes_allocated);
+		track->keyframes_allocated = new_allocated;
+	}
+
+// The first keyframe is frame 0 when the track is created.  The rest are
+// stored as 1 less than the frame which was added.
+	for(i = track->total_keyframes; i < vtrack->total_keyframe_numbers; i++)
+		track->keyframes[i ? vtrack->keyframe_numbers[i] + 1 : 0] = 1;
+	track->total_keyframes = vtrack->total_keyframe_numbers;
+
+	if(track->total_frames &&
+		frames == track->frames[track->total_frames - 1].frames) return;
+
+	if(track->total_frames >= track->frames_allocated)
+	{
+		track->frames_allocated = MAX(track->total_frames * 2, 1024);
+		track->frames = realloc(track->frames,
+			sizeof(mpeg3_tocframe_t) * track->frames_allocated);
+	}
+
+	frame = &track->frames[track->total_frames++];
+	frame->packet = start;
+	frame->frames = frames;
+	frame->remaining = vtrack->demuxer->data_size -
+		vtrack->demuxer->data_position;
+	frame->prev_frame_offset = vtrack->prev_frame_offset;
+	frame->got_top = vtrack->got_top;
+	frame->got_keyframe = vtrack->got_keyframe;
+	frame->repeat_count = video->picture->repeat_count;
+	frame->current_repeat = video->picture->current_repeat;
+	frame->pict_struct = video->picture->pict_struct;
+	frame->prog_seq = video->picture->prog_seq;
+	frame->found_seqhdr = video->picture->found_seqhdr;
+	frame->mpeg2 = video->picture->mpeg2;
+/* Older bytes in the bit buffer don't change the decoding */
+	frame->bfr = (uint32_t)video->vstream->bfr;
+	frame->bit_number = video->vstream->bit_number;
+	frame->bfr_size = video->vstream->bfr_size;
+
+	if(start >= range->end_byte) track->overlap++;
+}
+
+/* Store high and low pairs for the new samples */
+static void fold_pairs(mpeg3_toctrack_t *track, mpeg3audio_t *audio)
+{
+	int zoom = track->zoom;
+	int new_pairs = track->samples / zoom - track->total_pairs;
+	int i, j, k;
+
+	if(track->total_pairs + new_pairs > track->pairs_allocated)
+	{
+		track->pairs_allocated = MAX((track->total_pairs + new_pairs) * 2, 1024);
+		if(!track->pairs) track->pairs = calloc(track->channels, sizeof(float*));
+		for(i = 0; i < track->channels; i++)
+			track->pairs[i] = realloc(track->pairs[i],
+				sizeof(float) * 2 * track->pairs_allocated);
+	}
+
+	for(i = 0; i < track->channels; i++)
+	{
+		float *out = track->pairs[i] + track->total_pairs * 2;
+		for(j = 0; j < new_pairs; j++)
+		{
+			float *in = mpeg3audio_output(audio, 
+				i, 
+				(track->total_pairs + j) * zoom, 
+				zoom);
+			float max = in[0];
+			float min = in[0];
+			for(k = 1; k < zoom; k++)
+			{
+				max = MAX(max, in[k]);
+				min = MIN(min, in[k]);
+			}
+// Same as mpeg3_update_index
+			*out++ = max + 0.0f;
+			*out++ = min + 0.0f;
+		}
+	}
+
+	track->total_pairs += new_pairs;
+}
+
+/* Double the zoom of the pairs */
+static void halve_pairs(mpeg3_toctrack_t *track)
+{
+	int i, j;
+	for(i = 0; i < track->channels; i++)
+	{
+		float *in = track->pairs[i];
+		float *out = track->pairs[i];
+		for(j = 0; j < track->total_pairs / 2; j++)
+		{
+			*out++ = MAX(in[0], in[2]);
+			*out++ = MIN(in[1], in[3]);
+			in += 4;
+		}
+	}
+	track->total_pairs /= 2;
+	track->zoom *= 2;
+}
+
+/* Keep the state of the decoder after a packet which decoded samples */
+static void audio_packet(mpeg3_tocrange_t *range,
+	mpeg3_toctrack_t *track,
+	mpeg3_atrack_t *atrack,
+	int64_t start)
+{
+	mpeg3audio_t *audio = atrack->audio;
+	int64_t samples = (int64_t)audio->output_position + audio->output_size;
+
+	if(samples > track->samples)
+	{
+		int64_t increment = samples - track->samples;
+		mpeg3_tocchunk_t *chunk;
+
+// Pairs can't be longer than the largest power of 2 dividing every
+// increment
+		if(!track->zoom)
+		{
+			track->zoom = 1;
+			track->max_zoom = increment & -increment;
+			track->channels = atrack->channels;
+		}
+		track->max_zoom = MIN(track->max_zoom, increment & -increment);
+
+		if(track->zoom > track->max_zoom ||
+			atrack->channels != track->channels)
+		{
+			range->failed = 1;
+			return;
+		}
+
+		if(track->total_chunks >= track->chunks_allocated)
+		{
+			track->chunks_allocated = MAX(track->total_chunks * 2, 1024);
+			track->chunks = realloc(track->chunks,
+				sizeof(mpeg3_tocchunk_t) * track->chunks_allocated);
+		}
+
+		chunk = &track->chunks[track->total_chunks++];
+		chunk->packet = start;
+		chunk->prev_offset = track->prev_offset;
+		chunk->samples = samples;
+		chunk->idle = track->idle;
+		chunk->remaining = atrack->demuxer->data_size -
+			atrack->demuxer->data_position;
+		chunk->packet_position = audio->packet_position;
+
+		track->idle = 0;
+		track->samples = samples;
+		if(!range->failed)
+		{
+			fold_pairs(track, audio);
+			while(track->total_pairs > MPEG3_TOC_PAIRS &&
+				track->zoom < track->max_zoom)
+				halve_pairs(track);
+		}
+		if(start >= range->end_byte) track->overlap++;
+	}
+	else
+		track->idle++;
+
+	track->prev_offset = start;
+
+// Keep enough samples to finish the index if this is the last range of
+// the track.
+	if(audio->output_size > MPEG3_AUDIO_CHUNKSIZE * 4)
+	{
+		mpeg3_shift_audio(audio,
+			audio->output_size - MPEG3_AUDIO_CHUNKSIZE * 2);
+		atrack->current_position = audio->output_position;
+	}
+}
+
+/* Record the tracks which the last packet went to */
+static void range_packet(mpeg3_tocrange_t *range, int64_t start)
+{
+	mpeg3_t *file = range->file;
+	int i;
+
+// Subtitle offsets aren't stitched
+	if(file->total_sstreams) range->failed = 1;
+
+	for(i = 0; i < file->total_vstreams; i++)
+	{
+		mpeg3_vtrack_t *vtrack = file->vtrack[i];
+		if(i >= range->total_vtracks)
+			append_track(&range->vtracks,
+				&range->total_vtracks,
+				new_track(vtrack->pid, start))->vtrack = vtrack;
+		if(vtrack->prev_offset == start)
+			video_packet(range, range->vtracks[i], vtrack, start);
+	}
+
+	for(i = 0; i < file->total_astreams; i++)
+	{
+		mpeg3_atrack_t *atrack = file->atrack[i];
+		if(i >= range->total_atracks)
+			append_track(&range->atracks,
+				&range->total_atracks,
+				new_track(atrack->pid, start))->atrack = atrack;
+		if(atrack->prev_offset == start)
+			audio_packet(range, range->atracks[i], atrack, start);
+	}
+}
+
+/* The next range has probably caught up with every track */
+static int overlap_done(mpeg3_tocrange_t *range, int64_t start)
+{
+	int i;
+	if(start >= range->end_byte + MPEG3_TOC_OVERLAP) return 1;
+
+	for(i = 0; i < range->total_vtracks; i++)
+		if(range->vtracks[i]->overlap < MPEG3_TOC_RECORDS) return 0;
+	for(i = 0; i < range->total_atracks; i++)
+		if(range->atracks[i]->overlap < MPEG3_TOC_RECORDS) return 0;
+	return 1;
+}
+
+static void* range_loop(void *ptr)
+{
+	mpeg3_tocrange_t *range = ptr;
+	mpeg3_tocsplit_t *split = range->split;
+	mpeg3_t *file = range->file;
+	int64_t bytes = range->start_byte;
+	int64_t published = bytes;
+	int abort = 0;
+
+	while(!abort && !range->failed)
+	{
+		int64_t start = mpeg3demux_tell_byte(file->demuxer);
+		if(start >= range->end_byte && overlap_done(range, start)) break;
+
+		mpeg3_do_toc(file, &bytes);
+		range_packet(range, start);
+
+		if(bytes >= split->total_bytes || bytes <= start)
+		{
+			range->eof = 1;
+			break;
+		}
+
+		if(bytes - published >= 0x100000)
+		{
+			pthread_mutex_lock(&split->lock);
+			range->position = bytes;
+			abort = split->abort;
+			pthread_cond_broadcast(&split->cond);
+			pthread_mutex_unlock(&split->lock);
+			published = bytes;
+		}
+	}
+
+	pthread_mutex_lock(&split->lock);
+	range->position = bytes;
+	range->done = 1;
+	split->total_done++;
+// No point in finishing the others
+	if(range->failed) split->abort = 1;
+	pthread_cond_broadcast(&split->cond);
+	pthread_mutex_unlock(&split->lock);
+	return 0;
+}
+
+mpeg3_tocsplit_t* mpeg3_new_tocsplit(mpeg3_t *file, int cpus)
+{
+	mpeg3_tocsplit_t *split;
+	int64_t total_bytes = mpeg3demux_movie_size(file->demuxer);
+	int total_ranges = MIN(cpus, total_bytes / MPEG3_TOC_RANGE_MIN);
+	int i;
+
+	if(total_ranges < 2) return 0;
+
+	split = calloc(1, sizeof(mpeg3_tocsplit_t));
+	split->file = file;
+	split->total_bytes = total_bytes;
+	split->ranges = calloc(total_ranges, sizeof(mpeg3_tocrange_t*));
+	pthread_mutex_init(&split->lock, 0);
+	pthread_cond_init(&split->cond, 0);
+
+	for(i = 0; i < total_ranges; i++)
+	{
+		mpeg3_tocrange_t *range = calloc(1, sizeof(mpeg3_tocrange_t));
+		mpeg3_t *range_file;
+		split->ranges[split->total_ranges++] = range;
+		range->split = split;
+		range->start_byte = total_bytes * i / total_ranges;
+		if(file->packet_size > 0)
+			range->start_byte -= range->start_byte % file->packet_size;
+		range->position = range->start_byte;
+		if(i > 0) split->ranges[i - 1]->end_byte = range->start_byte;
+		range->end_byte = total_bytes;
+
+		range->file = range_file = mpeg3_new(file->fs->path);
+		range_file->toc_range = range;
+		if(mpeg3_open_toc_source(range_file))
+		{
+			mpeg3_delete_tocsplit(split);
+			return 0;
+		}
+		mpeg3demux_seek_byte(range_file->demuxer, range->start_byte);
+	}
+
+	for(i = 0; i < split->total_ranges; i++)
+	{
+		if(pthread_create(&split->ranges[i]->tid,
+			0,
+			range_loop,
+			split->ranges[i]))
+		{
+			perror("mpeg3_new_tocsplit");
+			mpeg3_delete_tocsplit(split);
+			return 0;
+		}
+		split->total_started++;
+	}
+
+	return split;
+}
+
+static void join_ranges(mpeg3_tocsplit_t *split)
+{
+	int i;
+	for(i = 0; i < split->total_started; i++)
+		pthread_join(split->ranges[i]->tid, 0);
+	split->total_started = 0;
+}
+
+void mpeg3_delete_tocsplit(mpeg3_tocsplit_t *split)
+{
+	int i;
+
+	pthread_mutex_lock(&split->lock);
+	split->abort = 1;
+	pthread_mutex_unlock(&split->lock);
+	join_ranges(split);
+
+	for(i = 0; i < split->total_ranges; i++)
+		delete_range(split->ranges[i]);
+	free(split->ranges);
+	pthread_mutex_destroy(&split->lock);
+	pthread_cond_destroy(&split->cond);
+	free(split);
+}
+
+
+
+
+
+
+/* Find the track in the range after number */
+static mpeg3_toctrack_t* next_track(mpeg3_tocsplit_t *split,
+	int total_ranges,
+	int number,
+	int is_audio,
+	int pid)
+{
+	mpeg3_tocrange_t *range;
+	int i;
+	if(number + 1 >= total_ranges) return 0;
+
+	range = split->ranges[number + 1];
+	if(is_audio)
+	{
+		for(i = 0; i < range->total_atracks; i++)
+			if(range->atracks[i]->pid == pid) return range->atracks[i];
+	}
+	else
+	{
+		for(i = 0; i < range->total_vtracks; i++)
+			if(range->vtracks[i]->pid == pid) return range->vtracks[i];
+	}
+	return 0;
+}
+
+/* Without a picture coding extension current_repeat only grows, so it */
+/* only matters through repeat_count - current_repeat and once that's */
+/* not positive get_header clamps repeat_count to 0 either way. */
+static int repeats_equal(mpeg3_tocframe_t *a, mpeg3_tocframe_t *b)
+{
+	int a_left = a->repeat_count - a->current_repeat;
+	int b_left = b->repeat_count - b->current_repeat;
+	return a->repeat_count == b->repeat_count &&
+		(a_left == b_left || (a_left <= 0 && b_left <= 0));
+}
+
+static int frames_equal(mpeg3_tocframe_t *a, mpeg3_tocframe_t *b)
+{
+	return a->packet == b->packet &&
+		a->remaining == b->remaining &&
+		a->prev_frame_offset == b->prev_frame_offset &&
+		a->got_top == b->got_top &&
+		a->got_keyframe == b->got_keyframe &&
+		repeats_equal(a, b) &&
+		a->pict_struct == b->pict_struct &&
+		a->prog_seq == b->prog_seq &&
+		a->found_seqhdr == b->found_seqhdr &&
+		a->mpeg2 == b->mpeg2 &&
+		a->bfr == b->bfr &&
+		a->bit_number == b->bit_number &&
+		a->bfr_size == b->bfr_size;
+}
+
+/* Find the first packet after which 2 ranges agree on a video track. */
+/* Returns 1 if there is none. */
+static int video_seam(mpeg3_toctrack_t *a,
+	mpeg3_toctrack_t *b,
+	int *a_frame,
+	int *b_frame)
+{
+	int i, j = 0;
+	for(i = 1; i < a->total_frames; i++)
+	{
+		mpeg3_tocframe_t *frame = &a->frames[i];
+		while(j < b->total_frames && b->frames[j].packet < frame->packet) j++;
+		if(j >= b->total_frames) break;
+
+		if(j > 0 &&
+			frames_equal(frame - 1, &b->frames[j - 1]) &&
+			frames_equal(frame, &b->frames[j]) &&
+			frame->frames - frame[-1].frames ==
+				b->frames[j].frames - b->frames[j - 1].frames)
+		{
+			*a_frame = i;
+			*b_frame = j;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int chunks_equal(mpeg3_toctrack_t *a,
+	int i,
+	mpeg3_toctrack_t *b,
+	int j)
+{
+	mpeg3_tocchunk_t *a_chunk = &a->chunks[i];
+	mpeg3_tocchunk_t *b_chunk = &b->chunks[j];
+	return i > 0 &&
+		j > 0 &&
+		a_chunk->packet == b_chunk->packet &&
+		a_chunk->prev_offset == b_chunk->prev_offset &&
+		a_chunk->idle == b_chunk->idle &&
+		a_chunk->remaining == b_chunk->remaining &&
+		a_chunk->packet_position == b_chunk->packet_position &&
+		a_chunk->samples - a_chunk[-1].samples ==
+			b_chunk->samples - b_chunk[-1].samples;
+}
+
+/* High and low of zoom samples from sample in a range.  Both must be */
+/* multiples of the zoom of its pairs. */
+static void zoom_pair(mpeg3_toctrack_t *track,
+	int channel,
+	int64_t sample,
+	int zoom,
+	float *out)
+{
+	float *in = track->pairs[channel] + sample / track->zoom * 2;
+	int i;
+	out[0] = in[0];
+	out[1] = in[1];
+	for(i = 1; i < zoom / track->zoom; i++)
+	{
+		in += 2;
+		out[0] = MAX(out[0], in[0]);
+		out[1] = MIN(out[1], in[1]);
+	}
+}
+
+/* Find the first packet after which 2 ranges agree on an audio track and */
+/* decode the same samples.  Returns 1 if there is none. */
+static int audio_seam(mpeg3_toctrack_t *a,
+	mpeg3_toctrack_t *b,
+	int *a_chunk,
+	int *b_chunk)
+{
+	int i, j = 0, k, l;
+	int zoom, verify;
+
+	if(!a->zoom || !b->zoom || a->channels != b->channels) return 1;
+	zoom = MAX(a->zoom, b->zoom);
+	verify = MAX(MPEG3_TOC_VERIFY / zoom, 1);
+
+	for(i = 2; i < a->total_chunks; i++)
+	{
+		int64_t a_sample = a->chunks[i].samples;
+		int64_t b_sample;
+		int result = 0;
+		while(j < b->total_chunks && b->chunks[j].packet < a->chunks[i].packet) j++;
+		if(j >= b->total_chunks) break;
+
+		if(!chunks_equal(a, i - 1, b, j - 1) ||
+			!chunks_equal(a, i, b, j)) continue;
+
+		b_sample = b->chunks[j].samples;
+		if(a_sample % zoom || b_sample % zoom) continue;
+		if((a_sample + verify * zoom) / a->zoom > a->total_pairs ||
+			(b_sample + verify * zoom) / b->zoom > b->total_pairs) break;
+
+// Decoded samples only differ by rounding once the decoders agree
+		for(k = 0; k < a->channels && !result; k++)
+		{
+			for(l = 0; l < verify && !result; l++)
+			{
+				float a_pair[2], b_pair[2];
+				zoom_pair(a, k, a_sample + l * zoom, zoom, a_pair);
+				zoom_pair(b, k, b_sample + l * zoom, zoom, b_pair);
+				result = fabs(a_pair[0] - b_pair[0]) > 0.0001 ||
+					fabs(a_pair[1] - b_pair[1]) > 0.0001;
+			}
+		}
+		if(result) continue;
+
+		*a_chunk = i;
+		*b_chunk = j;
+		return 0;
+	}
+	return 1;
+}
+
+static int stitch_video(mpeg3_tocsplit_t *split,
+	int total_ranges,
+	int number,
+	mpeg3_toctrack_t *track)
+{
+	mpeg3_vtrack_t *result = calloc(1, sizeof(mpeg3_vtrack_t));
+	int from = 0;
+	int i;
+
+	while(1)
+	{
+		mpeg3_toctrack_t *next = next_track(split,
+			total_ranges,
+			number,
+			0,
+			track->pid);
+		int to = track->vtrack->total_frame_offsets;
+		int next_from = 0;
+
+		track->stitched = 1;
+		if(next)
+		{
+			int a_frame, b_frame;
+			if(video_seam(track, next, &a_frame, &b_frame))
+			{
+				free(result->frame_offsets);
+				free(result->keyframe_numbers);
+				free(result);
+				return 1;
+			}
+			to = track->frames[a_frame].frames;
+			next_from = next->frames[b_frame].frames;
+		}
+
+		for(i = from; i < to; i++)
+			mpeg3_append_frame(result,
+				track->vtrack->frame_offsets[i],
+				track->keyframes[i]);
+
+		if(!next) break;
+		track = next;
+		from = next_from;
+		number++;
+	}
+
+	track->stitched_vtrack = result;
+	return 0;
+}
+
+/* Divide the index like mpeg3_update_index */
+static int divide_index(mpeg3_t *file,
+	int64_t *size,
+	int *zoom,
+	int channels)
+{
+	if(*size * channels * sizeof(float) * 2 > file->index_bytes &&
+		!(*size % 2))
+	{
+		*size /= 2;
+		*zoom *= 2;
+		return 1;
+	}
+	return 0;
+}
+
+static int stitch_audio(mpeg3_tocsplit_t *split,
+	int total_ranges,
+	int number,
+	mpeg3_toctrack_t *track)
+{
+	mpeg3_t *file = split->file;
+	mpeg3_atrack_t *result = calloc(1, sizeof(mpeg3_atrack_t));
+	mpeg3_index_t *index = mpeg3_new_index();
+	mpeg3_toctrack_t **segments = calloc(total_ranges, sizeof(mpeg3_toctrack_t*));
+/* Sample in the stitched track where each segment ends or -1 */
+	int64_t *ends = calloc(total_ranges, sizeof(int64_t));
+	int total_segments = 0;
+	int zoom = 1, channels = 0;
+	int64_t size = 0, consumed = 0, delta = 0;
+/* Seam packet of the last segment */
+	int64_t seam = -1;
+	int from = 0;
+	int i, j;
+
+// The first entry is the start of the packet which created the track
+	mpeg3_append_samples(result, track->atrack->sample_offsets[0]);
+
+// Replay mpeg3_update_index for every packet which decoded samples
+	while(1)
+	{
+		mpeg3_toctrack_t *next = next_track(split,
+			total_ranges,
+			number,
+			1,
+			track->pid);
+		mpeg3_atrack_t *atrack = track->atrack;
+		int to = track->total_chunks;
+		int next_from = 0;
+		int64_t next_delta = 0;
+		int64_t next_seam = -1;
+
+		track->stitched = 1;
+		track->delta = delta;
+		segments[total_segments] = track;
+		ends[total_segments++] = -1;
+
+		if(track->zoom)
+		{
+			if(!channels) channels = track->channels;
+			if(channels != track->channels ||
+				delta % track->zoom) goto fail;
+		}
+
+		if(next)
+		{
+			int a_chunk, b_chunk;
+			if(audio_seam(track, next, &a_chunk, &b_chunk)) goto fail;
+			to = a_chunk + 1;
+			next_from = b_chunk + 1;
+			ends[total_segments - 1] = track->chunks[a_chunk].samples + delta;
+			next_delta = ends[total_segments - 1] - next->chunks[b_chunk].samples;
+			next_seam = track->chunks[a_chunk].packet;
+		}
+
+// Seek points of the frames starting between the seams
+		for(i = 0; i < atrack->total_seek_points; i++)
+		{
+			int64_t packet = atrack->seek_packets[i];
+			if(packet <= seam) continue;
+			if(next && packet > next_seam) break;
+			mpeg3_append_seek(result, packet, atrack->seek_samples[i] + delta);
+		}
+
+		for(i = from; i < to; i++)
+		{
+			mpeg3_tocchunk_t *chunk = &track->chunks[i];
+			int64_t samples = chunk->samples + delta;
+			for(j = 0; j < chunk->idle; j++)
+				if(!divide_index(file, &size, &zoom, channels)) break;
+
+			while(samples - consumed > MPEG3_AUDIO_CHUNKSIZE)
+			{
+				if(zoom > MPEG3_AUDIO_CHUNKSIZE) goto fail;
+				size += MPEG3_AUDIO_CHUNKSIZE / zoom;
+				mpeg3_append_samples(result, chunk->prev_offset);
+				consumed += MPEG3_AUDIO_CHUNKSIZE;
+			}
+			divide_index(file, &size, &zoom, channels);
+		}
+
+		if(!next)
+		{
+			for(j = 0; j < track->idle; j++)
+				if(!divide_index(file, &size, &zoom, channels)) break;
+			break;
+		}
+
+		track = next;
+		from = next_from;
+		delta = next_delta;
+		seam = next_seam;
+		number++;
+	}
+
+// Samples after the index go to mpeg3_stop_toc in the decoder of the last
+// range.
+	{
+		mpeg3audio_t *audio = track->atrack->audio;
+		int64_t local = consumed - track->delta;
+		if(local < audio->output_position ||
+			local > (int64_t)audio->output_position + audio->output_size)
+			goto fail;
+	}
+
+// Combine the pairs of the ranges into the index
+	if(consumed)
+	{
+		index->index_zoom = zoom;
+		index->index_size = index->index_allocated = size;
+		index->index_channels = channels;
+		index->index_data = calloc(channels, sizeof(float*));
+		for(i = 0; i < channels; i++)
+			index->index_data[i] = malloc(sizeof(float) * 2 * size);
+
+		for(i = 0; i < total_segments; i++)
+		{
+			mpeg3_toctrack_t *segment = segments[i];
+			int64_t sample = i ? ends[i - 1] : 0;
+			int64_t end = consumed;
+			if(ends[i] >= 0) end = MIN(ends[i], consumed);
+			if(sample >= end) continue;
+			if(!segment->zoom || zoom % segment->zoom) goto fail;
+
+			for( ; sample + segment->zoom <= end; sample += segment->zoom)
+			{
+				int64_t local = (sample - segment->delta) / segment->zoom;
+				if(local < 0 || local >= segment->total_pairs) goto fail;
+
+				for(j = 0; j < channels; j++)
+				{
+					float *in = segment->pairs[j] + local * 2;
+					float *out = index->index_data[j] + (sample / zoom) * 2;
+					if(!(sample % zoom))
+					{
+						out[0] = in[0];
+						out[1] = in[1];
+					}
+					else
+					{
+						out[0] = MAX(out[0], in[0]);
+						out[1] = MIN(out[1], in[1]);
+					}
+				}
+			}
+		}
+	}
+
+	track->stitched_atrack = result;
+	track->stitched_index = index;
+	track->stitched_samples = consumed;
+	free(segments);
+	free(ends);
+	return 0;
+
+fail:
+	free(result->sample_offsets);
+	free(result->seek_packets);
+	free(result->seek_samples);
+	free(result);
+	mpeg3_delete_index(index);
+	free(segments);
+	free(ends);
+	return 1;
+}
+
+/* Track starts in this range and no earlier range saw any of it */
+static int track_starts(mpeg3_tocsplit_t *split,
+	int number,
+	int is_audio,
+	mpeg3_toctrack_t *track)
+{
+	int i, j;
+	for(i = 0; i < number; i++)
+	{
+		mpeg3_tocrange_t *range = split->ranges[i];
+		if(is_audio)
+		{
+			for(j = 0; j < range->total_atracks; j++)
+				if(range->atracks[j]->pid == track->pid) return 0;
+		}
+		else
+		{
+			for(j = 0; j < range->total_vtracks; j++)
+				if(range->vtracks[j]->pid == track->pid) return 0;
+		}
+	}
+
+	return !number || track->created >= split->ranges[number - 1]->position;
+}
+
+static void remove_vtrack(mpeg3_t *file, mpeg3_vtrack_t *vtrack)
+{
+	int i;
+	for(i = 0; i < file->total_vstreams; i++)
+	{
+		if(file->vtrack[i] == vtrack)
+		{
+			memmove(file->vtrack + i,
+				file->vtrack + i + 1,
+				sizeof(mpeg3_vtrack_t*) * (file->total_vstreams - i - 1));
+			file->total_vstreams--;
+			return;
+		}
+	}
+}
+
+static void remove_atrack(mpeg3_t *file, mpeg3_atrack_t *atrack)
+{
+	int i;
+	for(i = 0; i < file->total_astreams; i++)
+	{
+		if(file->atrack[i] == atrack)
+		{
+			memmove(file->atrack + i,
+				file->atrack + i + 1,
+				sizeof(mpeg3_atrack_t*) * (file->total_astreams - i - 1));
+			file->total_astreams--;
+			return;
+		}
+	}
+}
+
+/* Give the tracks of the last range of every stitched track to the file */
+static void move_tracks(mpeg3_tocsplit_t *split, mpeg3_tocrange_t *range)
+{
+	mpeg3_t *file = split->file;
+	mpeg3_t *range_file = range->file;
+	int i;
+
+	for(i = 0; i < range->total_vtracks; i++)
+	{
+		mpeg3_toctrack_t *track = range->vtracks[i];
+		mpeg3_vtrack_t *vtrack = track->vtrack;
+		mpeg3_vtrack_t *result = track->stitched_vtrack;
+		if(!result) continue;
+
+// The last frames of the range are the last frames of the stitched track
+		mpeg3_shift_points(vtrack->toc_points,
+			vtrack->total_toc_points,
+			result->total_frame_offsets - vtrack->total_frame_offsets);
+		if(vtrack->private_offsets)
+		{
+			if(vtrack->frame_offsets) free(vtrack->frame_offsets);
+			if(vtrack->keyframe_numbers) free(vtrack->keyframe_numbers);
+		}
+		vtrack->frame_offsets = result->frame_offsets;
+		vtrack->total_frame_offsets = result->total_frame_offsets;
+		vtrack->frame_offsets_allocated = result->frame_offsets_allocated;
+		vtrack->keyframe_numbers = result->keyframe_numbers;
+		vtrack->total_keyframe_numbers = result->total_keyframe_numbers;
+		vtrack->keyframe_numbers_allocated = result->keyframe_numbers_allocated;
+		vtrack->private_offsets = 1;
+		free(result);
+		track->stitched_vtrack = 0;
+
+		remove_vtrack(range_file, vtrack);
+		mpeg3_append_vtrack(file, vtrack);
+	}
+
+	for(i = 0; i < range->total_atracks; i++)
+	{
+		mpeg3_toctrack_t *track = range->atracks[i];
+		mpeg3_atrack_t *atrack = track->atrack;
+		mpeg3_atrack_t *result = track->stitched_atrack;
+		mpeg3audio_t *audio = atrack->audio;
+		if(!result) continue;
+
+		if(atrack->sample_offsets && atrack->private_offsets)
+			free(atrack->sample_offsets);
+		atrack->sample_offsets = result->sample_offsets;
+		atrack->total_sample_offsets = result->total_sample_offsets;
+		atrack->sample_offsets_allocated = result->sample_offsets_allocated;
+		atrack->private_offsets = 1;
+		if(atrack->seek_packets) free(atrack->seek_packets);
+		if(atrack->seek_samples) free(atrack->seek_samples);
+		atrack->seek_packets = result->seek_packets;
+		atrack->seek_samples = result->seek_samples;
+		atrack->total_seek_points = result->total_seek_points;
+		atrack->seek_points_allocated = result->seek_points_allocated;
+		free(result);
+		track->stitched_atrack = 0;
+
+// Put the decoder at the first sample which isn't in the index
+		mpeg3_shift_audio(audio,
+			track->stitched_samples - track->delta - audio->output_position);
+		audio->output_position = track->stitched_samples;
+		atrack->current_position = track->stitched_samples;
+		mpeg3_shift_points(atrack->toc_points,
+			atrack->total_toc_points,
+			track->delta);
+
+		file->total_indexes++;
+		file->indexes = realloc(file->indexes,
+			file->total_indexes * sizeof(mpeg3_index_t*));
+		file->indexes[file->total_indexes - 1] = track->stitched_index;
+		track->stitched_index = 0;
+
+		remove_atrack(range_file, atrack);
+		mpeg3_append_atrack(file, atrack);
+	}
+}
+
+/* Returns 1 if the tracks can't be stitched */
+static int stitch(mpeg3_tocsplit_t *split)
+{
+	mpeg3_t *file = split->file;
+	int total_ranges = split->total_ranges;
+	int i, j;
+
+// Ranges after one which got to the end of the file aren't needed
+	for(i = 0; i < split->total_ranges; i++)
+	{
+		if(split->ranges[i]->eof)
+		{
+			total_ranges = i + 1;
+			break;
+		}
+	}
+
+	for(i = 0; i < total_ranges; i++)
+	{
+		mpeg3_tocrange_t *range = split->ranges[i];
+		for(j = 0; j < range->total_vtracks; j++)
+		{
+			mpeg3_toctrack_t *track = range->vtracks[j];
+			if(track->stitched) continue;
+			if(!track_starts(split, i, 0, track) ||
+				stitch_video(split, total_ranges, i, track)) return 1;
+		}
+
+		for(j = 0; j < range->total_atracks; j++)
+		{
+			mpeg3_toctrack_t *track = range->atracks[j];
+			if(track->stitched) continue;
+			if(!track_starts(split, i, 1, track) ||
+				stitch_audio(split, total_ranges, i, track)) return 1;
+		}
+	}
+
+	for(i = 0; i < total_ranges; i++)
+	{
+		mpeg3_tocrange_t *range = split->ranges[i];
+		mpeg3_demuxer_t *demuxer = ((mpeg3_t*)range->file)->demuxer;
+		for(j = 0; j < demuxer->total_streams; j++)
+		{
+			mpeg3_streamid_t *stream = &demuxer->streams[j];
+			if(stream->audio)
+				mpeg3demux_set_audio_stream(file->demuxer,
+					stream->id,
+					stream->audio);
+			if(stream->video)
+				mpeg3demux_set_video_stream(file->demuxer,
+					stream->id,
+					stream->video);
+		}
+
+		move_tracks(split, range);
+	}
+
+	return 0;
+}
+
+int mpeg3_tocsplit_wait(mpeg3_tocsplit_t *split, int64_t *bytes_processed)
+{
+	int64_t progress = 0;
+	int done;
+	int i;
+
+	if(split->stitched)
+	{
+		*bytes_processed = split->total_bytes;
+		return 0;
+	}
+
+	pthread_mutex_lock(&split->lock);
+	if(split->total_done < split->total_started)
+	{
+		struct timeval now;
+		struct timespec timeout;
+		gettimeofday(&now, 0);
+		timeout.tv_sec = now.tv_sec + 1;
+		timeout.tv_nsec = now.tv_usec * 1000;
+		pthread_cond_timedwait(&split->cond, &split->lock, &timeout);
+	}
+
+	for(i = 0; i < split->total_ranges; i++)
+	{
+		mpeg3_tocrange_t *range = split->ranges[i];
+		progress += MIN(range->position, range->end_byte) - range->start_byte;
+	}
+	done = split->total_done >= split->total_started;
+	pthread_mutex_unlock(&split->lock);
+
+	if(!done)
+	{
+		*bytes_processed = MIN(progress, split->total_bytes - 1);
+		return 0;
+	}
+
+	join_ranges(split);
+	if(split->abort || stitch(split))
+	{
+		fprintf(stderr,
+			"mpeg3_do_toc: couldn't stitch the byte ranges.  "
+			"Scanning from the start.\n");
+		*bytes_processed = 0;
+		return 1;
+	}
+
+	split->stitched = 1;
+	*bytes_processed = split->total_bytes;
+	return 0;
+}
+
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 static FILE *test_file = 0;
@@ -131,6 +132,163 @@ static void complete_path(char *result, char *toc_path, char *path)
 	}
 }
 
+// Map a table of contents with a section directory.  The header is the
+// prefix, the version, the byte order mark, the number of sections and the
+// offset of the directory.
+static int map_toc(mpeg3_t *file)
+{
+	int64_t bytes = mpeg3io_total_bytes(file->fs);
+	unsigned char *map;
+	uint32_t order, total_sections;
+	uint64_t directory;
+
+	if(bytes < 24 || (size_t)bytes != bytes)
+	{
+		fprintf(stderr, "mpeg3_read_toc: TOC is truncated\n");
+		return 1;
+	}
+
+	map = mmap(0, bytes, PROT_READ, MAP_PRIVATE, fileno(file->fs->fd), 0);
+	if(map == MAP_FAILED)
+	{
+		perror("mpeg3_read_toc");
+		return 1;
+	}
+	file->toc_map = map;
+	file->toc_map_size = bytes;
+
+	memcpy(&order, map + 8, sizeof(uint32_t));
+	memcpy(&total_sections, map + 12, sizeof(uint32_t));
+	memcpy(&directory, map + 16, sizeof(uint64_t));
+	if(order != MPEG3_TOC_ORDER)
+	{
+		fprintf(stderr, 
+			"mpeg3_read_toc: TOC was written with another byte order\n");
+		return 1;
+	}
+
+	if(directory % MPEG3_TOC_ALIGN ||
+		directory > bytes ||
+		total_sections > (bytes - directory) / sizeof(mpeg3_tocsection_t))
+	{
+		fprintf(stderr, "mpeg3_read_toc: TOC is truncated\n");
+		return 1;
+	}
+	return 0;
+}
+
+// Get a section from a mapped table of contents
+static mpeg3_tocsection_t* find_section(mpeg3_t *file, int type, int track)
+{
+	uint32_t total_sections;
+	uint64_t directory;
+	mpeg3_tocsection_t *sections;
+	int i;
+
+	memcpy(&total_sections, file->toc_map + 12, sizeof(uint32_t));
+	memcpy(&directory, file->toc_map + 16, sizeof(uint64_t));
+	sections = (mpeg3_tocsection_t*)(file->toc_map + directory);
+
+	for(i = 0; i < total_sections; i++)
+	{
+		mpeg3_tocsection_t *section = &sections[i];
+		if(section->type == type && section->track == track)
+		{
+			if(!(section->offset % MPEG3_TOC_ALIGN) &&
+				section->offset <= file->toc_map_size &&
+				section->bytes <= file->toc_map_size - section->offset)
+				return section;
+			break;
+		}
+	}
+
+	fprintf(stderr, 
+		"mpeg3_read_toc: bad section %x of track %d\n", 
+		type, 
+		track);
+	return 0;
+}
+
+// Get a table of count entries of size bytes
+static void* toc_table(mpeg3_t *file, 
+	int type, 
+	int track, 
+	int64_t count, 
+	int size)
+{
+	mpeg3_tocsection_t *section = find_section(file, type, track);
+	if(!section) return 0;
+	if(section->count != count || section->bytes != count * size)
+	{
+		fprintf(stderr, 
+			"mpeg3_read_toc: wrong size of section %x of track %d\n", 
+			type, 
+			track);
+		return 0;
+	}
+	return file->toc_map + section->offset;
+}
+
+// Get a packed table of count entries
+static unsigned char* toc_packed(mpeg3_t *file, 
+	int type, 
+	int track, 
+	int64_t count)
+{
+	mpeg3_tocsection_t *section = find_section(file, type, track);
+	int64_t blocks = (count + MPEG3_TOC_BLOCK - 1) / MPEG3_TOC_BLOCK;
+	unsigned char *table;
+	int64_t i;
+
+	if(!section) return 0;
+	table = file->toc_map + section->offset;
+	if(section->count != count ||
+		section->bytes < blocks * sizeof(mpeg3_tocblock_t) + 8)
+		blocks = -1;
+
+// Every entry must be readable with an 8 byte load inside the section
+	for(i = 0; i < blocks; i++)
+	{
+		mpeg3_tocblock_t *block = (mpeg3_tocblock_t*)table + i;
+		int64_t entries = MIN(count - i * MPEG3_TOC_BLOCK, MPEG3_TOC_BLOCK);
+		if((block->bits > 57 && block->bits != 64) ||
+			block->offset + (entries * block->bits + 7) / 8 + 8 > 
+				section->bytes)
+			break;
+	}
+
+	if(i < blocks || blocks < 0)
+	{
+		fprintf(stderr, 
+			"mpeg3_read_toc: wrong size of section %x of track %d\n", 
+			type, 
+			track);
+		return 0;
+	}
+	return table;
+}
+
+// Get the resume points of a track
+static mpeg3_tocpoint_t* toc_points(mpeg3_t *file, 
+	int type, 
+	int track, 
+	int *total)
+{
+	mpeg3_tocsection_t *section = find_section(file, type, track);
+	if(!section) return 0;
+	if(section->count > MPEG3_TOC_POINTS ||
+		section->bytes != section->count * sizeof(mpeg3_tocpoint_t))
+	{
+		fprintf(stderr, 
+			"mpeg3_read_toc: wrong size of section %x of track %d\n", 
+			type, 
+			track);
+		return 0;
+	}
+	*total = section->count;
+	return (mpeg3_tocpoint_t*)(file->toc_map + section->offset);
+}
+
 int mpeg3_read_toc(mpeg3_t *file, 
 	int *atracks_return, 
 	int *vtracks_return)
@@ -152,15 +310,32 @@ const int debug = 0;
 	if(!strncmp(file->fs->path, RENDERFARM_FS_PREFIX, vfs_len))
 		is_vfs = 1;
 
-	buffer_size = mpeg3io_total_bytes(file->fs);
-	buffer = malloc(buffer_size);
-	mpeg3io_seek(file->fs, 0);
-	mpeg3io_read_data(buffer, buffer_size, file->fs);
-
 // Test version
-	if((toc_version = read_int32(buffer, &position)) != MPEG3_TOC_VERSION)
+	mpeg3io_seek(file->fs, 4);
+	toc_version = mpeg3io_read_int32(file->fs);
+	if(toc_version == MPEG3_TOC_VERSION)
+	{
+// Tables stay in the mapping and are paged in when they're used
+		mpeg3_tocsection_t *info;
+		if(map_toc(file) ||
+			!(info = find_section(file, SECTION_INFO, 0)) ||
+			info->offset + info->bytes > 0x7fffffff) 
+			return MPEG3_INVALID_TOC_VERSION;
+		buffer = file->toc_map;
+		position = info->offset;
+		buffer_size = info->offset + info->bytes;
+	}
+	else
+	if(toc_version == MPEG3_TOC_VERSION_INLINE)
+	{
+		buffer_size = mpeg3io_total_bytes(file->fs);
+		buffer = malloc(buffer_size);
+		mpeg3io_seek(file->fs, 0);
+		mpeg3io_read_data(buffer, buffer_size, file->fs);
+		position = 8;
+	}
+	else
 	{
-		free(buffer);
 		fprintf(stderr,
 			"mpeg3_read_toc: invalid TOC version %x\n", 
 			toc_version);
@@ -198,7 +373,11 @@ const int debug = 0;
 				complete_path(string2, file->fs->path, string);
 
 				position += MPEG3_STRLEN;
+				string[MPEG3_STRLEN - 1] = 0;
+				strcpy(file->source_path, string);
 				file->source_date = read_int64(buffer, &position);
+				if(file->toc_map)
+					file->source_size = read_int64(buffer, &position);
 				int64_t current_date = mpeg3_calculate_source_date(string2);
 /*
  * printf("mpeg3_read_toc file=%s source_date=%lld current_date=%lld\n", 
@@ -206,10 +385,11 @@ const int debug = 0;
  * file->source_date,
  * current_date);
  */
-				if(current_date != file->source_date)
+				if(current_date != file->source_date && 
+					!file->ignore_source_date)
 				{
 					fprintf(stderr, "read_toc: date mismatch\n");
-					free(buffer);
+					if(!file->toc_map) free(buffer);
 					return MPEG3_TOC_DATE_MISMATCH;
 				}
 				break;
@@ -221,7 +401,7 @@ const int debug = 0;
 				int stream_id;
 				number = read_int32(buffer, &position);
 				stream_id = read_int32(buffer, &position);
-				file->demuxer->astream_table[number] = stream_id;
+				mpeg3demux_set_audio_stream(file->demuxer, number, stream_id);
 				break;
 			}
 
@@ -232,7 +412,7 @@ const int debug = 0;
 
 				number = read_int32(buffer, &position);
 				stream_id = read_int32(buffer, &position);
-				file->demuxer->vstream_table[number] = stream_id;
+				mpeg3demux_set_video_stream(file->demuxer, number, stream_id);
 				break;
 			}
 
@@ -246,6 +426,21 @@ const int debug = 0;
 				file->total_samples = calloc(sizeof(int64_t), *atracks_return);
 				file->indexes = calloc(sizeof(mpeg3_index_t*), *atracks_return);
 				file->total_indexes = *atracks_return;
+				if(file->toc_map)
+				{
+					file->packed_sample_offsets = 
+						calloc(sizeof(unsigned char*), *atracks_return);
+					file->audio_points = 
+						calloc(sizeof(mpeg3_tocpoint_t*), *atracks_return);
+					file->total_audio_points = 
+						calloc(sizeof(int), *atracks_return);
+					file->packed_seek_packets = 
+						calloc(sizeof(unsigned char*), *atracks_return);
+					file->packed_seek_samples = 
+						calloc(sizeof(unsigned char*), *atracks_return);
+					file->total_seek_points = 
+						calloc(sizeof(int), *atracks_return);
+				}
 				for(i = 0; i < *atracks_return; i++)
 				{
 					file->audio_eof[i] = read_int64(buffer, &position);
@@ -254,10 +449,33 @@ const int debug = 0;
 					file->total_samples[i] = read_int64(buffer, &position);
 
 					if(file->total_samples[i] < 1) file->total_samples[i] = 1;
-					file->sample_offsets[i] = malloc(file->total_sample_offsets[i] * sizeof(int64_t));
-					for(j = 0; j < file->total_sample_offsets[i]; j++)
+					if(file->toc_map)
+					{
+						file->total_seek_points[i] = read_int32(buffer, &position);
+						if(!(file->packed_seek_packets[i] = toc_packed(file,
+								SECTION_PACKED_SEEK_PACKETS,
+								i,
+								file->total_seek_points[i])) ||
+							!(file->packed_seek_samples[i] = toc_packed(file,
+								SECTION_PACKED_SEEK_SAMPLES,
+								i,
+								file->total_seek_points[i])) ||
+							!(file->audio_points[i] = toc_points(file,
+								SECTION_AUDIO_POINTS,
+								i,
+								&file->total_audio_points[i])) ||
+							!(file->packed_sample_offsets[i] = toc_packed(file,
+								SECTION_PACKED_SAMPLE_OFFSETS,
+								i,
+								file->total_sample_offsets[i]))) return 1;
+					}
+					else
 					{
-						file->sample_offsets[i][j] = read_int64(buffer, &position);
+						file->sample_offsets[i] = malloc(file->total_sample_offsets[i] * sizeof(int64_t));
+						for(j = 0; j < file->total_sample_offsets[i]; j++)
+						{
+							file->sample_offsets[i][j] = read_int64(buffer, &position);
+						}
 					}
 
 					mpeg3_index_t *index = file->indexes[i] = mpeg3_new_index();
@@ -265,6 +483,21 @@ const int debug = 0;
 					index->index_zoom = read_int32(buffer, &position);
 //printf("mpeg3_read_toc %d %d %d\n", i, index->index_size, index->index_zoom);
 					int channels = index->index_channels = file->channel_counts[i];
+					if(channels && file->toc_map)
+					{
+						float *data = toc_table(file,
+							SECTION_INDEX,
+							i,
+							(int64_t)index->index_size * 2 * channels,
+							sizeof(float));
+						if(!data) return 1;
+						index->index_data = calloc(sizeof(float*), channels);
+						for(j = 0; j < channels; j++)
+							index->index_data[j] = data + 
+								(int64_t)index->index_size * 2 * j;
+						index->mapped = 1;
+					}
+					else
 					if(channels)
 					{
 						index->index_data = calloc(sizeof(float*), channels);
@@ -288,10 +521,39 @@ const int debug = 0;
 				file->keyframe_numbers = calloc(sizeof(int64_t*), *vtracks_return);
 				file->total_keyframe_numbers = calloc(sizeof(int), *vtracks_return);
 				file->video_eof = calloc(sizeof(int64_t), *vtracks_return);
+				if(file->toc_map)
+				{
+					file->packed_frame_offsets = 
+						calloc(sizeof(unsigned char*), *vtracks_return);
+					file->packed_keyframe_numbers = 
+						calloc(sizeof(unsigned char*), *vtracks_return);
+					file->video_points = 
+						calloc(sizeof(mpeg3_tocpoint_t*), *vtracks_return);
+					file->total_video_points = 
+						calloc(sizeof(int), *vtracks_return);
+				}
 				for(i = 0; i < *vtracks_return; i++)
 				{
 					file->video_eof[i] = read_int64(buffer, &position);
 					file->total_frame_offsets[i] = read_int32(buffer, &position);
+					if(file->toc_map)
+					{
+						file->total_keyframe_numbers[i] = read_int32(buffer, &position);
+						if(!(file->video_points[i] = toc_points(file,
+								SECTION_VIDEO_POINTS,
+								i,
+								&file->total_video_points[i])) ||
+							!(file->packed_frame_offsets[i] = toc_packed(file,
+								SECTION_PACKED_FRAME_OFFSETS,
+								i,
+								file->total_frame_offsets[i])) ||
+							!(file->packed_keyframe_numbers[i] = toc_packed(file,
+								SECTION_PACKED_KEYFRAMES,
+								i,
+								file->total_keyframe_numbers[i]))) return 1;
+						continue;
+					}
+
 					file->frame_offsets[i] = malloc(file->total_frame_offsets[i] * sizeof(int64_t));
 if(debug) printf("mpeg3_read_toc 62 %d %d %lld\n", 
 file->total_frame_offsets[i], position, buffer_size);
@@ -314,14 +576,29 @@ if(debug) printf("mpeg3_read_toc 64\n");
 
 			case STRACK_COUNT:
 			{
-				file->total_sstreams = read_int32(buffer, &position);
-				for(i = 0; i < file->total_sstreams; i++)
+				int total_sstreams = read_int32(buffer, &position);
+				for(i = 0; i < total_sstreams; i++)
 				{
 					int id = read_int32(buffer, &position);
-					mpeg3_strack_t *strack = file->strack[i] = mpeg3_new_strack(id);
+					mpeg3_strack_t *strack = 
+						mpeg3_append_strack(file, mpeg3_new_strack(id));
 					strack->total_offsets = read_int32(buffer, &position);
 					strack->offsets = malloc(sizeof(int64_t) * strack->total_offsets);
 					strack->allocated_offsets = strack->total_offsets;
+// Subtitle tracks are copied between files so they own their offsets
+					if(file->toc_map)
+					{
+						int64_t *offsets = toc_table(file,
+							SECTION_SUBTITLE_OFFSETS,
+							i,
+							strack->total_offsets,
+							sizeof(int64_t));
+						if(!offsets) return 1;
+						memcpy(strack->offsets, 
+							offsets, 
+							sizeof(int64_t) * strack->total_offsets);
+					}
+					else
 					for(j = 0; j < strack->total_offsets; j++)
 					{
 						strack->offsets[j] = read_int64(buffer, &position);
@@ -417,8 +694,8 @@ if(debug) printf("mpeg3_read_toc 20\n");
 
 if(debug) printf("mpeg3_read_toc 30\n");
 				title = 
-					file->demuxer->titles[file->demuxer->total_titles++] = 
-					mpeg3_new_title(file, string);
+					mpeg3demux_append_title(file->demuxer,
+						mpeg3_new_title(file, string));
 
 				title->total_bytes = read_int64(buffer, &position);
 				title->start_byte = current_byte;
@@ -483,7 +760,7 @@ if(debug) printf("mpeg3_read_toc 30\n");
 
 
 
-	free(buffer);
+	if(!file->toc_map) free(buffer);
 if(debug) printf("mpeg3_read_toc 90\n");
 
 
@@ -495,39 +772,20 @@ if(debug) printf("mpeg3_read_toc 100\n");
 }
 
 
-mpeg3_t* mpeg3_start_toc(char *path, char *toc_path, int64_t *total_bytes)
+int mpeg3_open_toc_source(mpeg3_t *file)
 {
-	*total_bytes = 0;
-	mpeg3_t *file = mpeg3_new(path);
-
-
-	file->toc_fd = fopen(toc_path, "w");
-	if(!file->toc_fd)
-	{
-		printf("mpeg3_start_toc: can't open \"%s\".  %s\n",
-			toc_path,
-			strerror(errno));
-		mpeg3_delete(file);
-		return 0;
-	}
-	
-	
-	file->source_date = mpeg3_calculate_source_date(path);
 	file->seekable = 0;
 
 /* Authenticate encryption before reading a single byte */
 	if(mpeg3io_open_file(file->fs))
 	{
-		mpeg3_delete(file);
-		return 0;
+		return 1;
 	}
 
 // Determine file type
-	int toc_atracks = 0, toc_vtracks = 0;
 	if(mpeg3_get_file_type(file, 0, 0, 0))
 	{
-		mpeg3_delete(file);
-		return 0;
+		return 1;
 	}
 
 
@@ -536,8 +794,8 @@ mpeg3_t* mpeg3_start_toc(char *path, char *toc_path, int64_t *total_bytes)
 	if(!file->demuxer->total_titles)
 	{
 		mpeg3_title_t *title;
-		title = file->demuxer->titles[0] = mpeg3_new_title(file, file->fs->path);
-		file->demuxer->total_titles = 1;
+		title = mpeg3demux_append_title(file->demuxer,
+			mpeg3_new_title(file, file->fs->path));
 		mpeg3demux_open_title(file->demuxer, 0);
 		title->total_bytes = mpeg3io_total_bytes(title->fs);
 		title->start_byte = 0;
@@ -553,17 +811,102 @@ mpeg3_t* mpeg3_start_toc(char *path, char *toc_path, int64_t *total_bytes)
 //	mpeg3demux_seek_byte(file->demuxer, 0x1734e4800LL);
 	mpeg3demux_seek_byte(file->demuxer, 0);
 	file->demuxer->read_all = 1;
-	*total_bytes = mpeg3demux_movie_size(file->demuxer);
+	return 0;
+}
+
+// Readers may have the old TOC mapped so it's replaced only when the new one
+// is complete.
+int mpeg3_create_toc_file(mpeg3_t *file, char *toc_path)
+{
+	char temp_path[MPEG3_STRLEN + 5];
+
+	if(strlen(toc_path) >= MPEG3_STRLEN)
+	{
+		errno = ENAMETOOLONG;
+		return 1;
+	}
+	strcpy(file->toc_path, toc_path);
+	sprintf(temp_path, "%s.new", toc_path);
+	file->toc_fd = fopen(temp_path, "w");
+	return !file->toc_fd;
+}
+
+int mpeg3_finish_toc_file(mpeg3_t *file)
+{
+	char temp_path[MPEG3_STRLEN + 5];
+	int result = 0;
+
+	sprintf(temp_path, "%s.new", file->toc_path);
+	if(ferror(file->toc_fd)) result = 1;
+	if(fclose(file->toc_fd)) result = 1;
+	file->toc_fd = 0;
+	if(!result && rename(temp_path, file->toc_path)) result = 1;
+	if(result) remove(temp_path);
+	return result;
+}
+
+void mpeg3_cancel_toc_file(mpeg3_t *file)
+{
+	char temp_path[MPEG3_STRLEN + 5];
+
+	sprintf(temp_path, "%s.new", file->toc_path);
+	fclose(file->toc_fd);
+	file->toc_fd = 0;
+	remove(temp_path);
+}
+
+mpeg3_t* mpeg3_start_toc(char *path, char *toc_path, int64_t *total_bytes)
+{
+	*total_bytes = 0;
+	mpeg3_t *file = mpeg3_new(path);
+
+
+	if(mpeg3_create_toc_file(file, toc_path))
+	{
+		printf("mpeg3_start_toc: can't open \"%s\".  %s\n",
+			toc_path,
+			strerror(errno));
+		mpeg3_delete(file);
+		return 0;
+	}
+	
+	
+	strcpy(file->source_path, path);
+	file->source_date = mpeg3_calculate_source_date(path);
+	if(mpeg3_open_toc_source(file))
+	{
+		mpeg3_delete(file);
+		return 0;
+	}
+
+	*total_bytes = file->source_size = mpeg3demux_movie_size(file->demuxer);
 
 //*total_bytes = 500000000;
 	return file;
 }
 
+mpeg3_t* mpeg3_start_toc_parallel(char *path, 
+	char *toc_path, 
+	int cpus, 
+	int64_t *total_bytes)
+{
+	mpeg3_t *file = mpeg3_start_toc(path, toc_path, total_bytes);
+// Files which are too small are scanned by mpeg3_do_toc
+	if(file && cpus > 1)
+		file->toc_split = mpeg3_new_tocsplit(file, cpus);
+	return file;
+}
+
 void mpeg3_set_index_bytes(mpeg3_t *file, int64_t bytes)
 {
 	file->index_bytes = bytes;
 }
 
+void mpeg3_set_seek_samples(mpeg3_t *file, int samples)
+{
+	file->seek_samples = MAX(samples, 0);
+}
+
 
 
 
@@ -671,7 +1014,10 @@ int mpeg3_update_index(mpeg3_t *file,
 // Calculate new index chunk
 		for(i = 0; i < atrack->channels; i++)
 		{
-			float *in_channel = atrack->audio->output[i];
+			float *in_channel = mpeg3audio_output(atrack->audio, 
+				i, 
+				atrack->audio->output_position, 
+				fragment);
 			float *out_channel = index->index_data[i] + 
 				index->index_size * 2;
 			float min = 0;
@@ -710,8 +1056,10 @@ int mpeg3_update_index(mpeg3_t *file,
 						in_channel++;
 					}
 				}
-				*out_channel++ = max;
-				*out_channel++ = min;
+// Adding 0 turns -0 into 0 so pairs don't depend on which of the two
+// came first.  Ranges of a parallel TOC combine their pairs in any order.
+				*out_channel++ = max + 0.0f;
+				*out_channel++ = min + 0.0f;
 			}
 		}
 
@@ -740,7 +1088,8 @@ int mpeg3_update_index(mpeg3_t *file,
 
 
 static int handle_audio(mpeg3_t *file, 
-	int track_number)
+	int track_number,
+	int64_t start_byte)
 {
 	int i, j, k;
 	mpeg3_atrack_t *atrack = file->atrack[track_number];
@@ -750,14 +1099,20 @@ static int handle_audio(mpeg3_t *file,
 
 // Append demuxed data to track buffer
 	if(file->demuxer->audio_size)
+	{
 		mpeg3demux_append_data(atrack->demuxer,
 			file->demuxer->audio_buffer,
 			file->demuxer->audio_size);
+		mpeg3_append_payload(atrack, start_byte, file->demuxer->audio_size);
+	}
 	else
 	if(file->demuxer->data_size)
+	{
 		mpeg3demux_append_data(atrack->demuxer,
 			file->demuxer->data_buffer,
 			file->demuxer->data_size);
+		mpeg3_append_payload(atrack, start_byte, file->demuxer->data_size);
+	}
 
 
 
@@ -791,7 +1146,11 @@ static int handle_audio(mpeg3_t *file,
 
 // When a chunk is available, 
 // add downsampled samples to the index buffer and create toc entry.
-	mpeg3_update_index(file, track_number, 0);
+// Ranges of a parallel TOC build the index when they're stitched.
+// Tracks of an extended TOC build it after they line up with the old one.
+	if(!file->toc_range && 
+		!(file->total_resume && mpeg3_pending_resume(file, atrack->pid, 1)))
+		mpeg3_update_index(file, track_number, 0);
 
 	return 0;
 }
@@ -836,6 +1195,10 @@ static int handle_video(mpeg3_t *file,
 	if(vtrack->demuxer->data_size - vtrack->demuxer->data_position <
 		MPEG3_VIDEO_STREAM_SIZE) return 0;
 
+// The header reader can leave the position before the bytes which were
+// shifted out.
+	if(vtrack->demuxer->data_position < 0) vtrack->demuxer->data_position = 0;
+
 // Scan for a start code a certain number of bytes from the end of the 
 // buffer.  Then scan the header using the video decoder to get the 
 // repeat count.
@@ -862,14 +1225,14 @@ static int handle_video(mpeg3_t *file,
 /*
  * printf("handle_video 1 %d %d %d\n", 
  * vtrack->demuxer->data_position, 
- * video->pict_struct, 
- * video->pict_type);
+ * video->picture->pict_struct, 
+ * video->picture->pict_type);
  */
-				if(video->pict_struct == BOTTOM_FIELD ||
-					video->pict_struct == FRAME_PICTURE ||
-					!video->pict_struct)
+				if(video->picture->pict_struct == BOTTOM_FIELD ||
+					video->picture->pict_struct == FRAME_PICTURE ||
+					!video->picture->pict_struct)
 				{
-					vtrack->got_keyframe |= (video->pict_type == I_TYPE);
+					vtrack->got_keyframe |= (video->picture->pict_type == I_TYPE);
 
 // Add entry for every repeat count.
 /*
@@ -880,11 +1243,11 @@ static int handle_video(mpeg3_t *file,
  * vtrack->got_keyframe);
  */
 					mpeg3_append_frame(vtrack, vtrack->prev_frame_offset, vtrack->got_keyframe);
-					video->current_repeat += 100;
-					while(video->repeat_count - video->current_repeat >= 100)
+					video->picture->current_repeat += 100;
+					while(video->picture->repeat_count - video->picture->current_repeat >= 100)
 					{
 						mpeg3_append_frame(vtrack, vtrack->prev_frame_offset, vtrack->got_keyframe);
-						video->current_repeat += 100;
+						video->picture->current_repeat += 100;
 					}
 
 /*
@@ -915,7 +1278,7 @@ static int handle_video(mpeg3_t *file,
 				{
 // This was a TOP FIELD
 // Shift out data from this field
-					vtrack->got_keyframe = (video->pict_type == I_TYPE);
+					vtrack->got_keyframe = (video->picture->pict_type == I_TYPE);
 					vtrack->got_top = 1;
 					vtrack->demuxer->data_position++;
 				    mpeg3demux_shift_data(vtrack->demuxer, 
@@ -928,7 +1291,7 @@ static int handle_video(mpeg3_t *file,
 					ptr += 4;
 
 					vtrack->prev_frame_offset = -1;
-					video->current_repeat += 100;
+					video->picture->current_repeat += 100;
 					break;
 				}
 			}
@@ -1009,12 +1372,42 @@ static void handle_subtitle(mpeg3_t *file)
 	}
 }
 
+// Store the samples after a packet of an audio track for extending the TOC
+static void audio_point(mpeg3_t *file, int track_number, int64_t packet)
+{
+	mpeg3_atrack_t *atrack = file->atrack[track_number];
+	mpeg3audio_t *audio = atrack->audio;
+	mpeg3_append_point(&atrack->toc_points, 
+		&atrack->total_toc_points, 
+		packet, 
+		(int64_t)audio->output_position + audio->output_size);
+	if(file->total_resume) mpeg3_resume_atrack(file, track_number, packet);
+}
+
+static void video_point(mpeg3_t *file, mpeg3_vtrack_t *vtrack, int64_t packet)
+{
+	mpeg3_append_point(&vtrack->toc_points, 
+		&vtrack->total_toc_points, 
+		packet, 
+		vtrack->total_frame_offsets);
+	if(file->total_resume) mpeg3_resume_vtrack(file, vtrack, packet);
+}
+
 int mpeg3_do_toc(mpeg3_t *file, int64_t *bytes_processed)
 {
 	int i, j, k;
 // Starting byte before our packet read
 	int64_t start_byte;
 
+// Wait for the ranges of a parallel TOC
+	if(file->toc_split)
+	{
+		if(!mpeg3_tocsplit_wait(file->toc_split, bytes_processed))
+			return 0;
+		mpeg3_delete_tocsplit(file->toc_split);
+		file->toc_split = 0;
+	}
+
 	start_byte = mpeg3demux_tell_byte(file->demuxer);
 
 // printf("mpeg3_do_toc %d offset=%llx file->is_audio_stream=%d\n", 
@@ -1068,24 +1461,24 @@ int mpeg3_do_toc(mpeg3_t *file, int64_t *bytes_processed)
 				if(custom_id == atrack->pid)
 				{
 // Update an audio track
-					handle_audio(file, i);
+					handle_audio(file, i, start_byte);
 					atrack->prev_offset = start_byte;
+					audio_point(file, i, start_byte);
 					got_it = 1;
 					break;
 				}
 			}
 
 			if(!got_it && ((file->demuxer->got_audio &&
-				file->demuxer->astream_table[custom_id]) ||
+				mpeg3demux_audio_stream(file->demuxer, custom_id)) ||
 				file->is_audio_stream))
 			{
 				mpeg3_atrack_t *atrack = 
-					file->atrack[file->total_astreams] = 
-						mpeg3_new_atrack(file, 
-							custom_id, 
-							file->demuxer->astream_table[custom_id], 
-							file->demuxer,
-							file->total_astreams);
+					mpeg3_new_atrack(file, 
+						custom_id, 
+						mpeg3demux_audio_stream(file->demuxer, custom_id), 
+						file->demuxer,
+						file->total_astreams);
 
 				if(atrack)
 				{
@@ -1097,11 +1490,12 @@ int mpeg3_do_toc(mpeg3_t *file, int64_t *bytes_processed)
 						mpeg3_new_index();
 
 
-					file->total_astreams++;
+					mpeg3_append_atrack(file, atrack);
 // Make the first offset correspond to the start of the first packet.
 					mpeg3_append_samples(atrack, start_byte);
-					handle_audio(file, file->total_astreams - 1);
+					handle_audio(file, file->total_astreams - 1, start_byte);
 					atrack->prev_offset = start_byte;
+					audio_point(file, file->total_astreams - 1, start_byte);
 				}
 			}
 
@@ -1121,6 +1515,7 @@ int mpeg3_do_toc(mpeg3_t *file, int64_t *bytes_processed)
 // Update a video track
 					handle_video(file, vtrack);
 					vtrack->prev_offset = start_byte;
+					video_point(file, vtrack, start_byte);
 					got_it = 1;
 					break;
 				}
@@ -1129,24 +1524,24 @@ int mpeg3_do_toc(mpeg3_t *file, int64_t *bytes_processed)
 
 
 			if(!got_it && ((file->demuxer->got_video &&
-				file->demuxer->vstream_table[custom_id]) ||
+				mpeg3demux_video_stream(file->demuxer, custom_id)) ||
 				file->is_video_stream))
 			{
 				mpeg3_vtrack_t *vtrack = 
-					file->vtrack[file->total_vstreams] = 
-						mpeg3_new_vtrack(file, 
-							custom_id, 
-							file->demuxer, 
-							file->total_vstreams);
+					mpeg3_new_vtrack(file, 
+						custom_id, 
+						file->demuxer, 
+						file->total_vstreams);
 
 // Make the first offset correspond to the start of the first packet.
 				if(vtrack)
 				{
-					file->total_vstreams++;
+					mpeg3_append_vtrack(file, vtrack);
 // Create table entry for frame 0
 					mpeg3_append_frame(vtrack, start_byte, 1);
 					handle_video(file, vtrack);
 					vtrack->prev_offset = start_byte;
+					video_point(file, vtrack, start_byte);
 				}
 			}
 		}
@@ -1164,87 +1559,125 @@ int mpeg3_do_toc(mpeg3_t *file, int64_t *bytes_processed)
 
 
 
-void mpeg3_stop_toc(mpeg3_t *file)
+// Sections of the table of contents start aligned so the tables can be
+// used straight from a memory mapping.
+static void begin_section(mpeg3_t *file, 
+	mpeg3_tocsection_t *section,
+	int type,
+	int track,
+	int64_t count)
 {
-// Create final chunk for audio tracks to count the last samples.
-	int i, j, k;
-	for(i = 0; i < file->total_astreams; i++)
-	{
-		mpeg3_atrack_t *atrack = file->atrack[i];
-		mpeg3_append_samples(atrack, atrack->prev_offset);
-	}
+	while(ftello(file->toc_fd) % MPEG3_TOC_ALIGN)
+		fputc(0, file->toc_fd);
+	section->type = type;
+	section->track = track;
+	section->offset = ftello(file->toc_fd);
+	section->count = count;
+}
 
-// Flush audio indexes
-	for(i = 0; i < file->total_astreams; i++)
-		mpeg3_update_index(file, i, 1);
+static void end_section(mpeg3_t *file, mpeg3_tocsection_t *section)
+{
+	section->bytes = ftello(file->toc_fd) - section->offset;
+}
 
-// Make all indexes the same scale
-	int max_scale = 1;
-	for(i = 0; i < file->total_astreams; i++)
-	{
-		mpeg3_atrack_t *atrack = file->atrack[i];
-		mpeg3_index_t *index = file->indexes[i];
-		if(index->index_data && index->index_zoom > max_scale)
-			 	max_scale = index->index_zoom;
-	}
+// Store the resume points of a track oldest first
+static void write_points(mpeg3_t *file, 
+	mpeg3_tocsection_t *section,
+	int type,
+	int track,
+	mpeg3_tocpoint_t *points,
+	int total)
+{
+	int count = MIN(total, MPEG3_TOC_POINTS);
+	int i;
+
+	begin_section(file, section, type, track, count);
+	for(i = 0; i < count; i++)
+		fwrite(mpeg3_get_point(points, total, i), 
+			sizeof(mpeg3_tocpoint_t), 
+			1, 
+			file->toc_fd);
+	end_section(file, section);
+}
 
-	for(i = 0; i < file->total_astreams; i++)
+// Store a table in blocks of entries with the bits the block needs above
+// its smallest entry.  The table is either plain or packed.
+static void write_packed(mpeg3_t *file, 
+	mpeg3_tocsection_t *section,
+	int type,
+	int track,
+	int64_t *values,
+	unsigned char *packed,
+	int64_t total)
+{
+	int64_t blocks = (total + MPEG3_TOC_BLOCK - 1) / MPEG3_TOC_BLOCK;
+	int64_t header_size = blocks * sizeof(mpeg3_tocblock_t);
+	mpeg3_tocblock_t *header = calloc(blocks + 1, sizeof(mpeg3_tocblock_t));
+	unsigned char *data = calloc(total * sizeof(int64_t) + 8, 1);
+	int64_t data_size = 0;
+	int64_t i, j;
+
+	for(i = 0; i < blocks; i++)
 	{
-		mpeg3_atrack_t *atrack = file->atrack[i];
-		mpeg3_index_t *index = file->indexes[i];
-		if(index->index_data && index->index_zoom < max_scale)
-		{
-			while(index->index_zoom < max_scale)
-				divide_index(file, i);
-		}
-	}
-
-
+		mpeg3_tocblock_t *block = &header[i];
+		int64_t first = i * MPEG3_TOC_BLOCK;
+		int entries = MIN(total - first, MPEG3_TOC_BLOCK);
+		int64_t entry[MPEG3_TOC_BLOCK];
+		uint64_t range = 0;
 
-
-// Sort tracks by PID
-	int done = 0;
-	while(!done)
-	{
-		done = 1;
-		for(i = 0; i < file->total_astreams - 1; i++)
+		for(j = 0; j < entries; j++)
 		{
-			mpeg3_atrack_t *atrack1 = file->atrack[i];
-			mpeg3_atrack_t *atrack2 = file->atrack[i + 1];
-			if(atrack1->pid > atrack2->pid)
-			{
-				done = 0;
-				file->atrack[i + 1] = atrack1;
-				file->atrack[i] = atrack2;
-				mpeg3_index_t *index1 = file->indexes[i];
-				mpeg3_index_t *index2 = file->indexes[i + 1];
-				file->indexes[i] = index2;
-				file->indexes[i + 1] = index1;
-			}
+			entry[j] = values ? values[first + j] : 
+				mpeg3_packed_entry(packed, first + j);
+			if(!j || entry[j] < block->base) block->base = entry[j];
 		}
-	}
+		for(j = 0; j < entries; j++)
+			range |= (uint64_t)entry[j] - block->base;
 
+		block->bits = 0;
+		while(block->bits < 64 && (range >> block->bits)) block->bits++;
+// Wider entries can't be read with one shifted load
+		if(block->bits > 57) block->bits = 64;
+		block->offset = header_size + data_size;
 
-	done = 0;
-	while(!done)
-	{
-		done = 1;
-		for(i = 0; i < file->total_vstreams - 1; i++)
+		for(j = 0; j < entries; j++)
 		{
-			mpeg3_vtrack_t *vtrack1 = file->vtrack[i];
-			mpeg3_vtrack_t *vtrack2 = file->vtrack[i + 1];
-			if(vtrack1->pid > vtrack2->pid)
-			{
-				done = 0;
-				file->vtrack[i + 1] = vtrack1;
-				file->vtrack[i] = vtrack2;
-			}
+			uint64_t bit = j * block->bits;
+			uint64_t value = (uint64_t)entry[j] - block->base;
+			unsigned char *ptr = data + data_size + (bit >> 3);
+			int shift = bit & 7;
+			int k;
+
+			if(!block->bits) continue;
+			ptr[0] |= value << shift;
+			for(k = 1; k < 8; k++)
+				ptr[k] |= value >> (k * 8 - shift);
 		}
+		data_size += (entries * block->bits + 7) / 8;
 	}
 
+	begin_section(file, section, type, track, total);
+	fwrite(header, sizeof(mpeg3_tocblock_t), blocks, file->toc_fd);
+	fwrite(data, 1, data_size + 8, file->toc_fd);
+	end_section(file, section);
+	free(header);
+	free(data);
+}
 
+// Write the tables to file->toc_fd.  The tracks are in their final order.
+static void write_toc(mpeg3_t *file)
+{
+	int i, j, k;
+	mpeg3_tocsection_t *sections = calloc(1 + 
+			file->total_astreams * 5 + 
+			file->total_vstreams * 3 +
+			file->total_sstreams,
+		sizeof(mpeg3_tocsection_t));
+	mpeg3_tocsection_t *section = sections;
+	uint32_t order = MPEG3_TOC_ORDER;
+	uint32_t total_sections = 0;
+	uint64_t directory = 0;
 
-// Output toc to file
 // Write file type
 	fputc('T', file->toc_fd);
 	fputc('O', file->toc_fd);
@@ -1254,6 +1687,15 @@ void mpeg3_stop_toc(mpeg3_t *file)
 // Write version
 	PUT_INT32(MPEG3_TOC_VERSION);
 
+// Byte order of the tables and the directory.  The directory is written
+// last.
+	fwrite(&order, sizeof(uint32_t), 1, file->toc_fd);
+	fwrite(&total_sections, sizeof(uint32_t), 1, file->toc_fd);
+	fwrite(&directory, sizeof(uint64_t), 1, file->toc_fd);
+
+// Records without the tables
+	begin_section(file, section, SECTION_INFO, 0, 0);
+
 // Write stream type
 	if(file->is_program_stream)
 	{
@@ -1278,27 +1720,29 @@ void mpeg3_stop_toc(mpeg3_t *file)
 
 // Store file information
 	PUT_INT32(FILE_INFO);
-	fprintf(file->toc_fd, file->fs->path);
-	for(j = strlen(file->fs->path); j < MPEG3_STRLEN; j++)
+	fputs(file->source_path, file->toc_fd);
+	for(j = strlen(file->source_path); j < MPEG3_STRLEN; j++)
 			fputc(0, file->toc_fd);
 	PUT_INT64(file->source_date);
+	PUT_INT64(file->source_size);
 
 // Write stream ID's
 // Only program and transport streams have these
-	for(i = 0; i < MPEG3_MAX_STREAMS; i++)
+	for(i = 0; i < file->demuxer->total_streams; i++)
 	{
-		if(file->demuxer->astream_table[i])
+		mpeg3_streamid_t *stream = &file->demuxer->streams[i];
+		if(stream->audio)
 		{
 			PUT_INT32(STREAM_AUDIO);
-			PUT_INT32(i);
-			PUT_INT32(file->demuxer->astream_table[i]);
+			PUT_INT32(stream->id);
+			PUT_INT32(stream->audio);
 		}
 
-		if(file->demuxer->vstream_table[i])
+		if(stream->video)
 		{
 			PUT_INT32(STREAM_VIDEO);
-			PUT_INT32(i);
-			PUT_INT32(file->demuxer->vstream_table[i]);
+			PUT_INT32(stream->id);
+			PUT_INT32(stream->video);
 		}
 	}
 
@@ -1309,7 +1753,7 @@ void mpeg3_stop_toc(mpeg3_t *file)
 // Path
 		PUT_INT32(TITLE_PATH);
 
-		fprintf(file->toc_fd, title->fs->path);
+		fputs(title->fs->path, file->toc_fd);
 
 // Pad path with 0
 		for(j = strlen(title->fs->path); j < MPEG3_STRLEN; j++)
@@ -1338,30 +1782,19 @@ void mpeg3_stop_toc(mpeg3_t *file)
 	for(j = 0; j < file->total_astreams; j++)
 	{
 		mpeg3_atrack_t *atrack = file->atrack[j];
+		mpeg3_index_t *index = file->indexes[j];
 		PUT_INT64(atrack->audio_eof);
-		PUT_INT32(atrack->channels);
+// The index has the channel count of the table of contents
+		PUT_INT32(index->index_data ? index->index_channels : atrack->channels);
 		PUT_INT32(atrack->total_sample_offsets);
-// Total samples
-		PUT_INT64(atrack->current_position);
-// Sample offsets
-		for(i = 0; i < atrack->total_sample_offsets; i++)
-		{
-			PUT_INT64(atrack->sample_offsets[i]);
-		}
+		PUT_INT64(atrack->total_samples);
+		PUT_INT32(atrack->total_seek_points);
 
 // Index
-		mpeg3_index_t *index = file->indexes[j];
 		if(index->index_data)
 		{
 			PUT_INT32(index->index_size);
 			PUT_INT32(index->index_zoom);
-			for(k = 0; k < atrack->channels; k++)
-			{
-				fwrite(index->index_data[k], 
-					sizeof(float) * 2, 
-					index->index_size,
-					file->toc_fd);
-			}
 		}
 		else
 		{
@@ -1383,16 +1816,7 @@ void mpeg3_stop_toc(mpeg3_t *file)
 		mpeg3_vtrack_t *vtrack = file->vtrack[j];
 		PUT_INT64(vtrack->video_eof);
 		PUT_INT32(vtrack->total_frame_offsets);
-		for(i = 0; i < vtrack->total_frame_offsets; i++)
-		{
-			PUT_INT64(vtrack->frame_offsets[i]);
-		}
-
 		PUT_INT32(vtrack->total_keyframe_numbers);
-		for(i = 0; i < vtrack->total_keyframe_numbers; i++)
-		{
-			PUT_INT64(vtrack->keyframe_numbers[i]);
-		}
 	}
 
 
@@ -1407,10 +1831,6 @@ void mpeg3_stop_toc(mpeg3_t *file)
 		mpeg3_strack_t *strack = file->strack[i];
 		PUT_INT32(strack->id);
 		PUT_INT32(strack->total_offsets);
-		for(j = 0; j < strack->total_offsets; j++)
-		{
-			PUT_INT64(strack->offsets[j]);
-		}
 	}
 
 
@@ -1419,9 +1839,253 @@ void mpeg3_stop_toc(mpeg3_t *file)
 	{
 		fputc(file->palette[i], file->toc_fd);
 	}
+	end_section(file, section);
+	section->count = section->bytes;
+	section++;
 
 
-	fclose(file->toc_fd);
+// Tables
+	for(j = 0; j < file->total_astreams; j++)
+	{
+		mpeg3_atrack_t *atrack = file->atrack[j];
+		mpeg3_index_t *index = file->indexes[j];
+		write_packed(file, 
+			section++, 
+			SECTION_PACKED_SAMPLE_OFFSETS, 
+			j, 
+			atrack->sample_offsets, 
+			atrack->packed_sample_offsets, 
+			atrack->total_sample_offsets);
+
+		begin_section(file, 
+			section, 
+			SECTION_INDEX, 
+			j, 
+			index->index_data ? 
+				(int64_t)index->index_size * 2 * index->index_channels : 0);
+		for(k = 0; index->index_data && k < index->index_channels; k++)
+		{
+			fwrite(index->index_data[k], 
+				sizeof(float) * 2, 
+				index->index_size,
+				file->toc_fd);
+		}
+		end_section(file, section++);
+
+		write_points(file, 
+			section++, 
+			SECTION_AUDIO_POINTS, 
+			j, 
+			atrack->toc_points, 
+			atrack->total_toc_points);
+
+		write_packed(file, 
+			section++, 
+			SECTION_PACKED_SEEK_PACKETS, 
+			j, 
+			atrack->seek_packets, 
+			atrack->packed_seek_packets, 
+			atrack->total_seek_points);
+		write_packed(file, 
+			section++, 
+			SECTION_PACKED_SEEK_SAMPLES, 
+			j, 
+			atrack->seek_samples, 
+			atrack->packed_seek_samples, 
+			atrack->total_seek_points);
+	}
+
+	for(j = 0; j < file->total_vstreams; j++)
+	{
+		mpeg3_vtrack_t *vtrack = file->vtrack[j];
+		write_packed(file, 
+			section++, 
+			SECTION_PACKED_FRAME_OFFSETS, 
+			j, 
+			vtrack->frame_offsets, 
+			vtrack->packed_frame_offsets, 
+			vtrack->total_frame_offsets);
+		write_packed(file, 
+			section++, 
+			SECTION_PACKED_KEYFRAMES, 
+			j, 
+			vtrack->keyframe_numbers, 
+			vtrack->packed_keyframe_numbers, 
+			vtrack->total_keyframe_numbers);
+		write_points(file, 
+			section++, 
+			SECTION_VIDEO_POINTS, 
+			j, 
+			vtrack->toc_points, 
+			vtrack->total_toc_points);
+	}
+
+	for(j = 0; j < file->total_sstreams; j++)
+	{
+		mpeg3_strack_t *strack = file->strack[j];
+		begin_section(file, 
+			section, 
+			SECTION_SUBTITLE_OFFSETS, 
+			j, 
+			strack->total_offsets);
+		fwrite(strack->offsets, 
+			sizeof(int64_t), 
+			strack->total_offsets, 
+			file->toc_fd);
+		end_section(file, section++);
+	}
+
+// Directory
+	while(ftello(file->toc_fd) % MPEG3_TOC_ALIGN)
+		fputc(0, file->toc_fd);
+	directory = ftello(file->toc_fd);
+	total_sections = section - sections;
+	fwrite(sections, sizeof(mpeg3_tocsection_t), total_sections, file->toc_fd);
+	fseeko(file->toc_fd, 12, SEEK_SET);
+	fwrite(&total_sections, sizeof(uint32_t), 1, file->toc_fd);
+	fwrite(&directory, sizeof(uint64_t), 1, file->toc_fd);
+	free(sections);
+}
+
+int mpeg3_write_toc(mpeg3_t *file, char *toc_path)
+{
+	int result = 0;
+	if(mpeg3_create_toc_file(file, toc_path))
+	{
+		fprintf(stderr, 
+			"mpeg3_write_toc: can't open \"%s\".  %s\n",
+			toc_path,
+			strerror(errno));
+		return 1;
+	}
+
+	write_toc(file);
+	result = mpeg3_finish_toc_file(file);
+	if(result)
+		fprintf(stderr, 
+			"mpeg3_write_toc: can't write \"%s\".  %s\n",
+			toc_path,
+			strerror(errno));
+	return result;
+}
+
+// Keep the first seek point at or after every multiple of seek_samples.
+// Thinning the result again doesn't change it so points from an old TOC
+// can be thinned with the new ones.
+static void thin_seek_points(mpeg3_t *file, mpeg3_atrack_t *atrack)
+{
+	int64_t prev = 0;
+	int total = 0;
+	int i;
+
+	for(i = 0; file->seek_samples && i < atrack->total_seek_points; i++)
+	{
+		int64_t sample = atrack->seek_samples[i];
+		if(!total ||
+			(sample / file->seek_samples > prev / file->seek_samples &&
+			sample > atrack->seek_samples[total - 1]))
+		{
+			atrack->seek_packets[total] = atrack->seek_packets[i];
+			atrack->seek_samples[total++] = sample;
+		}
+		prev = sample;
+	}
+	atrack->total_seek_points = total;
+}
+
+void mpeg3_stop_toc(mpeg3_t *file)
+{
+// Create final chunk for audio tracks to count the last samples.
+	int i, j, k;
+	for(i = 0; i < file->total_astreams; i++)
+	{
+		mpeg3_atrack_t *atrack = file->atrack[i];
+		mpeg3_append_samples(atrack, atrack->prev_offset);
+	}
+
+// Flush audio indexes
+	for(i = 0; i < file->total_astreams; i++)
+		mpeg3_update_index(file, i, 1);
+
+// Make all indexes the same scale
+	int max_scale = 1;
+	for(i = 0; i < file->total_astreams; i++)
+	{
+		mpeg3_atrack_t *atrack = file->atrack[i];
+		mpeg3_index_t *index = file->indexes[i];
+		if(index->index_data && index->index_zoom > max_scale)
+			 	max_scale = index->index_zoom;
+	}
+
+	for(i = 0; i < file->total_astreams; i++)
+	{
+		mpeg3_atrack_t *atrack = file->atrack[i];
+		mpeg3_index_t *index = file->indexes[i];
+		if(index->index_data && index->index_zoom < max_scale)
+		{
+			while(index->index_zoom < max_scale)
+				divide_index(file, i);
+		}
+	}
+
+	for(i = 0; i < file->total_astreams; i++)
+		thin_seek_points(file, file->atrack[i]);
+
+
+
+
+// Sort tracks by PID
+	int done = 0;
+	while(!done)
+	{
+		done = 1;
+		for(i = 0; i < file->total_astreams - 1; i++)
+		{
+			mpeg3_atrack_t *atrack1 = file->atrack[i];
+			mpeg3_atrack_t *atrack2 = file->atrack[i + 1];
+			if(atrack1->pid > atrack2->pid)
+			{
+				done = 0;
+				file->atrack[i + 1] = atrack1;
+				file->atrack[i] = atrack2;
+				mpeg3_index_t *index1 = file->indexes[i];
+				mpeg3_index_t *index2 = file->indexes[i + 1];
+				file->indexes[i] = index2;
+				file->indexes[i + 1] = index1;
+			}
+		}
+	}
+
+
+	done = 0;
+	while(!done)
+	{
+		done = 1;
+		for(i = 0; i < file->total_vstreams - 1; i++)
+		{
+			mpeg3_vtrack_t *vtrack1 = file->vtrack[i];
+			mpeg3_vtrack_t *vtrack2 = file->vtrack[i + 1];
+			if(vtrack1->pid > vtrack2->pid)
+			{
+				done = 0;
+				file->vtrack[i + 1] = vtrack1;
+				file->vtrack[i] = vtrack2;
+			}
+		}
+	}
+
+
+
+// Total samples are counted by the position of the last chunk
+	for(i = 0; i < file->total_astreams; i++)
+		file->atrack[i]->total_samples = file->atrack[i]->current_position;
+
+	write_toc(file);
+	if(mpeg3_finish_toc_file(file))
+		fprintf(stderr, 
+			"mpeg3_stop_toc: can't write \"%s\".  %s\n",
+			file->toc_path,
+			strerror(errno));
 
 
 	mpeg3_delete(file);
@@ -1493,3 +2157,48 @@ int64_t mpeg3_calculate_source_date(char *path)
 	stat64(path, &ostat);
 	return ostat.st_mtime;
 }
+
+int64_t mpeg3_get_source_size(mpeg3_t *file)
+{
+	return file->source_size;
+}
+
+int64_t mpeg3_calculate_source_size(char *path)
+{
+	struct stat64 ostat;
+	bzero(&ostat, sizeof(struct stat64));
+	stat64(path, &ostat);
+	return ostat.st_size;
+}
+
+void mpeg3_append_point(mpeg3_tocpoint_t **points, 
+	int *total, 
+	int64_t packet, 
+	int64_t count)
+{
+	mpeg3_tocpoint_t *point;
+	if(count == (*total ? mpeg3_get_point(*points, *total, 
+		MIN(*total, MPEG3_TOC_POINTS) - 1)->count : 0)) return;
+
+	if(!*points) *points = calloc(MPEG3_TOC_POINTS, sizeof(mpeg3_tocpoint_t));
+	point = &(*points)[*total % MPEG3_TOC_POINTS];
+	point->packet = packet;
+	point->count = count;
+// Only the position in the ring matters after it's full
+	if(++(*total) >= MPEG3_TOC_POINTS * 2) *total -= MPEG3_TOC_POINTS;
+}
+
+void mpeg3_shift_points(mpeg3_tocpoint_t *points, int total, int64_t shift)
+{
+	int i;
+	for(i = 0; i < MIN(total, MPEG3_TOC_POINTS); i++)
+		points[i].count += shift;
+}
+
+mpeg3_tocpoint_t* mpeg3_get_point(mpeg3_tocpoint_t *points, 
+	int total, 
+	int number)
+{
+	if(total > MPEG3_TOC_POINTS) number += total - MPEG3_TOC_POINTS;
+	return &points[number % MPEG3_TOC_POINTS];
+}
@@ -28,7 +28,26 @@ mpeg3_vtrack_t* mpeg3_new_vtrack(mpeg3_t *file,
 		new_vtrack->total_frame_offsets = file->total_frame_offsets[number];
 		new_vtrack->keyframe_numbers = file->keyframe_numbers[number];
 		new_vtrack->total_keyframe_numbers = file->total_keyframe_numbers[number];
-		new_vtrack->demuxer->stream_end = file->video_eof[number];
+		if(file->packed_frame_offsets)
+		{
+			new_vtrack->packed_frame_offsets = 
+				file->packed_frame_offsets[number];
+			new_vtrack->packed_keyframe_numbers = 
+				file->packed_keyframe_numbers[number];
+		}
+		new_vtrack->demuxer->stream_end = 
+			new_vtrack->video_eof = file->video_eof[number];
+	}
+
+// Keep the resume points for rewriting the TOC
+	if(file->video_points)
+	{
+		int i;
+		for(i = 0; i < file->total_video_points[number]; i++)
+			mpeg3_append_point(&new_vtrack->toc_points,
+				&new_vtrack->total_toc_points,
+				file->video_points[number][i].packet,
+				file->video_points[number][i].count);
 	}
 
 /* Get information about the track here. */
@@ -55,6 +74,7 @@ int mpeg3_delete_vtrack(mpeg3_t *file, mpeg3_vtrack_t *vtrack)
 		if(vtrack->frame_offsets) free(vtrack->frame_offsets);
 		if(vtrack->keyframe_numbers) free(vtrack->keyframe_numbers);
 	}
+	if(vtrack->toc_points) free(vtrack->toc_points);
 	mpeg3_delete_cache(vtrack->frame_cache);
 
 	int i;
@@ -68,6 +88,18 @@ int mpeg3_delete_vtrack(mpeg3_t *file, mpeg3_vtrack_t *vtrack)
 }
 
 static int last_keyframe = 0;
+mpeg3_vtrack_t* mpeg3_append_vtrack(mpeg3_t *file, mpeg3_vtrack_t *vtrack)
+{
+	if(file->total_vstreams >= file->vtracks_allocated)
+	{
+		file->vtracks_allocated = MAX(file->total_vstreams * 2, 4);
+		file->vtrack = realloc(file->vtrack,
+			sizeof(mpeg3_vtrack_t*) * file->vtracks_allocated);
+	}
+	file->vtrack[file->total_vstreams++] = vtrack;
+	return vtrack;
+}
+
 void mpeg3_append_frame(mpeg3_vtrack_t *vtrack, int64_t offset, int is_keyframe)
 {
 	if(vtrack->total_frame_offsets >= vtrack->frame_offsets_allocated)
@@ -115,7 +115,7 @@ int mpeg3video_getintrablock(mpeg3_slice_t *slice,
 		int comp, 
 		int dc_dct_pred[])
 {
-	int val, i, j = 8, sign;
+	int val, i, j = 0, sign;
 	unsigned int code;
 	mpeg3_DCTtab_t *tab = 0;
 	short *bp = slice->block[comp];
@@ -195,7 +195,7 @@ int mpeg3video_getintrablock(mpeg3_slice_t *slice,
 		}
 			
 
-    	val = (val * slice->quant_scale * video->intra_quantizer_matrix[j]) >> 3;
+    	val = (val * slice->quant_scale * video->picture->intra_quantizer_matrix[j]) >> 3;
     	val = (val - 1) | 1;
 
     	bp[j] = sign ? -val : val;
@@ -284,7 +284,7 @@ int mpeg3video_getinterblock(mpeg3_slice_t *slice,
 
     	j = video->mpeg3_zigzag_scan_table[i];
 
-   		val = (((val << 1)+1) * slice->quant_scale * video->non_intra_quantizer_matrix[j]) >> 4;
+   		val = (((val << 1)+1) * slice->quant_scale * video->picture->non_intra_quantizer_matrix[j]) >> 4;
    		val = (val - 1) | 1;
 
     	bp[j] = sign ? -val : val;
@@ -305,7 +305,7 @@ int mpeg3video_getmpg2intrablock(mpeg3_slice_t *slice,
 		int comp, 
 		int dc_dct_pred[])
 {
-	int val, i, j, sign, nc;
+	int val, i, j = 0, sign, nc;
 	unsigned int code;
 	mpeg3_DCTtab_t *tab;
 	short *bp;
@@ -315,9 +315,9 @@ int mpeg3video_getmpg2intrablock(mpeg3_slice_t *slice,
 /* with data partitioning, data always goes to base layer */
   	bp = slice->block[comp];
 
-  	qmat = (comp < 4 || video->chroma_format == CHROMA420)
-         ? video->intra_quantizer_matrix
-         : video->chroma_intra_quantizer_matrix;
+  	qmat = (comp < 4 || video->picture->chroma_format == CHROMA420)
+         ? video->picture->intra_quantizer_matrix
+         : video->picture->chroma_intra_quantizer_matrix;
 
 /* decode DC coefficients */
 	if(comp < 4)           
@@ -329,7 +329,7 @@ int mpeg3video_getmpg2intrablock(mpeg3_slice_t *slice,
 		val = (dc_dct_pred[2] += mpeg3video_getdcchrom(slice_buffer));
 
   	if(slice->fault) return 0;
-	bp[0] = val << (3 - video->dc_prec);
+	bp[0] = val << (3 - video->picture->dc_prec);
 
   	nc = 0;
 
@@ -338,12 +338,12 @@ int mpeg3video_getmpg2intrablock(mpeg3_slice_t *slice,
 	{
     	code = mpeg3slice_showbits16(slice_buffer);
 
-    	if(code >= 16384 && !video->intravlc)
+    	if(code >= 16384 && !video->picture->intravlc)
 			tab = &mpeg3_DCTtabnext[(code >> 12) - 4];
     	else 
 		if(code >= 1024)
 		{
-    		if(video->intravlc) 
+    		if(video->picture->intravlc) 
 				tab = &mpeg3_DCTtab0a[(code >> 8) - 4];
     		else 
 				tab = &mpeg3_DCTtab0[(code >> 8) - 4];
@@ -351,7 +351,7 @@ int mpeg3video_getmpg2intrablock(mpeg3_slice_t *slice,
     	else 
 		if(code >= 512)
 		{
-    		if(video->intravlc)     
+    		if(video->picture->intravlc)     
 		  	  	tab = &mpeg3_DCTtab1a[(code >> 6) - 8];
     		else              
 				tab = &mpeg3_DCTtab1[(code >> 6) - 8];
@@ -400,7 +400,7 @@ int mpeg3video_getmpg2intrablock(mpeg3_slice_t *slice,
     		sign = mpeg3slice_getbit(slice_buffer);
     	}
 
-    	j = (video->altscan ? video->mpeg3_alternate_scan_table : video->mpeg3_zigzag_scan_table)[i];
+    	j = (video->picture->altscan ? video->mpeg3_alternate_scan_table : video->mpeg3_zigzag_scan_table)[i];
 
    		val = (val * slice->quant_scale * qmat[j]) >> 4;
 
@@ -433,9 +433,9 @@ int mpeg3video_getmpg2interblock(mpeg3_slice_t *slice,
 /* with data partitioning, data always goes to base layer */
   	bp = slice->block[comp];
 
-  	qmat = (comp < 4 || video->chroma_format == CHROMA420)
-         ? video->non_intra_quantizer_matrix
-         : video->chroma_non_intra_quantizer_matrix;
+  	qmat = (comp < 4 || video->picture->chroma_format == CHROMA420)
+         ? video->picture->non_intra_quantizer_matrix
+         : video->picture->chroma_non_intra_quantizer_matrix;
 
   	nc = 0;
 
@@ -495,7 +495,7 @@ int mpeg3video_getmpg2interblock(mpeg3_slice_t *slice,
     		sign = mpeg3slice_getbit(slice_buffer);
     	}
 
-    	j = (video->altscan ? video->mpeg3_alternate_scan_table : video->mpeg3_zigzag_scan_table)[i];
+    	j = (video->picture->altscan ? video->mpeg3_alternate_scan_table : video->mpeg3_zigzag_scan_table)[i];
 
    		val = (((val << 1)+1) * slice->quant_scale * qmat[j]) >> 5;
 
@@ -511,23 +511,120 @@ int mpeg3video_getmpg2interblock(mpeg3_slice_t *slice,
 }
 
 
+/* Make room for size more bytes in the slice buffer */
+static inline void mpeg3video_reserve_slice(mpeg3_slice_buffer_t *slice_buffer, int size)
+{
+	while(slice_buffer->buffer_allocation < slice_buffer->buffer_size + size)
+		mpeg3_expand_slice_buffer(slice_buffer);
+}
+
+/* Copy the slice out of the demuxer buffer up to the next start code */
+/* prefix or the end of the buffer.  The bitstream must be holding the 3 */
+/* bytes after the last byte copied.  Produces the same result as copying */
+/* 1 byte at a time since the end of file can't change without reading a */
+/* packet. */
+static void mpeg3video_scan_slice(mpeg3_slice_buffer_t *slice_buffer, 
+	mpeg3_bits_t *vstream)
+{
+	mpeg3_demuxer_t *demuxer = vstream->demuxer;
+	unsigned char *data = demuxer->data_buffer;
+	int start = demuxer->data_position;
+	int end = demuxer->data_size;
+	unsigned char bits[3];
+	unsigned char *ptr;
+	int length, i;
+
+	if(vstream->input_ptr || vstream->bit_number != 24 || start >= end) return;
+
+	bits[0] = (vstream->bfr >> 16) & 0xff;
+	bits[1] = (vstream->bfr >> 8) & 0xff;
+	bits[2] = vstream->bfr & 0xff;
+
+/* Bytes before the code in the bitstream or the buffer */
+#define SCAN_BYTE(i) ((i) < 3 ? bits[(i)] : data[start + (i) - 3])
+
+/* length is the number of bytes before the first prefix ending in the buffer */
+	length = end - start;
+	for(ptr = data + start; 
+		(ptr = memchr(ptr, 1, data + end - ptr)) != 0; 
+		ptr++)
+	{
+		i = ptr - data - start;
+		if(!SCAN_BYTE(i + 1) && !SCAN_BYTE(i + 2))
+		{
+			length = i + 1;
+			break;
+		}
+	}
+
+	mpeg3video_reserve_slice(slice_buffer, length);
+	for(i = 0; i < 3 && i < length; i++)
+		slice_buffer->data[slice_buffer->buffer_size++] = bits[i];
+	if(length > 3)
+	{
+		memcpy(slice_buffer->data + slice_buffer->buffer_size, 
+			data + start, 
+			length - 3);
+		slice_buffer->buffer_size += length - 3;
+	}
+
+/* Reload the bitstream with the 3 bytes after the copy */
+	vstream->bfr = (uint32_t)SCAN_BYTE(length - 1) << 24;
+	vstream->bfr |= SCAN_BYTE(length) << 16;
+	vstream->bfr |= SCAN_BYTE(length + 1) << 8;
+	vstream->bfr |= SCAN_BYTE(length + 2);
+	vstream->bfr_size = 32;
+	demuxer->data_position = start + length;
+#undef SCAN_BYTE
+}
+
+/* Hand the loaded slices to the decoders */
+static void mpeg3video_publish_slices(mpeg3video_t *video, 
+	int total_slice_buffers, 
+	int loaded)
+{
+	pthread_mutex_lock(&(video->slice_lock));
+	if(!video->busy_slice_decoders)
+	{
+/* Start the decoders on the first slice */
+		video->next_slice_buffer = 0;
+		video->busy_slice_decoders = video->total_slice_decoders;
+		video->picture_number++;
+		pthread_cond_broadcast(&(video->slice_start));
+	}
+	__atomic_store_n(&(video->total_slice_buffers), 
+		total_slice_buffers, 
+		__ATOMIC_RELEASE);
+	video->slice_buffers_loaded = loaded;
+/* Release the output bands if every slice was already reconstructed */
+	if(video->total_output_bands &&
+		loaded &&
+		video->finished_slice_buffers >= total_slice_buffers)
+		__atomic_store_n(&(video->mb_rows_ready), 
+			video->picture->mb_height, 
+			__ATOMIC_RELEASE);
+	pthread_cond_broadcast(&(video->slice_loaded));
+	pthread_mutex_unlock(&(video->slice_lock));
+}
+
 /* decode all macroblocks of the current picture */
 int mpeg3video_get_macroblocks(mpeg3video_t *video, int framenum)
 {
 	unsigned int code;
 	mpeg3_slice_buffer_t *slice_buffer; /* Buffer being loaded */
-	int i;
 	int current_buffer;
 	mpeg3_bits_t *vstream = video->vstream;
 
-/* Load every slice into a buffer array */
+/* Load every slice into a buffer array.  The other decoders start */
+/* on each slice as soon as it is loaded. */
 	video->total_slice_buffers = 0;
+	video->slice_buffers_loaded = 0;
 	current_buffer = 0;
 
 	while(!mpeg3bits_eof(vstream) && 
 		mpeg3bits_showbits32_noptr(vstream) >= MPEG3_SLICE_MIN_START && 
 		mpeg3bits_showbits32_noptr(vstream) <= MPEG3_SLICE_MAX_START &&
-		video->total_slice_buffers < MPEG3_MAX_CPUS)
+		current_buffer < MPEG3_MAX_CPUS)
 	{
 /* Initialize the buffer */
 		if(current_buffer >= video->slice_buffers_initialized)
@@ -536,7 +633,6 @@ int mpeg3video_get_macroblocks(mpeg3video_t *video, int framenum)
 		slice_buffer->buffer_size = 0;
 		slice_buffer->current_position = 0;
 		slice_buffer->bits_size = 0;
-		slice_buffer->done = 0;
 
 /* Read the slice into the buffer including the slice start code */
 		do
@@ -547,8 +643,15 @@ int mpeg3video_get_macroblocks(mpeg3video_t *video, int framenum)
 
 /* Load 1 char into buffer */
 			slice_buffer->data[slice_buffer->buffer_size++] = mpeg3bits_getbyte_noptr(vstream);
-		}while(!mpeg3bits_eof(vstream) &&
-			mpeg3bits_showbits24_noptr(vstream) != MPEG3_PACKET_START_CODE_PREFIX);
+			if(mpeg3bits_eof(vstream) ||
+				mpeg3bits_showbits24_noptr(vstream) == MPEG3_PACKET_START_CODE_PREFIX)
+				break;
+
+/* Copy the rest of the demuxer buffer in bulk unless the last packet */
+/* was just read. */
+			if(!mpeg3bits_eof(vstream))
+				mpeg3video_scan_slice(slice_buffer, vstream);
+		}while(mpeg3bits_showbits24_noptr(vstream) != MPEG3_PACKET_START_CODE_PREFIX);
 
 /* Pad the buffer to get the last macroblock */
 		if(slice_buffer->buffer_allocation <= slice_buffer->buffer_size + 4)
@@ -560,78 +663,114 @@ int mpeg3video_get_macroblocks(mpeg3video_t *video, int framenum)
 		slice_buffer->data[slice_buffer->buffer_size++] = 0;
 		slice_buffer->bits_size = 0;
 
-		pthread_mutex_lock(&(slice_buffer->completion_lock)); 
 		current_buffer++;
-		video->total_slice_buffers++;
+		if(video->total_slice_decoders > 1 || video->async_slices)
+			mpeg3video_publish_slices(video, current_buffer, 0);
 	}
 
 
 
-/* Run the slice decoders */
-	if(video->total_slice_buffers > 0)
+	if(current_buffer > 0)
 	{
-		for(i = 0; i < video->total_slice_decoders; i++)
+		mpeg3video_publish_slices(video, current_buffer, 1);
+
+/* Decode the rest in this thread.  The calling thread is decoder 0. */
+		if(!video->async_slices)
 		{
-			if(i == 0 && video->total_slice_decoders > 1)
-			{
-				video->slice_decoders[i].current_buffer = 0;
-				video->slice_decoders[i].buffer_step = 1;
-				video->slice_decoders[i].last_buffer = (video->total_slice_buffers - 1);
-			}
-			else
-			if(i == 1)
-			{
-				video->slice_decoders[i].current_buffer = video->total_slice_buffers - 1;
-				video->slice_decoders[i].buffer_step = -1;
-				video->slice_decoders[i].last_buffer = 0;
-			}
-			else
-			{
-				video->slice_decoders[i].current_buffer = i;
-				video->slice_decoders[i].buffer_step = 1;
-				video->slice_decoders[i].last_buffer = video->total_slice_buffers - 1;
-			}
-			pthread_mutex_unlock(&(video->slice_decoders[i].input_lock));
+			mpeg3_decode_slices(&(video->slice_decoders[0]));
+			mpeg3video_wait_slices(video);
+			if(video->total_output_bands) video->output_done = 1;
 		}
 	}
+	if(!video->async_slices) video->total_output_bands = 0;
+	return 0;
+}
 
-/* Wait for the slice buffers to finish */
-	if(video->total_slice_buffers > 0)
-	{
-		for(i = 0; i < video->total_slice_buffers; i++)
-		{
-			pthread_mutex_lock(&(video->slice_buffers[i].completion_lock));
-			pthread_mutex_unlock(&(video->slice_buffers[i].completion_lock));
-		}
+/* Wait for the decoders so the buffers aren't overwritten */
+void mpeg3video_wait_slices(mpeg3video_t *video)
+{
+	pthread_mutex_lock(&(video->slice_lock));
+	while(video->busy_slice_decoders)
+		pthread_cond_wait(&(video->slice_done), &(video->slice_lock));
+	pthread_mutex_unlock(&(video->slice_lock));
+}
 
-/* Wait for decoders to finish so packages aren't overwritten */
-		for(i = 0; i < video->total_slice_decoders; i++)
-		{
-			pthread_mutex_lock(&(video->slice_decoders[i].completion_lock));
-		}
+/* Set up the output bands for the slice decoders.  rows_ready is the */
+/* number of macroblock rows in src which are already reconstructed. */
+void mpeg3video_start_bands(mpeg3video_t *video, 
+	unsigned char **src, 
+	int rows_ready)
+{
+	if(video->mb_rows_allocated < video->picture->mb_height)
+	{
+		video->mb_rows_done = realloc(video->mb_rows_done, 
+			sizeof(int) * video->picture->mb_height);
+		video->mb_rows_allocated = video->picture->mb_height;
 	}
-	return 0;
+	memset(video->mb_rows_done, 0, sizeof(int) * video->picture->mb_height);
+
+	video->output_band_src[0] = src[0];
+	video->output_band_src[1] = src[1];
+	video->output_band_src[2] = src[2];
+	video->mb_rows_ready = rows_ready;
+	video->finished_slice_buffers = 0;
+	video->next_output_band = 0;
+	video->total_output_bands = 
+		(video->out_h + MPEG3_OUTPUT_BAND - 1) / MPEG3_OUTPUT_BAND;
+}
+
+/* Convert a finished frame in bands on the slice decoders */
+void mpeg3video_present_bands(mpeg3video_t *video, unsigned char **src)
+{
+	mpeg3video_start_bands(video, src, video->picture->mb_height);
+	mpeg3video_publish_slices(video, 0, 1);
+	mpeg3_decode_slices(&(video->slice_decoders[0]));
+	mpeg3video_wait_slices(video);
+	video->total_output_bands = 0;
+}
+
+/* Decode a B frame on bframe_video without waiting.  It gets a copy of */
+/* the picture state since the next picture header overwrites it. */
+static int mpeg3video_start_bframe(mpeg3video_t *video, int framenum)
+{
+	mpeg3_t *file = video->file;
+	mpeg3video_t *bframe_video = video->bframe_video;
+
+	*bframe_video->picture = *video->picture;
+	bframe_video->file = video->file;
+	bframe_video->track = video->track;
+	bframe_video->vstream = video->vstream;
+	bframe_video->mpeg3_zigzag_scan_table = video->mpeg3_zigzag_scan_table;
+	bframe_video->mpeg3_alternate_scan_table = video->mpeg3_alternate_scan_table;
+	bframe_video->idct_conversion = video->idct_conversion;
+	bframe_video->recon_table = video->recon_table;
+
+	mpeg3video_allocate_decoders(bframe_video, file->bframe_cpus);
+	video->bframe_pending = 1;
+	return mpeg3video_get_macroblocks(bframe_video, framenum);
 }
 
 int mpeg3video_allocate_decoders(mpeg3video_t *video, int decoder_count)
 {
 	int i;
 	mpeg3_t *file = video->file;
+	int total = MAX(1, MIN(decoder_count, MPEG3_MAX_CPUS));
 /* Get the slice decoders */
-	if(video->total_slice_decoders != file->cpus)
+	if(video->total_slice_decoders != total)
 	{
 		for(i = 0; i < video->total_slice_decoders; i++)
 		{
 			mpeg3_delete_slice_decoder(&(video->slice_decoders[i]));
 		}
 
-		for(i = 0; i < file->cpus && i < MPEG3_MAX_CPUS; i++)
+		for(i = 0; i < total; i++)
 		{
-			mpeg3_new_slice_decoder(video, &(video->slice_decoders[i]));
-			video->slice_decoders[i].thread_number = i;
+			mpeg3_new_slice_decoder(video, 
+				&(video->slice_decoders[i]), 
+				i + video->async_slices);
 		}
 
-		video->total_slice_decoders = file->cpus;
+		video->total_slice_decoders = total;
 	}
 	return 0;
 }
@@ -642,78 +781,127 @@ int mpeg3video_getpicture(mpeg3video_t *video, int framenum)
 {
 	int i, result = 0;
 	mpeg3_t *file = video->file;
+	int decode_picture, start_bframe;
 
-	if(video->pict_struct == FRAME_PICTURE && video->secondfield)
+	if(video->picture->pict_struct == FRAME_PICTURE && video->picture->secondfield)
 	{
 /* recover from illegal number of field pictures */
-    	video->secondfield = 0;
+    	video->picture->secondfield = 0;
 	}
 
-	if(!video->mpeg2)
+	if(!video->picture->mpeg2)
 	{
-		video->current_repeat = video->repeat_count = 0;
+		video->picture->current_repeat = video->picture->repeat_count = 0;
 	}
 
 	mpeg3video_allocate_decoders(video, file->cpus);
 
+/* The problem is when a B frame lands on the first repeat and is skipped, */
+/* the second repeat goes for the same bitmap as the skipped repeat, */
+/* so it picks up a frame from 3 frames back. */
+/* The first repeat must consititutively read a B frame if its B frame is going to be */
+/* used in a later repeat. */
+	decode_picture = !video->picture->current_repeat &&
+		(!(video->skip_bframes && video->picture->pict_type == B_TYPE) || 
+			(video->picture->repeat_count >= 100 + 100 * video->skip_bframes));
+
+	start_bframe = decode_picture &&
+		video->decode_ahead &&
+		file->bframe_cpus > 0 &&
+		video->picture->pict_type == B_TYPE &&
+		video->picture->pict_struct == FRAME_PICTURE &&
+		!video->picture->scalable_mode &&
+		framenum > -1;
+	if(start_bframe && !video->bframe_video)
+		mpeg3video_new_bframe_video(video);
+
   	for(i = 0; i < 3; i++)
 	{
-    	if(video->pict_type == B_TYPE)
+    	if(video->picture->pict_type == B_TYPE)
 		{
-			video->newframe[i] = video->auxframe[i];
+/* Use the other auxframe while a B frame is decoded in the background */
+			if(decode_picture && 
+				!video->picture->secondfield &&
+				(start_bframe || video->bframe_pending))
+			{
+				unsigned char *tmp = video->picture->auxframe[i];
+				video->picture->auxframe[i] = video->picture->spareauxframe[i];
+				video->picture->spareauxframe[i] = tmp;
+			}
+			video->picture->newframe[i] = video->picture->auxframe[i];
 		}
     	else 
 		{
-    	  	if(!video->secondfield && !video->current_repeat)
+    	  	if(!video->picture->secondfield && !video->picture->current_repeat)
 			{
 /* Swap refframes for I frames */
-        		unsigned char* tmp = video->oldrefframe[i];
-        		video->oldrefframe[i] = video->refframe[i];
-        		video->refframe[i] = tmp;
+        		unsigned char* tmp = video->picture->oldrefframe[i];
+        		video->picture->oldrefframe[i] = video->picture->refframe[i];
+/* A B frame decoding in the background still reads the old oldrefframe */
+				if(video->bframe_pending)
+				{
+					video->picture->refframe[i] = video->picture->spareframe[i];
+					video->picture->spareframe[i] = tmp;
+				}
+				else
+        			video->picture->refframe[i] = tmp;
     	  	}
 
-    	 	video->newframe[i] = video->refframe[i];
+    	 	video->picture->newframe[i] = video->picture->refframe[i];
     	}
 
-    	if(video->pict_struct == BOTTOM_FIELD)
+    	if(video->picture->pict_struct == BOTTOM_FIELD)
 		{
 /* Only used if fields are in different pictures */
-    	    video->newframe[i] += (i == 0) ? 
-				video->coded_picture_width : 
-				video->chrom_width;
+    	    video->picture->newframe[i] += (i == 0) ? 
+				video->picture->coded_picture_width : 
+				video->picture->chrom_width;
 		}
 	}
 
 
-/* The problem is when a B frame lands on the first repeat and is skipped, */
-/* the second repeat goes for the same bitmap as the skipped repeat, */
-/* so it picks up a frame from 3 frames back. */
-/* The first repeat must consititutively read a B frame if its B frame is going to be */
-/* used in a later repeat. */
-	if(!video->current_repeat)
-		if(!(video->skip_bframes && video->pict_type == B_TYPE) || 
-			(video->repeat_count >= 100 + 100 * video->skip_bframes))
-  			result = mpeg3video_get_macroblocks(video, framenum);
+/* Convert the output on the slice decoders as the rows are reconstructed. */
+/* The output of an I or P frame is the previous reference frame, */
+/* which is already finished. */
+	if(!start_bframe &&
+		decode_picture &&
+		video->early_output &&
+		framenum > -1 &&
+		video->picture->pict_struct == FRAME_PICTURE &&
+		video->picture->chroma_format != CHROMA444 &&
+		video->total_slice_decoders > 1)
+	{
+		if(video->picture->pict_type == B_TYPE)
+			mpeg3video_start_bands(video, video->picture->auxframe, 0);
+		else
+			mpeg3video_start_bands(video, video->picture->oldrefframe, video->picture->mb_height);
+	}
+
+	if(start_bframe)
+		result = mpeg3video_start_bframe(video, framenum);
+	else
+	if(decode_picture)
+  		result = mpeg3video_get_macroblocks(video, framenum);
 
 /* Set the frame to display */
-	video->output_src[0] = 0;
-	video->output_src[1] = 0;
-	video->output_src[2] = 0;
+	video->picture->output_src[0] = 0;
+	video->picture->output_src[1] = 0;
+	video->picture->output_src[2] = 0;
 	if(framenum > -1 && !result)
 	{
-    	if(video->pict_struct == FRAME_PICTURE || video->secondfield)
+    	if(video->picture->pict_struct == FRAME_PICTURE || video->picture->secondfield)
 		{
-     	  	if(video->pict_type == B_TYPE)
+     	  	if(video->picture->pict_type == B_TYPE)
 			{
-				video->output_src[0] = video->auxframe[0];
-				video->output_src[1] = video->auxframe[1];
-				video->output_src[2] = video->auxframe[2];
+				video->picture->output_src[0] = video->picture->auxframe[0];
+				video->picture->output_src[1] = video->picture->auxframe[1];
+				video->picture->output_src[2] = video->picture->auxframe[2];
 			}
      	  	else
 			{
-				video->output_src[0] = video->oldrefframe[0];
-				video->output_src[1] = video->oldrefframe[1];
-				video->output_src[2] = video->oldrefframe[2];
+				video->picture->output_src[0] = video->picture->oldrefframe[0];
+				video->picture->output_src[1] = video->picture->oldrefframe[1];
+				video->picture->output_src[2] = video->picture->oldrefframe[2];
 			}
     	}
     	else 
@@ -722,12 +910,12 @@ int mpeg3video_getpicture(mpeg3video_t *video, int framenum)
 		}
 	}
 
-	if(video->mpeg2)
+	if(video->picture->mpeg2)
 	{
-		video->current_repeat += 100;
+		video->picture->current_repeat += 100;
 	}
 
-  	if(video->pict_struct != FRAME_PICTURE) 
-		video->secondfield = !video->secondfield;
+  	if(video->picture->pict_struct != FRAME_PICTURE) 
+		video->picture->secondfield = !video->picture->secondfield;
 	return result;
 }
@@ -16,45 +16,45 @@ int mpeg3video_getseqhdr(mpeg3video_t *video)
 	int load_intra_quantizer_matrix, load_non_intra_quantizer_matrix;
 
 //printf("mpeg3video_getseqhdr 1\n");
-	video->horizontal_size = mpeg3bits_getbits(video->vstream, 12);
-	video->vertical_size = mpeg3bits_getbits(video->vstream, 12);
+	video->picture->horizontal_size = mpeg3bits_getbits(video->vstream, 12);
+	video->picture->vertical_size = mpeg3bits_getbits(video->vstream, 12);
 	aspect_ratio = mpeg3bits_getbits(video->vstream, 4);
-	video->framerate_code = mpeg3bits_getbits(video->vstream, 4);
-	video->bitrate = mpeg3bits_getbits(video->vstream, 18);
+	video->picture->framerate_code = mpeg3bits_getbits(video->vstream, 4);
+	video->picture->bitrate = mpeg3bits_getbits(video->vstream, 18);
 	mpeg3bits_getbit_noptr(video->vstream); /* marker bit (=1) */
 	vbv_buffer_size = mpeg3bits_getbits(video->vstream, 10);
 	constrained_parameters_flag = mpeg3bits_getbit_noptr(video->vstream);
-	video->frame_rate = mpeg3_frame_rate_table[video->framerate_code];
+	video->picture->frame_rate = mpeg3_frame_rate_table[video->picture->framerate_code];
 
  	load_intra_quantizer_matrix = mpeg3bits_getbit_noptr(video->vstream);
  	if(load_intra_quantizer_matrix)
 	{
     	for(i = 0; i < 64; i++)
-      		video->intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]] = mpeg3bits_getbyte_noptr(video->vstream);
+      		video->picture->intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]] = mpeg3bits_getbyte_noptr(video->vstream);
   	}
   	else 
 	{
     	for(i = 0; i < 64; i++)
-      		video->intra_quantizer_matrix[i] = mpeg3_default_intra_quantizer_matrix[i];
+      		video->picture->intra_quantizer_matrix[i] = mpeg3_default_intra_quantizer_matrix[i];
   	}
 
 	load_non_intra_quantizer_matrix = mpeg3bits_getbit_noptr(video->vstream);
 	if(load_non_intra_quantizer_matrix)
 	{
     	for(i = 0; i < 64; i++)
-      		video->non_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]] = mpeg3bits_getbyte_noptr(video->vstream);
+      		video->picture->non_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]] = mpeg3bits_getbyte_noptr(video->vstream);
   	}
   	else 
 	{
     	for(i = 0; i < 64; i++)
-      		video->non_intra_quantizer_matrix[i] = 16;
+      		video->picture->non_intra_quantizer_matrix[i] = 16;
   	}
 
 /* copy luminance to chrominance matrices */
   	for(i = 0; i < 64; i++)
 	{
-    	video->chroma_intra_quantizer_matrix[i] = video->intra_quantizer_matrix[i];
-   	 	video->chroma_non_intra_quantizer_matrix[i] = video->non_intra_quantizer_matrix[i];
+    	video->picture->chroma_intra_quantizer_matrix[i] = video->picture->intra_quantizer_matrix[i];
+   	 	video->picture->chroma_non_intra_quantizer_matrix[i] = video->picture->non_intra_quantizer_matrix[i];
   	}
 
 //printf("mpeg3video_getseqhdr 100\n");
@@ -72,11 +72,11 @@ int mpeg3video_sequence_extension(mpeg3video_t *video)
 	int frame_rate_extension_n, frame_rate_extension_d;
 	int pos = 0;
 
-	video->mpeg2 = 1;
-	video->scalable_mode = SC_NONE; /* unless overwritten by seq. scal. ext. */
+	video->picture->mpeg2 = 1;
+	video->picture->scalable_mode = SC_NONE; /* unless overwritten by seq. scal. ext. */
 	prof_lev = mpeg3bits_getbyte_noptr(video->vstream);
-	video->prog_seq = mpeg3bits_getbit_noptr(video->vstream);
-	video->chroma_format = mpeg3bits_getbits(video->vstream, 2);
+	video->picture->prog_seq = mpeg3bits_getbit_noptr(video->vstream);
+	video->picture->chroma_format = mpeg3bits_getbits(video->vstream, 2);
 	horizontal_size_extension = mpeg3bits_getbits(video->vstream, 2);
 	vertical_size_extension = mpeg3bits_getbits(video->vstream, 2);
 	bit_rate_extension = mpeg3bits_getbits(video->vstream, 12);
@@ -85,8 +85,8 @@ int mpeg3video_sequence_extension(mpeg3video_t *video)
 	low_delay = mpeg3bits_getbit_noptr(video->vstream);
 	frame_rate_extension_n = mpeg3bits_getbits(video->vstream, 2);
 	frame_rate_extension_d = mpeg3bits_getbits(video->vstream, 5);
-	video->horizontal_size = (horizontal_size_extension << 12) | (video->horizontal_size & 0x0fff);
-	video->vertical_size = (vertical_size_extension << 12) | (video->vertical_size & 0x0fff);
+	video->picture->horizontal_size = (horizontal_size_extension << 12) | (video->picture->horizontal_size & 0x0fff);
+	video->picture->vertical_size = (vertical_size_extension << 12) | (video->picture->vertical_size & 0x0fff);
 	return 0;
 }
 
@@ -105,7 +105,7 @@ int mpeg3video_sequence_display_extension(mpeg3video_t *video)
 	{
     	colour_primaries = mpeg3bits_getbyte_noptr(video->vstream);
     	transfer_characteristics = mpeg3bits_getbyte_noptr(video->vstream);
-    	video->matrix_coefficients = mpeg3bits_getbyte_noptr(video->vstream);
+    	video->picture->matrix_coefficients = mpeg3bits_getbyte_noptr(video->vstream);
 	}
 
 	display_horizontal_size = mpeg3bits_getbits(video->vstream, 14);
@@ -129,8 +129,8 @@ int mpeg3video_quant_matrix_extension(mpeg3video_t *video)
 	{
       	for(i = 0; i < 64; i++)
 		{
-    		video->chroma_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]]
-    			= video->intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]]
+    		video->picture->chroma_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]]
+    			= video->picture->intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]]
     			= mpeg3bits_getbyte_noptr(video->vstream);
       	}
 	}
@@ -139,8 +139,8 @@ int mpeg3video_quant_matrix_extension(mpeg3video_t *video)
 	{
     	for (i = 0; i < 64; i++)
 		{
-    		video->chroma_non_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]]
-    			= video->non_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]]
+    		video->picture->chroma_non_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]]
+    			= video->picture->non_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]]
     			= mpeg3bits_getbyte_noptr(video->vstream);
     	}
 	}
@@ -148,13 +148,13 @@ int mpeg3video_quant_matrix_extension(mpeg3video_t *video)
 	if((load_chroma_intra_quantiser_matrix = mpeg3bits_getbit_noptr(video->vstream)) != 0)
 	{
     	for(i = 0; i < 64; i++)
-    		video->chroma_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]] = mpeg3bits_getbyte_noptr(video->vstream);
+    		video->picture->chroma_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]] = mpeg3bits_getbyte_noptr(video->vstream);
 	}
 
 	if((load_chroma_non_intra_quantiser_matrix = mpeg3bits_getbit_noptr(video->vstream)) != 0)
 	{
       	for(i = 0; i < 64; i++)
-    		video->chroma_non_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]] = mpeg3bits_getbyte_noptr(video->vstream);
+    		video->picture->chroma_non_intra_quantizer_matrix[video->mpeg3_zigzag_scan_table[i]] = mpeg3bits_getbyte_noptr(video->vstream);
 	}
 	return 0;
 }
@@ -166,21 +166,21 @@ int mpeg3video_sequence_scalable_extension(mpeg3video_t *video)
 {
 	int layer_id;
 
-	video->scalable_mode = mpeg3bits_getbits(video->vstream, 2) + 1; /* add 1 to make SC_DP != SC_NONE */
+	video->picture->scalable_mode = mpeg3bits_getbits(video->vstream, 2) + 1; /* add 1 to make SC_DP != SC_NONE */
 	layer_id = mpeg3bits_getbits(video->vstream, 4);
 
-	if(video->scalable_mode == SC_SPAT)
+	if(video->picture->scalable_mode == SC_SPAT)
 	{
-    	video->llw = mpeg3bits_getbits(video->vstream, 14); /* lower_layer_prediction_horizontal_size */
+    	video->picture->llw = mpeg3bits_getbits(video->vstream, 14); /* lower_layer_prediction_horizontal_size */
     	mpeg3bits_getbit_noptr(video->vstream);
-    	video->llh = mpeg3bits_getbits(video->vstream, 14); /* lower_layer_prediction_vertical_size */
-    	video->hm = mpeg3bits_getbits(video->vstream, 5);
-    	video->hn = mpeg3bits_getbits(video->vstream, 5);
-    	video->vm = mpeg3bits_getbits(video->vstream, 5);
-    	video->vn = mpeg3bits_getbits(video->vstream, 5);
+    	video->picture->llh = mpeg3bits_getbits(video->vstream, 14); /* lower_layer_prediction_vertical_size */
+    	video->picture->hm = mpeg3bits_getbits(video->vstream, 5);
+    	video->picture->hn = mpeg3bits_getbits(video->vstream, 5);
+    	video->picture->vm = mpeg3bits_getbits(video->vstream, 5);
+    	video->picture->vn = mpeg3bits_getbits(video->vstream, 5);
 	}
 
-	if(video->scalable_mode == SC_TEMP)
+	if(video->picture->scalable_mode == SC_TEMP)
       	fprintf(stderr, "mpeg3video_sequence_scalable_extension: temporal scalability not implemented\n");
 	return 0;
 }
@@ -196,10 +196,10 @@ int mpeg3video_picture_display_extension(mpeg3video_t *video)
 
 
 
-	if(video->prog_seq || video->pict_struct != FRAME_PICTURE)
+	if(video->picture->prog_seq || video->picture->pict_struct != FRAME_PICTURE)
 		n = 1;
 	else 
-		n = video->repeatfirst ? 3 : 2;
+		n = video->picture->repeatfirst ? 3 : 2;
 
 
 
@@ -222,55 +222,55 @@ int mpeg3video_picture_coding_extension(mpeg3video_t *video)
 	int chroma_420_type, composite_display_flag;
 	int v_axis = 0, sub_carrier = 0, burst_amplitude = 0, sub_carrier_phase = 0;
 
-	video->h_forw_r_size = mpeg3bits_getbits(video->vstream, 4) - 1;
-	video->v_forw_r_size = mpeg3bits_getbits(video->vstream, 4) - 1;
-	video->h_back_r_size = mpeg3bits_getbits(video->vstream, 4) - 1;
-	video->v_back_r_size = mpeg3bits_getbits(video->vstream, 4) - 1;
-	video->dc_prec = mpeg3bits_getbits(video->vstream, 2);
-	video->pict_struct = mpeg3bits_getbits(video->vstream, 2);
-	video->topfirst = mpeg3bits_getbit_noptr(video->vstream);
-	video->frame_pred_dct = mpeg3bits_getbit_noptr(video->vstream);
-	video->conceal_mv = mpeg3bits_getbit_noptr(video->vstream);
-	video->qscale_type = mpeg3bits_getbit_noptr(video->vstream);
-	video->intravlc = mpeg3bits_getbit_noptr(video->vstream);
-	video->altscan = mpeg3bits_getbit_noptr(video->vstream);
+	video->picture->h_forw_r_size = mpeg3bits_getbits(video->vstream, 4) - 1;
+	video->picture->v_forw_r_size = mpeg3bits_getbits(video->vstream, 4) - 1;
+	video->picture->h_back_r_size = mpeg3bits_getbits(video->vstream, 4) - 1;
+	video->picture->v_back_r_size = mpeg3bits_getbits(video->vstream, 4) - 1;
+	video->picture->dc_prec = mpeg3bits_getbits(video->vstream, 2);
+	video->picture->pict_struct = mpeg3bits_getbits(video->vstream, 2);
+	video->picture->topfirst = mpeg3bits_getbit_noptr(video->vstream);
+	video->picture->frame_pred_dct = mpeg3bits_getbit_noptr(video->vstream);
+	video->picture->conceal_mv = mpeg3bits_getbit_noptr(video->vstream);
+	video->picture->qscale_type = mpeg3bits_getbit_noptr(video->vstream);
+	video->picture->intravlc = mpeg3bits_getbit_noptr(video->vstream);
+	video->picture->altscan = mpeg3bits_getbit_noptr(video->vstream);
 
 
-	video->repeatfirst = mpeg3bits_getbit_noptr(video->vstream);
+	video->picture->repeatfirst = mpeg3bits_getbit_noptr(video->vstream);
 
 
 	chroma_420_type = mpeg3bits_getbit_noptr(video->vstream);
-	video->prog_frame = mpeg3bits_getbit_noptr(video->vstream);
+	video->picture->prog_frame = mpeg3bits_getbit_noptr(video->vstream);
 
-	if(video->repeat_count > 100)
-		video->repeat_count = 0;
-	video->repeat_count += 100;
+	if(video->picture->repeat_count > 100)
+		video->picture->repeat_count = 0;
+	video->picture->repeat_count += 100;
 
-	video->current_repeat = 0;
+	video->picture->current_repeat = 0;
 
 /*
  * printf("%d %d %d %d\n", 
- * video->prog_seq ? 1 : 0, 
- * video->prog_frame ? 1 : 0, 
- * video->topfirst ? 1 : 0, 
- * video->repeatfirst ? 1 : 0);
+ * video->picture->prog_seq ? 1 : 0, 
+ * video->picture->prog_frame ? 1 : 0, 
+ * video->picture->topfirst ? 1 : 0, 
+ * video->picture->repeatfirst ? 1 : 0);
  */
 
 
 
-	if(video->repeatfirst)
+	if(video->picture->repeatfirst)
 	{
-		if(video->prog_seq)
+		if(video->picture->prog_seq)
 		{
-			if(video->topfirst)
-				video->repeat_count += 200;
+			if(video->picture->topfirst)
+				video->picture->repeat_count += 200;
 			else
-				video->repeat_count += 100;
+				video->picture->repeat_count += 100;
 		}
 		else
-		if(video->prog_frame)
+		if(video->picture->prog_frame)
 		{
-			video->repeat_count += 50;
+			video->picture->repeat_count += 50;
 		}
 	}
 
@@ -279,7 +279,7 @@ int mpeg3video_picture_coding_extension(mpeg3video_t *video)
 	if(composite_display_flag)
 	{
     	v_axis = mpeg3bits_getbit_noptr(video->vstream);
-    	video->field_sequence = mpeg3bits_getbits(video->vstream, 3);
+    	video->picture->field_sequence = mpeg3bits_getbits(video->vstream, 3);
     	sub_carrier = mpeg3bits_getbit_noptr(video->vstream);
     	burst_amplitude = mpeg3bits_getbits(video->vstream, 7);
     	sub_carrier_phase = mpeg3bits_getbyte_noptr(video->vstream);
@@ -292,18 +292,18 @@ int mpeg3video_picture_coding_extension(mpeg3video_t *video)
 
 int mpeg3video_picture_spatial_scalable_extension(mpeg3video_t *video)
 {
-	video->pict_scal = 1; /* use spatial scalability in this picture */
+	video->picture->pict_scal = 1; /* use spatial scalability in this picture */
 
-	video->lltempref = mpeg3bits_getbits(video->vstream, 10);
+	video->picture->lltempref = mpeg3bits_getbits(video->vstream, 10);
 	mpeg3bits_getbit_noptr(video->vstream);
-	video->llx0 = mpeg3bits_getbits(video->vstream, 15);
-	if(video->llx0 >= 16384) video->llx0 -= 32768;
+	video->picture->llx0 = mpeg3bits_getbits(video->vstream, 15);
+	if(video->picture->llx0 >= 16384) video->picture->llx0 -= 32768;
 	mpeg3bits_getbit_noptr(video->vstream);
-	video->lly0 = mpeg3bits_getbits(video->vstream, 15);
-	if(video->lly0 >= 16384) video->lly0 -= 32768;
-	video->stwc_table_index = mpeg3bits_getbits(video->vstream, 2);
-	video->llprog_frame = mpeg3bits_getbit_noptr(video->vstream);
-	video->llfieldsel = mpeg3bits_getbit_noptr(video->vstream);
+	video->picture->lly0 = mpeg3bits_getbits(video->vstream, 15);
+	if(video->picture->lly0 >= 16384) video->picture->lly0 -= 32768;
+	video->picture->stwc_table_index = mpeg3bits_getbits(video->vstream, 2);
+	video->picture->llprog_frame = mpeg3bits_getbit_noptr(video->vstream);
+	video->picture->llfieldsel = mpeg3bits_getbit_noptr(video->vstream);
 	return 0;
 }
 
@@ -372,8 +372,8 @@ int mpeg3video_ext_user_data(mpeg3video_t *video)
 
 /*
  * printf("mpeg3video_ext_user_data prog_seq=%d prog_frame=%d\n", 
- * video->prog_seq, 
- * video->prog_frame);
+ * video->picture->prog_seq, 
+ * video->picture->prog_frame);
  */
 	return 0;
 }
@@ -386,19 +386,19 @@ int mpeg3video_getgophdr(mpeg3video_t *video)
 	int drop_flag, closed_gop, broken_link;
 
 //printf("mpeg3video_getgophdr 1\n");
-	video->has_gops = 1;
+	video->picture->has_gops = 1;
 	drop_flag = mpeg3bits_getbit_noptr(video->vstream);
-	video->gop_timecode.hour = mpeg3bits_getbits(video->vstream, 5);
-	video->gop_timecode.minute = mpeg3bits_getbits(video->vstream, 6);
+	video->picture->gop_timecode.hour = mpeg3bits_getbits(video->vstream, 5);
+	video->picture->gop_timecode.minute = mpeg3bits_getbits(video->vstream, 6);
 	mpeg3bits_getbit_noptr(video->vstream);
-	video->gop_timecode.second = mpeg3bits_getbits(video->vstream, 6);
-	video->gop_timecode.frame = mpeg3bits_getbits(video->vstream, 6);
+	video->picture->gop_timecode.second = mpeg3bits_getbits(video->vstream, 6);
+	video->picture->gop_timecode.frame = mpeg3bits_getbits(video->vstream, 6);
 	closed_gop = mpeg3bits_getbit_noptr(video->vstream);
 	broken_link = mpeg3bits_getbit_noptr(video->vstream);
 
 //printf("mpeg3video_getgophdr 100\n");
 /*
- * printf("%d:%d:%d:%d %d %d %d\n", video->gop_timecode.hour, video->gop_timecode.minute, video->gop_timecode.second, video->gop_timecode.frame, 
+ * printf("%d:%d:%d:%d %d %d %d\n", video->picture->gop_timecode.hour, video->picture->gop_timecode.minute, video->picture->gop_timecode.second, video->picture->gop_timecode.frame, 
  *  	drop_flag, closed_gop, broken_link);
  */
 	return mpeg3bits_error(video->vstream);
@@ -410,22 +410,22 @@ int mpeg3video_getpicturehdr(mpeg3video_t *video)
 {
 	int temp_ref, vbv_delay;
 
-	video->pict_scal = 0; /* unless overwritten by pict. spat. scal. ext. */
+	video->picture->pict_scal = 0; /* unless overwritten by pict. spat. scal. ext. */
 
 	temp_ref = mpeg3bits_getbits(video->vstream, 10);
-	video->pict_type = mpeg3bits_getbits(video->vstream, 3);
+	video->picture->pict_type = mpeg3bits_getbits(video->vstream, 3);
 	vbv_delay = mpeg3bits_getbits(video->vstream, 16);
 
-	if(video->pict_type == P_TYPE || video->pict_type == B_TYPE)
+	if(video->picture->pict_type == P_TYPE || video->picture->pict_type == B_TYPE)
 	{
-    	video->full_forw = mpeg3bits_getbit_noptr(video->vstream);
-    	video->forw_r_size = mpeg3bits_getbits(video->vstream, 3) - 1;
+    	video->picture->full_forw = mpeg3bits_getbit_noptr(video->vstream);
+    	video->picture->forw_r_size = mpeg3bits_getbits(video->vstream, 3) - 1;
 	}
 
-	if(video->pict_type == B_TYPE)
+	if(video->picture->pict_type == B_TYPE)
 	{
-    	video->full_back = mpeg3bits_getbit_noptr(video->vstream);
-    	video->back_r_size = mpeg3bits_getbits(video->vstream, 3) - 1;
+    	video->picture->full_back = mpeg3bits_getbit_noptr(video->vstream);
+    	video->picture->back_r_size = mpeg3bits_getbits(video->vstream, 3) - 1;
 	}
 
 /* get extra bit picture */
@@ -448,21 +448,21 @@ int mpeg3video_get_header(mpeg3video_t *video, int dont_repeat)
 /* first time (this is to set horizontal/vertical size properly) */
 
 /* Repeat the frame until it's less than 1 count from repeat_count */
-	if(video->repeat_count - video->current_repeat >= 100 && !dont_repeat)
+	if(video->picture->repeat_count - video->picture->current_repeat >= 100 && !dont_repeat)
 	{
 		return 0;
 	}
 
 	if(dont_repeat)
 	{
-		video->repeat_count = 0;
-		video->current_repeat = 0;
+		video->picture->repeat_count = 0;
+		video->picture->current_repeat = 0;
 	}
 	else
-		video->repeat_count -= video->current_repeat;
+		video->picture->repeat_count -= video->picture->current_repeat;
 
 // Case of no picture coding extension
-	if(video->repeat_count < 0) video->repeat_count = 0;
+	if(video->picture->repeat_count < 0) video->picture->repeat_count = 0;
 
 	while(1)
 	{
@@ -478,7 +478,7 @@ int mpeg3video_get_header(mpeg3video_t *video, int dont_repeat)
     	switch(code)
 		{
     		case MPEG3_SEQUENCE_START_CODE:
-    			video->found_seqhdr = 1;
+    			video->picture->found_seqhdr = 1;
     			mpeg3video_getseqhdr(video);  
     			mpeg3video_ext_user_data(video);
     			break;
@@ -491,7 +491,7 @@ int mpeg3video_get_header(mpeg3video_t *video, int dont_repeat)
     		case MPEG3_PICTURE_START_CODE:
     			mpeg3video_getpicturehdr(video);
     			mpeg3video_ext_user_data(video);
-    			if(video->found_seqhdr) return 0;       /* Exit here */
+    			if(video->picture->found_seqhdr) return 0;       /* Exit here */
     			break;
 
     		case MPEG3_SEQUENCE_END_CODE:
@@ -520,13 +520,13 @@ int mpeg3video_getslicehdr(mpeg3_slice_t *slice, mpeg3video_t *video)
 	int slice_vertical_position_extension, intra_slice;
 	int qs;
 
-  	slice_vertical_position_extension = (video->mpeg2 && video->vertical_size > 2800) ? 
+  	slice_vertical_position_extension = (video->picture->mpeg2 && video->picture->vertical_size > 2800) ? 
 		mpeg3slice_getbits(slice->slice_buffer, 3) : 0;
 
-  	if(video->scalable_mode == SC_DP) slice->pri_brk = mpeg3slice_getbits(slice->slice_buffer, 7);
+  	if(video->picture->scalable_mode == SC_DP) slice->pri_brk = mpeg3slice_getbits(slice->slice_buffer, 7);
 
   	qs = mpeg3slice_getbits(slice->slice_buffer, 5);
-  	slice->quant_scale = video->mpeg2 ? (video->qscale_type ? mpeg3_non_linear_mquant_table[qs] : (qs << 1)) : qs;
+  	slice->quant_scale = video->picture->mpeg2 ? (video->picture->qscale_type ? mpeg3_non_linear_mquant_table[qs] : (qs << 1)) : qs;
 
   	if(mpeg3slice_getbit(slice->slice_buffer))
 	{
@@ -208,17 +208,17 @@ static inline int mpeg3video_get_snrmb_type(mpeg3_slice_t *slice)
 
 int mpeg3video_get_mb_type(mpeg3_slice_t *slice, mpeg3video_t *video)
 {
-	if(video->scalable_mode == SC_SNR)
+	if(video->picture->scalable_mode == SC_SNR)
 	{
 		return mpeg3video_get_snrmb_type(slice);
 	}
 	else
 	{
-    	switch(video->pict_type)
+    	switch(video->picture->pict_type)
 		{
-    		case I_TYPE: return video->pict_scal ? mpeg3video_getsp_imb_type(slice) : mpeg3video_get_imb_type(slice);
-    		case P_TYPE: return video->pict_scal ? mpeg3video_getsp_pmb_type(slice) : mpeg3video_get_pmb_type(slice);
-    		case B_TYPE: return video->pict_scal ? mpeg3video_getsp_bmb_type(slice) : mpeg3video_get_bmb_type(slice);
+    		case I_TYPE: return video->picture->pict_scal ? mpeg3video_getsp_imb_type(slice) : mpeg3video_get_imb_type(slice);
+    		case P_TYPE: return video->picture->pict_scal ? mpeg3video_getsp_pmb_type(slice) : mpeg3video_get_pmb_type(slice);
+    		case B_TYPE: return video->picture->pict_scal ? mpeg3video_getsp_bmb_type(slice) : mpeg3video_get_bmb_type(slice);
     		case D_TYPE: return mpeg3video_get_dmb_type(slice);
     		default: 
 				/*fprintf(stderr, "mpeg3video_getmbtype: unknown coding type\n"); */
@@ -260,12 +260,12 @@ int mpeg3video_macroblock_modes(mpeg3_slice_t *slice,
 /* get spatial_temporal_weight_code */
   	if(mb_type & MB_WEIGHT)
   	{
-    	if(video->stwc_table_index == 0)
+    	if(video->picture->stwc_table_index == 0)
       		stwtype = 4;
     	else
     	{
       		stwcode = mpeg3slice_getbits2(slice_buffer);
-      		stwtype = stwc_table[video->stwc_table_index - 1][stwcode];
+      		stwtype = stwc_table[video->picture->stwc_table_index - 1][stwcode];
     	}
   	}
   	else
@@ -277,10 +277,10 @@ int mpeg3video_macroblock_modes(mpeg3_slice_t *slice,
 /* get frame/field motion type */
   	if(mb_type & (MB_FORWARD | MB_BACKWARD))
 	{
-    	if(video->pict_struct == FRAME_PICTURE)
+    	if(video->picture->pict_struct == FRAME_PICTURE)
 		{ 
 /* frame_motion_type */
-      		motion_type = video->frame_pred_dct ? MC_FRAME : mpeg3slice_getbits2(slice_buffer);
+      		motion_type = video->picture->frame_pred_dct ? MC_FRAME : mpeg3slice_getbits2(slice_buffer);
     	}
     	else 
 		{ 
@@ -289,14 +289,14 @@ int mpeg3video_macroblock_modes(mpeg3_slice_t *slice,
     	}
   	}
   	else 
-	if((mb_type & MB_INTRA) && video->conceal_mv)
+	if((mb_type & MB_INTRA) && video->picture->conceal_mv)
   	{
 /* concealment motion vectors */
-    	motion_type = (video->pict_struct == FRAME_PICTURE) ? MC_FRAME : MC_FIELD;
+    	motion_type = (video->picture->pict_struct == FRAME_PICTURE) ? MC_FRAME : MC_FIELD;
   	}
 
 /* derive mv_count, mv_format and dmv, (table 6-17, 6-18) */
-  	if(video->pict_struct == FRAME_PICTURE)
+  	if(video->picture->pict_struct == FRAME_PICTURE)
   	{
     	mv_count = (motion_type == MC_FIELD && stwclass < 2) ? 2 : 1;
     	mv_format = (motion_type == MC_FRAME) ? MV_FRAME : MV_FIELD;
@@ -310,11 +310,11 @@ int mpeg3video_macroblock_modes(mpeg3_slice_t *slice,
   	dmv = (motion_type == MC_DMV); /* dual prime */
 
 /* field mv predictions in frame pictures have to be scaled */
-  	mvscale = ((mv_format == MV_FIELD) && (video->pict_struct == FRAME_PICTURE));
+  	mvscale = ((mv_format == MV_FIELD) && (video->picture->pict_struct == FRAME_PICTURE));
 
 /* get dct_type (frame DCT / field DCT) */
-  	dct_type = (video->pict_struct == FRAME_PICTURE) && 
-             	(!video->frame_pred_dct) && 
+  	dct_type = (video->picture->pict_struct == FRAME_PICTURE) && 
+             	(!video->picture->frame_pred_dct) && 
              	(mb_type & (MB_PATTERN | MB_INTRA)) ? 
              	mpeg3slice_getbit(slice_buffer) : 0;
 
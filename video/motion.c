@@ -37,9 +37,9 @@ void mpeg3video_calc_dmv(mpeg3video_t *video,
 		int mvx, 
 		int mvy)
 {
-	if(video->pict_struct == FRAME_PICTURE)
+	if(video->picture->pict_struct == FRAME_PICTURE)
 	{
-    	if(video->topfirst)
+    	if(video->picture->topfirst)
 		{
 /* vector for prediction of top field from bottom field */
     		DMV[0][0] = ((mvx  + (mvx>0)) >> 1) + dmvector[0];
@@ -67,7 +67,7 @@ void mpeg3video_calc_dmv(mpeg3video_t *video,
     	DMV[0][1] = ((mvy + (mvy > 0)) >> 1) + dmvector[1];
 
 /* correct for vertical field shift */
-    	if(video->pict_struct == TOP_FIELD)
+    	if(video->picture->pict_struct == TOP_FIELD)
 			DMV[0][1]--;
     	else 
 			DMV[0][1]++;
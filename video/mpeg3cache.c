@@ -5,35 +5,161 @@
 
 
 
-// This is basically qtcache.c with quicktime_ replaced by mpeg3_
+// Decoded frames hashed by frame number.  The least recently used frames
+// are dropped when the cache exceeds max_bytes.
 
+#define HASH_SIZE 64
+
+static int mpeg3_cache_hash(mpeg3_cache_t *ptr, int64_t frame_number)
+{
+	return frame_number & (ptr->hash_size - 1);
+}
+
+static void mpeg3_cache_rehash(mpeg3_cache_t *ptr, int hash_size)
+{
+	int i;
+	ptr->hash = realloc(ptr->hash, sizeof(int) * hash_size);
+	ptr->hash_size = hash_size;
+	for(i = 0; i < hash_size; i++) ptr->hash[i] = -1;
+
+	for(i = ptr->lru_head; i >= 0; i = ptr->frames[i].next)
+	{
+		int bucket = mpeg3_cache_hash(ptr, ptr->frames[i].frame_number);
+		ptr->frames[i].next_hash = ptr->hash[bucket];
+		ptr->hash[bucket] = i;
+	}
+}
+
+static int mpeg3_cache_find(mpeg3_cache_t *ptr, int64_t frame_number)
+{
+	int i;
+	if(!ptr->hash_size) return -1;
+	for(i = ptr->hash[mpeg3_cache_hash(ptr, frame_number)];
+		i >= 0;
+		i = ptr->frames[i].next_hash)
+	{
+		if(ptr->frames[i].frame_number == frame_number) return i;
+	}
+	return -1;
+}
+
+static void mpeg3_cache_unlink(mpeg3_cache_t *ptr, int i)
+{
+	mpeg3_cacheframe_t *frame = &ptr->frames[i];
+	if(frame->prev >= 0)
+		ptr->frames[frame->prev].next = frame->next;
+	else
+		ptr->lru_head = frame->next;
+	if(frame->next >= 0)
+		ptr->frames[frame->next].prev = frame->prev;
+	else
+		ptr->lru_tail = frame->prev;
+}
+
+/* Make the frame the most recently used */
+static void mpeg3_cache_link(mpeg3_cache_t *ptr, int i)
+{
+	mpeg3_cacheframe_t *frame = &ptr->frames[i];
+	frame->prev = -1;
+	frame->next = ptr->lru_head;
+	if(ptr->lru_head >= 0)
+		ptr->frames[ptr->lru_head].prev = i;
+	else
+		ptr->lru_tail = i;
+	ptr->lru_head = i;
+}
+
+/* Take the frame out of the hash table and the LRU list.  The buffers are */
+/* kept for the caller. */
+static void mpeg3_cache_remove(mpeg3_cache_t *ptr, int i)
+{
+	mpeg3_cacheframe_t *frame = &ptr->frames[i];
+	int *link = &ptr->hash[mpeg3_cache_hash(ptr, frame->frame_number)];
+	while(*link != i) link = &ptr->frames[*link].next_hash;
+	*link = frame->next_hash;
+
+	mpeg3_cache_unlink(ptr, i);
+	ptr->bytes -= frame->y_size + frame->u_size + frame->v_size;
+	ptr->total--;
+}
+
+static void mpeg3_cache_release(mpeg3_cache_t *ptr, int i)
+{
+	mpeg3_cacheframe_t *frame = &ptr->frames[i];
+	if(frame->y) free(frame->y);
+	if(frame->u) free(frame->u);
+	if(frame->v) free(frame->v);
+	frame->y = frame->u = frame->v = 0;
+	frame->y_size = frame->u_size = frame->v_size = 0;
+	frame->next_hash = ptr->free_frames;
+	ptr->free_frames = i;
+}
+
+/* Drop least recently used frames until bytes more fit in the budget. */
+/* Returns an evicted frame whose buffers have the requested sizes or -1. */
+static int mpeg3_cache_evict(mpeg3_cache_t *ptr,
+	int64_t bytes,
+	int y_size,
+	int u_size,
+	int v_size)
+{
+	int result = -1;
+	while(ptr->lru_tail >= 0 && ptr->bytes + bytes > ptr->max_bytes)
+	{
+		int i = ptr->lru_tail;
+		mpeg3_cacheframe_t *frame = &ptr->frames[i];
+		mpeg3_cache_remove(ptr, i);
+		ptr->evictions++;
+
+		if(result < 0 &&
+			frame->y_size == y_size &&
+			frame->u_size == u_size &&
+			frame->v_size == v_size)
+			result = i;
+		else
+			mpeg3_cache_release(ptr, i);
+	}
+	return result;
+}
 
 mpeg3_cache_t* mpeg3_new_cache()
 {
 	mpeg3_cache_t *result = calloc(1, sizeof(mpeg3_cache_t));
+	result->free_frames = -1;
+	result->lru_head = result->lru_tail = -1;
+	result->max_bytes = MPEG3_CACHE_SIZE;
 	return result;
 }
 
 void mpeg3_delete_cache(mpeg3_cache_t *ptr)
 {
-	if(ptr->frames) 
+	int i;
+	for(i = 0; i < ptr->allocation; i++)
 	{
-		int i;
-		for(i = 0; i < ptr->allocation; i++)
-		{
-			mpeg3_cacheframe_t *frame = &ptr->frames[i];
-			if(frame->y) free(frame->y);
-			if(frame->u) free(frame->u);
-			if(frame->v) free(frame->v);
-		}
-		free(ptr->frames);
-		free(ptr);
+		mpeg3_cacheframe_t *frame = &ptr->frames[i];
+		if(frame->y) free(frame->y);
+		if(frame->u) free(frame->u);
+		if(frame->v) free(frame->v);
 	}
+	if(ptr->frames) free(ptr->frames);
+	if(ptr->hash) free(ptr->hash);
+	free(ptr);
 }
 
 void mpeg3_reset_cache(mpeg3_cache_t *ptr)
 {
-	ptr->total = 0;
+	while(ptr->lru_tail >= 0)
+	{
+		int i = ptr->lru_tail;
+		mpeg3_cache_remove(ptr, i);
+		mpeg3_cache_release(ptr, i);
+	}
+}
+
+void mpeg3_cache_set_size(mpeg3_cache_t *ptr, int64_t bytes)
+{
+	ptr->max_bytes = bytes;
+	mpeg3_cache_evict(ptr, 0, -1, -1, -1);
 }
 
 void mpeg3_cache_put_frame(mpeg3_cache_t *ptr,
@@ -46,63 +172,80 @@ void mpeg3_cache_put_frame(mpeg3_cache_t *ptr,
 	int v_size)
 {
 	mpeg3_cacheframe_t *frame = 0;
-	int i;
+	int64_t bytes;
+	int i, bucket;
+
+	if(!y) y_size = 0;
+	if(!u) u_size = 0;
+	if(!v) v_size = 0;
+	bytes = (int64_t)y_size + u_size + v_size;
 
-//printf("mpeg3_put_frame 1\n");
-// Get existing frame
-	for(i = 0; i < ptr->total; i++)
+// Existing frames aren't replaced
+	i = mpeg3_cache_find(ptr, frame_number);
+	if(i >= 0)
 	{
-		if(ptr->frames[i].frame_number == frame_number)
-		{
-			frame = &ptr->frames[i];
-			break;
-		}
+		mpeg3_cache_unlink(ptr, i);
+		mpeg3_cache_link(ptr, i);
+		return;
 	}
 
+	if(bytes > ptr->max_bytes) return;
 
-	if(!frame)
-	{
-		if(ptr->total >= ptr->allocation)
-		{
-			int new_allocation = ptr->allocation * 2;
-//printf("mpeg3_put_frame 10 %d\n", new_allocation);
-			if(!new_allocation) new_allocation = 32;
-			ptr->frames = realloc(ptr->frames, 
-				sizeof(mpeg3_cacheframe_t) * new_allocation);
-			bzero(ptr->frames + ptr->total,
-				sizeof(mpeg3_cacheframe_t) * (new_allocation - ptr->allocation));
-//printf("mpeg3_put_frame 20 %d %d %d\n", new_allocation, ptr->allocation, ptr->total);
-			ptr->allocation = new_allocation;
-		}
-
-		frame = &ptr->frames[ptr->total];
-//printf("mpeg3_put_frame 30 %d %p %p %p\n", ptr->total, frame->y, frame->u, frame->v);
-		ptr->total++;
+// Reuse the buffers of an evicted frame if possible
+	i = mpeg3_cache_evict(ptr, bytes, y_size, u_size, v_size);
 
-// Memcpy is a lot slower than just dropping the seeking frames.
-		if(y) 
-		{
-			frame->y = realloc(frame->y, y_size);
-			frame->y_size = y_size;
-			memcpy(frame->y, y, y_size);
-		}
+	if(i < 0 && ptr->free_frames >= 0)
+	{
+		i = ptr->free_frames;
+		ptr->free_frames = ptr->frames[i].next_hash;
+	}
 
-		if(u)
+	if(i < 0)
+	{
+		int new_allocation = ptr->allocation * 2;
+		if(!new_allocation) new_allocation = 32;
+		ptr->frames = realloc(ptr->frames,
+			sizeof(mpeg3_cacheframe_t) * new_allocation);
+		bzero(ptr->frames + ptr->allocation,
+			sizeof(mpeg3_cacheframe_t) * (new_allocation - ptr->allocation));
+		for(i = new_allocation - 1; i > ptr->allocation; i--)
 		{
-			frame->u = realloc(frame->u, u_size);
-			frame->u_size = u_size;
-			memcpy(frame->u, u, u_size);
+			ptr->frames[i].next_hash = ptr->free_frames;
+			ptr->free_frames = i;
 		}
+		i = ptr->allocation;
+		ptr->allocation = new_allocation;
+	}
 
-		if(v)
-		{
-			frame->v = realloc(frame->v, v_size);
-			frame->v_size = v_size;
-			memcpy(frame->v, v, v_size);
-		}
-		frame->frame_number = frame_number;
+	frame = &ptr->frames[i];
+	if(frame->y_size != y_size)
+	{
+		frame->y = realloc(frame->y, y_size);
+		frame->y_size = y_size;
+	}
+	if(frame->u_size != u_size)
+	{
+		frame->u = realloc(frame->u, u_size);
+		frame->u_size = u_size;
 	}
-//printf("mpeg3_put_frame 100\n");
+	if(frame->v_size != v_size)
+	{
+		frame->v = realloc(frame->v, v_size);
+		frame->v_size = v_size;
+	}
+	if(y) memcpy(frame->y, y, y_size);
+	if(u) memcpy(frame->u, u, u_size);
+	if(v) memcpy(frame->v, v, v_size);
+	frame->frame_number = frame_number;
+
+	ptr->total++;
+	ptr->bytes += bytes;
+	if(ptr->total > ptr->hash_size)
+		mpeg3_cache_rehash(ptr, ptr->hash_size ? ptr->hash_size * 2 : HASH_SIZE);
+	mpeg3_cache_link(ptr, i);
+	bucket = mpeg3_cache_hash(ptr, frame_number);
+	frame->next_hash = ptr->hash[bucket];
+	ptr->hash[bucket] = i;
 }
 
 int mpeg3_cache_get_frame(mpeg3_cache_t *ptr,
@@ -111,22 +254,21 @@ int mpeg3_cache_get_frame(mpeg3_cache_t *ptr,
 	unsigned char **u,
 	unsigned char **v)
 {
-	int i;
+	int i = mpeg3_cache_find(ptr, frame_number);
 
-	for(i = 0; i < ptr->total; i++)
+	if(i >= 0)
 	{
 		mpeg3_cacheframe_t *frame = &ptr->frames[i];
-		if(frame->frame_number == frame_number)
-		{
-			
-			*y = frame->y;
-			*u = frame->u;
-			*v = frame->v;
-			return 1;
-			break;
-		}
+		mpeg3_cache_unlink(ptr, i);
+		mpeg3_cache_link(ptr, i);
+		*y = frame->y;
+		*u = frame->u;
+		*v = frame->v;
+		ptr->hits++;
+		return 1;
 	}
 
+	ptr->misses++;
 	return 0;
 }
 
@@ -134,28 +276,12 @@ int mpeg3_cache_get_frame(mpeg3_cache_t *ptr,
 int mpeg3_cache_has_frame(mpeg3_cache_t *ptr,
 	int64_t frame_number)
 {
-	int i;
-
-	for(i = 0; i < ptr->total; i++)
-	{
-		mpeg3_cacheframe_t *frame = &ptr->frames[i];
-		if(frame->frame_number == frame_number)
-			return 1;
-	}
-
-	return 0;
+	return mpeg3_cache_find(ptr, frame_number) >= 0;
 }
 
 int64_t mpeg3_cache_usage(mpeg3_cache_t *ptr)
 {
-	int64_t result = 0;
-	int i;
-	for(i = 0; i < ptr->allocation; i++)
-	{
-		mpeg3_cacheframe_t *frame = &ptr->frames[i];
-		result += frame->y_size + frame->u_size + frame->v_size;
-	}
-	return result;
+	return ptr->bytes;
 }
 
 
@@ -5,6 +5,7 @@
 #include "mpeg3videoprotos.h"
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 // "ŵ" <doogle@shinbiro.com>
 
@@ -69,6 +70,25 @@ double mpeg3_frame_rate_table[16] =
   0,
 };
 
+/* Allocate a contiguous YUV frame with the padding of the refframes */
+static unsigned char* mpeg3video_allocate_frame(mpeg3video_t *video, unsigned char **frame)
+{
+	long size[2], padding[2];
+	unsigned char *buffer;
+
+	padding[0] = 16 * video->picture->coded_picture_width;
+	size[0] = video->picture->coded_picture_width * video->picture->coded_picture_height + padding[0] * 2;
+	padding[1] = 16 * video->picture->chrom_width;
+	size[1] = video->picture->chrom_width * video->picture->chrom_height + 2 * padding[1];
+
+	buffer = (unsigned char*)calloc(1, (size[0] + padding[0]) + 2 * (size[1] + padding[1]));
+/* Direct pointers to areas of contiguous fragments in YVU order per Microsoft */	
+	frame[0] = buffer;
+	frame[2] = buffer + size[0] + padding[0];
+	frame[1] = buffer + size[0] + padding[0] + size[1] + padding[1];
+	return buffer;
+}
+
 int mpeg3video_initdecoder(mpeg3video_t *video)
 {
 	int blk_cnt_tab[3] = {6, 8, 12};
@@ -76,72 +96,57 @@ int mpeg3video_initdecoder(mpeg3video_t *video)
   	int i;
 	long size[4], padding[2];         /* Size of Y, U, and V buffers */
 
-	if(!video->mpeg2)
+	if(!video->picture->mpeg2)
 	{
 /* force MPEG-1 parameters */
-    	video->prog_seq = 1;
-    	video->prog_frame = 1;
-    	video->pict_struct = FRAME_PICTURE;
-    	video->frame_pred_dct = 1;
-    	video->chroma_format = CHROMA420;
-    	video->matrix_coefficients = 5;
+    	video->picture->prog_seq = 1;
+    	video->picture->prog_frame = 1;
+    	video->picture->pict_struct = FRAME_PICTURE;
+    	video->picture->frame_pred_dct = 1;
+    	video->picture->chroma_format = CHROMA420;
+    	video->picture->matrix_coefficients = 5;
 	}
 
 /* Get dimensions rounded to nearest multiple of coded macroblocks */
-	video->mb_width = (video->horizontal_size + 15) / 16;
-	video->mb_height = (video->mpeg2 && !video->prog_seq) ? 
-					(2 * ((video->vertical_size + 31) / 32)) : 
-					((video->vertical_size + 15) / 16);
-	video->coded_picture_width = 16 * video->mb_width;
-	video->coded_picture_height = 16 * video->mb_height;
-	video->chrom_width = (video->chroma_format == CHROMA444) ? 
-					video->coded_picture_width : 
-					(video->coded_picture_width >> 1);
-	video->chrom_height = (video->chroma_format != CHROMA420) ? 
-					video->coded_picture_height : 
-                    (video->coded_picture_height >> 1);
-	video->blk_cnt = blk_cnt_tab[video->chroma_format - 1];
+	video->picture->mb_width = (video->picture->horizontal_size + 15) / 16;
+	video->picture->mb_height = (video->picture->mpeg2 && !video->picture->prog_seq) ? 
+					(2 * ((video->picture->vertical_size + 31) / 32)) : 
+					((video->picture->vertical_size + 15) / 16);
+	video->picture->coded_picture_width = 16 * video->picture->mb_width;
+	video->picture->coded_picture_height = 16 * video->picture->mb_height;
+	video->picture->chrom_width = (video->picture->chroma_format == CHROMA444) ? 
+					video->picture->coded_picture_width : 
+					(video->picture->coded_picture_width >> 1);
+	video->picture->chrom_height = (video->picture->chroma_format != CHROMA420) ? 
+					video->picture->coded_picture_height : 
+                    (video->picture->coded_picture_height >> 1);
+	video->picture->blk_cnt = blk_cnt_tab[video->picture->chroma_format - 1];
 
 /* Get sizes of YUV buffers */
-	padding[0] = 16 * video->coded_picture_width;
-	size[0] = video->coded_picture_width * video->coded_picture_height + padding[0] * 2;
-
-	padding[1] = 16 * video->chrom_width;
-	size[1] = video->chrom_width * video->chrom_height + 2 * padding[1];
-
-	size[2] = (video->llw * video->llh);
-	size[3] = (video->llw * video->llh) / 4;
+	padding[0] = 16 * video->picture->coded_picture_width;
+	padding[1] = 16 * video->picture->chrom_width;
+	size[2] = (video->picture->llw * video->picture->llh);
+	size[3] = (video->picture->llw * video->picture->llh) / 4;
 
 /* Allocate contiguous fragments for YUV buffers for hardware YUV decoding */
-	video->yuv_buffer[0] = (unsigned char*)calloc(1, (size[0] + padding[0]) + 2 * (size[1] + padding[1]));
-	video->yuv_buffer[1] = (unsigned char*)calloc(1, (size[0] + padding[0]) + 2 * (size[1] + padding[1]));
-	video->yuv_buffer[2] = (unsigned char*)calloc(1, (size[0] + padding[0]) + 2 * (size[1] + padding[1]));
+	video->yuv_buffer[0] = mpeg3video_allocate_frame(video, video->picture->refframe);
+	video->yuv_buffer[1] = mpeg3video_allocate_frame(video, video->picture->oldrefframe);
+	video->yuv_buffer[2] = mpeg3video_allocate_frame(video, video->picture->auxframe);
 
-    if(video->scalable_mode == SC_SPAT)
+    if(video->picture->scalable_mode == SC_SPAT)
 	{
 		video->yuv_buffer[3] = (unsigned char*)calloc(1, size[2] + 2 * size[3]);
 		video->yuv_buffer[4] = (unsigned char*)calloc(1, size[2] + 2 * size[3]);
 	}
 
-/* Direct pointers to areas of contiguous fragments in YVU order per Microsoft */	
 	for(cc = 0; cc < 3; cc++)
 	{
 		video->llframe0[cc] = 0;
 		video->llframe1[cc] = 0;
-		video->newframe[cc] = 0;
+		video->picture->newframe[cc] = 0;
 	}
 
-	video->refframe[0]    = video->yuv_buffer[0];
-	video->oldrefframe[0] = video->yuv_buffer[1];
-	video->auxframe[0]    = video->yuv_buffer[2];
-	video->refframe[2]    = video->yuv_buffer[0] + size[0] + padding[0];
-	video->oldrefframe[2] = video->yuv_buffer[1] + size[0] + padding[0];
-	video->auxframe[2]    = video->yuv_buffer[2] + size[0] + padding[0];
-	video->refframe[1]    = video->yuv_buffer[0] + size[0] + padding[0] + size[1] + padding[1];
-	video->oldrefframe[1] = video->yuv_buffer[1] + size[0] + padding[0] + size[1] + padding[1];
-	video->auxframe[1]    = video->yuv_buffer[2] + size[0] + padding[0] + size[1] + padding[1];
-
-    if(video->scalable_mode == SC_SPAT)
+    if(video->picture->scalable_mode == SC_SPAT)
 	{
 /* this assumes lower layer is 4:2:0 */
 		video->llframe0[0] = video->yuv_buffer[3] + padding[0] 				   ;
@@ -152,7 +157,16 @@ int mpeg3video_initdecoder(mpeg3video_t *video)
 		video->llframe1[1] = video->yuv_buffer[4] + padding[1] + size[2] + size[3];
     }
 
+	mpeg3video_init_idct(video);
+	mpeg3video_init_recon(video);
+	mpeg3video_init_yuv_tables(video);
+	return 0;
+}
+
 /* Initialize the YUV tables for software YUV decoding */
+void mpeg3video_init_yuv_tables(mpeg3video_t *video)
+{
+	int i;
 	video->cr_to_r = malloc(sizeof(long) * 256);
 	video->cr_to_g = malloc(sizeof(long) * 256);
 	video->cb_to_g = malloc(sizeof(long) * 256);
@@ -169,8 +183,6 @@ int mpeg3video_initdecoder(mpeg3video_t *video)
 		video->cb_to_g_ptr[i] = (long)(-0.336 * 65536 * i);
 		video->cb_to_b_ptr[i] = (long)( 1.732 * 65536 * i);
 	}
-
-	return 0;
 }
 
 int mpeg3video_deletedecoder(mpeg3video_t *video)
@@ -180,6 +192,8 @@ int mpeg3video_deletedecoder(mpeg3video_t *video)
 	if(video->yuv_buffer[0]) free(video->yuv_buffer[0]);
 	if(video->yuv_buffer[1]) free(video->yuv_buffer[1]);
 	if(video->yuv_buffer[2]) free(video->yuv_buffer[2]);
+	if(video->spare_buffer[0]) free(video->spare_buffer[0]);
+	if(video->spare_buffer[1]) free(video->spare_buffer[1]);
 
 	if(video->subtitle_frame[0]) free(video->subtitle_frame[0]);
 	if(video->subtitle_frame[1]) free(video->subtitle_frame[1]);
@@ -206,11 +220,12 @@ void mpeg3video_init_scantables(mpeg3video_t *video)
 	}
 }
 
+static void mpeg3video_init_instance(mpeg3video_t *video);
+
 mpeg3video_t* mpeg3video_allocate_struct(mpeg3_t *file, mpeg3_vtrack_t *track)
 {
 	int i;
 	mpeg3video_t *video = calloc(1, sizeof(mpeg3video_t));
-	pthread_mutexattr_t mutex_attr;
 
 	video->file = file;
 	video->track = track;
@@ -226,32 +241,72 @@ mpeg3video_t* mpeg3video_allocate_struct(mpeg3_t *file, mpeg3_vtrack_t *track)
 
 	mpeg3video_init_scantables(video);
 	mpeg3video_init_output();
+	mpeg3video_init_instance(video);
+	return video;
+}
 
+static void mpeg3video_init_instance(mpeg3video_t *video)
+{
+	pthread_mutexattr_t mutex_attr;
 	pthread_mutexattr_init(&mutex_attr);
 //	pthread_mutexattr_setkind_np(&mutex_attr, PTHREAD_MUTEX_FAST_NP);
 	pthread_mutex_init(&(video->test_lock), &mutex_attr);
 	pthread_mutex_init(&(video->slice_lock), &mutex_attr);
-	return video;
+	pthread_cond_init(&(video->slice_start), 0);
+	pthread_cond_init(&(video->slice_done), 0);
+	pthread_cond_init(&(video->slice_loaded), 0);
+	video->picture = &(video->pictures[0]);
+	video->ahead_picture = &(video->pictures[1]);
 }
 
-int mpeg3video_delete_struct(mpeg3video_t *video)
+static void mpeg3video_delete_instance(mpeg3video_t *video)
 {
 	int i;
-	mpeg3bits_delete_stream(video->vstream);
+	if(video->total_slice_decoders)
+	{
+		for(i = 0; i < video->total_slice_decoders; i++)
+			mpeg3_delete_slice_decoder(&(video->slice_decoders[i]));
+	}
 	pthread_mutex_destroy(&(video->test_lock));
 	pthread_mutex_destroy(&(video->slice_lock));
+	pthread_cond_destroy(&(video->slice_start));
+	pthread_cond_destroy(&(video->slice_done));
+	pthread_cond_destroy(&(video->slice_loaded));
+	for(i = 0; i < video->slice_buffers_initialized; i++)
+		mpeg3_delete_slice_buffer(&(video->slice_buffers[i]));
+	if(video->mb_rows_done) free(video->mb_rows_done);
+}
+
+/* Create the decoder for B frames in frame parallel mode.  It only owns */
+/* slice decoders.  The picture state is copied in for every B frame. */
+/* The rest of the decoder is shared with video. */
+int mpeg3video_new_bframe_video(mpeg3video_t *video)
+{
+	mpeg3video_t *bframe_video = calloc(1, sizeof(mpeg3video_t));
+	mpeg3video_init_instance(bframe_video);
+	bframe_video->async_slices = 1;
+	video->bframe_video = bframe_video;
+
+	video->spare_buffer[0] = mpeg3video_allocate_frame(video, video->picture->spareframe);
+	video->spare_buffer[1] = mpeg3video_allocate_frame(video, video->picture->spareauxframe);
+	return 0;
+}
+
+int mpeg3video_delete_struct(mpeg3video_t *video)
+{
+	mpeg3bits_delete_stream(video->vstream);
 	if(video->x_table)
 	{
 		free(video->x_table);
 		free(video->y_table);
 	}
-	if(video->total_slice_decoders)
+	if(video->bframe_video)
 	{
-		for(i = 0; i < video->total_slice_decoders; i++)
-			mpeg3_delete_slice_decoder(&(video->slice_decoders[i]));
+		mpeg3video_wait_slices(video->bframe_video);
+		mpeg3video_delete_instance(video->bframe_video);
+		free(video->bframe_video);
 	}
-	for(i = 0; i < video->slice_buffers_initialized; i++)
-		mpeg3_delete_slice_buffer(&(video->slice_buffers[i]));
+	mpeg3video_delete_instance(video);
 
 
 	free(video);
@@ -259,24 +314,21 @@ int mpeg3video_delete_struct(mpeg3video_t *video)
 }
 
 
-int mpeg3video_read_frame_backend(mpeg3video_t *video, int skip_bframes)
+/* Decode the next frame or pair of fields */
+static int mpeg3video_read_picture(mpeg3video_t *video, int skip_bframes)
 {
 	int result = 0;
 	int got_top = 0, got_bottom = 0;
 	int i = 0;
-	mpeg3_vtrack_t *track = video->track;
-	mpeg3_t *file = (mpeg3_t*)video->file;
 	const int debug = 0;
 
-if(debug) printf("mpeg3video_read_frame_backend %d\n", __LINE__);
-
 	do
 	{
 		if(mpeg3bits_eof(video->vstream)) result = 1;
-if(debug) printf("mpeg3video_read_frame_backend %d\n", __LINE__);
+if(debug) printf("mpeg3video_read_picture %d\n", __LINE__);
 
 		if(!result) result = mpeg3video_get_header(video, 0);
-if(debug) printf("mpeg3video_read_frame_backend %d\n", __LINE__);
+if(debug) printf("mpeg3video_read_picture %d\n", __LINE__);
 
 
 /* skip_bframes is the number of bframes we can skip successfully. */
@@ -288,22 +340,22 @@ if(debug) printf("mpeg3video_read_frame_backend %d\n", __LINE__);
 			result = mpeg3video_getpicture(video, video->framenum);
 
 
-		if(video->pict_struct == TOP_FIELD)
+		if(video->picture->pict_struct == TOP_FIELD)
 		{
 			got_top == 1;
 		}
 		else
-		if(video->pict_struct == BOTTOM_FIELD)
+		if(video->picture->pict_struct == BOTTOM_FIELD)
 		{
 			got_bottom = 1;
-			video->secondfield = 0;
+			video->picture->secondfield = 0;
 		}
 		else
-		if(video->pict_struct == FRAME_PICTURE)
+		if(video->picture->pict_struct == FRAME_PICTURE)
 		{
 			got_top = got_bottom = 1;
 		}
-if(debug) printf("mpeg3video_read_frame_backend %d\n", __LINE__);
+if(debug) printf("mpeg3video_read_picture %d\n", __LINE__);
 
 		i++;
 	}while(i < 2 && 
@@ -313,7 +365,71 @@ if(debug) printf("mpeg3video_read_frame_backend %d\n", __LINE__);
 // the I frames have the top field but both the I frame and
 // subsequent P frame are interlaced to make the keyframe.
 
+	return result;
+}
+
+/* Exchange the picture state with ahead_picture */
+static void mpeg3video_swap_ahead(mpeg3video_t *video)
+{
+	mpeg3_picture_t *temp = video->picture;
+	video->picture = video->ahead_picture;
+	video->ahead_picture = temp;
+}
+
+/* Decode the picture after the B frame while bframe_video decodes the */
+/* B frame.  The state after the B frame is restored and the next call */
+/* to read_frame_backend takes the state after the next picture. */
+static void mpeg3video_decode_ahead(mpeg3video_t *video)
+{
+	if(video->framenum < 0 ||
+		video->picture->repeat_count - video->picture->current_repeat >= 100 ||
+		mpeg3bits_eof(video->vstream)) return;
+
+	*video->ahead_picture = *video->picture;
+
+	video->decode_ahead = 0;
+	video->early_output = 0;
+	video->ahead_result = mpeg3video_read_picture(video, 0);
+	mpeg3video_swap_ahead(video);
+	video->ahead_valid = 1;
+}
+
+/* Take the picture decoded ahead */
+static int mpeg3video_use_ahead(mpeg3video_t *video)
+{
+	mpeg3video_swap_ahead(video);
+	video->ahead_valid = 0;
+	return video->ahead_result;
+}
+
+/* Discard the picture decoded ahead before moving the stream */
+void mpeg3video_drop_ahead(mpeg3video_t *video)
+{
+	video->ahead_valid = 0;
+}
+
+int mpeg3video_read_frame_backend(mpeg3video_t *video, int skip_bframes)
+{
+	int result = 0;
+	const int debug = 0;
+
+if(debug) printf("mpeg3video_read_frame_backend %d\n", __LINE__);
+
+	if(video->ahead_valid)
+	{
+		result = mpeg3video_use_ahead(video);
+	}
+	else
+	{
+		result = mpeg3video_read_picture(video, skip_bframes);
 
+		if(video->bframe_pending)
+		{
+			mpeg3video_decode_ahead(video);
+			mpeg3video_wait_slices(video->bframe_video);
+			video->bframe_pending = 0;
+		}
+	}
 
 if(debug) printf("mpeg3video_read_frame_backend %d\n", __LINE__);
 
@@ -333,6 +449,20 @@ if(debug) printf("mpeg3video_read_frame_backend %d\n", __LINE__);
 	return result;
 }
 
+/* Read the next frame for presentation.  A B frame may be decoded in */
+/* parallel with the picture after it. */
+static int mpeg3video_read_next_frame(mpeg3video_t *video)
+{
+	mpeg3_t *file = video->file;
+	int result;
+	video->decode_ahead = file->bframe_cpus > 0;
+	video->output_done = 0;
+	result = mpeg3video_read_frame_backend(video, 0);
+	video->decode_ahead = 0;
+	video->early_output = 0;
+	return result;
+}
+
 int* mpeg3video_get_scaletable(int input_w, int output_w)
 {
 	int *result = malloc(sizeof(int) * output_w);
@@ -349,7 +479,7 @@ int* mpeg3video_get_scaletable(int input_w, int output_w)
 int mpeg3video_get_firstframe(mpeg3video_t *video)
 {
 	int result = 0;
-	video->repeat_count = video->current_repeat = 0;
+	video->picture->repeat_count = video->picture->current_repeat = 0;
 	result = mpeg3video_read_frame_backend(video, 0);
 	return result;
 }
@@ -360,7 +490,7 @@ static long gop_to_frame(mpeg3video_t *video, mpeg3_timecode_t *gop_timecode)
 	long result;
 
 // Mirror of what mpeg2enc does
-	fps = (int)(video->frame_rate + 0.5);
+	fps = (int)(video->picture->frame_rate + 0.5);
 
 
 	hour = gop_timecode->hour;
@@ -407,12 +537,12 @@ mpeg3video_t* mpeg3video_new(mpeg3_t *file,
 
 			mpeg3video_initdecoder(video);
 			video->decoder_initted = 1;
-			track->width = video->horizontal_size;
-			track->height = video->vertical_size;
-			track->frame_rate = video->frame_rate;
+			track->width = video->picture->horizontal_size;
+			track->height = video->picture->vertical_size;
+			track->frame_rate = video->picture->frame_rate;
 
 /* Try to get the length of the file from GOP's */
-			if(!track->frame_offsets)
+			if(!mpeg3vtrack_has_offsets(track))
 			{
 				if(file->is_video_stream)
 				{
@@ -423,17 +553,17 @@ mpeg3video_t* mpeg3video_new(mpeg3_t *file,
 					if(!result) mpeg3bits_getbits(bitstream, 32);
 					if(!result) result = mpeg3video_getgophdr(video);
 
-					hour = video->gop_timecode.hour;
-					minute = video->gop_timecode.minute;
-					second = video->gop_timecode.second;
-					frame = video->gop_timecode.frame;
+					hour = video->picture->gop_timecode.hour;
+					minute = video->picture->gop_timecode.minute;
+					second = video->picture->gop_timecode.second;
+					frame = video->picture->gop_timecode.frame;
 
-					video->first_frame = gop_to_frame(video, &video->gop_timecode);
+					video->first_frame = gop_to_frame(video, &video->picture->gop_timecode);
 
 /*
- * 			video->first_frame = (long)(hour * 3600 * video->frame_rate + 
- * 				minute * 60 * video->frame_rate +
- * 				second * video->frame_rate +
+ * 			video->first_frame = (long)(hour * 3600 * video->picture->frame_rate + 
+ * 				minute * 60 * video->picture->frame_rate +
+ * 				second * video->picture->frame_rate +
  * 				frame);
  */
 
@@ -455,17 +585,17 @@ mpeg3video_t* mpeg3video_new(mpeg3_t *file,
 					mpeg3bits_getbits(bitstream, 8);
 					if(!result) result = mpeg3video_getgophdr(video);
 
-					hour = video->gop_timecode.hour;
-					minute = video->gop_timecode.minute;
-					second = video->gop_timecode.second;
-					frame = video->gop_timecode.frame;
+					hour = video->picture->gop_timecode.hour;
+					minute = video->picture->gop_timecode.minute;
+					second = video->picture->gop_timecode.second;
+					frame = video->picture->gop_timecode.frame;
 
-					video->last_frame = gop_to_frame(video, &video->gop_timecode);
+					video->last_frame = gop_to_frame(video, &video->picture->gop_timecode);
 
 /*
- * 			video->last_frame = (long)((double)hour * 3600 * video->frame_rate + 
- * 				minute * 60 * video->frame_rate +
- * 				second * video->frame_rate +
+ * 			video->last_frame = (long)((double)hour * 3600 * video->picture->frame_rate + 
+ * 				minute * 60 * video->picture->frame_rate +
+ * 				second * video->picture->frame_rate +
  * 				frame);
  */
 
@@ -494,7 +624,7 @@ mpeg3video_t* mpeg3video_new(mpeg3_t *file,
  * 				video->first_frame = 0;
  * 				track->total_frames = video->last_frame = 
  * 					(long)(mpeg3demux_length(video->vstream->demuxer) * 
- * 						video->frame_rate);
+ * 						video->picture->frame_rate);
  * 				video->first_frame = 0;
  */
 				}
@@ -508,7 +638,7 @@ mpeg3video_t* mpeg3video_new(mpeg3_t *file,
 
 
 			video->maxframe = track->total_frames;
-			video->repeat_count = 0;
+			video->picture->repeat_count = 0;
 			mpeg3_rewind_video(video);
 			mpeg3video_get_firstframe(video);
 		}
@@ -592,6 +722,7 @@ int mpeg3video_read_frame(mpeg3video_t *video,
 		int color_model)
 {
 	int result = 0;
+	mpeg3_t *file = video->file;
 	mpeg3_vtrack_t *track = video->track;
 
 	video->want_yvu = 0;
@@ -639,25 +770,21 @@ int mpeg3video_read_frame(mpeg3video_t *video,
 //printf("mpeg3video_read_frame 1 %d\n", frame_number);
 // Swap output data for cache data
 		unsigned char *temp[3];
-		temp[0] = video->output_src[0];
-		temp[1] = video->output_src[1];
-		temp[2] = video->output_src[2];
+		temp[0] = video->picture->output_src[0];
+		temp[1] = video->picture->output_src[1];
+		temp[2] = video->picture->output_src[2];
 
-		video->output_src[0] = y;
-		video->output_src[1] = u;
-		video->output_src[2] = v;
+		video->picture->output_src[0] = y;
+		video->picture->output_src[1] = u;
+		video->picture->output_src[2] = v;
 // Transfer with cropping
-		if(video->output_src[0]) mpeg3video_present_frame(video);
-		video->output_src[0] = temp[0];
-		video->output_src[1] = temp[1];
-		video->output_src[2] = temp[2];
-
-// Advance either framenum or frame_seek
-		if(frame_number == video->framenum)
-			video->framenum = ++frame_number;
-		else
-		if(frame_number == video->frame_seek)
-			video->frame_seek = ++frame_number;
+		if(video->picture->output_src[0]) mpeg3video_present_frame(video);
+		video->picture->output_src[0] = temp[0];
+		video->picture->output_src[1] = temp[1];
+		video->picture->output_src[2] = temp[2];
+
+// The stream didn't move, so the next frame read seeks to its position
+		video->frame_seek = frame_number + 1;
 	}
 	else
 	{
@@ -668,16 +795,25 @@ int mpeg3video_read_frame(mpeg3video_t *video,
 			video->frame_seek != video->last_number)
 		{
 			if(!result) result = mpeg3video_seek(video);
-			if(!result) result = mpeg3video_read_frame_backend(video, 0);
+			if(!result)
+			{
+/* The RGB conversion can start before the picture is finished unless */
+/* subtitles are composited on it. */
+				video->early_output = file->subtitle_track < 0 ||
+					file->subtitle_track >= mpeg3_subtitle_tracks(file);
+				result = mpeg3video_read_next_frame(video);
+			}
 		}
 		else
 		{
 			video->framenum = video->frame_seek + 1;
 			video->last_number = video->frame_seek;
 			video->frame_seek = -1;
+			video->output_done = 0;
 		}
 
-		if(video->output_src[0]) mpeg3video_present_frame(video);
+		if(video->picture->output_src[0] && !video->output_done) 
+			mpeg3video_present_frame(video);
 	}
 
 	return result;
@@ -717,41 +853,37 @@ int mpeg3video_read_yuvframe(mpeg3video_t *video,
 
 
 //printf("mpeg3video_read_yuvframe 1 %d\n", frame_number);
-		if(video->chroma_format == CHROMA420)
+		if(video->picture->chroma_format == CHROMA420)
 			chroma_denominator = 2;
 		else
 			chroma_denominator = 1;
-		size0 = video->coded_picture_width * video->in_h;
-		size1 = video->chrom_width * (int)((float)video->in_h / chroma_denominator + 0.5);
+		size0 = video->picture->coded_picture_width * video->in_h;
+		size1 = video->picture->chrom_width * (int)((float)video->in_h / chroma_denominator + 0.5);
 
 
 // Swap output data for cache data
 		unsigned char *temp[3];
-		temp[0] = video->output_src[0];
-		temp[1] = video->output_src[1];
-		temp[2] = video->output_src[2];
+		temp[0] = video->picture->output_src[0];
+		temp[1] = video->picture->output_src[1];
+		temp[2] = video->picture->output_src[2];
 
-		video->output_src[0] = y;
-		video->output_src[1] = u;
-		video->output_src[2] = v;
+		video->picture->output_src[0] = y;
+		video->picture->output_src[1] = u;
+		video->picture->output_src[2] = v;
 // Transfer with cropping
-		if(video->output_src[0]) mpeg3video_present_frame(video);
-		video->output_src[0] = temp[0];
-		video->output_src[1] = temp[1];
-		video->output_src[2] = temp[2];
-
-// Advance either framenum or frame_seek
-		if(frame_number == video->framenum)
-			video->framenum = ++frame_number;
-		else
-		if(frame_number == video->frame_seek)
-			video->frame_seek = ++frame_number;
+		if(video->picture->output_src[0]) mpeg3video_present_frame(video);
+		video->picture->output_src[0] = temp[0];
+		video->picture->output_src[1] = temp[1];
+		video->picture->output_src[2] = temp[2];
+
+// The stream didn't move, so the next frame read seeks to its position
+		video->frame_seek = frame_number + 1;
 	}
 	else
 	{
 		if(!result) result = mpeg3video_seek(video);
-		if(!result) result = mpeg3video_read_frame_backend(video, 0);
-		if(video->output_src[0]) mpeg3video_present_frame(video);
+		if(!result) result = mpeg3video_read_next_frame(video);
+		if(video->picture->output_src[0]) mpeg3video_present_frame(video);
 	}
 
 
@@ -785,12 +917,8 @@ if(debug) printf("mpeg3video_read_yuvframe_ptr %d\n", __LINE__);
 		*u_output = (char*)u;
 		*v_output = (char*)v;
 
-// Advance either framenum or frame_seek
-		if(frame_number == video->framenum)
-			video->framenum = ++frame_number;
-		else
-		if(frame_number == video->frame_seek)
-			video->frame_seek = ++frame_number;
+// The stream didn't move, so the next frame read seeks to its position
+		video->frame_seek = frame_number + 1;
 if(debug) printf("mpeg3video_read_yuvframe_ptr %d\n", __LINE__);
 	}
 	else
@@ -802,14 +930,14 @@ if(debug) printf("mpeg3video_read_yuvframe_ptr %d\n", __LINE__);
 if(debug) printf("mpeg3video_read_yuvframe_ptr %d\n", __LINE__);
 		if(!result) result = mpeg3video_seek(video);
 if(debug) printf("mpeg3video_read_yuvframe_ptr %d\n", __LINE__);
-		if(!result) result = mpeg3video_read_frame_backend(video, 0);
+		if(!result) result = mpeg3video_read_next_frame(video);
 if(debug) printf("mpeg3video_read_yuvframe_ptr %d\n", __LINE__);
 
-        if(video->output_src[0])
+        if(video->picture->output_src[0])
         {
-            *y_output = (char*)video->output_src[0];
-            *u_output = (char*)video->output_src[1];
-            *v_output = (char*)video->output_src[2];
+            *y_output = (char*)video->picture->output_src[0];
+            *u_output = (char*)video->picture->output_src[1];
+            *v_output = (char*)video->picture->output_src[2];
         }
 if(debug) printf("mpeg3video_read_yuvframe_ptr %d\n", __LINE__);
 	}
@@ -820,11 +948,11 @@ if(debug) printf("mpeg3video_read_yuvframe_ptr %d\n", __LINE__);
 		video->last_number = video->frame_seek;
 		video->frame_seek = -1;
 
-        if(video->output_src[0])
+        if(video->picture->output_src[0])
         {
-            *y_output = (char*)video->output_src[0];
-            *u_output = (char*)video->output_src[1];
-            *v_output = (char*)video->output_src[2];
+            *y_output = (char*)video->picture->output_src[0];
+            *u_output = (char*)video->picture->output_src[1];
+            *v_output = (char*)video->picture->output_src[2];
         }
 if(debug) printf("mpeg3video_read_yuvframe_ptr %d\n", __LINE__);
 	}
@@ -841,7 +969,7 @@ if(debug) printf("mpeg3video_read_yuvframe_ptr %d\n", __LINE__);
 
 int mpeg3video_colormodel(mpeg3video_t *video)
 {
-	switch(video->chroma_format)
+	switch(video->picture->chroma_format)
 	{
 		case CHROMA422:
 			return MPEG3_YUV422P;
@@ -859,15 +987,15 @@ void mpeg3video_dump(mpeg3video_t *video)
 {
 	printf("mpeg3video_dump 1\n");
 	printf(" *** sequence extension 1\n");
-	printf("prog_seq=%d\n", video->prog_seq);
+	printf("prog_seq=%d\n", video->picture->prog_seq);
 	printf(" *** picture header 1\n");
-	printf("pict_type=%d field_sequence=%d\n", video->pict_type, video->field_sequence);
+	printf("pict_type=%d field_sequence=%d\n", video->picture->pict_type, video->picture->field_sequence);
 	printf(" *** picture coding extension 1\n");
 	printf("field_sequence=%d repeatfirst=%d prog_frame=%d pict_struct=%d\n", 
-		video->field_sequence,
-		video->repeatfirst, 
-		video->prog_frame,
-		video->pict_struct);
+		video->picture->field_sequence,
+		video->picture->repeatfirst, 
+		video->picture->prog_frame,
+		video->picture->pict_struct);
 }
 
 
@@ -1,4 +1,5 @@
 #include "../libmpeg3.h"
+#include "../mpeg3protos.h"
 #include "mpeg3video.h"
 #include <string.h>
 
@@ -14,27 +15,27 @@ static unsigned char mpeg3_601_to_rgb[256];
 
 
 #define DITHER_ROW_HEAD \
-	for(h = 0; h < video->out_h; h++) \
+	for(h = row_start; h < row_end; h++) \
 	{ \
 		y_in = &src[0][(video->y_table[h] + video->in_y) * \
-			video->coded_picture_width] + \
+			video->picture->coded_picture_width] + \
 			video->in_x; \
-		if(video->chroma_format == CHROMA420) \
+		if(video->picture->chroma_format == CHROMA420) \
 		{ \
 			cb_in = &src[1][((video->y_table[h] + video->in_y) >> 1) * \
-				video->chrom_width] + \
+				video->picture->chrom_width] + \
 				(video->in_x >> 1); \
 			cr_in = &src[2][((video->y_table[h] + video->in_y) >> 1) * \
-				video->chrom_width] + \
+				video->picture->chrom_width] + \
 				(video->in_x >> 1); \
 		} \
 		else \
 		{ \
 			cb_in = &src[1][(video->y_table[h] + video->in_y) * \
-				video->chrom_width] + \
+				video->picture->chrom_width] + \
 				(video->in_x >> 1); \
 			cr_in = &src[2][(video->y_table[h] + video->in_y) * \
-				video->chrom_width] + \
+				video->picture->chrom_width] + \
 				(video->in_x >> 1); \
 		} \
 		data = output_rows[h];
@@ -66,7 +67,7 @@ static unsigned char mpeg3_601_to_rgb[256];
 	}
 
 #define DITHER_HEAD \
-    for(w = 0; w < video->horizontal_size; w++) \
+    for(w = 0; w < video->picture->horizontal_size; w++) \
 	{ \
 		y_l = *y_in++; \
 		y_l <<= 16; \
@@ -75,7 +76,7 @@ static unsigned char mpeg3_601_to_rgb[256];
 		b_l = (y_l + video->cb_to_b[*cb_in]) >> 16;
 
 #define DITHER_601_HEAD \
-    for(w = 0; w < video->horizontal_size; w++) \
+    for(w = 0; w < video->picture->horizontal_size; w++) \
 	{ \
 		y_l = mpeg3_601_to_rgb[*y_in++]; \
 		y_l <<= 16; \
@@ -129,10 +130,348 @@ static unsigned char mpeg3_601_to_rgb[256];
 
 
 
+#if defined(__x86_64__)
+
+#include <emmintrin.h>
+#include <tmmintrin.h>
+
+/* Pixels converted per pass over the row buffers */
+#define DITHER_CHUNK 256
+
+/* Since y is shifted up 16 bits before the table value is added, */
+/* y + (table value >> 16) is the same as DITHER_HEAD. */
+static inline void mpeg3video_chroma_diff(mpeg3video_t *video, 
+	int cb, 
+	int cr, 
+	short *r, 
+	short *g, 
+	short *b)
+{
+	*r = video->cr_to_r[cr] >> 16;
+	*g = (video->cr_to_g[cr] + video->cb_to_g[cb]) >> 16;
+	*b = video->cb_to_b[cb] >> 16;
+}
+
+/* Store 1 pixel from the tail of a row */
+static inline unsigned char* mpeg3video_store_pixel(unsigned char *data, 
+	int color_model, 
+	int r_l, 
+	int g_l, 
+	int b_l)
+{
+	switch(color_model)
+	{
+		case MPEG3_BGR888:
+		case MPEG3_601_BGR888:
+			STORE_PIXEL_BGR888
+			break;
+		case MPEG3_BGRA8888:
+		case MPEG3_601_BGRA8888:
+			STORE_PIXEL_BGRA8888
+			break;
+		case MPEG3_RGB565:
+		case MPEG3_601_RGB565:
+			STORE_PIXEL_RGB565
+			break;
+		case MPEG3_RGB888:
+		case MPEG3_601_RGB888:
+			STORE_PIXEL_RGB888
+			break;
+		case MPEG3_RGBA8888:
+		case MPEG3_601_RGBA8888:
+			STORE_PIXEL_RGBA8888
+			break;
+		case MPEG3_RGBA16161616:
+		{
+			register unsigned short *data_s = (unsigned short*)data;
+			STORE_PIXEL_RGBA16161616
+			data = (unsigned char*)data_s;
+		}
+			break;
+	}
+	return data;
+}
+
+/* Interleave 16 pixels of 3 planes into 4 byte pixels with a 0 byte */
+static inline void mpeg3video_interleave_sse2(__m128i c0, 
+	__m128i c1, 
+	__m128i c2, 
+	__m128i *p)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo01 = _mm_unpacklo_epi8(c0, c1);
+	__m128i hi01 = _mm_unpackhi_epi8(c0, c1);
+	__m128i lo2 = _mm_unpacklo_epi8(c2, zero);
+	__m128i hi2 = _mm_unpackhi_epi8(c2, zero);
+	p[0] = _mm_unpacklo_epi16(lo01, lo2);
+	p[1] = _mm_unpackhi_epi16(lo01, lo2);
+	p[2] = _mm_unpacklo_epi16(hi01, hi2);
+	p[3] = _mm_unpackhi_epi16(hi01, hi2);
+}
+
+/* Drop the 0 bytes from 16 4 byte pixels */
+static __attribute__((target("ssse3"))) void mpeg3video_store24_ssse3(unsigned char *data, 
+	__m128i *p)
+{
+	__m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 
+		-1, -1, -1, -1);
+	__m128i c0 = _mm_shuffle_epi8(p[0], mask);
+	__m128i c1 = _mm_shuffle_epi8(p[1], mask);
+	__m128i c2 = _mm_shuffle_epi8(p[2], mask);
+	__m128i c3 = _mm_shuffle_epi8(p[3], mask);
+	_mm_storeu_si128((__m128i*)data, 
+		_mm_or_si128(c0, _mm_slli_si128(c1, 12)));
+	_mm_storeu_si128((__m128i*)(data + 16), 
+		_mm_or_si128(_mm_srli_si128(c1, 4), _mm_slli_si128(c2, 8)));
+	_mm_storeu_si128((__m128i*)(data + 32), 
+		_mm_or_si128(_mm_srli_si128(c2, 8), _mm_slli_si128(c3, 4)));
+}
+
+static inline void mpeg3video_store24_sse2(unsigned char *data, __m128i *p)
+{
+	unsigned char temp[64];
+	int i;
+	_mm_storeu_si128((__m128i*)temp, p[0]);
+	_mm_storeu_si128((__m128i*)(temp + 16), p[1]);
+	_mm_storeu_si128((__m128i*)(temp + 32), p[2]);
+	_mm_storeu_si128((__m128i*)(temp + 48), p[3]);
+	for(i = 0; i < 16; i++)
+	{
+		data[0] = temp[i * 4];
+		data[1] = temp[i * 4 + 1];
+		data[2] = temp[i * 4 + 2];
+		data += 3;
+	}
+}
+
+/* RGB565 for 8 pixels in 16 bit lanes */
+static inline __m128i mpeg3video_rgb565_sse2(__m128i r, __m128i g, __m128i b)
+{
+	return _mm_or_si128(
+		_mm_or_si128(_mm_slli_epi16(_mm_and_si128(r, _mm_set1_epi16(0xf8)), 8),
+			_mm_slli_epi16(_mm_and_si128(g, _mm_set1_epi16(0xfc)), 3)),
+		_mm_srli_epi16(_mm_and_si128(b, _mm_set1_epi16(0xf8)), 3));
+}
+
+/* Store 16 pixels in the color model */
+static inline unsigned char* mpeg3video_store16_sse2(unsigned char *data, 
+	int color_model, 
+	int ssse3,
+	__m128i r, 
+	__m128i g, 
+	__m128i b)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i p[4];
+	int i;
+
+	switch(color_model)
+	{
+		case MPEG3_BGR888:
+		case MPEG3_601_BGR888:
+			mpeg3video_interleave_sse2(b, g, r, p);
+			if(ssse3)
+				mpeg3video_store24_ssse3(data, p);
+			else
+				mpeg3video_store24_sse2(data, p);
+			data += 48;
+			break;
+		case MPEG3_RGB888:
+		case MPEG3_601_RGB888:
+			mpeg3video_interleave_sse2(r, g, b, p);
+			if(ssse3)
+				mpeg3video_store24_ssse3(data, p);
+			else
+				mpeg3video_store24_sse2(data, p);
+			data += 48;
+			break;
+		case MPEG3_BGRA8888:
+		case MPEG3_601_BGRA8888:
+			mpeg3video_interleave_sse2(b, g, r, p);
+			for(i = 0; i < 4; i++)
+				_mm_storeu_si128((__m128i*)data + i, p[i]);
+			data += 64;
+			break;
+		case MPEG3_RGBA8888:
+		case MPEG3_601_RGBA8888:
+			mpeg3video_interleave_sse2(r, g, b, p);
+			for(i = 0; i < 4; i++)
+				_mm_storeu_si128((__m128i*)data + i, p[i]);
+			data += 64;
+			break;
+		case MPEG3_RGB565:
+		case MPEG3_601_RGB565:
+			_mm_storeu_si128((__m128i*)data, 
+				mpeg3video_rgb565_sse2(_mm_unpacklo_epi8(r, zero), 
+					_mm_unpacklo_epi8(g, zero), 
+					_mm_unpacklo_epi8(b, zero)));
+			_mm_storeu_si128((__m128i*)data + 1, 
+				mpeg3video_rgb565_sse2(_mm_unpackhi_epi8(r, zero), 
+					_mm_unpackhi_epi8(g, zero), 
+					_mm_unpackhi_epi8(b, zero)));
+			data += 32;
+			break;
+		case MPEG3_RGBA16161616:
+		{
+			__m128i rg, b0;
+/* 8 pixels at a time in 16 bit lanes */
+			for(i = 0; i < 2; i++)
+			{
+				__m128i r16 = i ? _mm_unpackhi_epi8(r, zero) : _mm_unpacklo_epi8(r, zero);
+				__m128i g16 = i ? _mm_unpackhi_epi8(g, zero) : _mm_unpacklo_epi8(g, zero);
+				__m128i b16 = i ? _mm_unpackhi_epi8(b, zero) : _mm_unpacklo_epi8(b, zero);
+				rg = _mm_unpacklo_epi16(r16, g16);
+				b0 = _mm_unpacklo_epi16(b16, zero);
+				_mm_storeu_si128((__m128i*)data, _mm_unpacklo_epi32(rg, b0));
+				_mm_storeu_si128((__m128i*)data + 1, _mm_unpackhi_epi32(rg, b0));
+				rg = _mm_unpackhi_epi16(r16, g16);
+				b0 = _mm_unpackhi_epi16(b16, zero);
+				_mm_storeu_si128((__m128i*)data + 2, _mm_unpacklo_epi32(rg, b0));
+				_mm_storeu_si128((__m128i*)data + 3, _mm_unpackhi_epi32(rg, b0));
+				data += 64;
+			}
+		}
+			break;
+	}
+	return data;
+}
+
+/* y + color difference for 16 pixels, clipped like CLIP */
+static inline __m128i mpeg3video_add_diff_sse2(__m128i y, __m128i lo, __m128i hi)
+{
+	__m128i zero = _mm_setzero_si128();
+	return _mm_packus_epi16(_mm_add_epi16(_mm_unpacklo_epi8(y, zero), lo),
+		_mm_add_epi16(_mm_unpackhi_epi8(y, zero), hi));
+}
+
+/* Same output as the C version.  The color differences are computed */
+/* once per chroma sample, then 16 pixels are converted at a time. */
+/* ssse3 stores the 3 byte color models with a byte shuffle. */
+static int mpeg3video_ditherframe_sse2(mpeg3video_t *video, 
+	unsigned char **src, 
+	unsigned char **output_rows,
+	int row_start,
+	int row_end,
+	int ssse3)
+{
+	int h = 0;
+	unsigned char *y_in, *cb_in, *cr_in;
+	unsigned char *data;
+	int w, i;
+	int color_model = video->color_model;
+	int scale = video->out_w != video->picture->horizontal_size;
+	int width = scale ? video->out_w : video->picture->horizontal_size;
+	int is_601 = color_model == MPEG3_601_BGR888 ||
+		color_model == MPEG3_601_BGRA8888 ||
+		color_model == MPEG3_601_RGB565 ||
+		color_model == MPEG3_601_RGB888 ||
+		color_model == MPEG3_601_RGBA8888;
+	unsigned char y_buffer[DITHER_CHUNK];
+	short r_diff[DITHER_CHUNK], g_diff[DITHER_CHUNK], b_diff[DITHER_CHUNK];
+
+	DITHER_ROW_HEAD
+		for(w = 0; w < width; w += DITHER_CHUNK)
+		{
+			int n = width - w;
+			unsigned char *y_row = y_buffer;
+			if(n > DITHER_CHUNK) n = DITHER_CHUNK;
+
+			if(scale)
+			{
+/* Color differences for every output pixel */
+				for(i = 0; i < n; i++)
+				{
+					int x = video->x_table[w + i];
+					int uv_subscript = x / 2;
+					y_buffer[i] = is_601 ? mpeg3_601_to_rgb[y_in[x]] : y_in[x];
+					mpeg3video_chroma_diff(video, 
+						cb_in[uv_subscript], 
+						cr_in[uv_subscript], 
+						&r_diff[i], 
+						&g_diff[i], 
+						&b_diff[i]);
+				}
+			}
+			else
+			{
+/* Color differences for every chroma sample */
+				for(i = 0; i < (n + 1) / 2; i++)
+					mpeg3video_chroma_diff(video, 
+						cb_in[w / 2 + i], 
+						cr_in[w / 2 + i], 
+						&r_diff[i], 
+						&g_diff[i], 
+						&b_diff[i]);
+				if(is_601)
+				{
+					for(i = 0; i < n; i++)
+						y_buffer[i] = mpeg3_601_to_rgb[y_in[w + i]];
+				}
+				else
+					y_row = y_in + w;
+			}
+
+			for(i = 0; i + 16 <= n; i += 16)
+			{
+				__m128i y = _mm_loadu_si128((__m128i*)(y_row + i));
+				__m128i r_lo, r_hi, g_lo, g_hi, b_lo, b_hi;
+				if(scale)
+				{
+					r_lo = _mm_loadu_si128((__m128i*)(r_diff + i));
+					r_hi = _mm_loadu_si128((__m128i*)(r_diff + i + 8));
+					g_lo = _mm_loadu_si128((__m128i*)(g_diff + i));
+					g_hi = _mm_loadu_si128((__m128i*)(g_diff + i + 8));
+					b_lo = _mm_loadu_si128((__m128i*)(b_diff + i));
+					b_hi = _mm_loadu_si128((__m128i*)(b_diff + i + 8));
+				}
+				else
+				{
+/* Each chroma sample covers 2 pixels */
+					__m128i r = _mm_loadu_si128((__m128i*)(r_diff + i / 2));
+					__m128i g = _mm_loadu_si128((__m128i*)(g_diff + i / 2));
+					__m128i b = _mm_loadu_si128((__m128i*)(b_diff + i / 2));
+					r_lo = _mm_unpacklo_epi16(r, r);
+					r_hi = _mm_unpackhi_epi16(r, r);
+					g_lo = _mm_unpacklo_epi16(g, g);
+					g_hi = _mm_unpackhi_epi16(g, g);
+					b_lo = _mm_unpacklo_epi16(b, b);
+					b_hi = _mm_unpackhi_epi16(b, b);
+				}
+
+				data = mpeg3video_store16_sse2(data, 
+					color_model, 
+					ssse3,
+					mpeg3video_add_diff_sse2(y, r_lo, r_hi),
+					mpeg3video_add_diff_sse2(y, g_lo, g_hi),
+					mpeg3video_add_diff_sse2(y, b_lo, b_hi));
+			}
+
+			for( ; i < n; i++)
+			{
+				int j = scale ? i : i / 2;
+				int y_l = y_row[i];
+				data = mpeg3video_store_pixel(data, 
+					color_model, 
+					y_l + r_diff[j], 
+					y_l + g_diff[j], 
+					y_l + b_diff[j]);
+			}
+		}
+	DITHER_ROW_TAIL
+
+	return 0;
+}
+
+#endif /* __x86_64__ */
+
+
 /* Only good for YUV 4:2:0 */
-int mpeg3video_ditherframe(mpeg3video_t *video, 
+/* Converts output rows row_start to row_end - 1 */
+static int mpeg3video_ditherframe_c(mpeg3video_t *video, 
 	unsigned char **src, 
-	unsigned char **output_rows)
+	unsigned char **output_rows,
+	int row_start,
+	int row_end)
 {
 	int h = 0;
 	unsigned char *y_in, *cb_in, *cr_in;
@@ -140,11 +479,9 @@ int mpeg3video_ditherframe(mpeg3video_t *video,
 	unsigned char *data;
 	int uv_subscript, step, w = -1;
 
-
-
 	DITHER_ROW_HEAD
 /* Transfer row with scaling */
-		if(video->out_w != video->horizontal_size)
+		if(video->out_w != video->picture->horizontal_size)
 		{
 			switch(video->color_model)
 			{
@@ -278,6 +615,157 @@ int mpeg3video_ditherframe(mpeg3video_t *video,
 	return 0;
 }
 
+int mpeg3video_ditherframe(mpeg3video_t *video, 
+	unsigned char **src, 
+	unsigned char **output_rows,
+	int row_start,
+	int row_end)
+{
+#if defined(__x86_64__)
+	return mpeg3video_ditherframe_sse2(video, 
+		src, 
+		output_rows, 
+		row_start, 
+		row_end,
+		__builtin_cpu_supports("ssse3"));
+#else
+	return mpeg3video_ditherframe_c(video, 
+		src, 
+		output_rows, 
+		row_start, 
+		row_end);
+#endif
+}
+
+#if defined(__x86_64__)
+
+/* Compare one version of the SSE2 conversion to the C version on random */
+/* pictures in every color model, scaled and unscaled. */
+/* Returns the number of mismatches. */
+static int mpeg3video_check_dither_sse2(int ssse3, char *name)
+{
+	static int color_models[] = 
+	{
+		MPEG3_BGR888, MPEG3_BGRA8888, MPEG3_RGB565, MPEG3_RGB888,
+		MPEG3_RGBA8888, MPEG3_RGBA16161616, MPEG3_601_BGR888,
+		MPEG3_601_BGRA8888, MPEG3_601_RGB565, MPEG3_601_RGB888,
+		MPEG3_601_RGBA8888
+	};
+/* Widths with and without a tail and wider than a chunk */
+	static int widths[] = { 16, 38, 306, 720 };
+	const int total_models = sizeof(color_models) / sizeof(int);
+	const int rows = 12, pixel_bytes = 8;
+	mpeg3video_t *video = calloc(1, sizeof(mpeg3video_t));
+	unsigned char *src[3];
+	unsigned char *output1[rows], *output2[rows];
+	int i, j, k, model, errors = 0;
+
+	mpeg3video_init_output();
+	video->picture = &(video->pictures[0]);
+	mpeg3video_init_yuv_tables(video);
+	video->picture->chroma_format = CHROMA420;
+	srand(1);
+
+	for(i = 0; i < sizeof(widths) / sizeof(int) * 3; i++)
+	{
+		int width = widths[i / 3];
+		int scale = i % 3;
+		int crop = scale ? (i & 1) * 2 : 0;
+		int size, out_size;
+
+		video->picture->horizontal_size = width;
+		video->picture->coded_picture_width = (width + 15) & ~15;
+		video->picture->chrom_width = video->picture->coded_picture_width / 2;
+		video->in_x = crop;
+		video->in_y = crop;
+		video->in_w = width - crop;
+		video->in_h = rows;
+/* Unscaled, enlarged or reduced */
+		video->out_w = scale == 0 ? width : 
+			scale == 1 ? video->in_w * 3 / 2 : video->in_w / 2;
+		video->out_h = rows;
+		video->x_table = mpeg3video_get_scaletable(video->in_w, video->out_w);
+		video->y_table = mpeg3video_get_scaletable(video->in_h, video->out_h);
+
+		size = video->picture->coded_picture_width * (rows + crop);
+		out_size = MAX(video->out_w, width) * pixel_bytes + 16;
+		src[0] = malloc(size);
+		src[1] = malloc(size / 4);
+		src[2] = malloc(size / 4);
+		for(j = 0; j < rows; j++)
+		{
+			output1[j] = malloc(out_size);
+			output2[j] = malloc(out_size);
+		}
+
+		for(model = 0; model < total_models; model++)
+		{
+			video->color_model = color_models[model];
+			for(j = 0; j < size; j++) src[0][j] = rand();
+			for(j = 0; j < size / 4; j++)
+			{
+				src[1][j] = rand();
+				src[2][j] = rand();
+			}
+/* Bytes past the end of the rows show overruns */
+			for(j = 0; j < rows; j++)
+				for(k = 0; k < out_size; k++)
+					output1[j][k] = output2[j][k] = rand();
+
+			mpeg3video_ditherframe_c(video, src, output1, 0, rows);
+			mpeg3video_ditherframe_sse2(video, src, output2, 0, rows, ssse3);
+			for(j = 0; j < rows; j++)
+			{
+				if(memcmp(output1[j], output2[j], out_size))
+				{
+					if(!errors)
+						fprintf(stderr, 
+							"mpeg3video_check_dither: %s color model %d width %d %s differs\n", 
+							name,
+							video->color_model,
+							width,
+							video->out_w == width ? "unscaled" : "scaled");
+					errors++;
+					break;
+				}
+			}
+		}
+
+		free(src[0]);
+		free(src[1]);
+		free(src[2]);
+		for(j = 0; j < rows; j++)
+		{
+			free(output1[j]);
+			free(output2[j]);
+		}
+		free(video->x_table);
+		free(video->y_table);
+	}
+
+	free(video->cr_to_r);
+	free(video->cr_to_g);
+	free(video->cb_to_g);
+	free(video->cb_to_b);
+	free(video);
+	return errors;
+}
+
+#endif /* __x86_64__ */
+
+/* Compare the color conversions to the C version. */
+/* Returns the number of mismatches. */
+int mpeg3video_check_dither()
+{
+	int errors = 0;
+#if defined(__x86_64__)
+	errors += mpeg3video_check_dither_sse2(0, "SSE2");
+	if(__builtin_cpu_supports("ssse3"))
+		errors += mpeg3video_check_dither_sse2(1, "SSSE3");
+#endif
+	return errors;
+}
+
 int mpeg3video_ditherframe444(mpeg3video_t *video, unsigned char *src[])
 {
 	return 0;
@@ -285,7 +773,7 @@ int mpeg3video_ditherframe444(mpeg3video_t *video, unsigned char *src[])
 
 int mpeg3video_dithertop(mpeg3video_t *video, unsigned char *src[])
 {
-	return mpeg3video_ditherframe(video, src, video->output_rows);
+	return mpeg3video_ditherframe(video, src, video->output_rows, 0, video->out_h);
 }
 
 int mpeg3video_dithertop444(mpeg3video_t *video, unsigned char *src[])
@@ -329,6 +817,26 @@ void memcpy_fast(unsigned char *output, unsigned char *input, long len)
 		memcpy(output, input, len);
 }
 
+/* Convert 1 band of output rows from output_band_src */
+int mpeg3video_dither_band(mpeg3video_t *video, int band)
+{
+	int row_start = band * MPEG3_OUTPUT_BAND;
+	int row_end = MIN(row_start + MPEG3_OUTPUT_BAND, video->out_h);
+	return mpeg3video_ditherframe(video, 
+		video->output_band_src, 
+		video->output_rows, 
+		row_start, 
+		row_end);
+}
+
+/* Last macroblock row read by a band */
+int mpeg3video_band_mb_row(mpeg3video_t *video, int band)
+{
+	int row_end = MIN((band + 1) * MPEG3_OUTPUT_BAND, video->out_h);
+	int row = (video->y_table[row_end - 1] + video->in_y) / 16;
+	return MIN(row, video->picture->mb_height - 1);
+}
+
 int mpeg3video_init_output()
 {
 	int i, value;
@@ -347,9 +855,9 @@ int mpeg3video_present_frame(mpeg3video_t *video)
 {
 	int i, j, k, l;
 	unsigned char *src[3];
-	src[0] = video->output_src[0];
-	src[1] = video->output_src[1];
-	src[2] = video->output_src[2];
+	src[0] = video->picture->output_src[0];
+	src[1] = video->picture->output_src[1];
+	src[2] = video->picture->output_src[2];
 
 /* Copy YUV buffers */
 	if(video->want_yvu)
@@ -358,7 +866,7 @@ int mpeg3video_present_frame(mpeg3video_t *video)
 		long offset0, offset1;
 		int chroma_denominator;
 		
-		if(video->chroma_format == CHROMA420)
+		if(video->picture->chroma_format == CHROMA420)
 			chroma_denominator = 2;
 		else
 			chroma_denominator = 1;
@@ -369,20 +877,20 @@ int mpeg3video_present_frame(mpeg3video_t *video)
 /* Copy a frame */
 /* Three blocks */
 		if(video->in_x == 0 && 
-			video->in_w >= video->coded_picture_width &&
-			video->row_span == video->coded_picture_width)
+			video->in_w >= video->picture->coded_picture_width &&
+			video->row_span == video->picture->coded_picture_width)
 		{
-			size0 = video->coded_picture_width * video->in_h;
-			size1 = video->chrom_width * (int)((float)video->in_h / chroma_denominator + 0.5);
-			offset0 = video->coded_picture_width * video->in_y;
-			offset1 = video->chrom_width * (int)((float)video->in_y / chroma_denominator + 0.5);
+			size0 = video->picture->coded_picture_width * video->in_h;
+			size1 = video->picture->chrom_width * (int)((float)video->in_h / chroma_denominator + 0.5);
+			offset0 = video->picture->coded_picture_width * video->in_y;
+			offset1 = video->picture->chrom_width * (int)((float)video->in_y / chroma_denominator + 0.5);
 
 printf("mpeg3video_present_frame 1\n");
 /*
  * 			if(video->in_y > 0)
  * 			{
- * 				offset[1] += video->chrom_width / 2;
- * 				size[1] += video->chrom_width / 2;
+ * 				offset[1] += video->picture->chrom_width / 2;
+ * 				size[1] += video->picture->chrom_width / 2;
  * 			}
  */
 
@@ -393,7 +901,7 @@ printf("mpeg3video_present_frame 1\n");
 		else
 /* One block per row */
 		{
-//printf("mpeg3video_present_frame 2 %d %d %d\n", video->in_w, video->coded_picture_width, video->chrom_width);
+//printf("mpeg3video_present_frame 2 %d %d %d\n", video->in_w, video->picture->coded_picture_width, video->picture->chrom_width);
 			int row_span = video->in_w;
 			int row_span0;
 			int row_span1;
@@ -405,8 +913,8 @@ printf("mpeg3video_present_frame 1\n");
 			row_span1 = (row_span >> 1);
 			size0 = video->in_w;
 			size1 = (video->in_w >> 1);
-			offset0 = video->coded_picture_width * video->in_y;
-			offset1 = video->chrom_width * video->in_y / chroma_denominator;
+			offset0 = video->picture->coded_picture_width * video->in_y;
+			offset1 = video->picture->chrom_width * video->in_y / chroma_denominator;
 	
 			for(i = 0; i < video->in_h; i++)
 			{
@@ -414,7 +922,7 @@ printf("mpeg3video_present_frame 1\n");
 					src[0] + offset0 + video->in_x, 
 					size0);
 
-				offset0 += video->coded_picture_width;
+				offset0 += video->picture->coded_picture_width;
 
 				if(chroma_denominator == 1 || !(i % 2))
 				{
@@ -424,26 +932,26 @@ printf("mpeg3video_present_frame 1\n");
 					memcpy(video->v_output + i / chroma_denominator * row_span1, 
 						src[2] + offset1 + (video->in_x >> 1), 
 						size1);
-					if(video->horizontal_size < video->in_w)
+					if(video->picture->horizontal_size < video->in_w)
 					{
 						memset(video->u_output + 
 							i / chroma_denominator * row_span1 +
-							(video->horizontal_size >> 1),
+							(video->picture->horizontal_size >> 1),
 							0x80,
 							(video->in_w >> 1) - 
-							(video->horizontal_size >> 1));
+							(video->picture->horizontal_size >> 1));
 						memset(video->v_output + 
 							i / chroma_denominator * row_span1 +
-							(video->horizontal_size >> 1),
+							(video->picture->horizontal_size >> 1),
 							0x80,
 							(video->in_w >> 1) - 
-							(video->horizontal_size >> 1));
+							(video->picture->horizontal_size >> 1));
 					}
 				}
 				
 
 				if(chroma_denominator == 1 || (i % 2))
-					offset1 += video->chrom_width;
+					offset1 += video->picture->chrom_width;
 			}
 		}
 
@@ -451,23 +959,32 @@ printf("mpeg3video_present_frame 1\n");
 	}
 
 /* Want RGB buffer */
+/* Split the conversion among the slice decoders */
+	if(video->total_slice_decoders > 1 && 
+		!video->async_slices &&
+		video->picture->chroma_format != CHROMA444)
+	{
+		mpeg3video_present_bands(video, src);
+		return 0;
+	}
+
 /* Copy the frame to the output with YUV to RGB conversion */
-  	if(video->prog_seq)
+  	if(video->picture->prog_seq)
 	{
-    	if(video->chroma_format != CHROMA444)
+    	if(video->picture->chroma_format != CHROMA444)
 		{
-    		mpeg3video_ditherframe(video, src, video->output_rows);
+    		mpeg3video_ditherframe(video, src, video->output_rows, 0, video->out_h);
     	}
     	else
     	  	mpeg3video_ditherframe444(video, src);
   	}
 	else
 	{
-   		if((video->pict_struct == FRAME_PICTURE && video->topfirst) || 
-			video->pict_struct == BOTTOM_FIELD)
+   		if((video->picture->pict_struct == FRAME_PICTURE && video->picture->topfirst) || 
+			video->picture->pict_struct == BOTTOM_FIELD)
 		{
 /* top field first */
-    		if(video->chroma_format != CHROMA444)
+    		if(video->picture->chroma_format != CHROMA444)
 			{
         		mpeg3video_dithertop(video, src);
         		mpeg3video_ditherbot(video, src);
@@ -481,7 +998,7 @@ printf("mpeg3video_present_frame 1\n");
     	else 
 		{
 /* bottom field first */
-    		if(video->chroma_format != CHROMA444)
+    		if(video->picture->chroma_format != CHROMA444)
 			{
         		mpeg3video_ditherbot(video, src);
         		mpeg3video_dithertop(video, src);
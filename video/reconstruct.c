@@ -413,6 +413,33 @@ static inline void rec4ac(unsigned char *s,unsigned char  *d, int lx, int lx2, i
 	}
 }
 
+/* Wrappers with a common signature for the table */
+static void recc_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { recc(s, d, lx2, h); }
+static void rec_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { rec(s, d, lx2, h); }
+static void recac_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { recac(s, d, lx2, h); }
+static void reca_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { reca(s, d, lx2, h); }
+static void recvc_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { recvc(s, d, lx, lx2, h); }
+static void recv_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { recv(s, d, lx, lx2, h); }
+static void recvac_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { recvac(s, d, lx, lx2, h); }
+static void recva_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { recva(s, d, lx, lx2, h); }
+static void rechc_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { rechc(s, d, lx2, h); }
+static void rech_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { rech(s, d, lx2, h); }
+static void rechac_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { rechac(s, d, lx2, h); }
+static void recha_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { recha(s, d, lx2, h); }
+static void rec4c_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { rec4c(s, d, lx, lx2, h); }
+static void rec4_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { rec4(s, d, lx, lx2, h); }
+static void rec4ac_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { rec4ac(s, d, lx, lx2, h); }
+static void rec4a_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { rec4a(s, d, lx, lx2, h); }
+
+/* Indexed by half pel x, half pel y, averaging, and 16 pixel width */
+mpeg3_recon_t mpeg3video_recon_c[16] = 
+{
+	recc_c,  rec_c,  recac_c,  reca_c,
+	recvc_c, recv_c, recvac_c, recva_c,
+	rechc_c, rech_c, rechac_c, recha_c,
+	rec4c_c, rec4_c, rec4ac_c, rec4a_c
+};
+
 static inline
 void recon_comp(mpeg3video_t *video, 
 		unsigned char *src, 
@@ -437,31 +464,7 @@ void recon_comp(mpeg3video_t *video,
 	s = src + lx * (y + (dy >> 1)) + x + (dx >> 1);
 	d = dst + lx * y + x;
 
-// Accelerated functions
-	switch(switcher)
-	{
-		case 0x3: 	reca(s, d, lx2, h);       break;
-		case 0x2:	recac(s, d, lx2, h);      break;
-		case 0x1:	rec(s, d, lx2, h);        break;
-		case 0x0:	recc(s, d, lx2, h);       break;
-		case 0x7:   recva(s, d, lx, lx2, h);  break;
-		case 0x6:   recvac(s, d, lx, lx2, h); break;
-		case 0x5:	recv(s, d, lx, lx2, h);   break;
-		case 0x4:	recvc(s, d, lx, lx2, h);  break;
-		case 0x9:	rech(s, d, lx2, h);       break;
-		case 0x8:   rechc(s, d, lx2, h);      break;
-	}
-
-// Unaccelerated functions
-	switch(switcher) 
-	{
-		case 0xb: 	recha(s, d, lx2, h);      break;
-		case 0xa:	rechac(s, d, lx2, h);     break;
-		case 0xf: 	rec4a(s, d, lx, lx2, h);  break;
-		case 0xe:	rec4ac(s, d, lx, lx2, h); break;
-		case 0xd:	rec4(s, d, lx, lx2, h);   break;
-		case 0xc:	rec4c(s, d, lx, lx2, h);  break;
-	 }
+	video->recon_table[switcher](s, d, lx, lx2, h);
 }
 
 /*
@@ -496,7 +499,7 @@ static void recon(mpeg3video_t *video,
 	       dst[0] + (dfield ? (lx2 >> 1) : 0),
            lx, lx2, w, h, x, y, dx, dy, addflag);
 
-	if(video->chroma_format != CHROMA444)
+	if(video->picture->chroma_format != CHROMA444)
 	{
       	lx >>= 1; 
 		dx /= 2; 
@@ -505,7 +508,7 @@ static void recon(mpeg3video_t *video,
 		x >>= 1; 
 	}
 
-	if(video->chroma_format == CHROMA420)
+	if(video->picture->chroma_format == CHROMA420)
 	{
       	h >>= 1; 
 		dy /= 2; 
@@ -543,22 +546,22 @@ int mpeg3video_reconstruct(mpeg3video_t *video,
 	stwtop = stwtype % 3; /* 0:temporal, 1 : (spat+temp) / 2, 2 : spatial */
 	stwbot = stwtype / 3;
 
-	if((mb_type & MB_FORWARD) || (video->pict_type == P_TYPE))
+	if((mb_type & MB_FORWARD) || (video->picture->pict_type == P_TYPE))
 	{
-    	if(video->pict_struct == FRAME_PICTURE)
+    	if(video->picture->pict_struct == FRAME_PICTURE)
 		{
     		if((motion_type == MC_FRAME) || !(mb_type & MB_FORWARD))
 			{
 /* frame-based prediction */
 				{
         			if(stwtop < 2)
-        				recon(video, video->oldrefframe, 0, video->newframe, 0,
-        	    			video->coded_picture_width, video->coded_picture_width << 1, WIDTH, 8, bx, by,
+        				recon(video, video->picture->oldrefframe, 0, video->picture->newframe, 0,
+        	    			video->picture->coded_picture_width, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by,
             			  	PMV[0][0][0], PMV[0][0][1], stwtop);
 
         			if(stwbot < 2)
-        				recon(video, video->oldrefframe, 1, video->newframe, 1,
-       	    				video->coded_picture_width, video->coded_picture_width << 1, WIDTH, 8, bx, by,
+        				recon(video, video->picture->oldrefframe, 1, video->picture->newframe, 1,
+       	    				video->picture->coded_picture_width, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by,
             				PMV[0][0][0], PMV[0][0][1], stwbot);
     		  	}
     		}
@@ -566,14 +569,14 @@ int mpeg3video_reconstruct(mpeg3video_t *video,
     		{
 /* top field prediction */
         		if(stwtop < 2)
-        			recon(video, video->oldrefframe, mv_field_sel[0][0], video->newframe, 0,
-            			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 8, bx, by >> 1,
+        			recon(video, video->picture->oldrefframe, mv_field_sel[0][0], video->picture->newframe, 0,
+            			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by >> 1,
             			PMV[0][0][0], PMV[0][0][1] >> 1, stwtop);
 
 /* bottom field prediction */
         		if(stwbot < 2)
-        			recon(video, video->oldrefframe, mv_field_sel[1][0], video->newframe, 1,
-            			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 8, bx, by >> 1, 
+        			recon(video, video->picture->oldrefframe, mv_field_sel[1][0], video->picture->newframe, 1,
+            			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by >> 1, 
             			PMV[1][0][0], PMV[1][0][1] >> 1, stwbot);
     		}
     		else if(motion_type == MC_DMV)
@@ -589,26 +592,26 @@ int mpeg3video_reconstruct(mpeg3video_t *video,
         		if(stwtop < 2)
 				{
 /* predict top field from top field */
-        			recon(video, video->oldrefframe, 0, video->newframe, 0, 
-            			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 8, bx, by>>1, 
+        			recon(video, video->picture->oldrefframe, 0, video->picture->newframe, 0, 
+            			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by>>1, 
             			PMV[0][0][0], PMV[0][0][1] >> 1, 0);
 
 /* predict and add to top field from bottom field */
-        			recon(video, video->oldrefframe, 1, video->newframe, 0, 
-            			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 8, bx, by>>1, 
+        			recon(video, video->picture->oldrefframe, 1, video->picture->newframe, 0, 
+            			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by>>1, 
             			DMV[0][0], DMV[0][1], 1);
         		}
 
         		if(stwbot < 2)
         		{
 /* predict bottom field from bottom field */
-        			recon(video, video->oldrefframe, 1, video->newframe, 1, 
-            			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 8, bx, by>>1, 
+        			recon(video, video->picture->oldrefframe, 1, video->picture->newframe, 1, 
+            			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by>>1, 
             			PMV[0][0][0], PMV[0][0][1]>>1, 0);
 
 /* predict and add to bottom field from top field */
-        			recon(video, video->oldrefframe, 0, video->newframe, 1, 
-            			video->coded_picture_width << 1, video->coded_picture_width<<1, WIDTH, 8, bx, by>>1, 
+        			recon(video, video->picture->oldrefframe, 0, video->picture->newframe, 1, 
+            			video->picture->coded_picture_width << 1, video->picture->coded_picture_width<<1, WIDTH, 8, bx, by>>1, 
             			DMV[1][0], DMV[1][1], 1);
         		}
     		}
@@ -621,21 +624,21 @@ int mpeg3video_reconstruct(mpeg3video_t *video,
       	{
 /* TOP_FIELD or BOTTOM_FIELD */
 /* field picture */
-    		currentfield = (video->pict_struct == BOTTOM_FIELD);
+    		currentfield = (video->picture->pict_struct == BOTTOM_FIELD);
 
 /* determine which frame to use for prediction */
-    		if((video->pict_type == P_TYPE) && video->secondfield
+    		if((video->picture->pict_type == P_TYPE) && video->picture->secondfield
         	   && (currentfield != mv_field_sel[0][0]))
-        		predframe = video->refframe; /* same frame */
+        		predframe = video->picture->refframe; /* same frame */
     		else
-        	 	predframe = video->oldrefframe; /* previous frame */
+        	 	predframe = video->picture->oldrefframe; /* previous frame */
 
     		if((motion_type == MC_FIELD) || !(mb_type & MB_FORWARD))
     		{
 /* field-based prediction */
         		if(stwtop < 2)
-        			recon(video, predframe,mv_field_sel[0][0],video->newframe,0,
-            			video->coded_picture_width << 1,video->coded_picture_width << 1,WIDTH,16,bx,by,
+        			recon(video, predframe,mv_field_sel[0][0],video->picture->newframe,0,
+            			video->picture->coded_picture_width << 1,video->picture->coded_picture_width << 1,WIDTH,16,bx,by,
             			PMV[0][0][0],PMV[0][0][1],stwtop);
     		}
     		else 
@@ -643,29 +646,29 @@ int mpeg3video_reconstruct(mpeg3video_t *video,
     		{
         		if(stwtop < 2)
         		{
-        			recon(video, predframe, mv_field_sel[0][0], video->newframe, 0, 
-            			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 8, bx, by, 
+        			recon(video, predframe, mv_field_sel[0][0], video->picture->newframe, 0, 
+            			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by, 
             			PMV[0][0][0], PMV[0][0][1], stwtop);
 
         			/* determine which frame to use for lower half prediction */
-        			if((video->pict_type==P_TYPE) && video->secondfield
+        			if((video->picture->pict_type==P_TYPE) && video->picture->secondfield
             		   && (currentfield!=mv_field_sel[1][0]))
-            		  predframe = video->refframe; /* same frame */
+            		  predframe = video->picture->refframe; /* same frame */
         			else
-            		  predframe = video->oldrefframe; /* previous frame */
+            		  predframe = video->picture->oldrefframe; /* previous frame */
 
-        			recon(video, predframe, mv_field_sel[1][0], video->newframe, 0, 
-            			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 8, bx, by+8, 
+        			recon(video, predframe, mv_field_sel[1][0], video->picture->newframe, 0, 
+            			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by+8, 
             			PMV[1][0][0], PMV[1][0][1], stwtop);
         		}
     		}
     		else 
 			if(motion_type == MC_DMV) /* dual prime prediction */
     		{
-        		if(video->secondfield)
-        		  	predframe = video->refframe; /* same frame */
+        		if(video->picture->secondfield)
+        		  	predframe = video->picture->refframe; /* same frame */
         		else
-        		  	predframe = video->oldrefframe; /* previous frame */
+        		  	predframe = video->picture->oldrefframe; /* previous frame */
 
 /* calculate derived motion vectors */
         		mpeg3video_calc_dmv(video, 
@@ -675,13 +678,13 @@ int mpeg3video_reconstruct(mpeg3video_t *video,
 					PMV[0][0][1]);
 
 /* predict from field of same parity */
-        		recon(video, video->oldrefframe, currentfield, video->newframe, 0, 
-        			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 16, bx, by, 
+        		recon(video, video->picture->oldrefframe, currentfield, video->picture->newframe, 0, 
+        			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 16, bx, by, 
         			PMV[0][0][0], PMV[0][0][1], 0);
 
 /* predict from field of opposite parity */
-        		recon(video, predframe, !currentfield, video->newframe, 0, 
-        			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 16, bx, by, 
+        		recon(video, predframe, !currentfield, video->picture->newframe, 0, 
+        			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 16, bx, by, 
         			DMV[0][0], DMV[0][1], 1);
     		}
     		else
@@ -694,19 +697,19 @@ int mpeg3video_reconstruct(mpeg3video_t *video,
 
 	if(mb_type & MB_BACKWARD)
 	{
-    	if(video->pict_struct == FRAME_PICTURE)
+    	if(video->picture->pict_struct == FRAME_PICTURE)
     	{
     		if(motion_type == MC_FRAME)
     		{
 /* frame-based prediction */
         		if(stwtop < 2)
-        			recon(video, video->refframe, 0, video->newframe, 0, 
-            			video->coded_picture_width, video->coded_picture_width << 1, WIDTH, 8, bx, by, 
+        			recon(video, video->picture->refframe, 0, video->picture->newframe, 0, 
+            			video->picture->coded_picture_width, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by, 
             			PMV[0][1][0], PMV[0][1][1], stwtop);
 
         		if(stwbot < 2)
-        			recon(video, video->refframe, 1, video->newframe, 1, 
-						video->coded_picture_width, video->coded_picture_width << 1, WIDTH, 8, bx, by, 
+        			recon(video, video->picture->refframe, 1, video->picture->newframe, 1, 
+						video->picture->coded_picture_width, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by, 
 						PMV[0][1][0], PMV[0][1][1], stwbot);
     		}
     		else 
@@ -715,16 +718,16 @@ int mpeg3video_reconstruct(mpeg3video_t *video,
 /* top field prediction */
 				if(stwtop < 2)
 				{
-					recon(video, video->refframe, mv_field_sel[0][1], video->newframe, 0,
-						(video->coded_picture_width << 1), (video->coded_picture_width<<1), WIDTH, 8, bx, (by >> 1),
+					recon(video, video->picture->refframe, mv_field_sel[0][1], video->picture->newframe, 0,
+						(video->picture->coded_picture_width << 1), (video->picture->coded_picture_width<<1), WIDTH, 8, bx, (by >> 1),
 						PMV[0][1][0], (PMV[0][1][1] >> 1), stwtop);
 				}
 
 /* bottom field prediction */
         		if(stwbot < 2)
 				{
-        			recon(video, video->refframe, mv_field_sel[1][1], video->newframe, 1, (video->coded_picture_width << 1),
-						(video->coded_picture_width << 1), WIDTH, 8, bx, (by>>1),
+        			recon(video, video->picture->refframe, mv_field_sel[1][1], video->picture->newframe, 1, (video->picture->coded_picture_width << 1),
+						(video->picture->coded_picture_width << 1), WIDTH, 8, bx, (by>>1),
 						PMV[1][1][0], (PMV[1][1][1]>>1), stwbot);
 				}
     		}
@@ -736,18 +739,18 @@ int mpeg3video_reconstruct(mpeg3video_t *video,
     		if(motion_type == MC_FIELD)
 			{
 /* field-based prediction */
-        		recon(video, video->refframe, mv_field_sel[0][1], video->newframe, 0, 
-	    			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 16, bx, by, 
+        		recon(video, video->picture->refframe, mv_field_sel[0][1], video->picture->newframe, 0, 
+	    			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 16, bx, by, 
 	    			PMV[0][1][0], PMV[0][1][1], stwtop);
     		}
     		else if(motion_type==MC_16X8)
     		{
-        		recon(video, video->refframe, mv_field_sel[0][1], video->newframe, 0, 
-        			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 8, bx, by, 
+        		recon(video, video->picture->refframe, mv_field_sel[0][1], video->picture->newframe, 0, 
+        			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by, 
         			PMV[0][1][0], PMV[0][1][1], stwtop);
 
-        		recon(video, video->refframe, mv_field_sel[1][1], video->newframe, 0, 
-        			video->coded_picture_width << 1, video->coded_picture_width << 1, WIDTH, 8, bx, by+8, 
+        		recon(video, video->picture->refframe, mv_field_sel[1][1], video->picture->newframe, 0, 
+        			video->picture->coded_picture_width << 1, video->picture->coded_picture_width << 1, WIDTH, 8, bx, by+8, 
         			PMV[1][1][0], PMV[1][1][1], stwtop);
     		}
     		else
@@ -12,30 +12,28 @@ void mpeg3video_toc_error()
 		"to generate a table of contents and load the table of contents instead.\n");
 }
 
-int mpeg3video_drop_frames(mpeg3video_t *video, long frames, int cache_it)
+int mpeg3video_drop_frames(mpeg3video_t *video, long frames, long cache_from)
 {
 	int result = 0;
 	long frame_number = video->framenum + frames;
 	mpeg3_vtrack_t *track = video->track;
-/* first 3 frames are garbage as proven by printfs in the read_frame calls */
-	int drop_count = 3;
 
 /* Read the selected number of frames and skip b-frames */
 	while(!result && frame_number > video->framenum)
 	{
-		if(cache_it)
+		if(cache_from >= 0)
 		{
 			result = mpeg3video_read_frame_backend(video, 0);
-        	if(video->output_src[0] && drop_count--)
+        	if(video->picture->output_src[0] && video->framenum - 1 >= cache_from)
         	{
 				mpeg3_cache_put_frame(track->frame_cache,
 					video->framenum - 1,
-					video->output_src[0],
-					video->output_src[1],
-					video->output_src[2],
-					video->coded_picture_width * video->coded_picture_height,
-					video->chrom_width * video->chrom_height,
-					video->chrom_width * video->chrom_height);
+					video->picture->output_src[0],
+					video->picture->output_src[1],
+					video->picture->output_src[2],
+					video->picture->coded_picture_width * video->picture->coded_picture_height,
+					video->picture->chrom_width * video->picture->chrom_height,
+					video->picture->chrom_width * video->picture->chrom_height);
 //printf("mpeg3video_drop_frames 1 %d\n", video->framenum);
         	}
 		}
@@ -48,6 +46,65 @@ int mpeg3video_drop_frames(mpeg3video_t *video, long frames, int cache_it)
 	return result;
 }
 
+/* Move the bit buffer to the next start code in the current packet instead */
+/* of stepping through the packet a byte at a time.  code must be a start */
+/* code or 0 to match any start code.  Returns 0 if the bit buffer isn't */
+/* lined up with the packet. */
+static int skip_to_code(mpeg3_bits_t *stream, uint32_t code)
+{
+	mpeg3_demuxer_t *demuxer = stream->demuxer;
+	unsigned char *buffer = demuxer->data_buffer;
+	int position = demuxer->data_position;
+	int size = demuxer->data_size;
+	int offset;
+
+/* The bit buffer must hold the 4 bytes before the read position */
+	if(stream->input_ptr ||
+		stream->bit_number != 32 ||
+		position < 4 ||
+		position >= size ||
+		(uint32_t)stream->bfr != mpeg3_get_code(buffer + position - 4)) return 0;
+
+	for(offset = position - 3;
+		(offset = mpeg3_find_startcode(buffer, offset, size)) >= 0;
+		offset++)
+	{
+		if(!code || mpeg3_get_code(buffer + offset) == code) break;
+	}
+	if(offset < 0) offset = size - 4;
+
+	demuxer->data_position = offset + 4;
+	stream->bfr = mpeg3_get_code(buffer + offset);
+	stream->bfr_size = 32;
+	return 1;
+}
+
+/* Same thing in reverse for mpeg3video_prev_code */
+static int skip_to_prev_code(mpeg3_demuxer_t *demuxer, 
+	uint32_t *current_code, 
+	uint32_t code)
+{
+	unsigned char *buffer = demuxer->data_buffer;
+	int position = demuxer->data_position;
+	int offset;
+
+/* The current code must hold the 4 bytes after the read position */
+	if(position < 1 ||
+		position + 4 >= demuxer->data_size ||
+		*current_code != mpeg3_get_code(buffer + position + 1)) return 0;
+
+	for(offset = position + 1;
+		(offset = mpeg3_rfind_startcode(buffer, 1, offset + 3)) >= 0; )
+	{
+		if(mpeg3_get_code(buffer + offset) == code) break;
+	}
+	if(offset < 0) offset = 1;
+
+	demuxer->data_position = offset - 1;
+	*current_code = mpeg3_get_code(buffer + offset);
+	return 1;
+}
+
 unsigned int mpeg3bits_next_startcode(mpeg3_bits_t* stream)
 {
 /* Perform forwards search */
@@ -76,7 +133,7 @@ unsigned int mpeg3bits_next_startcode(mpeg3_bits_t* stream)
 		if(mpeg3bits_eof(stream)) break;
 
 
-		mpeg3bits_getbyte_noptr(stream);
+		if(!skip_to_code(stream, 0)) mpeg3bits_getbyte_noptr(stream);
 
 /*
  * printf("mpeg3bits_next_startcode 3 %08x %d %d\n", 
@@ -98,7 +155,7 @@ int mpeg3video_next_code(mpeg3_bits_t* stream, unsigned int code)
 	while(!mpeg3bits_eof(stream) && 
 		mpeg3bits_showbits32_noptr(stream) != code)
 	{
-		mpeg3bits_getbyte_noptr(stream);
+		if(!skip_to_code(stream, code)) mpeg3bits_getbyte_noptr(stream);
 	}
 	return mpeg3bits_eof(stream);
 }
@@ -121,7 +178,7 @@ int mpeg3video_prev_code(mpeg3_demuxer_t *demuxer, unsigned int code)
 
 	while(!mpeg3demux_bof(demuxer) && current_code != code)
 	{
-		PREV_CODE_MACRO
+		if(!skip_to_prev_code(demuxer, &current_code, code)) PREV_CODE_MACRO
 	}
 	return mpeg3demux_bof(demuxer);
 }
@@ -129,11 +186,11 @@ int mpeg3video_prev_code(mpeg3_demuxer_t *demuxer, unsigned int code)
 long mpeg3video_goptimecode_to_frame(mpeg3video_t *video)
 {
 /*  printf("mpeg3video_goptimecode_to_frame %d %d %d %d %f\n",  */
-/*  	video->gop_timecode.hour, video->gop_timecode.minute, video->gop_timecode.second, video->gop_timecode.frame, video->frame_rate); */
-	return (long)(video->gop_timecode.hour * 3600 * video->frame_rate + 
-		video->gop_timecode.minute * 60 * video->frame_rate +
-		video->gop_timecode.second * video->frame_rate +
-		video->gop_timecode.frame) - 1 - video->first_frame;
+/*  	video->picture->gop_timecode.hour, video->picture->gop_timecode.minute, video->picture->gop_timecode.second, video->picture->gop_timecode.frame, video->picture->frame_rate); */
+	return (long)(video->picture->gop_timecode.hour * 3600 * video->picture->frame_rate + 
+		video->picture->gop_timecode.minute * 60 * video->picture->frame_rate +
+		video->picture->gop_timecode.second * video->picture->frame_rate +
+		video->picture->gop_timecode.frame) - 1 - video->first_frame;
 }
 
 int mpeg3video_match_refframes(mpeg3video_t *video)
@@ -143,23 +200,23 @@ int mpeg3video_match_refframes(mpeg3video_t *video)
 
 	for(i = 0; i < 3; i++)
 	{
-		if(video->newframe[i])
+		if(video->picture->newframe[i])
 		{
-			if(video->newframe[i] == video->refframe[i])
+			if(video->picture->newframe[i] == video->picture->refframe[i])
 			{
-				src = video->refframe[i];
-				dst = video->oldrefframe[i];
+				src = video->picture->refframe[i];
+				dst = video->picture->oldrefframe[i];
 			}
 			else
 			{
-				src = video->oldrefframe[i];
-				dst = video->refframe[i];
+				src = video->picture->oldrefframe[i];
+				dst = video->picture->refframe[i];
 			}
 
     		if(i == 0)
-				size = video->coded_picture_width * video->coded_picture_height + 32 * video->coded_picture_width;
+				size = video->picture->coded_picture_width * video->picture->coded_picture_height + 32 * video->picture->coded_picture_width;
     		else 
-				size = video->chrom_width * video->chrom_height + 32 * video->chrom_width;
+				size = video->picture->chrom_width * video->picture->chrom_height + 32 * video->picture->chrom_width;
 
 			memcpy(dst, src, size);
 		}
@@ -174,6 +231,7 @@ int mpeg3video_seek_byte(mpeg3video_t *video, int64_t byte)
 	mpeg3_demuxer_t *demuxer = vstream->demuxer;
 
 	video->byte_seek = byte;
+	mpeg3video_drop_ahead(video);
 
 
 
@@ -194,8 +252,9 @@ int mpeg3_rewind_video(mpeg3video_t *video)
 	mpeg3_vtrack_t *track = video->track;
 	mpeg3_bits_t *vstream = video->vstream;
 
-	if(track->frame_offsets)
-		mpeg3bits_seek_byte(vstream, track->frame_offsets[0]);
+	mpeg3video_drop_ahead(video);
+	if(mpeg3vtrack_has_offsets(track))
+		mpeg3bits_seek_byte(vstream, mpeg3vtrack_frame_offset(track, 0));
 	else
 		mpeg3bits_seek_byte(vstream, 0);
 
@@ -226,8 +285,11 @@ int mpeg3video_seek(mpeg3video_t *video)
 	{
 		byte = video->byte_seek;
 		video->byte_seek = -1;
+		mpeg3video_drop_ahead(video);
 		mpeg3demux_seek_byte(demuxer, byte);
 
+// Frame numbers in the cache don't apply after a byte seek
+		mpeg3_reset_cache(track->frame_cache);
 
 // Clear subtitles
 		mpeg3_reset_subtitles(file);
@@ -242,7 +304,7 @@ int mpeg3video_seek(mpeg3video_t *video)
 //printf("mpeg3video_seek 1 %lld\n", mpeg3demux_tell_byte(demuxer));
 			if(!result)
 			{
-				if(video->has_gops)
+				if(video->picture->has_gops)
 					result = mpeg3video_prev_code(demuxer, MPEG3_GOP_START_CODE);
 				else
 					result = mpeg3video_prev_code(demuxer, MPEG3_SEQUENCE_START_CODE);
@@ -251,7 +313,7 @@ int mpeg3video_seek(mpeg3video_t *video)
 
 			if(!result)
 			{
-				if(video->has_gops)
+				if(video->picture->has_gops)
 					result = mpeg3video_prev_code(demuxer, MPEG3_GOP_START_CODE);
 				else
 					result = mpeg3video_prev_code(demuxer, MPEG3_SEQUENCE_START_CODE);
@@ -266,11 +328,11 @@ int mpeg3video_seek(mpeg3video_t *video)
 		else
 		{
 // Read first frame
-			video->repeat_count = 0;
+			video->picture->repeat_count = 0;
 			mpeg3bits_reset(vstream);
 			mpeg3video_read_frame_backend(video, 0);
 			mpeg3_rewind_video(video);
-			video->repeat_count = 0;
+			video->picture->repeat_count = 0;
 		}
 
 
@@ -279,7 +341,7 @@ int mpeg3video_seek(mpeg3video_t *video)
 //printf("mpeg3video_seek 4 %lld\n", mpeg3demux_tell_byte(demuxer));
 // Read up to the correct byte
 		result = 0;
-		video->repeat_count = 0;
+		video->picture->repeat_count = 0;
 		while(!result && 
 			!mpeg3demux_eof(demuxer) &&
 			mpeg3demux_tell_byte(demuxer) < byte)
@@ -317,11 +379,9 @@ if(debug) printf("mpeg3video_seek %d %ld %ld\n", __LINE__, frame_number, video->
 /* Seek to I frame in table of contents. */
 /* Determine time between seek position and previous subtitle. */
 /* Subtract time difference from subtitle display time. */
-		if(track->frame_offsets)
+		if(mpeg3vtrack_has_offsets(track))
 		{
 if(debug) printf("mpeg3video_seek %d\n", __LINE__);
-			mpeg3_reset_cache(track->frame_cache);
-if(debug) printf("mpeg3video_seek %d\n", __LINE__);
 
 			if((frame_number < video->framenum || 
 				frame_number - video->framenum > MPEG3_SEEK_THRESHOLD))
@@ -329,22 +389,30 @@ if(debug) printf("mpeg3video_seek %d\n", __LINE__);
 				int i;
 				for(i = track->total_keyframe_numbers - 1; i >= 0; i--)
 				{
-					if(track->keyframe_numbers[i] <= frame_number)
+					if(mpeg3vtrack_keyframe_number(track, i) <= frame_number)
 					{
 						int frame;
 						int64_t byte;
+/* Frames before the I-frame preceding the target may be predicted from */
+/* data before the seek point, so they aren't cached. */
+						long cache_from = mpeg3vtrack_keyframe_number(track, i);
 
 // Go 2 I-frames before current position
 						if(i > 0) i--;
 
-						frame = track->keyframe_numbers[i];
+						frame = mpeg3vtrack_keyframe_number(track, i);
 						if(frame == 0)
-							byte = track->frame_offsets[0];
+						{
+							byte = mpeg3vtrack_frame_offset(track, 0);
+/* Everything from the start of the stream is decoded normally */
+							cache_from = 0;
+						}
 						else
-							byte = track->frame_offsets[frame];
-						video->framenum = track->keyframe_numbers[i];
+							byte = mpeg3vtrack_frame_offset(track, frame);
+						video->framenum = frame;
 if(debug) printf("mpeg3video_seek %d\n", __LINE__);
 
+						mpeg3video_drop_ahead(video);
 						mpeg3bits_seek_byte(vstream, byte);
 
 if(debug) printf("mpeg3video_seek %d\n", __LINE__);
@@ -358,11 +426,13 @@ if(debug) printf("mpeg3video_seek %d\n", __LINE__);
 
 					
 
-						video->repeat_count = 0;
+						video->picture->repeat_count = 0;
 
 // Read up to current frame
 if(debug) printf("mpeg3video_seek %d %ld %ld\n", __LINE__, frame_number, video->framenum);
-						mpeg3video_drop_frames(video, frame_number - video->framenum, 1);
+						mpeg3video_drop_frames(video, 
+							frame_number - video->framenum, 
+							cache_from);
 if(debug) printf("mpeg3video_seek %d\n", __LINE__);
 						break;
 					}
@@ -370,9 +440,9 @@ if(debug) printf("mpeg3video_seek %d\n", __LINE__);
 			}
 			else
 			{
-				video->repeat_count = 0;
+				video->picture->repeat_count = 0;
 if(debug) printf("mpeg3video_seek %d\n", __LINE__);
-				mpeg3video_drop_frames(video, frame_number - video->framenum, 0);
+				mpeg3video_drop_frames(video, frame_number - video->framenum, -1);
 if(debug) printf("mpeg3video_seek %d\n", __LINE__);
 			}
 		}
@@ -400,6 +470,7 @@ int mpeg3video_previous_frame(mpeg3video_t *video)
 	int64_t target_byte = 0;
 
 	if(mpeg3demux_tell_byte(demuxer) <= 0) return 1;
+	mpeg3video_drop_ahead(video);
 
 // Get location of end of previous picture
 	mpeg3demux_start_reverse(demuxer);
@@ -412,7 +483,7 @@ int mpeg3video_previous_frame(mpeg3video_t *video)
 // Rewind 2 I-frames
 	if(!result)
 	{
-		if(video->has_gops)
+		if(video->picture->has_gops)
 			result = mpeg3video_prev_code(demuxer, MPEG3_GOP_START_CODE);
 		else
 			result = mpeg3video_prev_code(demuxer, MPEG3_SEQUENCE_START_CODE);
@@ -420,7 +491,7 @@ int mpeg3video_previous_frame(mpeg3video_t *video)
 
 	if(!result)
 	{
-		if(video->has_gops)
+		if(video->picture->has_gops)
 			result = mpeg3video_prev_code(demuxer, MPEG3_GOP_START_CODE);
 		else
 			result = mpeg3video_prev_code(demuxer, MPEG3_SEQUENCE_START_CODE);
@@ -431,7 +502,7 @@ int mpeg3video_previous_frame(mpeg3video_t *video)
 
 // Read up to correct byte
 	result = 0;
-	video->repeat_count = 0;
+	video->picture->repeat_count = 0;
 	while(!result && 
 		!mpeg3demux_eof(demuxer) &&
 		mpeg3demux_tell_byte(demuxer) < target_byte)
@@ -439,6 +510,6 @@ int mpeg3video_previous_frame(mpeg3video_t *video)
 		result = mpeg3video_read_frame_backend(video, 0);
 	}
 
-	video->repeat_count = 0;
+	video->picture->repeat_count = 0;
 	return 0;
 }
@@ -3,40 +3,32 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define CLIP(x)  ((x) >= 0 ? ((x) < 255 ? (x) : 255) : 0)
 
 
 int mpeg3_new_slice_buffer(mpeg3_slice_buffer_t *slice_buffer)
 {
-	pthread_mutexattr_t mutex_attr;
-
 	slice_buffer->data = malloc(1024);
 	slice_buffer->buffer_size = 0;
 	slice_buffer->buffer_allocation = 1024;
 	slice_buffer->current_position = 0;
 	slice_buffer->bits_size = 0;
 	slice_buffer->bits = 0;
-	slice_buffer->done = 0;
-	pthread_mutexattr_init(&mutex_attr);
-//	pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_ADAPTIVE_NP);
-	pthread_mutex_init(&(slice_buffer->completion_lock), &mutex_attr);
 	return 0;
 }
 
 int mpeg3_delete_slice_buffer(mpeg3_slice_buffer_t *slice_buffer)
 {
 	free(slice_buffer->data);
-	pthread_mutex_destroy(&(slice_buffer->completion_lock));
 	return 0;
 }
 
 int mpeg3_expand_slice_buffer(mpeg3_slice_buffer_t *slice_buffer)
 {
-	int i;
 	unsigned char *new_buffer = malloc(slice_buffer->buffer_allocation * 2);
-	for(i = 0; i < slice_buffer->buffer_size; i++)
-		new_buffer[i] = slice_buffer->data[i];
+	memcpy(new_buffer, slice_buffer->data, slice_buffer->buffer_size);
 	free(slice_buffer->data);
 	slice_buffer->data = new_buffer;
 	slice_buffer->buffer_allocation *= 2;
@@ -65,29 +57,29 @@ static inline int mpeg3video_addblock(mpeg3_slice_t *slice,
   	if(cc == 0)
 	{   
 /* luminance */
-    	if(video->pict_struct == FRAME_PICTURE)
+    	if(video->picture->pict_struct == FRAME_PICTURE)
 		{
       		if(dct_type)
 			{
 /* field DCT coding */
-        		rfp = video->newframe[0] + 
-              		video->coded_picture_width * (by + ((comp & 2) >> 1)) + bx + ((comp & 1) << 3);
-        		iincr = (video->coded_picture_width << 1);
+        		rfp = video->picture->newframe[0] + 
+              		video->picture->coded_picture_width * (by + ((comp & 2) >> 1)) + bx + ((comp & 1) << 3);
+        		iincr = (video->picture->coded_picture_width << 1);
       		}
       		else
 			{
 /* frame DCT coding */
-        		rfp = video->newframe[0] + 
-             		video->coded_picture_width * (by + ((comp & 2) << 2)) + bx + ((comp & 1) << 3);
-        		iincr = video->coded_picture_width;
+        		rfp = video->picture->newframe[0] + 
+             		video->picture->coded_picture_width * (by + ((comp & 2) << 2)) + bx + ((comp & 1) << 3);
+        		iincr = video->picture->coded_picture_width;
       		}
 		}
     	else 
 		{
 /* field picture */
-      		rfp = video->newframe[0] + 
-           		(video->coded_picture_width << 1) * (by + ((comp & 2) << 2)) + bx + ((comp & 1) << 3);
-      		iincr = (video->coded_picture_width << 1);
+      		rfp = video->picture->newframe[0] + 
+           		(video->picture->coded_picture_width << 1) * (by + ((comp & 2) << 2)) + bx + ((comp & 1) << 3);
+      		iincr = (video->picture->coded_picture_width << 1);
     	}
  	}
   	else 
@@ -95,36 +87,62 @@ static inline int mpeg3video_addblock(mpeg3_slice_t *slice,
 /* chrominance */
 
 /* scale coordinates */
-    	if(video->chroma_format != CHROMA444) bx >>= 1;
-    	if(video->chroma_format == CHROMA420) by >>= 1;
-    	if(video->pict_struct == FRAME_PICTURE)
+    	if(video->picture->chroma_format != CHROMA444) bx >>= 1;
+    	if(video->picture->chroma_format == CHROMA420) by >>= 1;
+    	if(video->picture->pict_struct == FRAME_PICTURE)
 		{
-    		if(dct_type && (video->chroma_format != CHROMA420))
+    		if(dct_type && (video->picture->chroma_format != CHROMA420))
 			{
 /* field DCT coding */
-        		rfp = video->newframe[cc]
-            		  + video->chrom_width * (by + ((comp & 2) >> 1)) + bx + (comp & 8);
-        		iincr = (video->chrom_width << 1);
+        		rfp = video->picture->newframe[cc]
+            		  + video->picture->chrom_width * (by + ((comp & 2) >> 1)) + bx + (comp & 8);
+        		iincr = (video->picture->chrom_width << 1);
     		}
     		else 
 			{
 /* frame DCT coding */
-        		rfp = video->newframe[cc]
-            		  + video->chrom_width * (by + ((comp & 2) << 2)) + bx + (comp & 8);
-        		iincr = video->chrom_width;
+        		rfp = video->picture->newframe[cc]
+            		  + video->picture->chrom_width * (by + ((comp & 2) << 2)) + bx + (comp & 8);
+        		iincr = video->picture->chrom_width;
     		}
     	}
     	else 
 		{
 /* field picture */
-    		rfp = video->newframe[cc]
-            	  + (video->chrom_width << 1) * (by + ((comp & 2) << 2)) + bx + (comp & 8);
-    		iincr = (video->chrom_width << 1);
+    		rfp = video->picture->newframe[cc]
+            	  + (video->picture->chrom_width << 1) * (by + ((comp & 2) << 2)) + bx + (comp & 8);
+    		iincr = (video->picture->chrom_width << 1);
     	}
   	}
 
   	bp = slice->block[comp];
 
+	if(spar)
+	{
+/* Only the DC coefficient is nonzero so every output of the IDCT is */
+/* the same.  This is the IDCT shortcut for a DC only row and column. */
+		int dc = ((short)(bp[0] << 3) + 32) >> 6;
+		if(!addflag) dc += 128;
+
+		for(i = 0; i < 8; i++)
+		{
+			if(addflag)
+			{
+    			rfp[0] = CLIP(dc + rfp[0]);
+    			rfp[1] = CLIP(dc + rfp[1]);
+    			rfp[2] = CLIP(dc + rfp[2]);
+    			rfp[3] = CLIP(dc + rfp[3]);
+    			rfp[4] = CLIP(dc + rfp[4]);
+    			rfp[5] = CLIP(dc + rfp[5]);
+    			rfp[6] = CLIP(dc + rfp[6]);
+    			rfp[7] = CLIP(dc + rfp[7]);
+			}
+			else
+				memset(rfp, CLIP(dc), 8);
+    		rfp += iincr;
+		}
+	}
+	else
 	if(addflag)
 	{
 		for(i = 0; i < 8; i++)
@@ -180,10 +198,10 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
 	mpeg3_slice_buffer_t *slice_buffer = slice->slice_buffer;
 
 /* number of macroblocks per picture */
-  	mba_max = video->mb_width * video->mb_height;
+  	mba_max = video->picture->mb_width * video->picture->mb_height;
 
 /* field picture has half as many macroblocks as frame */
-	if(video->pict_struct != FRAME_PICTURE)
+	if(video->picture->pict_struct != FRAME_PICTURE)
 	    mba_max >>= 1; 
 
 /* macroblock address */
@@ -191,6 +209,7 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
 /* first macroblock in slice is not skipped */
   	mba_inc = 0;
   	slice->fault = 0;
+	slice->first_macroblock = slice->last_macroblock = 0;
 
 	code = mpeg3slice_getbits(slice_buffer, 32);
 /* decode slice header (may change quant_scale) */
@@ -202,7 +221,7 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
     pmv[0][1][0] = pmv[0][1][1] = pmv[1][1][0] = pmv[1][1][1] = 0;
 
   	for(i = 0; 
-		slice_buffer->current_position < slice_buffer->buffer_size; 
+		mpeg3slice_more_data(slice_buffer); 
 		i++)
 	{
 		if(mba_inc == 0)
@@ -217,7 +236,8 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
     		if(i == 0)
 			{
 /* Get the macroblock_address */
-				macroblock_address = ((slice_vert_pos_ext << 7) + (code & 255) - 1) * video->mb_width + mba_inc - 1;
+				macroblock_address = ((slice_vert_pos_ext << 7) + (code & 255) - 1) * video->picture->mb_width + mba_inc - 1;
+				slice->first_macroblock = slice->last_macroblock = macroblock_address;
 /* first macroblock in slice: not skipped */
 				mba_inc = 1;
 			}
@@ -253,12 +273,12 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
 			{
         		qs = mpeg3slice_getbits(slice_buffer, 5);
 
-        		if(video->mpeg2)
-            	 	slice->quant_scale = video->qscale_type ? mpeg3_non_linear_mquant_table[qs] : (qs << 1);
+        		if(video->picture->mpeg2)
+            	 	slice->quant_scale = video->picture->qscale_type ? mpeg3_non_linear_mquant_table[qs] : (qs << 1);
         		else 
 					slice->quant_scale = qs;
 
-        		if(video->scalable_mode == SC_DP)
+        		if(video->picture->scalable_mode == SC_DP)
 /* make sure quant_scale is valid */
           			slice->quant_scale = slice->quant_scale;
       		}
@@ -267,9 +287,9 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
 
 
 /* decode forward motion vectors */
-      		if((mb_type & MB_FORWARD) || ((mb_type & MB_INTRA) && video->conceal_mv))
+      		if((mb_type & MB_FORWARD) || ((mb_type & MB_INTRA) && video->picture->conceal_mv))
 			{
-        		if(video->mpeg2)
+        		if(video->picture->mpeg2)
         			mpeg3video_motion_vectors(slice, 
 						video, 
 						pmv, 
@@ -278,8 +298,8 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
             			0, 
 						mv_count, 
 						mv_format, 
-						video->h_forw_r_size, 
-						video->v_forw_r_size, 
+						video->picture->h_forw_r_size, 
+						video->picture->v_forw_r_size, 
 						dmv, 
 						mvscale);
         		else
@@ -287,18 +307,18 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
 						video, 
 						pmv[0][0], 
 						dmvector, 
-            			video->forw_r_size, 
-						video->forw_r_size, 
+            			video->picture->forw_r_size, 
+						video->picture->forw_r_size, 
 						0, 
 						0, 
-						video->full_forw);
+						video->picture->full_forw);
     		}
       		if(slice->fault) return 1;
 
 /* decode backward motion vectors */
     		if(mb_type & MB_BACKWARD)
 			{
-        		if(video->mpeg2)
+        		if(video->picture->mpeg2)
         		  	mpeg3video_motion_vectors(slice, 
 						video, 
 						pmv, 
@@ -307,8 +327,8 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
             			1, 
 						mv_count, 
 						mv_format, 
-						video->h_back_r_size, 
-						video->v_back_r_size, 
+						video->picture->h_back_r_size, 
+						video->picture->v_back_r_size, 
 						0, 
 						mvscale);
         		else
@@ -316,55 +336,55 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
 						video, 
 						pmv[0][1], 
 						dmvector, 
-            			video->back_r_size, 
-						video->back_r_size, 
+            			video->picture->back_r_size, 
+						video->picture->back_r_size, 
 						0, 
 						0, 
-						video->full_back);
+						video->picture->full_back);
     		}
 
       		if(slice->fault) return 1;
 
 /* remove marker_bit */
-      		if((mb_type & MB_INTRA) && video->conceal_mv)
+      		if((mb_type & MB_INTRA) && video->picture->conceal_mv)
         		mpeg3slice_flushbit(slice_buffer);
 
 /* macroblock_pattern */
       		if(mb_type & MB_PATTERN)
 			{
         		cbp = mpeg3video_get_cbp(slice);
-        		if(video->chroma_format == CHROMA422)
+        		if(video->picture->chroma_format == CHROMA422)
 				{
 /* coded_block_pattern_1 */
         		  	cbp = (cbp << 2) | mpeg3slice_getbits2(slice_buffer); 
         		}
         		else
-				if(video->chroma_format == CHROMA444)
+				if(video->picture->chroma_format == CHROMA444)
 				{
 /* coded_block_pattern_2 */
         		  	cbp = (cbp << 6) | mpeg3slice_getbits(slice_buffer, 6); 
         		}
     		}
     		else
-        	  	cbp = (mb_type & MB_INTRA) ? ((1 << video->blk_cnt) - 1) : 0;
+        	  	cbp = (mb_type & MB_INTRA) ? ((1 << video->picture->blk_cnt) - 1) : 0;
 
       		if(slice->fault) return 1;
 /* decode blocks */
-      		mpeg3video_clearblock(slice, 0, video->blk_cnt);
-      		for(comp = 0; comp < video->blk_cnt; comp++)
+      		mpeg3video_clearblock(slice, 0, video->picture->blk_cnt);
+      		for(comp = 0; comp < video->picture->blk_cnt; comp++)
 			{
-        		if(cbp & (1 << (video->blk_cnt - comp - 1)))
+        		if(cbp & (1 << (video->picture->blk_cnt - comp - 1)))
 				{
           			if(mb_type & MB_INTRA)
 					{
-            			if(video->mpeg2)
+            			if(video->picture->mpeg2)
 							mpeg3video_getmpg2intrablock(slice, video, comp, dc_dct_pred);
             			else
 							mpeg3video_getintrablock(slice, video, comp, dc_dct_pred);
           			}
         			else 
 					{
-            		  	if(video->mpeg2) 
+            		  	if(video->picture->mpeg2) 
 					  		mpeg3video_getmpg2interblock(slice, video, comp);
             		  	else           
 					  		mpeg3video_getinterblock(slice, video, comp);
@@ -378,26 +398,26 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
         	  	dc_dct_pred[0] = dc_dct_pred[1] = dc_dct_pred[2] = 0;
 
 /* reset motion vector predictors */
-    		if((mb_type & MB_INTRA) && !video->conceal_mv)
+    		if((mb_type & MB_INTRA) && !video->picture->conceal_mv)
 			{
 /* intra mb without concealment motion vectors */
         		pmv[0][0][0] = pmv[0][0][1] = pmv[1][0][0] = pmv[1][0][1] = 0;
         		pmv[0][1][0] = pmv[0][1][1] = pmv[1][1][0] = pmv[1][1][1] = 0;
     		}
 
-    		if((video->pict_type == P_TYPE) && !(mb_type & (MB_FORWARD | MB_INTRA)))
+    		if((video->picture->pict_type == P_TYPE) && !(mb_type & (MB_FORWARD | MB_INTRA)))
 			{
 /* non-intra mb without forward mv in a P picture */
         		pmv[0][0][0] = pmv[0][0][1] = pmv[1][0][0] = pmv[1][0][1] = 0;
 
 /* derive motion_type */
-        		if(video->pict_struct == FRAME_PICTURE) 
+        		if(video->picture->pict_struct == FRAME_PICTURE) 
 					motion_type = MC_FRAME;
         		else
         		{
         			motion_type = MC_FIELD;
 /* predict from field of same parity */
-        			mv_field_sel[0][0] = (video->pict_struct == BOTTOM_FIELD);
+        			mv_field_sel[0][0] = (video->picture->pict_struct == BOTTOM_FIELD);
         		}
       		}
 
@@ -411,28 +431,28 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
     	else 
 		{
 /* mba_inc!=1: skipped macroblock */
-      		mpeg3video_clearblock(slice, 0, video->blk_cnt);
+      		mpeg3video_clearblock(slice, 0, video->picture->blk_cnt);
 
 /* reset intra_dc predictors */
       		dc_dct_pred[0] = dc_dct_pred[1] = dc_dct_pred[2] = 0;
 
 /* reset motion vector predictors */
-      		if(video->pict_type == P_TYPE)
+      		if(video->picture->pict_type == P_TYPE)
         		pmv[0][0][0] = pmv[0][0][1] = pmv[1][0][0] = pmv[1][0][1] = 0;
 
 /* derive motion_type */
-      		if(video->pict_struct == FRAME_PICTURE)
+      		if(video->picture->pict_struct == FRAME_PICTURE)
         		motion_type = MC_FRAME;
     		else
     		{
         		motion_type = MC_FIELD;
 /* predict from field of same parity */
-        		mv_field_sel[0][0] = mv_field_sel[0][1] = (video->pict_struct == BOTTOM_FIELD);
+        		mv_field_sel[0][0] = mv_field_sel[0][1] = (video->picture->pict_struct == BOTTOM_FIELD);
     		}
 
 /* skipped I are spatial-only predicted, */
 /* skipped P and B are temporal-only predicted */
-      		stwtype = (video->pict_type == I_TYPE) ? 8 : 0;
+      		stwtype = (video->picture->pict_type == I_TYPE) ? 8 : 0;
 
 /* clear MB_INTRA */
       		mb_type &= ~MB_INTRA;
@@ -444,8 +464,8 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
     	snr_cbp = 0;
 
 /* pixel coordinates of top left corner of current macroblock */
-    	bx = 16 * (macroblock_address % video->mb_width);
-    	by = 16 * (macroblock_address / video->mb_width);
+    	bx = 16 * (macroblock_address % video->picture->mb_width);
+    	by = 16 * (macroblock_address / video->picture->mb_width);
 
 /* motion compensation */
     	if(!(mb_type & MB_INTRA))
@@ -460,11 +480,13 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
 				stwtype);
 
 /* copy or add block data into picture */
-    	for(comp = 0; comp < video->blk_cnt; comp++)
+    	for(comp = 0; comp < video->picture->blk_cnt; comp++)
 		{
-      		if((cbp | snr_cbp) & (1 << (video->blk_cnt - 1 - comp)))
+      		if((cbp | snr_cbp) & (1 << (video->picture->blk_cnt - 1 - comp)))
 			{
-       			mpeg3video_idct_conversion(slice->block[comp]);
+/* DC only blocks are transformed in addblock */
+				if(!slice->sparse[comp])
+       				video->idct_conversion(slice->block[comp]);
 
         		mpeg3video_addblock(slice, 
 					video, 
@@ -479,102 +501,155 @@ int mpeg3_decode_slice(mpeg3_slice_t *slice)
 /* advance to next macroblock */
     	macroblock_address++;
     	mba_inc--;
+		slice->last_macroblock = macroblock_address;
   	}
 
 	return 0;
 }
 
-void mpeg3_slice_loop(mpeg3_slice_t *slice)
+/* Count the macroblocks reconstructed in every row so the output bands */
+/* can start on the top of the picture */
+static void mpeg3_finish_rows(mpeg3_slice_t *slice)
 {
 	mpeg3video_t *video = slice->video;
-	int result = 1;
+	int address = MAX(slice->first_macroblock, 0);
+	int rows_ready;
 
-	while(!slice->done)
+	pthread_mutex_lock(&(video->slice_lock));
+	while(address < slice->last_macroblock)
+	{
+		int row = address / video->picture->mb_width;
+		int end = MIN((row + 1) * video->picture->mb_width, slice->last_macroblock);
+		video->mb_rows_done[row] += end - address;
+		address = end;
+	}
+	video->finished_slice_buffers++;
+
+	rows_ready = video->mb_rows_ready;
+	while(rows_ready < video->picture->mb_height &&
+		video->mb_rows_done[rows_ready] >= video->picture->mb_width)
+		rows_ready++;
+/* Damaged slices may leave rows incomplete */
+	if(video->slice_buffers_loaded &&
+		video->finished_slice_buffers >= video->total_slice_buffers)
+		rows_ready = video->picture->mb_height;
+
+	if(rows_ready != video->mb_rows_ready)
 	{
-		pthread_mutex_lock(&(slice->input_lock));
+		__atomic_store_n(&(video->mb_rows_ready), rows_ready, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&(video->slice_loaded));
+	}
+	pthread_mutex_unlock(&(video->slice_lock));
+}
+
+/* Convert output bands once the rows they read are reconstructed */
+static void mpeg3_output_bands(mpeg3_slice_t *slice)
+{
+	mpeg3video_t *video = slice->video;
+	int band;
 
-		if(!slice->done)
+	while((band = __sync_fetch_and_add(&(video->next_output_band), 1)) < 
+		video->total_output_bands)
+	{
+		int row = mpeg3video_band_mb_row(video, band);
+		if(row >= __atomic_load_n(&(video->mb_rows_ready), __ATOMIC_ACQUIRE))
 		{
-/* Get a buffer to decode */
-			result = 1;
 			pthread_mutex_lock(&(video->slice_lock));
-			if(slice->buffer_step > 0)
-			{
-				while(slice->current_buffer <= slice->last_buffer)
-				{
-					if(!video->slice_buffers[slice->current_buffer].done &&
-						slice->current_buffer <= slice->last_buffer)
-					{
-						result = 0;
-						break;
-					}
-					slice->current_buffer += slice->buffer_step;
-				}
-			}
-			else
-			{
-				while(slice->current_buffer >= slice->last_buffer)
-				{
-					if(!video->slice_buffers[slice->current_buffer].done &&
-						slice->current_buffer >= slice->last_buffer)
-					{
-						result = 0;
-						break;
-					}
-					slice->current_buffer += slice->buffer_step;
-				}
-			}
+			while(row >= video->mb_rows_ready)
+				pthread_cond_wait(&(video->slice_loaded), &(video->slice_lock));
+			pthread_mutex_unlock(&(video->slice_lock));
+		}
+		mpeg3video_dither_band(video, band);
+	}
+}
 
-/* Got one */
-			if(!result && slice->current_buffer >= 0 && slice->current_buffer < video->total_slice_buffers)
-			{
-				slice->slice_buffer = &(video->slice_buffers[slice->current_buffer]);
-				slice->slice_buffer->done = 1;
-				pthread_mutex_unlock(&(video->slice_lock));
-				pthread_mutex_unlock(&(slice->input_lock));
-				mpeg3_decode_slice(slice);
-				pthread_mutex_unlock(&(slice->slice_buffer->completion_lock));
-			}
-			else
-/* Finished with all */
-			{
-				pthread_mutex_unlock(&(slice->completion_lock));
-				pthread_mutex_unlock(&(video->slice_lock));
-			}
+/* Take slices from the picture until all of them are loaded and taken */
+int mpeg3_decode_slices(mpeg3_slice_t *slice)
+{
+	mpeg3video_t *video = slice->video;
+	int current_buffer;
+
+	while(1)
+	{
+		current_buffer = __sync_fetch_and_add(&(video->next_slice_buffer), 1);
+
+/* Wait for getpicture to load it */
+		if(current_buffer >= 
+			__atomic_load_n(&(video->total_slice_buffers), __ATOMIC_ACQUIRE))
+		{
+			int done;
+			pthread_mutex_lock(&(video->slice_lock));
+			while(current_buffer >= video->total_slice_buffers &&
+				!video->slice_buffers_loaded)
+				pthread_cond_wait(&(video->slice_loaded), &(video->slice_lock));
+			done = current_buffer >= video->total_slice_buffers;
+			pthread_mutex_unlock(&(video->slice_lock));
+			if(done) break;
 		}
 
-		pthread_mutex_unlock(&(slice->output_lock));
+		slice->slice_buffer = &(video->slice_buffers[current_buffer]);
+		mpeg3_decode_slice(slice);
+		if(video->total_output_bands) mpeg3_finish_rows(slice);
 	}
+
+/* Convert the output while the other decoders finish their slices */
+	if(video->total_output_bands) mpeg3_output_bands(slice);
+
+	pthread_mutex_lock(&(video->slice_lock));
+	if(!--video->busy_slice_decoders)
+		pthread_cond_signal(&(video->slice_done));
+	pthread_mutex_unlock(&(video->slice_lock));
+	return 0;
 }
 
-int mpeg3_new_slice_decoder(void *video, mpeg3_slice_t *slice)
+void mpeg3_slice_loop(mpeg3_slice_t *slice)
+{
+	mpeg3video_t *video = slice->video;
+
+	pthread_mutex_lock(&(video->slice_lock));
+	while(1)
+	{
+		while(!slice->done && slice->picture_number == video->picture_number)
+			pthread_cond_wait(&(video->slice_start), &(video->slice_lock));
+		if(slice->done) break;
+
+		slice->picture_number = video->picture_number;
+		pthread_mutex_unlock(&(video->slice_lock));
+		mpeg3_decode_slices(slice);
+		pthread_mutex_lock(&(video->slice_lock));
+	}
+	pthread_mutex_unlock(&(video->slice_lock));
+}
+
+int mpeg3_new_slice_decoder(void *video, mpeg3_slice_t *slice, int thread_number)
 {
 	pthread_attr_t  attr;
-	pthread_mutexattr_t mutex_attr;
 
 	slice->video = video;
 	slice->done = 0;
-	pthread_mutexattr_init(&mutex_attr);
-//	pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_ADAPTIVE_NP);
-	pthread_mutex_init(&(slice->input_lock), &mutex_attr);
-	pthread_mutex_lock(&(slice->input_lock));
-	pthread_mutex_init(&(slice->output_lock), &mutex_attr);
-	pthread_mutex_lock(&(slice->output_lock));
-	pthread_mutex_init(&(slice->completion_lock), &mutex_attr);
-	pthread_mutex_lock(&(slice->completion_lock));
-
-	pthread_attr_init(&attr);
-	pthread_create(&(slice->tid), &attr, (void*)mpeg3_slice_loop, slice);
+	slice->thread_number = thread_number;
+	slice->picture_number = ((mpeg3video_t*)video)->picture_number;
+
+/* The first decoder runs in the thread calling getpicture */
+	if(thread_number > 0)
+	{
+		pthread_attr_init(&attr);
+		pthread_create(&(slice->tid), &attr, (void*)mpeg3_slice_loop, slice);
+	}
 
 	return 0;
 }
 
 int mpeg3_delete_slice_decoder(mpeg3_slice_t *slice)
 {
-	slice->done = 1;
-	pthread_mutex_unlock(&(slice->input_lock));
-	pthread_join(slice->tid, 0);
-	pthread_mutex_destroy(&(slice->input_lock));
-	pthread_mutex_destroy(&(slice->output_lock));
+	mpeg3video_t *video = slice->video;
+	if(slice->thread_number > 0)
+	{
+		pthread_mutex_lock(&(video->slice_lock));
+		slice->done = 1;
+		pthread_cond_broadcast(&(video->slice_start));
+		pthread_mutex_unlock(&(video->slice_lock));
+		pthread_join(slice->tid, 0);
+	}
 	return 0;
 }
@@ -0,0 +1,339 @@
+#include "../mpeg3private.h"
+#include "../mpeg3protos.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* SSE2 and AVX2 versions of the Chen-Wang IDCT in idct.c. */
+/* They produce the same output as mpeg3video_idct_conversion, bit for bit. */
+/* The 8 rows or columns of a block are transformed in parallel and the */
+/* multiplies by 2 coefficients are paired up with pmaddwd. */
+
+#if defined(__x86_64__)
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#define W1 2841 /* 2048*sqrt(2)*cos(1*pi/16) */
+#define W2 2676 /* 2048*sqrt(2)*cos(2*pi/16) */
+#define W3 2408 /* 2048*sqrt(2)*cos(3*pi/16) */
+#define W5 1609 /* 2048*sqrt(2)*cos(5*pi/16) */
+#define W6 1108 /* 2048*sqrt(2)*cos(6*pi/16) */
+#define W7 565  /* 2048*sqrt(2)*cos(7*pi/16) */
+
+/* Coefficient pairs for pmaddwd */
+#define PAIR(a, b) ((int)(((unsigned int)(b) << 16) | ((a) & 0xffff)))
+
+static inline void mpeg3video_transpose_sse2(__m128i *r)
+{
+	__m128i a0, a1, a2, a3, a4, a5, a6, a7;
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7;
+
+	a0 = _mm_unpacklo_epi16(r[0], r[1]);
+	a1 = _mm_unpackhi_epi16(r[0], r[1]);
+	a2 = _mm_unpacklo_epi16(r[2], r[3]);
+	a3 = _mm_unpackhi_epi16(r[2], r[3]);
+	a4 = _mm_unpacklo_epi16(r[4], r[5]);
+	a5 = _mm_unpackhi_epi16(r[4], r[5]);
+	a6 = _mm_unpacklo_epi16(r[6], r[7]);
+	a7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+	b0 = _mm_unpacklo_epi32(a0, a2);
+	b1 = _mm_unpackhi_epi32(a0, a2);
+	b2 = _mm_unpacklo_epi32(a1, a3);
+	b3 = _mm_unpackhi_epi32(a1, a3);
+	b4 = _mm_unpacklo_epi32(a4, a6);
+	b5 = _mm_unpackhi_epi32(a4, a6);
+	b6 = _mm_unpacklo_epi32(a5, a7);
+	b7 = _mm_unpackhi_epi32(a5, a7);
+
+	r[0] = _mm_unpacklo_epi64(b0, b4);
+	r[1] = _mm_unpackhi_epi64(b0, b4);
+	r[2] = _mm_unpacklo_epi64(b1, b5);
+	r[3] = _mm_unpackhi_epi64(b1, b5);
+	r[4] = _mm_unpacklo_epi64(b2, b6);
+	r[5] = _mm_unpackhi_epi64(b2, b6);
+	r[6] = _mm_unpacklo_epi64(b3, b7);
+	r[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+/* Truncate 2 vectors of 32 bit results to 16 bits like a store to a short */
+static inline __m128i mpeg3video_pack_sse2(__m128i lo, __m128i hi)
+{
+	lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+	hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+	return _mm_packs_epi32(lo, hi);
+}
+
+/* 181 * x without pmulld */
+static inline __m128i mpeg3video_mul181_sse2(__m128i x)
+{
+	return _mm_add_epi32(
+		_mm_add_epi32(_mm_add_epi32(x, _mm_slli_epi32(x, 2)),
+			_mm_add_epi32(_mm_slli_epi32(x, 4), _mm_slli_epi32(x, 5))),
+		_mm_slli_epi32(x, 7));
+}
+
+/* One half of a row or column pass.  p17, p53, p26, p04 are the */
+/* interleaved coefficient pairs.  col selects the column rounding. */
+static inline void mpeg3video_idct4_sse2(__m128i p17,
+	__m128i p53,
+	__m128i p26,
+	__m128i p04,
+	__m128i *out,
+	int col)
+{
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+	__m128i dc_scale = col ? _mm_set1_epi32(PAIR(256, 256)) : _mm_set1_epi32(PAIR(2048, 2048));
+	__m128i dc_scale2 = col ? _mm_set1_epi32(PAIR(256, -256)) : _mm_set1_epi32(PAIR(2048, -2048));
+	__m128i dc_round = _mm_set1_epi32(col ? 8192 : 128);
+
+/* first stage */
+	x4 = _mm_madd_epi16(p17, _mm_set1_epi32(PAIR(W1, W7)));
+	x5 = _mm_madd_epi16(p17, _mm_set1_epi32(PAIR(W7, -W1)));
+	x6 = _mm_madd_epi16(p53, _mm_set1_epi32(PAIR(W5, W3)));
+	x7 = _mm_madd_epi16(p53, _mm_set1_epi32(PAIR(W3, -W5)));
+	x2 = _mm_madd_epi16(p26, _mm_set1_epi32(PAIR(W6, -W2)));
+	x3 = _mm_madd_epi16(p26, _mm_set1_epi32(PAIR(W2, W6)));
+	if(col)
+	{
+		__m128i round = _mm_set1_epi32(4);
+		x4 = _mm_srai_epi32(_mm_add_epi32(x4, round), 3);
+		x5 = _mm_srai_epi32(_mm_add_epi32(x5, round), 3);
+		x6 = _mm_srai_epi32(_mm_add_epi32(x6, round), 3);
+		x7 = _mm_srai_epi32(_mm_add_epi32(x7, round), 3);
+		x2 = _mm_srai_epi32(_mm_add_epi32(x2, round), 3);
+		x3 = _mm_srai_epi32(_mm_add_epi32(x3, round), 3);
+	}
+
+/* second stage */
+	x8 = _mm_add_epi32(_mm_madd_epi16(p04, dc_scale), dc_round);
+	x0 = _mm_add_epi32(_mm_madd_epi16(p04, dc_scale2), dc_round);
+	x1 = _mm_add_epi32(x4, x6);
+	x4 = _mm_sub_epi32(x4, x6);
+	x6 = _mm_add_epi32(x5, x7);
+	x5 = _mm_sub_epi32(x5, x7);
+
+/* third stage */
+	x7 = _mm_add_epi32(x8, x3);
+	x8 = _mm_sub_epi32(x8, x3);
+	x3 = _mm_add_epi32(x0, x2);
+	x0 = _mm_sub_epi32(x0, x2);
+	x2 = _mm_srai_epi32(_mm_add_epi32(
+		mpeg3video_mul181_sse2(_mm_add_epi32(x4, x5)), _mm_set1_epi32(128)), 8);
+	x4 = _mm_srai_epi32(_mm_add_epi32(
+		mpeg3video_mul181_sse2(_mm_sub_epi32(x4, x5)), _mm_set1_epi32(128)), 8);
+
+/* fourth stage */
+	out[0] = _mm_add_epi32(x7, x1);
+	out[1] = _mm_add_epi32(x3, x2);
+	out[2] = _mm_add_epi32(x0, x4);
+	out[3] = _mm_add_epi32(x8, x6);
+	out[4] = _mm_sub_epi32(x8, x6);
+	out[5] = _mm_sub_epi32(x0, x4);
+	out[6] = _mm_sub_epi32(x3, x2);
+	out[7] = _mm_sub_epi32(x7, x1);
+}
+
+/* Transform 8 rows or columns stored 1 coefficient per vector */
+static inline void mpeg3video_idct8_sse2(__m128i *r, int col)
+{
+	__m128i lo[8], hi[8];
+	int shift = col ? 14 : 8;
+	int i;
+
+	mpeg3video_idct4_sse2(_mm_unpacklo_epi16(r[1], r[7]),
+		_mm_unpacklo_epi16(r[5], r[3]),
+		_mm_unpacklo_epi16(r[2], r[6]),
+		_mm_unpacklo_epi16(r[0], r[4]),
+		lo,
+		col);
+	mpeg3video_idct4_sse2(_mm_unpackhi_epi16(r[1], r[7]),
+		_mm_unpackhi_epi16(r[5], r[3]),
+		_mm_unpackhi_epi16(r[2], r[6]),
+		_mm_unpackhi_epi16(r[0], r[4]),
+		hi,
+		col);
+
+	for(i = 0; i < 8; i++)
+		r[i] = mpeg3video_pack_sse2(_mm_srai_epi32(lo[i], shift),
+			_mm_srai_epi32(hi[i], shift));
+}
+
+void mpeg3video_idct_sse2(short *block)
+{
+	__m128i r[8];
+	int i;
+
+	for(i = 0; i < 8; i++)
+		r[i] = _mm_loadu_si128((__m128i*)(block + i * 8));
+
+/* rows */
+	mpeg3video_transpose_sse2(r);
+	mpeg3video_idct8_sse2(r, 0);
+
+/* columns */
+	mpeg3video_transpose_sse2(r);
+	mpeg3video_idct8_sse2(r, 1);
+
+	for(i = 0; i < 8; i++)
+		_mm_storeu_si128((__m128i*)(block + i * 8), r[i]);
+}
+
+
+
+/* The AVX2 version does both halves of each pass in 1 register. */
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i mpeg3video_join_avx2(__m128i lo, __m128i hi)
+{
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+static inline AVX2 void mpeg3video_idct8_avx2(__m128i *r, int col)
+{
+	__m256i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+	__m256i p17, p53, p26, p04;
+	__m256i out[8];
+	__m256i dc_scale = col ? _mm256_set1_epi32(PAIR(256, 256)) : _mm256_set1_epi32(PAIR(2048, 2048));
+	__m256i dc_scale2 = col ? _mm256_set1_epi32(PAIR(256, -256)) : _mm256_set1_epi32(PAIR(2048, -2048));
+	__m256i dc_round = _mm256_set1_epi32(col ? 8192 : 128);
+	__m256i c181 = _mm256_set1_epi32(181);
+	__m128i shift = _mm_cvtsi32_si128(col ? 14 : 8);
+	int i;
+
+	p17 = mpeg3video_join_avx2(_mm_unpacklo_epi16(r[1], r[7]), _mm_unpackhi_epi16(r[1], r[7]));
+	p53 = mpeg3video_join_avx2(_mm_unpacklo_epi16(r[5], r[3]), _mm_unpackhi_epi16(r[5], r[3]));
+	p26 = mpeg3video_join_avx2(_mm_unpacklo_epi16(r[2], r[6]), _mm_unpackhi_epi16(r[2], r[6]));
+	p04 = mpeg3video_join_avx2(_mm_unpacklo_epi16(r[0], r[4]), _mm_unpackhi_epi16(r[0], r[4]));
+
+/* first stage */
+	x4 = _mm256_madd_epi16(p17, _mm256_set1_epi32(PAIR(W1, W7)));
+	x5 = _mm256_madd_epi16(p17, _mm256_set1_epi32(PAIR(W7, -W1)));
+	x6 = _mm256_madd_epi16(p53, _mm256_set1_epi32(PAIR(W5, W3)));
+	x7 = _mm256_madd_epi16(p53, _mm256_set1_epi32(PAIR(W3, -W5)));
+	x2 = _mm256_madd_epi16(p26, _mm256_set1_epi32(PAIR(W6, -W2)));
+	x3 = _mm256_madd_epi16(p26, _mm256_set1_epi32(PAIR(W2, W6)));
+	if(col)
+	{
+		__m256i round = _mm256_set1_epi32(4);
+		x4 = _mm256_srai_epi32(_mm256_add_epi32(x4, round), 3);
+		x5 = _mm256_srai_epi32(_mm256_add_epi32(x5, round), 3);
+		x6 = _mm256_srai_epi32(_mm256_add_epi32(x6, round), 3);
+		x7 = _mm256_srai_epi32(_mm256_add_epi32(x7, round), 3);
+		x2 = _mm256_srai_epi32(_mm256_add_epi32(x2, round), 3);
+		x3 = _mm256_srai_epi32(_mm256_add_epi32(x3, round), 3);
+	}
+
+/* second stage */
+	x8 = _mm256_add_epi32(_mm256_madd_epi16(p04, dc_scale), dc_round);
+	x0 = _mm256_add_epi32(_mm256_madd_epi16(p04, dc_scale2), dc_round);
+	x1 = _mm256_add_epi32(x4, x6);
+	x4 = _mm256_sub_epi32(x4, x6);
+	x6 = _mm256_add_epi32(x5, x7);
+	x5 = _mm256_sub_epi32(x5, x7);
+
+/* third stage */
+	x7 = _mm256_add_epi32(x8, x3);
+	x8 = _mm256_sub_epi32(x8, x3);
+	x3 = _mm256_add_epi32(x0, x2);
+	x0 = _mm256_sub_epi32(x0, x2);
+	x2 = _mm256_srai_epi32(_mm256_add_epi32(
+		_mm256_mullo_epi32(_mm256_add_epi32(x4, x5), c181), _mm256_set1_epi32(128)), 8);
+	x4 = _mm256_srai_epi32(_mm256_add_epi32(
+		_mm256_mullo_epi32(_mm256_sub_epi32(x4, x5), c181), _mm256_set1_epi32(128)), 8);
+
+/* fourth stage */
+	out[0] = _mm256_add_epi32(x7, x1);
+	out[1] = _mm256_add_epi32(x3, x2);
+	out[2] = _mm256_add_epi32(x0, x4);
+	out[3] = _mm256_add_epi32(x8, x6);
+	out[4] = _mm256_sub_epi32(x8, x6);
+	out[5] = _mm256_sub_epi32(x0, x4);
+	out[6] = _mm256_sub_epi32(x3, x2);
+	out[7] = _mm256_sub_epi32(x7, x1);
+
+	for(i = 0; i < 8; i++)
+	{
+		__m256i x = _mm256_sra_epi32(out[i], shift);
+		x = _mm256_srai_epi32(_mm256_slli_epi32(x, 16), 16);
+		r[i] = _mm_packs_epi32(_mm256_castsi256_si128(x),
+			_mm256_extracti128_si256(x, 1));
+	}
+}
+
+AVX2 void mpeg3video_idct_avx2(short *block)
+{
+	__m128i r[8];
+	int i;
+
+	for(i = 0; i < 8; i++)
+		r[i] = _mm_loadu_si128((__m128i*)(block + i * 8));
+
+	mpeg3video_transpose_sse2(r);
+	mpeg3video_idct8_avx2(r, 0);
+
+	mpeg3video_transpose_sse2(r);
+	mpeg3video_idct8_avx2(r, 1);
+
+	for(i = 0; i < 8; i++)
+		_mm_storeu_si128((__m128i*)(block + i * 8), r[i]);
+}
+
+#endif /* __x86_64__ */
+
+/* Choose the fastest IDCT for this CPU */
+void mpeg3video_init_idct(mpeg3video_t *video)
+{
+	video->idct_conversion = mpeg3video_idct_conversion;
+#if defined(__x86_64__)
+	if(__builtin_cpu_supports("avx2"))
+		video->idct_conversion = mpeg3video_idct_avx2;
+	else
+		video->idct_conversion = mpeg3video_idct_sse2;
+#endif
+}
+
+/* Compare one IDCT to the C version on random blocks. */
+/* Returns the number of mismatches. */
+static int mpeg3video_check_kernel(void (*idct)(short *block), char *name)
+{
+	short block1[64], block2[64];
+	int i, j, errors = 0;
+
+	srand(1);
+	for(i = 0; i < 100000; i++)
+	{
+/* IEEE 1180 ranges plus a few sparse blocks */
+		int range = (i & 1) ? 512 : 4096;
+		for(j = 0; j < 64; j++)
+		{
+			block1[j] = (i & 2) && (rand() & 7) ? 
+				0 : 
+				(rand() % range) - range / 2;
+			block2[j] = block1[j];
+		}
+
+		mpeg3video_idct_conversion(block1);
+		idct(block2);
+		if(memcmp(block1, block2, sizeof(block1)))
+		{
+			if(!errors)
+				fprintf(stderr, "mpeg3video_check_idct: %s block %d differs\n", name, i);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+int mpeg3video_check_idct()
+{
+	int errors = 0;
+#if defined(__x86_64__)
+	errors += mpeg3video_check_kernel(mpeg3video_idct_sse2, "SSE2");
+	if(__builtin_cpu_supports("avx2"))
+		errors += mpeg3video_check_kernel(mpeg3video_idct_avx2, "AVX2");
+#endif
+	return errors;
+}
@@ -0,0 +1,234 @@
+#include "../mpeg3private.h"
+#include "../mpeg3protos.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Vector versions of the motion compensation in reconstruct.c. */
+/* Every table entry produces the same pixels as the C version. */
+/* (a + b + 1) >> 1 is a rounding byte average.  The 4 point average */
+/* is done in 16 bits. */
+
+/* Declare the 16 table entries for one instruction set */
+#define RECON_FUNCTIONS(prefix) \
+static void prefix##_0(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 0, 0, 0, 0); } \
+static void prefix##_1(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 0, 0, 0, 1); } \
+static void prefix##_2(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 0, 0, 1, 0); } \
+static void prefix##_3(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 0, 0, 1, 1); } \
+static void prefix##_4(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 0, 1, 0, 0); } \
+static void prefix##_5(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 0, 1, 0, 1); } \
+static void prefix##_6(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 0, 1, 1, 0); } \
+static void prefix##_7(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 0, 1, 1, 1); } \
+static void prefix##_8(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 1, 0, 0, 0); } \
+static void prefix##_9(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 1, 0, 0, 1); } \
+static void prefix##_a(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 1, 0, 1, 0); } \
+static void prefix##_b(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 1, 0, 1, 1); } \
+static void prefix##_c(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 1, 1, 0, 0); } \
+static void prefix##_d(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 1, 1, 0, 1); } \
+static void prefix##_e(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 1, 1, 1, 0); } \
+static void prefix##_f(unsigned char *s, unsigned char *d, int lx, int lx2, int h) { prefix(s, d, lx, lx2, h, 1, 1, 1, 1); } \
+static mpeg3_recon_t prefix##_table[16] = \
+{ \
+	prefix##_0, prefix##_1, prefix##_2, prefix##_3, \
+	prefix##_4, prefix##_5, prefix##_6, prefix##_7, \
+	prefix##_8, prefix##_9, prefix##_a, prefix##_b, \
+	prefix##_c, prefix##_d, prefix##_e, prefix##_f \
+};
+
+
+
+#if defined(__x86_64__)
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+static inline __m128i load_sse2(unsigned char *s, int w)
+{
+	return w ? _mm_loadu_si128((__m128i*)s) : _mm_loadl_epi64((__m128i*)s);
+}
+
+static inline void store_sse2(unsigned char *d, __m128i x, int w)
+{
+	if(w)
+		_mm_storeu_si128((__m128i*)d, x);
+	else
+		_mm_storel_epi64((__m128i*)d, x);
+}
+
+/* (a + b + c + d + 2) >> 2 for 8 pixels in the low half */
+static inline __m128i average4_sse2(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i sum = _mm_add_epi16(
+		_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+		_mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+	sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+	return sum;
+}
+
+static inline void recon_sse2(unsigned char *s,
+	unsigned char *d,
+	int lx,
+	int lx2,
+	int h,
+	int hpel,
+	int vpel,
+	int average,
+	int w)
+{
+	int j;
+	for(j = 0; j < h; j++, s += lx2, d += lx2)
+	{
+		__m128i x;
+		if(hpel && vpel)
+		{
+			__m128i a = load_sse2(s, w);
+			__m128i b = load_sse2(s + 1, w);
+			__m128i c = load_sse2(s + lx, w);
+			__m128i e = load_sse2(s + lx + 1, w);
+			__m128i zero = _mm_setzero_si128();
+			__m128i lo = average4_sse2(a, b, c, e);
+			__m128i hi = w ? average4_sse2(_mm_unpackhi_epi64(a, zero),
+				_mm_unpackhi_epi64(b, zero),
+				_mm_unpackhi_epi64(c, zero),
+				_mm_unpackhi_epi64(e, zero)) : zero;
+			x = _mm_packus_epi16(lo, hi);
+		}
+		else
+		if(hpel)
+			x = _mm_avg_epu8(load_sse2(s, w), load_sse2(s + 1, w));
+		else
+		if(vpel)
+			x = _mm_avg_epu8(load_sse2(s, w), load_sse2(s + lx, w));
+		else
+			x = load_sse2(s, w);
+
+		if(average) x = _mm_avg_epu8(x, load_sse2(d, w));
+		store_sse2(d, x, w);
+	}
+}
+
+RECON_FUNCTIONS(recon_sse2)
+
+
+
+/* AVX2 only helps the 4 point average, which needs 16 bit sums. */
+/* The other entries are the same as SSE2. */
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m128i average4_avx2(unsigned char *s, int lx)
+{
+	__m256i sum = _mm256_add_epi16(
+		_mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)s)),
+			_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)(s + 1)))),
+		_mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)(s + lx))),
+			_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)(s + lx + 1)))));
+	sum = _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+	return _mm_packus_epi16(_mm256_castsi256_si128(sum),
+		_mm256_extracti128_si256(sum, 1));
+}
+
+static inline AVX2 void recon_avx2(unsigned char *s,
+	unsigned char *d,
+	int lx,
+	int lx2,
+	int h,
+	int hpel,
+	int vpel,
+	int average,
+	int w)
+{
+	int j;
+	if(!(hpel && vpel && w))
+	{
+		recon_sse2(s, d, lx, lx2, h, hpel, vpel, average, w);
+		return;
+	}
+
+	for(j = 0; j < h; j++, s += lx2, d += lx2)
+	{
+		__m128i x = average4_avx2(s, lx);
+		if(average) x = _mm_avg_epu8(x, _mm_loadu_si128((__m128i*)d));
+		_mm_storeu_si128((__m128i*)d, x);
+	}
+}
+
+RECON_FUNCTIONS(recon_avx2)
+
+#endif
+
+
+
+/* Choose the motion compensation for this CPU */
+void mpeg3video_init_recon(mpeg3video_t *video)
+{
+	video->recon_table = mpeg3video_recon_c;
+#if defined(__x86_64__)
+	if(__builtin_cpu_supports("avx2"))
+		video->recon_table = recon_avx2_table;
+	else
+		video->recon_table = recon_sse2_table;
+#endif
+}
+
+/* Compare one table to the C versions on random blocks. */
+/* Returns the number of mismatches. */
+static int mpeg3video_check_table(mpeg3_recon_t *table, char *name)
+{
+	const int lx = 64, size = lx * 40;
+	unsigned char *src = malloc(size);
+	unsigned char *dst1 = malloc(size);
+	unsigned char *dst2 = malloc(size);
+	int i, j, errors = 0;
+
+	srand(1);
+	for(i = 0; i < 1000; i++)
+	{
+		for(j = 0; j < size; j++)
+		{
+			src[j] = rand();
+			dst1[j] = dst2[j] = rand();
+		}
+
+/* Extreme values make the rounding overflow if done in 8 bits */
+		if(i < 2)
+		{
+			memset(src, i ? 0xff : 0x00, size);
+			memset(dst1, i ? 0xff : 0x00, size);
+			memset(dst2, i ? 0xff : 0x00, size);
+		}
+
+		for(j = 0; j < 16; j++)
+		{
+			int lx2 = (i & 1) ? lx * 2 : lx;
+			int h = (i & 2) ? 16 : 8;
+			int offset = rand() % 16;
+			mpeg3video_recon_c[j](src + offset, dst1 + 8, lx, lx2, h);
+			table[j](src + offset, dst2 + 8, lx, lx2, h);
+			if(memcmp(dst1, dst2, size))
+			{
+				if(!errors)
+					fprintf(stderr, "mpeg3video_check_recon: %s entry %x differs\n", name, j);
+				errors++;
+				memcpy(dst2, dst1, size);
+			}
+		}
+	}
+
+	free(src);
+	free(dst1);
+	free(dst2);
+	return errors;
+}
+
+int mpeg3video_check_recon()
+{
+	int errors = 0;
+#if defined(__x86_64__)
+	errors += mpeg3video_check_table(recon_sse2_table, "SSE2");
+	if(__builtin_cpu_supports("avx2"))
+		errors += mpeg3video_check_table(recon_avx2_table, "AVX2");
+#endif
+	return errors;
+}
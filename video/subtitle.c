@@ -489,17 +489,17 @@ void overlay_subtitle(mpeg3video_t *video, mpeg3_subtitle_t *subtitle)
 		!subtitle->image_a) return;
 
 	for(y = subtitle->y1; 
-		y < subtitle->y2 && y < video->coded_picture_height; 
+		y < subtitle->y2 && y < video->picture->coded_picture_height; 
 		y++)
 	{
 		unsigned char *output_y = video->subtitle_frame[0] + 
-			y * video->coded_picture_width +
+			y * video->picture->coded_picture_width +
 			subtitle->x1;
 		unsigned char *output_u = video->subtitle_frame[1] + 
-			y / 2 * video->chrom_width +
+			y / 2 * video->picture->chrom_width +
 			subtitle->x1 / 2;
 		unsigned char *output_v = video->subtitle_frame[2] + 
-			y / 2 * video->chrom_width +
+			y / 2 * video->picture->chrom_width +
 			subtitle->x1 / 2;
 		unsigned char *input_y = subtitle->image_y + (y - subtitle->y1) * subtitle->w;
 		unsigned char *input_u = subtitle->image_u + (y - subtitle->y1) * subtitle->w;
@@ -507,7 +507,7 @@ void overlay_subtitle(mpeg3video_t *video, mpeg3_subtitle_t *subtitle)
 		unsigned char *input_a = subtitle->image_a + (y - subtitle->y1) * subtitle->w;
 
 		for(x = subtitle->x1; 
-			x < subtitle->x2 && x < video->coded_picture_width; 
+			x < subtitle->x2 && x < video->picture->coded_picture_width; 
 			x++)
 		{
 			int opacity = *input_a;
@@ -591,36 +591,36 @@ void mpeg3_decode_subtitle(mpeg3video_t *video)
 						if(!video->subtitle_frame[0])
 						{
 							video->subtitle_frame[0] = malloc(
-								video->coded_picture_width * 
-								video->coded_picture_height + 8);
+								video->picture->coded_picture_width * 
+								video->picture->coded_picture_height + 8);
 							video->subtitle_frame[1] = malloc(
-								video->chrom_width * 
-								video->chrom_height + 8);
+								video->picture->chrom_width * 
+								video->picture->chrom_height + 8);
 							video->subtitle_frame[2] = malloc(
-								video->chrom_width * 
-								video->chrom_height + 8);
+								video->picture->chrom_width * 
+								video->picture->chrom_height + 8);
 						}
 
 						memcpy(video->subtitle_frame[0],
-							video->output_src[0],
-							video->coded_picture_width * video->coded_picture_height);
+							video->picture->output_src[0],
+							video->picture->coded_picture_width * video->picture->coded_picture_height);
 						memcpy(video->subtitle_frame[1],
-							video->output_src[1],
-							video->chrom_width * video->chrom_height);
+							video->picture->output_src[1],
+							video->picture->chrom_width * video->picture->chrom_height);
 						memcpy(video->subtitle_frame[2],
-							video->output_src[2],
-							video->chrom_width * video->chrom_height);
+							video->picture->output_src[2],
+							video->picture->chrom_width * video->picture->chrom_height);
 
-						video->output_src[0] = video->subtitle_frame[0];
-						video->output_src[1] = video->subtitle_frame[1];
-						video->output_src[2] = video->subtitle_frame[2];
+						video->picture->output_src[0] = video->subtitle_frame[0];
+						video->picture->output_src[1] = video->subtitle_frame[1];
+						video->picture->output_src[2] = video->subtitle_frame[2];
 					}
 					total++;
 
 
 // Overlay subtitle on video
 					overlay_subtitle(video, subtitle);
-					subtitle->stop_time -= (int)(100.0 / video->frame_rate);
+					subtitle->stop_time -= (int)(100.0 / video->picture->frame_rate);
 				}
 
 				if(subtitle->stop_time <= 0)